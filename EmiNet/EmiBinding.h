@@ -71,6 +71,12 @@ public:
     inline static void releasePersistentData(NSData *data) {
         // Because of ARC, we can leave this as a no-op
     }
+    // Returns a reference to the same data that can be released
+    // separately from data, without copying the data.
+    inline static NSData *sharePersistentData(NSData *data) {
+        // NSData is immutable and ARC does the reference counting
+        return data;
+    }
     inline static NSData *castToTemporary(NSData *data) {
         return data;
     }
@@ -112,6 +118,7 @@ public:
                                          EmiOnMessage *callback,
                                          void *userData,
                                          const sockaddr_storage& address,
+                                         size_t reusePortShards,
                                          __strong NSError*& err);
     static void extractLocalAddress(GCDAsyncUdpSocket *socket, sockaddr_storage& address);
     static void sendData(GCDAsyncUdpSocket *socket, const sockaddr_storage& address, const uint8_t *data, size_t size);
@@ -86,7 +86,13 @@ GCDAsyncUdpSocket *EmiBinding::openSocket(dispatch_queue_t socketCookie,
                                           EmiOnMessage *callback,
                                           void *userData,
                                           const sockaddr_storage& address,
+                                          size_t reusePortShards,
                                           __strong NSError*& err) {
+    // reusePort is never set in this binding. On Darwin, SO_REUSEPORT
+    // does not spread unicast datagrams over the sockets that share a
+    // port, so it can't be used to shard a server.
+    ASSERT(0 == reusePortShards);
+    
     GCDAsyncUdpSocket *socket = [[GCDAsyncUdpSocket alloc] initWithDelegate:[EmiSocket class]
                                                               delegateQueue:socketCookie
                                                                 socketQueue:socketCookie];
@@ -25,10 +25,13 @@ public:
     EmiConnDelegate& operator=(const EmiConnDelegate& other);
     
     void invalidate();
+    void emiConnMoved(const sockaddr_storage& oldAddress);
     
     void emiConnPacketLoss(EmiChannelQualifier channelQualifier,
                            EmiSequenceNumber packetsLost);
     void emiConnMessage(EmiChannelQualifier channelQualifier, NSData *data, NSUInteger offset, NSUInteger size);
+    void emiConnMessagePart(EmiChannelQualifier channelQualifier, NSData *data, NSUInteger offset, NSUInteger size,
+                            EmiMessagePartFlags partFlags);
     
     void emiConnLost();
     void emiConnRegained();
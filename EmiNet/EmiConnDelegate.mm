@@ -50,6 +50,12 @@ void EmiConnDelegate::invalidate() {
     _conn = nil;
 }
 
+void EmiConnDelegate::emiConnMoved(const sockaddr_storage& oldAddress) {
+    dispatch_sync(_conn.emiSocket.socketQueue, ^{
+        _conn.emiSocket.sock->serverConnectionMoved(_conn.conn, oldAddress);
+    });
+}
+
 void EmiConnDelegate::emiConnPacketLoss(EmiChannelQualifier channelQualifier,
                                         EmiSequenceNumber packetsLost) {
     if (_conn.delegateQueue) {
@@ -77,6 +83,23 @@ void EmiConnDelegate::emiConnMessage(EmiChannelQualifier channelQualifier, NSDat
     }
 }
 
+void EmiConnDelegate::emiConnMessagePart(EmiChannelQualifier channelQualifier, NSData *data, NSUInteger offset, NSUInteger size,
+                                         EmiMessagePartFlags partFlags) {
+    if (_conn.delegateQueue) {
+        id<EmiConnectionDelegate> connDelegate = _conn.delegate;
+        EmiConnection *conn = _conn;
+        dispatch_group_async(_dispatchGroup, _conn.delegateQueue, ^{
+            if ([connDelegate respondsToSelector:@selector(emiConnectionMessagePart:channelQualifier:data:first:last:)]) {
+                [connDelegate emiConnectionMessagePart:conn
+                                      channelQualifier:channelQualifier
+                                                  data:[data subdataWithRange:NSMakeRange(offset, size)]
+                                                 first:!!(partFlags & EMI_MESSAGE_PART_FIRST)
+                                                  last:!!(partFlags & EMI_MESSAGE_PART_LAST)];
+            }
+        });
+    }
+}
+
 void EmiConnDelegate::emiConnLost() {
     if (_conn.delegateQueue) {
         id<EmiConnectionDelegate> connDelegate = _conn.delegate;
@@ -15,6 +15,9 @@
 
 // err is nil on no error
 typedef void (^EmiConnectionSendFinishedBlock)(NSError *err);
+typedef void (^EmiConnectionPolledMessageBlock)(EmiChannelQualifier channelQualifier, NSData *data);
+typedef void (^EmiConnectionPolledMessagePartBlock)(EmiChannelQualifier channelQualifier, NSData *data,
+                                                    BOOL first, BOOL last);
 
 @protocol EmiConnectionDelegate <NSObject>
 - (void)emiConnectionOpened:(EmiConnection *)connection userData:(id)userData;
@@ -31,6 +34,17 @@ typedef void (^EmiConnectionSendFinishedBlock)(NSError *err);
 
 @optional
 
+// When the socket config has streamMessages set, large messages on
+// reliable ordered channels are delivered part by part through this
+// method as soon as each part is in order, instead of to
+// emiConnectionMessage: when the whole message has arrived. Whole
+// messages are still delivered to emiConnectionMessage:.
+- (void)emiConnectionMessagePart:(EmiConnection *)connection
+                channelQualifier:(EmiChannelQualifier)channelQualifier
+                            data:(NSData *)data
+                           first:(BOOL)first
+                            last:(BOOL)last;
+
 - (void)emiConnectionPacketLoss:(EmiConnection *)connection
                channelQualifier:(EmiChannelQualifier)channelQualifier
                     packetsLost:(EmiSequenceNumber)packetsLost;
@@ -79,6 +93,33 @@ typedef void (^EmiConnectionSendFinishedBlock)(NSError *err);
 - (void)send:(NSData *)data channelQualifier:(EmiChannelQualifier)channelQualifier
     priority:(EmiPriority)priority finished:(EmiConnectionSendFinishedBlock)block;
 
+// Lock free send that may be invoked from any thread. The message is put
+// in a queue that the connection's queue drains on its next tick, and the
+// connection's queue is only woken up when it has drained that queue, so
+// this is much cheaper than the other send methods when sending lots of
+// messages. Messages that can't be sent, or that don't fit in the queue,
+// are silently dropped.
+- (void)enqueueSend:(NSData *)data channelQualifier:(EmiChannelQualifier)channelQualifier
+           priority:(EmiPriority)priority;
+
+// When the socket config has a non-zero pollQueueSize, received messages
+// are queued instead of being passed to emiConnectionMessage:. This
+// invokes block synchronously, on the calling queue, for at most
+// maxCount of the queued messages, and returns the number of messages.
+// It doesn't lock or wait for the connection queue, but it must not be
+// invoked from more than one queue at a time.
+- (NSUInteger)pollMessages:(NSUInteger)maxCount block:(EmiConnectionPolledMessageBlock)block;
+// Like pollMessages:block:, but also tells whether each message is the
+// first and/or the last part of a message. With streamMessages set in
+// the socket config, pollMessages:block: can't tell parts of large
+// messages apart from whole messages, so use this instead.
+- (NSUInteger)pollMessageParts:(NSUInteger)maxCount block:(EmiConnectionPolledMessagePartBlock)block;
+
+// The number of bytes of split messages on the channel that were evicted
+// from the receiver buffer because the rest of the message didn't arrive
+// in time. See incompleteMessageTimeout in EmiSocketConfig.
+- (uint64_t)evictedBytes:(EmiChannelQualifier)channelQualifier;
+
 // Synchronously sets both the delegate and the delegate queue
 - (void)setDelegate:(id<EmiConnectionDelegate>)delegate
       delegateQueue:(dispatch_queue_t)delegateQueue;
@@ -98,5 +139,7 @@ typedef void (^EmiConnectionSendFinishedBlock)(NSError *err);
 @property (nonatomic, readonly, assign) BOOL closed; // This is == !(open || opening)
 @property (nonatomic, readonly, assign) EmiP2PState p2pState;
 @property (nonatomic, readonly, assign) EmiConnectionType type;
+// The number of messages that were dropped because the poll queue was full
+@property (nonatomic, readonly, assign) NSUInteger droppedPolledMessages;
 
 @end
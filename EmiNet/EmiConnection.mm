@@ -176,6 +176,54 @@
     });
 }
 
+- (void)enqueueSend:(NSData *)data channelQualifier:(EmiChannelQualifier)channelQualifier
+           priority:(EmiPriority)priority {
+    if (((EC *)_ec)->enqueueSend(data, channelQualifier, priority)) {
+        dispatch_async(_connectionQueue, ^{
+            ((EC *)_ec)->sendsWereEnqueued();
+        });
+    }
+}
+
+- (NSUInteger)pollMessages:(NSUInteger)maxCount block:(EmiConnectionPolledMessageBlock)block {
+    return [self pollMessageParts:maxCount
+                            block:^(EmiChannelQualifier channelQualifier, NSData *data, BOOL first, BOOL last) {
+                                block(channelQualifier, data);
+                            }];
+}
+
+- (NSUInteger)pollMessageParts:(NSUInteger)maxCount block:(EmiConnectionPolledMessagePartBlock)block {
+    NSUInteger total = 0;
+    EC::PolledMessage msgs[32];
+    
+    while (total < maxCount) {
+        size_t count = ((EC *)_ec)->pollMessages(msgs, MIN(maxCount-total, sizeof(msgs)/sizeof(*msgs)));
+        if (0 == count) {
+            break;
+        }
+        
+        for (size_t i=0; i<count; i++) {
+            block(msgs[i].channelQualifier,
+                  msgs[i].data,
+                  !!(msgs[i].partFlags & EMI_MESSAGE_PART_FIRST),
+                  !!(msgs[i].partFlags & EMI_MESSAGE_PART_LAST));
+        }
+        EC::releasePolledMessages(msgs, count);
+        
+        total += count;
+    }
+    
+    return total;
+}
+
+- (NSUInteger)droppedPolledMessages {
+    return ((EC *)_ec)->droppedPolledMessages();
+}
+
+- (uint64_t)evictedBytes:(EmiChannelQualifier)channelQualifier {
+    SYNC_RETURN(uint64_t, ((EC *)_ec)->evictedBytes(channelQualifier));
+}
+
 - (BOOL)open {
     SYNC_RETURN(BOOL, ((EC *)_ec)->isOpen());
 }
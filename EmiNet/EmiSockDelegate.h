@@ -65,6 +65,10 @@ public:
     
     // This method will always be called from the socketqueue
     dispatch_queue_t getSocketCookie();
+    
+    // Connections have queues of their own, so they can't be ticked
+    // from the socket queue.
+    inline bool batchConnectionTicks() const { return false; }
 };
 
 #endif
@@ -19,6 +19,14 @@
 @property (nonatomic, assign) NSUInteger receiverBufferSize;
 @property (nonatomic, assign) NSUInteger senderBufferSize;
 @property (nonatomic, assign) BOOL acceptConnections;
+@property (nonatomic, assign) float synCookieThreshold;
+@property (nonatomic, assign) NSUInteger pollQueueSize;
+@property (nonatomic, assign) BOOL streamMessages;
+@property (nonatomic, assign) EmiTimeInterval incompleteMessageTimeout;
+@property (nonatomic, assign) float incompleteMessageTimeoutRtts;
+@property (nonatomic, assign) EmiCongestionControlType congestionControl;
+@property (nonatomic, assign) EmiTimeInterval targetQueueingDelay;
+@property (nonatomic, assign) EmiTimeInterval scavengerTargetQueueingDelay;
 @property (nonatomic, assign) uint16_t serverPort;
 @property (nonatomic, assign) NSUInteger MTU;
 @property (nonatomic, assign) float heartbeatFrequency;
@@ -88,6 +88,70 @@ typedef EmiSocketConfigSC SC;
     ((SC *)_sc)->acceptConnections = acceptConnections;
 }
 
+- (float)synCookieThreshold {
+    return ((SC *)_sc)->synCookieThreshold;
+}
+
+- (void)setSynCookieThreshold:(float)synCookieThreshold {
+    ((SC *)_sc)->synCookieThreshold = synCookieThreshold;
+}
+
+- (NSUInteger)pollQueueSize {
+    return ((SC *)_sc)->pollQueueSize;
+}
+
+- (void)setPollQueueSize:(NSUInteger)pollQueueSize {
+    ((SC *)_sc)->pollQueueSize = pollQueueSize;
+}
+
+- (BOOL)streamMessages {
+    return ((SC *)_sc)->streamMessages;
+}
+
+- (void)setStreamMessages:(BOOL)streamMessages {
+    ((SC *)_sc)->streamMessages = streamMessages;
+}
+
+- (EmiTimeInterval)incompleteMessageTimeout {
+    return ((SC *)_sc)->incompleteMessageTimeout;
+}
+
+- (void)setIncompleteMessageTimeout:(EmiTimeInterval)incompleteMessageTimeout {
+    ((SC *)_sc)->incompleteMessageTimeout = incompleteMessageTimeout;
+}
+
+- (float)incompleteMessageTimeoutRtts {
+    return ((SC *)_sc)->incompleteMessageTimeoutRtts;
+}
+
+- (void)setIncompleteMessageTimeoutRtts:(float)incompleteMessageTimeoutRtts {
+    ((SC *)_sc)->incompleteMessageTimeoutRtts = incompleteMessageTimeoutRtts;
+}
+
+- (EmiCongestionControlType)congestionControl {
+    return ((SC *)_sc)->congestionControl;
+}
+
+- (void)setCongestionControl:(EmiCongestionControlType)congestionControl {
+    ((SC *)_sc)->congestionControl = congestionControl;
+}
+
+- (EmiTimeInterval)targetQueueingDelay {
+    return ((SC *)_sc)->targetQueueingDelay;
+}
+
+- (void)setTargetQueueingDelay:(EmiTimeInterval)targetQueueingDelay {
+    ((SC *)_sc)->targetQueueingDelay = targetQueueingDelay;
+}
+
+- (EmiTimeInterval)scavengerTargetQueueingDelay {
+    return ((SC *)_sc)->scavengerTargetQueueingDelay;
+}
+
+- (void)setScavengerTargetQueueingDelay:(EmiTimeInterval)scavengerTargetQueueingDelay {
+    ((SC *)_sc)->scavengerTargetQueueingDelay = scavengerTargetQueueingDelay;
+}
+
 - (uint16_t)serverPort {
     return ((SC *)_sc)->port;
 }
@@ -0,0 +1,94 @@
+//
+//  EmiAcceptBench.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiBench.h"
+#include "EmiTestDelegates.h"
+
+// Measures how fast a server accepts a burst of connections, like the
+// one it gets when it starts or when a match ends. Each SYN comes from
+// an address of its own and SYN cookies are off, so every SYN makes a
+// server connection. Only the server's side of the handshake is
+// measured: the SYN-ACKs go to addresses that nobody listens on.
+
+static const uint16_t SERVER_PORT = 9000;
+
+typedef EmiMessage<EmiTestBinding> EM;
+
+// Sends count SYNs, from 10.0.0.1 and up
+static void sendSyns(size_t count) {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    
+    static const uint8_t serverIp[] = { 127, 0, 0, 1 };
+    sockaddr_storage server;
+    EmiNetUtil::makeAddress(AF_INET, serverIp, sizeof(serverIp), htons(SERVER_PORT), &server);
+    
+    for (size_t i=0; i<count; i++) {
+        uint32_t host = (uint32_t)i+1;
+        uint8_t ip[] = { 10, (uint8_t)(host >> 16), (uint8_t)(host >> 8), (uint8_t)host };
+        sockaddr_storage from;
+        EmiNetUtil::makeAddress(AF_INET, ip, sizeof(ip), htons(5000), &from);
+        
+        uint8_t buf[64];
+        size_t size = EM::writeControlPacket(EMI_SYN_FLAG, buf, sizeof(buf),
+                                             (EmiSequenceNumber)(net.random() & EMI_HEADER_SEQUENCE_NUMBER_MASK));
+        net.send(from, server, buf, size);
+    }
+}
+
+static void benchAccept(size_t connections) {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    net.reset();
+    net.setLatency(0.01);
+    
+    EmiSockConfig serverConfig;
+    serverConfig.acceptConnections = true;
+    serverConfig.port = SERVER_PORT;
+    serverConfig.synCookieThreshold = -1;
+    
+    size_t serverConnections;
+    double elapsed;
+    
+    {
+        EmiTestContext server(serverConfig);
+        
+        EmiTestError err;
+        if (!server.sock->open(err)) {
+            fprintf(stderr, "Failed to open the server socket\n");
+            exit(1);
+        }
+        
+        sendSyns(connections);
+        
+        double start = emiBenchTime();
+        // This delivers all the SYNs, and ticks the new connections
+        // once, which sends their SYN-ACKs
+        net.run(0.02);
+        elapsed = emiBenchTime()-start;
+        
+        serverConnections = server.serverConnections;
+    }
+    net.reset();
+    
+    if (connections != serverConnections) {
+        fprintf(stderr, "Expected %lu server connections, got %lu\n",
+                (unsigned long)connections, (unsigned long)serverConnections);
+        exit(1);
+    }
+    
+    char name[128];
+    snprintf(name, sizeof(name), "Accept a burst of %lu connections", (unsigned long)connections);
+    emiBenchReport(name, elapsed, (double)connections);
+}
+
+int main() {
+    // EmiTestNetwork doesn't queue more than 8192 packets
+    benchAccept(1000);
+    benchAccept(8000);
+    
+    return 0;
+}
@@ -0,0 +1,31 @@
+//
+//  EmiBench.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiBench_h
+#define eminet_EmiBench_h
+
+#include <stdio.h>
+#include <time.h>
+
+// Helpers that the benchmarks share. The benchmarks are plain programs
+// that print their results; they don't check anything. Build and run
+// them with make bench in this directory.
+
+// Monotonic wall clock time in seconds
+inline double emiBenchTime() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+inline void emiBenchReport(const char *name, double seconds, double operations) {
+    printf("%-48s %10.1f ns/op (%.0f ops in %.3f s)\n",
+           name, seconds*1e9/operations, operations, seconds);
+}
+
+#endif
@@ -0,0 +1,93 @@
+//
+//  EmiConnectionLookupBench.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiBench.h"
+
+#include "EmiHashTable.h"
+#include "EmiAddressKey.h"
+#include "EmiAddressCmp.h"
+#include "EmiNetUtil.h"
+
+#include <map>
+#include <vector>
+
+// Measures how long it takes for EmiSock to find the connection of a
+// received datagram by its remote address, with 100k connections. The
+// datagrams come from random connections, so the lookups don't hit the
+// one entry cache of EmiSock.
+//
+// std::map with EmiAddressCmp is what EmiSock used before it got
+// EmiHashTable.
+
+static const size_t NUM_CONNECTIONS = 100000;
+static const size_t NUM_LOOKUPS = 10000000;
+
+static sockaddr_storage makeAddress(uint32_t ip, uint16_t port) {
+    uint32_t ipN = htonl(ip);
+    sockaddr_storage address;
+    memset(&address, 0, sizeof(address));
+    EmiNetUtil::makeAddress(AF_INET, (const uint8_t *)&ipN, sizeof(ipN), htons(port), &address);
+    return address;
+}
+
+int main() {
+    std::vector<sockaddr_storage> addresses;
+    uint32_t random = 1;
+    for (size_t i=0; i<NUM_CONNECTIONS; i++) {
+        random = random*1103515245 + 12345;
+        addresses.push_back(makeAddress(random, (uint16_t)(1024 + i%50000)));
+    }
+    
+    // The order of the lookups is decided up front, so that both
+    // tables look up the same addresses
+    std::vector<uint32_t> order(NUM_LOOKUPS);
+    for (size_t i=0; i<NUM_LOOKUPS; i++) {
+        random = random*1103515245 + 12345;
+        order[i] = (random >> 8) % NUM_CONNECTIONS;
+    }
+    
+    size_t found = 0;
+    
+    {
+        std::map<sockaddr_storage, size_t, EmiAddressCmp> map;
+        for (size_t i=0; i<NUM_CONNECTIONS; i++) {
+            map.insert(std::make_pair(addresses[i], i));
+        }
+        
+        double start = emiBenchTime();
+        for (size_t i=0; i<NUM_LOOKUPS; i++) {
+            std::map<sockaddr_storage, size_t, EmiAddressCmp>::iterator iter(map.find(addresses[order[i]]));
+            if (map.end() != iter) found += iter->second;
+        }
+        emiBenchReport("std::map lookup, 100k connections", emiBenchTime()-start, NUM_LOOKUPS);
+    }
+    
+    {
+        EmiHashTable<EmiAddressKey, size_t> table(EmiSipHash::Key(0x0123456789abcdefULL, 0xfedcba9876543210ULL));
+        for (size_t i=0; i<NUM_CONNECTIONS; i++) {
+            table.insert(EmiAddressKey(addresses[i]), i);
+        }
+        
+        double start = emiBenchTime();
+        for (size_t i=0; i<NUM_LOOKUPS; i++) {
+            // EmiSock makes the key from the sockaddr_storage of the
+            // datagram, so that is included in the measurement
+            size_t *value = table.find(EmiAddressKey(addresses[order[i]]));
+            if (value) found -= *value;
+        }
+        emiBenchReport("EmiHashTable lookup, 100k connections", emiBenchTime()-start, NUM_LOOKUPS);
+    }
+    
+    // Both loops found the same connections, so this should be 0
+    if (0 != found) {
+        fprintf(stderr, "The tables disagree\n");
+        return 1;
+    }
+    
+    return 0;
+}
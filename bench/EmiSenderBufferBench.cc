@@ -0,0 +1,137 @@
+//
+//  EmiSenderBufferBench.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiBench.h"
+#include "EmiTestBinding.h"
+
+#include "EmiSenderBuffer.h"
+#include "EmiObjectPool.h"
+
+// Measures EmiSenderBuffer in the patterns that EmiConn uses it in:
+// Messages are registered and released on a number of channels, they
+// are acked some time later, and the RTO timer looks for messages to
+// retransmit.
+
+typedef EmiMessage<EmiTestBinding>      EM;
+typedef EmiSenderBuffer<EmiTestBinding> ESB;
+
+class EmiSenderBufferBenchDelegate {
+public:
+    size_t released;
+    size_t retransmitted;
+    
+    EmiSenderBufferBenchDelegate() : released(0), retransmitted(0) {}
+    
+    void releaseHeldMessagesIteration(EmiTimeInterval /*now*/, EM * /*msg*/) {
+        released++;
+    }
+    void eachCurrentMessageIteration(EmiTimeInterval /*now*/, EM * /*msg*/) {
+        retransmitted++;
+    }
+};
+
+static const size_t MESSAGE_LENGTH = 100;
+
+static void registerMessage(ESB& buffer, EmiObjectPool& pool, const uint8_t *payload,
+                            int32_t channelQualifier, EmiNonWrappingSequenceNumber sn) {
+    EM *msg = EM::make(pool, EmiTestBinding::makePersistentData(payload, MESSAGE_LENGTH));
+    msg->channelQualifier = channelQualifier;
+    msg->nonWrappingSequenceNumber = sn;
+    
+    EmiTestError err;
+    if (!buffer.registerReliableMessage(msg, err)) {
+        fprintf(stderr, "The sender buffer is full\n");
+        exit(1);
+    }
+    msg->release();
+}
+
+// Messages flow on numChannels channels. Each channel has window
+// unacked messages, and every message is acked window messages after
+// it was sent. The RTO timer runs once per channel round, but finds
+// nothing to retransmit.
+static void benchSteadyFlow(size_t numChannels, size_t window, size_t rounds) {
+    EmiObjectPool pool;
+    ESB buffer(64*1024*1024);
+    EmiSenderBufferBenchDelegate delegate;
+    uint8_t payload[MESSAGE_LENGTH] = { 0 };
+    
+    EmiTimeInterval now = 1;
+    double start = emiBenchTime();
+    
+    for (size_t round=0; round<rounds; round++) {
+        for (size_t channel=0; channel<numChannels; channel++) {
+            registerMessage(buffer, pool, payload, (int32_t)channel, (EmiNonWrappingSequenceNumber)round);
+        }
+        buffer.releaseHeldMessages(now, delegate);
+        
+        if (round >= window) {
+            for (size_t channel=0; channel<numChannels; channel++) {
+                buffer.deregisterReliableMessages((int32_t)channel,
+                                                  (EmiNonWrappingSequenceNumber)(round-window));
+            }
+        }
+        
+        buffer.eachCurrentMessage(now, /*rto:*/1, delegate);
+        now += 0.001;
+    }
+    
+    double elapsed = emiBenchTime()-start;
+    
+    char name[128];
+    snprintf(name, sizeof(name), "steady flow, %lu channels, window %lu",
+             (unsigned long)numChannels, (unsigned long)window);
+    emiBenchReport(name, elapsed, (double)(rounds*numChannels));
+    
+    if (0 != delegate.retransmitted) {
+        fprintf(stderr, "Unexpected retransmissions\n");
+        exit(1);
+    }
+}
+
+// numChannels channels have window unacked messages each, and all of
+// them have timed out every time the RTO timer runs.
+static void benchRetransmit(size_t numChannels, size_t window, size_t rounds) {
+    EmiObjectPool pool;
+    ESB buffer(64*1024*1024);
+    EmiSenderBufferBenchDelegate delegate;
+    uint8_t payload[MESSAGE_LENGTH] = { 0 };
+    
+    EmiTimeInterval now = 1;
+    for (size_t sn=0; sn<window; sn++) {
+        for (size_t channel=0; channel<numChannels; channel++) {
+            registerMessage(buffer, pool, payload, (int32_t)channel, (EmiNonWrappingSequenceNumber)sn);
+        }
+    }
+    buffer.releaseHeldMessages(now, delegate);
+    
+    double start = emiBenchTime();
+    
+    for (size_t round=0; round<rounds; round++) {
+        now += 1;
+        buffer.eachCurrentMessage(now, /*rto:*/0.5, delegate);
+    }
+    
+    double elapsed = emiBenchTime()-start;
+    
+    char name[128];
+    snprintf(name, sizeof(name), "retransmit, %lu channels, window %lu",
+             (unsigned long)numChannels, (unsigned long)window);
+    emiBenchReport(name, elapsed, (double)delegate.retransmitted);
+}
+
+int main() {
+    benchSteadyFlow(1, 64, 2000000);
+    benchSteadyFlow(16, 64, 200000);
+    benchSteadyFlow(256, 16, 20000);
+    
+    benchRetransmit(16, 64, 200000);
+    benchRetransmit(256, 16, 20000);
+    
+    return 0;
+}
@@ -0,0 +1,130 @@
+//
+//  EmiSynFloodBench.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiBench.h"
+#include "EmiTestDelegates.h"
+
+// Floods a server with SYNs from spoofed addresses, and measures how
+// long it takes for a real client to get a connection in the middle of
+// it, and what the flood costs the server. The network is simulated,
+// so the connection latency is in simulated time, while the cost of
+// the flood is in CPU time.
+
+static const uint16_t SERVER_PORT = 9000;
+
+typedef EmiMessage<EmiTestBinding> EM;
+
+class EmiSynFloodBenchContext : public EmiTestContext {
+public:
+    EmiTimeInterval openedTime;
+    
+    explicit EmiSynFloodBenchContext(const EmiSockConfig& config) :
+    EmiTestContext(config), openedTime(0) {}
+    
+    virtual void connectionOpened(EmiTestConnection& conn, bool error, EmiDisconnectReason reason) {
+        EmiTestContext::connectionOpened(conn, error, reason);
+        openedTime = EmiTestNetwork::get().now();
+    }
+};
+
+// Sends count SYNs, each from an address of its own
+static void sendSpoofedSyns(size_t count) {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    
+    static const uint8_t serverIp[] = { 127, 0, 0, 1 };
+    sockaddr_storage server;
+    EmiNetUtil::makeAddress(AF_INET, serverIp, sizeof(serverIp), htons(SERVER_PORT), &server);
+    
+    for (size_t i=0; i<count; i++) {
+        uint64_t random = net.random();
+        
+        uint8_t ip[] = { 10, (uint8_t)(random >> 8), (uint8_t)(random >> 16), (uint8_t)(random >> 24) };
+        sockaddr_storage from;
+        EmiNetUtil::makeAddress(AF_INET, ip, sizeof(ip), htons((uint16_t)(1024 + (random >> 32) % 60000)), &from);
+        
+        uint8_t buf[64];
+        size_t size = EM::writeControlPacket(EMI_SYN_FLAG, buf, sizeof(buf),
+                                             (EmiSequenceNumber)(random >> 40) & EMI_HEADER_SEQUENCE_NUMBER_MASK);
+        net.send(from, server, buf, size);
+    }
+}
+
+// synsPerMs spoofed SYNs arrive every millisecond for duration seconds.
+// Halfway through, a client connects.
+static void benchFlood(float synCookieThreshold, size_t synsPerMs, EmiTimeInterval duration) {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    net.reset();
+    net.setLatency(0.01);
+    
+    EmiSockConfig serverConfig;
+    serverConfig.acceptConnections = true;
+    serverConfig.port = SERVER_PORT;
+    serverConfig.synCookieThreshold = synCookieThreshold;
+    
+    size_t serverConnections;
+    EmiTimeInterval connectTime = 0;
+    EmiTimeInterval openedTime = 0;
+    double elapsed;
+    
+    {
+        EmiTestContext server(serverConfig);
+        EmiSynFloodBenchContext client((EmiSockConfig()));
+        
+        EmiTestError err;
+        if (!server.sock->open(err)) {
+            fprintf(stderr, "Failed to open the server socket\n");
+            exit(1);
+        }
+        
+        const size_t steps = (size_t)(duration*1000);
+        double start = emiBenchTime();
+        
+        for (size_t step=0; step<steps; step++) {
+            if (steps/2 == step) {
+                connectTime = net.now();
+                if (!client.connect(SERVER_PORT)) {
+                    fprintf(stderr, "Failed to connect\n");
+                    exit(1);
+                }
+            }
+            
+            sendSpoofedSyns(synsPerMs);
+            net.run(0.001);
+            server.reap();
+            client.reap();
+        }
+        
+        elapsed = emiBenchTime()-start;
+        openedTime = client.openedTime;
+        serverConnections = server.serverConnections;
+        
+        // Let the flood drain before the sockets are closed
+        net.run(1);
+    }
+    net.reset();
+    
+    char name[128];
+    snprintf(name, sizeof(name), "SYN flood, %lu SYN/s, cookie threshold %g",
+             (unsigned long)(synsPerMs*1000), synCookieThreshold);
+    emiBenchReport(name, elapsed, (double)(synsPerMs*(size_t)(duration*1000)));
+    
+    if (0 == openedTime) {
+        printf("    the client did not get a connection\n");
+    }
+    else {
+        printf("    connection latency %.1f ms, %lu server connections allocated\n",
+               (openedTime-connectTime)*1000, (unsigned long)serverConnections);
+    }
+}
+
+int main() {
+    benchFlood(EMI_DEFAULT_SYN_COOKIE_THRESHOLD, 100, 0.5);
+    benchFlood(/*synCookieThreshold:*/-1, 100, 0.5);
+    
+    return 0;
+}
@@ -2,7 +2,7 @@
   "targets": [
     {
       "target_name": "eminet",
-      "sources": ['core/EmiNetUtil.cc', 'core/EmiRC4.cc', 'core/EmiConnTime.cc', 'core/EmiMessageHeader.cc', 'core/EmiPacketHeader.cc', 'core/EmiDataArrivalRate.cc', 'core/EmiLossList.cc', 'core/EmiLinkCapacity.cc', 'node/slab_allocator.cc', 'node/eminet.cc', 'node/EmiSocket.cc', 'node/EmiConnection.cc', 'node/EmiConnDelegate.cc', 'node/EmiSockDelegate.cc', 'node/EmiConnectionParams.cc', 'node/EmiError.cc', 'node/EmiNodeUtil.cc', 'node/EmiBinding.cc', 'node/EmiP2PSocket.cc']
+      "sources": ['core/EmiNetUtil.cc', 'core/EmiRC4.cc', 'core/EmiConnTime.cc', 'core/EmiMessageHeader.cc', 'core/EmiPacketHeader.cc', 'core/EmiDataArrivalRate.cc', 'core/EmiLossList.cc', 'core/EmiLinkCapacity.cc', 'core/EmiTimerWheel.cc', 'core/EmiBuffer.cc', 'core/EmiObjectPool.cc', 'core/EmiBbrCongestionControl.cc', 'core/EmiDelayCongestionControl.cc', 'core/EmiLedbatCongestionControl.cc', 'node/slab_allocator.cc', 'node/eminet.cc', 'node/EmiSocket.cc', 'node/EmiConnection.cc', 'node/EmiConnDelegate.cc', 'node/EmiSockDelegate.cc', 'node/EmiError.cc', 'node/EmiNodeUtil.cc', 'node/EmiMessageBatch.cc', 'node/EmiBinding.cc', 'node/EmiP2PSocket.cc']
     }
   ]
 }
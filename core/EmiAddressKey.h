@@ -0,0 +1,73 @@
+//
+//  EmiAddressKey.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiAddressKey_h
+#define eminet_EmiAddressKey_h
+
+#include "EmiSipHash.h"
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <cstring>
+
+// A compact hash table key for a socket address. It contains only the
+// parts of the address that EmiAddressCmp::compare looks at (family,
+// port and IP address), so two keys are equal iff compare returns 0 for
+// their addresses. That is 20 bytes instead of the 128 bytes of a
+// sockaddr_storage, and the keys can be compared without branching on
+// the address family.
+class EmiAddressKey {
+    // IPv4 addresses use only the first word, the rest are 0
+    uint32_t _addr[4];
+    uint16_t _port;
+    uint16_t _family;
+    
+public:
+    EmiAddressKey() {
+        memset(this, 0, sizeof(*this));
+    }
+    
+    explicit EmiAddressKey(const sockaddr_storage& address) {
+        memset(this, 0, sizeof(*this));
+        
+        _family = address.ss_family;
+        
+        if (AF_INET == address.ss_family) {
+            const struct sockaddr_in *in = (const struct sockaddr_in *)&address;
+            _port = in->sin_port;
+            _addr[0] = in->sin_addr.s_addr;
+        }
+        else { // Assume AF_INET6
+            const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)&address;
+            _port = in6->sin6_port;
+            memcpy(_addr, in6->sin6_addr.s6_addr, sizeof(_addr));
+        }
+    }
+    
+    inline bool operator==(const EmiAddressKey& other) const {
+        return (_addr[0] == other._addr[0] &&
+                _addr[1] == other._addr[1] &&
+                _addr[2] == other._addr[2] &&
+                _addr[3] == other._addr[3] &&
+                _port    == other._port &&
+                _family  == other._family);
+    }
+    
+    inline bool operator!=(const EmiAddressKey& other) const {
+        return !(*this == other);
+    }
+    
+    // The remote address of a packet is chosen by whoever sends it, so
+    // the key is hashed with SipHash, keyed with a per table random key.
+    // Otherwise, it would be easy to craft addresses that collide.
+    inline uint32_t hash(const EmiSipHash::Key& hashKey) const {
+        return (uint32_t)EmiSipHash::hash(hashKey, (const uint8_t *)this, sizeof(*this));
+    }
+};
+
+#endif
@@ -0,0 +1,239 @@
+//
+//  EmiBbrCongestionControl.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiBbrCongestionControl.h"
+
+#include <algorithm>
+
+// 2/ln(2), the smallest gain that lets STARTUP double the sending rate
+// every round, like slow start does
+static const float HIGH_GAIN = 2.885f;
+static const float CWND_GAIN = 2;
+static const int   GAIN_CYCLE_LENGTH = 8;
+static const float PACING_GAIN_CYCLE[GAIN_CYCLE_LENGTH] = { 1.25f, 0.75f, 1, 1, 1, 1, 1, 1 };
+// In rounds
+static const int   BTL_BW_WINDOW = 10;
+static const EmiTimeInterval RTPROP_WINDOW = 10;
+static const EmiTimeInterval PROBE_RTT_DURATION = 0.2;
+static const int   MIN_CWND_PACKETS = 4;
+// STARTUP is done when the bottleneck bandwidth hasn't grown by this
+// much in FULL_BW_ROUNDS rounds
+static const float FULL_BW_THRESHOLD = 1.25f;
+static const int   FULL_BW_ROUNDS = 3;
+
+EmiBbrCongestionControl::EmiBbrCongestionControl() :
+_btlBw(BTL_BW_WINDOW) {
+    onPathChange();
+}
+
+EmiBbrCongestionControl::~EmiBbrCongestionControl() {}
+
+size_t EmiBbrCongestionControl::minCongestionWindow() const {
+    return std::max(EMI_MIN_CONGESTION_WINDOW, MIN_CWND_PACKETS*_maxPacketSize);
+}
+
+size_t EmiBbrCongestionControl::bdp(float gain) const {
+    return (size_t)(gain*_btlBw.get()*_rtProp);
+}
+
+void EmiBbrCongestionControl::enterStartup() {
+    _mode = BBR_MODE_STARTUP;
+    _pacingGain = HIGH_GAIN;
+    _cwndGain = HIGH_GAIN;
+}
+
+void EmiBbrCongestionControl::enterProbeBw(EmiTimeInterval now) {
+    _mode = BBR_MODE_PROBE_BW;
+    _cwndGain = CWND_GAIN;
+    
+    // Like BBR, start at a more or less random phase, but not at the
+    // draining one, so that flows that share a bottleneck don't probe
+    // in lockstep. The clock is random enough for that.
+    _cycleIndex = ((int)(now*1000)) % (GAIN_CYCLE_LENGTH-1);
+    if (1 <= _cycleIndex) {
+        _cycleIndex++;
+    }
+    _pacingGain = PACING_GAIN_CYCLE[_cycleIndex];
+    _cycleTime = now;
+}
+
+void EmiBbrCongestionControl::enterProbeRtt() {
+    _mode = BBR_MODE_PROBE_RTT;
+    _pacingGain = 1;
+    _cwndGain = 1;
+    _probeRttDoneTime = -1;
+}
+
+void EmiBbrCongestionControl::exitProbeRtt(EmiTimeInterval now) {
+    // The minimum RTT of the probe is the new round trip propagation
+    // time, so it is fresh now
+    _rtPropTime = now;
+    
+    if (_filledPipe) {
+        enterProbeBw(now);
+    }
+    else {
+        enterStartup();
+    }
+}
+
+void EmiBbrCongestionControl::checkFullPipe() {
+    if (_filledPipe) {
+        return;
+    }
+    
+    if (_btlBw.get() >= _fullBw*FULL_BW_THRESHOLD) {
+        // The bandwidth is still growing
+        _fullBw = _btlBw.get();
+        _fullBwCount = 0;
+        return;
+    }
+    
+    _fullBwCount++;
+    if (FULL_BW_ROUNDS <= _fullBwCount) {
+        _filledPipe = true;
+        
+        if (BBR_MODE_STARTUP == _mode) {
+            _mode = BBR_MODE_DRAIN;
+            _pacingGain = 1/HIGH_GAIN;
+            _cwndGain = HIGH_GAIN;
+        }
+    }
+}
+
+void EmiBbrCongestionControl::updateMode(EmiTimeInterval now, const State& state) {
+    if (BBR_MODE_DRAIN == _mode) {
+        if (hasModel() && state.bytesInFlight <= bdp(1)) {
+            enterProbeBw(now);
+        }
+    }
+    else if (BBR_MODE_PROBE_BW == _mode) {
+        bool phaseIsOver = (now-_cycleTime > std::max(_rtProp, (EmiTimeInterval)EMI_TICK_TIME));
+        
+        // The draining phase is over as soon as the queue is gone
+        if (1 > _pacingGain && hasModel() && state.bytesInFlight <= bdp(1)) {
+            phaseIsOver = true;
+        }
+        
+        if (phaseIsOver) {
+            _cycleIndex = (_cycleIndex+1) % GAIN_CYCLE_LENGTH;
+            _pacingGain = PACING_GAIN_CYCLE[_cycleIndex];
+            _cycleTime = now;
+        }
+    }
+    else if (BBR_MODE_PROBE_RTT == _mode) {
+        if (-1 == _probeRttDoneTime) {
+            if (state.bytesInFlight <= minCongestionWindow()) {
+                _probeRttDoneTime = now + std::max(PROBE_RTT_DURATION, _rtProp);
+            }
+        }
+        else if (now >= _probeRttDoneTime) {
+            exitProbeRtt(now);
+        }
+    }
+}
+
+void EmiBbrCongestionControl::updateCongestionWindow() {
+    size_t minCwnd = minCongestionWindow();
+    
+    if (_inRtoRecovery || BBR_MODE_PROBE_RTT == _mode) {
+        _congestionWindow = minCwnd;
+    }
+    else if (hasModel()) {
+        _congestionWindow = std::max(minCwnd, bdp(_cwndGain));
+    }
+    else {
+        _congestionWindow = std::max(minCwnd, _dataSentWithoutModel);
+    }
+    
+    _congestionWindow = std::min(EMI_MAX_CONGESTION_WINDOW, _congestionWindow);
+}
+
+void EmiBbrCongestionControl::onPacketSent(EmiTimeInterval /*now*/, EmiPacketSequenceNumber /*sequenceNumber*/, size_t size) {
+    _maxPacketSize = std::max(_maxPacketSize, size);
+    
+    if (!hasModel()) {
+        _dataSentWithoutModel += size;
+    }
+}
+
+void EmiBbrCongestionControl::onAck(EmiTimeInterval now, const State& state) {
+    _inRtoRecovery = false;
+    
+    updateMode(now, state);
+    updateCongestionWindow();
+}
+
+void EmiBbrCongestionControl::onNak(EmiTimeInterval /*now*/,
+                                    EmiPacketSequenceNumber /*nak*/,
+                                    EmiPacketSequenceNumber /*largestSNSoFar*/,
+                                    const State& /*state*/) {
+    // Loss is not a congestion signal for BBR. If the queue overflows,
+    // that shows in the data arrival rate instead.
+}
+
+void EmiBbrCongestionControl::onRttSample(EmiTimeInterval now, EmiTimeInterval rtt, const State& /*state*/) {
+    bool expired = (-1 != _rtProp && now-_rtPropTime > RTPROP_WINDOW);
+    
+    if (-1 == _rtProp || rtt <= _rtProp || expired) {
+        _rtProp = rtt;
+        _rtPropTime = now;
+    }
+    
+    if (expired && BBR_MODE_PROBE_RTT != _mode) {
+        enterProbeRtt();
+    }
+    
+    updateCongestionWindow();
+}
+
+void EmiBbrCongestionControl::onDataArrivalRateSample(EmiTimeInterval /*now*/, float rate) {
+    // Each report is a round
+    _round++;
+    _btlBw.pushValue(_round, rate);
+    
+    checkFullPipe();
+    updateCongestionWindow();
+}
+
+void EmiBbrCongestionControl::onRto() {
+    _inRtoRecovery = true;
+    updateCongestionWindow();
+}
+
+void EmiBbrCongestionControl::onPathChange() {
+    _btlBw.reset();
+    _round = 0;
+    _rtProp = -1;
+    _rtPropTime = 0;
+    
+    _filledPipe = false;
+    _fullBw = 0;
+    _fullBwCount = 0;
+    
+    _cycleIndex = 0;
+    _cycleTime = 0;
+    _probeRttDoneTime = -1;
+    
+    _maxPacketSize = 0;
+    _dataSentWithoutModel = 0;
+    _inRtoRecovery = false;
+    
+    enterStartup();
+    updateCongestionWindow();
+}
+
+size_t EmiBbrCongestionControl::congestionWindow() const {
+    return _congestionWindow;
+}
+
+float EmiBbrCongestionControl::pacingRate() const {
+    // Before the first report of the data arrival rate, sending is
+    // only limited by the congestion window, like in slow start
+    return (_btlBw.empty() ? 0 : _pacingGain*_btlBw.get());
+}
@@ -0,0 +1,127 @@
+//
+//  EmiBbrCongestionControl.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiBbrCongestionControl_h
+#define eminet_EmiBbrCongestionControl_h
+
+#include "EmiCongestionControlPolicy.h"
+#include "EmiWindowedFilter.h"
+
+// This class implements a congestion control algorithm that is modeled
+// after BBR. Instead of reacting to loss, it builds a model of the path:
+// The bottleneck bandwidth is the maximum data arrival rate that the
+// other host has reported during the last 10 rounds, and the round trip
+// propagation time is the minimum RTT during the last 10 seconds. It
+// then paces packets at about the bottleneck bandwidth, and keeps about
+// two bandwidth-delay products in flight, which keeps the queue at the
+// bottleneck short. Random loss, which is common on cellular paths,
+// doesn't make it slow down.
+//
+// Like BBR, it goes through four modes:
+//
+// * STARTUP: The pacing rate grows exponentially until the bottleneck
+//   bandwidth stops growing.
+// * DRAIN: The queue that STARTUP built up is drained.
+// * PROBE_BW: The pacing rate cycles through a phase that probes for
+//   more bandwidth, a phase that drains any queue that the probing
+//   built up, and six phases at the estimated bandwidth.
+// * PROBE_RTT: When the minimum RTT hasn't been seen for 10 seconds,
+//   the congestion window is cut to a few packets for a short while, so
+//   that the queue empties and the round trip propagation time can be
+//   measured again.
+//
+// The other host only reports its data arrival rate along with RTT
+// requests, which is about once per RTT, so a round of BBR is counted
+// as one such report, rather than by tracking delivered packets.
+class EmiBbrCongestionControl : public EmiCongestionControlPolicy {
+    
+    typedef enum {
+        BBR_MODE_STARTUP,
+        BBR_MODE_DRAIN,
+        BBR_MODE_PROBE_BW,
+        BBR_MODE_PROBE_RTT
+    } BbrMode;
+    
+    BbrMode _mode;
+    
+    // In bytes per second. The window is in rounds, not in seconds.
+    EmiWindowedFilter<float> _btlBw;
+    int _round;
+    // -1 until the first RTT sample
+    EmiTimeInterval _rtProp;
+    EmiTimeInterval _rtPropTime;
+    
+    float _pacingGain;
+    float _cwndGain;
+    
+    // For knowing when STARTUP has filled the pipe
+    bool  _filledPipe;
+    float _fullBw;
+    int   _fullBwCount;
+    
+    // The current phase of the PROBE_BW gain cycle, and when it began
+    int             _cycleIndex;
+    EmiTimeInterval _cycleTime;
+    
+    // When PROBE_RTT is done, or -1 if the congestion window has not
+    // yet been cut down enough for PROBE_RTT to start counting
+    EmiTimeInterval _probeRttDoneTime;
+    
+    // The largest packet that has been sent, used for the minimum
+    // congestion window
+    size_t _maxPacketSize;
+    // Until there is a model of the path, the congestion window grows
+    // like in slow start: by the amount of data that has been sent.
+    size_t _dataSentWithoutModel;
+    // Set on RTO until the next ack, to not send more than a few
+    // packets into a path that might be gone
+    bool _inRtoRecovery;
+    
+    size_t _congestionWindow;
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiBbrCongestionControl(const EmiBbrCongestionControl& other);
+    inline EmiBbrCongestionControl& operator=(const EmiBbrCongestionControl& other);
+    
+    inline bool hasModel() const {
+        return !_btlBw.empty() && -1 != _rtProp;
+    }
+    
+    size_t minCongestionWindow() const;
+    size_t bdp(float gain) const;
+    
+    void enterStartup();
+    void enterProbeBw(EmiTimeInterval now);
+    void enterProbeRtt();
+    void exitProbeRtt(EmiTimeInterval now);
+    
+    void checkFullPipe();
+    void updateMode(EmiTimeInterval now, const State& state);
+    void updateCongestionWindow();
+    
+public:
+    EmiBbrCongestionControl();
+    virtual ~EmiBbrCongestionControl();
+    
+    virtual void onPacketSent(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber, size_t size);
+    virtual void onAck(EmiTimeInterval now, const State& state);
+    virtual void onNak(EmiTimeInterval now,
+                       EmiPacketSequenceNumber nak,
+                       EmiPacketSequenceNumber largestSNSoFar,
+                       const State& state);
+    virtual void onRttSample(EmiTimeInterval now, EmiTimeInterval rtt, const State& state);
+    virtual void onDataArrivalRateSample(EmiTimeInterval now, float rate);
+    virtual void onRto();
+    virtual void onPathChange();
+    
+    virtual size_t congestionWindow() const;
+    virtual float pacingRate() const;
+};
+
+#endif
@@ -0,0 +1,96 @@
+//
+//  EmiBuffer.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiBuffer.h"
+
+#include <cstdlib>
+#include <cstring>
+
+EmiBuffer   *EmiBuffer::_freeLists[EmiBuffer::NUM_SIZE_CLASSES];
+size_t       EmiBuffer::_freeCounts[EmiBuffer::NUM_SIZE_CLASSES];
+volatile int EmiBuffer::_freeListLocks[EmiBuffer::NUM_SIZE_CLASSES];
+
+uint8_t EmiBuffer::sizeClassForLength(size_t length) {
+    if (length > MAX_POOLED_LENGTH) {
+        return NOT_POOLED;
+    }
+    
+    uint8_t sizeClass = 0;
+    while (((size_t)1 << (sizeClass+MIN_SIZE_CLASS_BITS)) < length) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+void EmiBuffer::lockFreeList(uint8_t sizeClass) {
+    while (__sync_lock_test_and_set(&_freeListLocks[sizeClass], 1));
+}
+
+void EmiBuffer::unlockFreeList(uint8_t sizeClass) {
+    __sync_lock_release(&_freeListLocks[sizeClass]);
+}
+
+EmiBuffer *EmiBuffer::make(size_t length) {
+    uint8_t sizeClass = sizeClassForLength(length);
+    
+    EmiBuffer *buffer = NULL;
+    if (NOT_POOLED == sizeClass) {
+        buffer = (EmiBuffer *)malloc(sizeof(EmiBuffer)+length);
+    }
+    else {
+        lockFreeList(sizeClass);
+        buffer = _freeLists[sizeClass];
+        if (buffer) {
+            _freeLists[sizeClass] = buffer->_nextFree;
+            _freeCounts[sizeClass]--;
+        }
+        unlockFreeList(sizeClass);
+        
+        if (!buffer) {
+            size_t capacity = (size_t)1 << (sizeClass+MIN_SIZE_CLASS_BITS);
+            buffer = (EmiBuffer *)malloc(sizeof(EmiBuffer)+capacity);
+        }
+    }
+    
+    ASSERT(buffer);
+    
+    buffer->_refCount = 1;
+    buffer->_length = length;
+    buffer->_sizeClass = sizeClass;
+    buffer->_nextFree = NULL;
+    
+    return buffer;
+}
+
+EmiBuffer *EmiBuffer::make(const uint8_t *data, size_t length) {
+    EmiBuffer *buffer = make(length);
+    memcpy(buffer->data(), data, length);
+    return buffer;
+}
+
+void EmiBuffer::recycle() {
+    if (NOT_POOLED == _sizeClass) {
+        ::free(this);
+        return;
+    }
+    
+    size_t capacity = (size_t)1 << (_sizeClass+MIN_SIZE_CLASS_BITS);
+    
+    lockFreeList(_sizeClass);
+    bool pooled = (_freeCounts[_sizeClass]+1)*capacity <= MAX_FREE_BYTES_PER_SIZE_CLASS;
+    if (pooled) {
+        _nextFree = _freeLists[_sizeClass];
+        _freeLists[_sizeClass] = this;
+        _freeCounts[_sizeClass]++;
+    }
+    unlockFreeList(_sizeClass);
+    
+    if (!pooled) {
+        ::free(this);
+    }
+}
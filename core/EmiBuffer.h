@@ -0,0 +1,162 @@
+//
+//  EmiBuffer.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiBuffer_h
+#define eminet_EmiBuffer_h
+
+#include "EmiNetUtil.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A reference counted byte buffer that is owned by native code. Bindings
+// can use it as their PersistentData type, so that every message that is
+// queued for sending, buffered in EmiReceiverBuffer or split into pieces
+// doesn't need an object of the host environment (such as a V8 object
+// and a persistent handle) of its own.
+//
+// The bytes are stored right after the EmiBuffer object, in the same
+// allocation. Buffers of up to MAX_POOLED_LENGTH bytes are allocated in
+// power of two size classes, and released buffers are kept in one free
+// list per size class, so that a steady flow of messages does not hit
+// malloc at all.
+//
+// EmiBuffer is thread safe: Buffers may be made, retained and released
+// from any thread. The reference count is updated with atomic
+// operations, and each free list is guarded by a spin lock of its own,
+// which is only held while a buffer is pushed or popped. This uses the
+// GCC __sync builtins, which are supported by both GCC and clang.
+class EmiBuffer {
+private:
+    static const size_t  MIN_SIZE_CLASS_BITS = 6;
+    static const size_t  MAX_SIZE_CLASS_BITS = 16;
+    static const size_t  NUM_SIZE_CLASSES = MAX_SIZE_CLASS_BITS-MIN_SIZE_CLASS_BITS+1;
+    static const uint8_t NOT_POOLED = 0xff;
+    // The free lists keep at most this many bytes worth of buffers per
+    // size class. Without a cap, a burst of traffic would leave lots of
+    // memory in the free lists for good.
+    static const size_t  MAX_FREE_BYTES_PER_SIZE_CLASS = 1024*1024;
+    
+    static EmiBuffer   *_freeLists[NUM_SIZE_CLASSES];
+    static size_t       _freeCounts[NUM_SIZE_CLASSES];
+    static volatile int _freeListLocks[NUM_SIZE_CLASSES];
+    
+    volatile size_t _refCount;
+    size_t   _length;
+    uint8_t  _sizeClass;
+    // Only used while the buffer is in a free list
+    EmiBuffer *_nextFree;
+    
+    // Private constructor, destructor, copy constructor and assignment
+    // operator; EmiBuffers are made with make and released with release
+    inline EmiBuffer();
+    inline ~EmiBuffer();
+    inline EmiBuffer(const EmiBuffer& other);
+    inline EmiBuffer& operator=(const EmiBuffer& other);
+    
+    static uint8_t sizeClassForLength(size_t length);
+    static void lockFreeList(uint8_t sizeClass);
+    static void unlockFreeList(uint8_t sizeClass);
+    void recycle();
+    
+public:
+    static const size_t MAX_POOLED_LENGTH = 1 << MAX_SIZE_CLASS_BITS;
+    
+    // Returns a buffer of the given length with a reference count of 1.
+    // The contents of the buffer are undefined.
+    static EmiBuffer *make(size_t length);
+    // Returns a buffer with a copy of data, with a reference count of 1
+    static EmiBuffer *make(const uint8_t *data, size_t length);
+    
+    inline void retain() {
+        __sync_add_and_fetch(&_refCount, 1);
+    }
+    
+    inline void release() {
+        ASSERT(0 != _refCount);
+        if (0 == __sync_sub_and_fetch(&_refCount, 1)) {
+            recycle();
+        }
+    }
+    
+    inline uint8_t *data() {
+        return (uint8_t *)(this+1);
+    }
+    
+    inline const uint8_t *data() const {
+        return (const uint8_t *)(this+1);
+    }
+    
+    inline size_t length() const {
+        return _length;
+    }
+};
+
+// A range of bytes that is valid for as long as the EmiBufferRef object
+// is. It either holds a reference to the EmiBuffer that the bytes are in,
+// or it refers to memory that is owned by someone else, in which case the
+// owner has to keep the memory alive. Bindings can use this as their
+// TemporaryData type.
+class EmiBufferRef {
+private:
+    EmiBuffer     *_buffer;
+    const uint8_t *_data;
+    size_t         _length;
+    
+public:
+    EmiBufferRef() :
+    _buffer(NULL),
+    _data(NULL),
+    _length(0) {}
+    
+    // Does not copy the data
+    EmiBufferRef(const uint8_t *data, size_t length) :
+    _buffer(NULL),
+    _data(data),
+    _length(length) {}
+    
+    // Retains buffer
+    explicit EmiBufferRef(EmiBuffer *buffer) :
+    _buffer(buffer),
+    _data(buffer ? buffer->data() : NULL),
+    _length(buffer ? buffer->length() : 0) {
+        if (_buffer) _buffer->retain();
+    }
+    
+    EmiBufferRef(const EmiBufferRef& other) :
+    _buffer(other._buffer),
+    _data(other._data),
+    _length(other._length) {
+        if (_buffer) _buffer->retain();
+    }
+    
+    EmiBufferRef& operator=(const EmiBufferRef& other) {
+        if (other._buffer) other._buffer->retain();
+        if (_buffer) _buffer->release();
+        
+        _buffer = other._buffer;
+        _data = other._data;
+        _length = other._length;
+        
+        return *this;
+    }
+    
+    ~EmiBufferRef() {
+        if (_buffer) _buffer->release();
+    }
+    
+    inline const uint8_t *data() const {
+        return _data;
+    }
+    
+    inline size_t length() const {
+        return _length;
+    }
+};
+
+#endif
@@ -13,10 +13,17 @@
 #include "EmiDataArrivalRate.h"
 #include "EmiPacketHeader.h"
 #include "EmiNetUtil.h"
-#include "EmiNetRandom.h"
+#include "EmiObjectPool.h"
+#include "EmiConnTime.h"
+#include "EmiCongestionControlPolicy.h"
+#include "EmiUdtCongestionControl.h"
+#include "EmiBbrCongestionControl.h"
+#include "EmiDelayCongestionControl.h"
+#include "EmiLedbatCongestionControl.h"
+#include "EmiSockConfig.h"
 
 #include <algorithm>
-#include <cmath>
+#include <new>
 
 // Set this to non-zero to add a few asserts regarding
 // sequence numbers. Warning: Do not enable these in
@@ -27,33 +34,25 @@
 
 class EmiPacketHeader;
 
-// This class implements the main congestion control algorithm.
-// It is based on the design of UDT.
+// This class does the congestion control bookkeeping of a connection:
+// It measures the link capacity and the data arrival rate, keeps track
+// of acks and of what the other host reports, and estimates how much
+// data is in flight. How much data may actually be sent is decided by
+// an EmiCongestionControlPolicy, which is picked with
+// EmiSockConfig::congestionControl.
 template<class Binding>
 class EmiCongestionControl {
     
-    size_t _congestionWindow;
-    // A sending rate of 0 means that we're in the slow start phase
-    float  _sendingRate;
-    size_t _totalDataSentInSlowStart;
+    EmiObjectPool& _pool;
+    // The policy is allocated from _pool
+    EmiCongestionControlPolicy *_policy;
+    size_t _policySize;
     
     EmiLinkCapacity    _linkCapacity;
     EmiDataArrivalRate _dataArrivalRate;
     
     float _avgPacketSize;
     
-    // The average number of NAKs in a congestion period.
-    float _avgNakCount;
-    // The number of NAKs in the current congestion period.
-    int _nakCount;
-    // The number of times the rate has been decreased in this
-    // congestion period
-    int _decCount;
-    int _decRandom;
-    // The biggest sequence number when last time the
-    // packet sending rate is decreased. Initially -1
-    EmiPacketSequenceNumber _lastDecSeq;
-    
     EmiPacketSequenceNumber _newestSentSN;
     EmiPacketSequenceNumber _newestSeenAckSN;
     
@@ -64,107 +63,58 @@ class EmiCongestionControl {
     float _remoteLinkCapacity;
     float _remoteDataArrivalRate;
     
-    void endSlowStartPhase() {
-        _sendingRate = _remoteDataArrivalRate;
+private:
+    // Private copy constructor and assignment operator
+    inline EmiCongestionControl(const EmiCongestionControl& other);
+    inline EmiCongestionControl& operator=(const EmiCongestionControl& other);
+    
+    template<class Policy>
+    void allocatePolicy() {
+        _policySize = sizeof(Policy);
+        _policy = new (_pool.allocate(_policySize)) Policy();
     }
     
-    void onAck(EmiTimeInterval rtt) {
-        if (0 == _sendingRate) {
-            // We're in the slow start phase
-            _congestionWindow = std::max(EMI_MIN_CONGESTION_WINDOW, _totalDataSentInSlowStart);
-            
-            if (_congestionWindow >= EMI_MAX_CONGESTION_WINDOW) {
-                _congestionWindow = EMI_MAX_CONGESTION_WINDOW;
-                
-                endSlowStartPhase();
-            }
-        }
-        else {
-            // We're not in the slow start phase
-            
-            float inc = 1;
-            
-            if (_remoteLinkCapacity > _sendingRate) {
-                // These are constants as specified by UDT. I have no
-                // idea of why they have this particular value.
-                static const double ALPHA = 8;
-                static const double BETA  = 0.0000015;
-                inc = std::max(std::pow(10, std::ceil(std::log10((_remoteLinkCapacity-_sendingRate)*ALPHA))) * BETA,
-                               1.0);
-            }
-            
-            _sendingRate += inc/EMI_TICK_TIME;
-            
-            _congestionWindow = (size_t) (_remoteDataArrivalRate * (rtt + EMI_TICK_TIME) + 10*1024);
-            _congestionWindow = std::min(EMI_MAX_CONGESTION_WINDOW, _congestionWindow);
-        }
+    template<class Policy, class Arg>
+    void allocatePolicy(const Arg& arg) {
+        _policySize = sizeof(Policy);
+        _policy = new (_pool.allocate(_policySize)) Policy(arg);
     }
     
-    void onNak(EmiPacketSequenceNumber nak,
-               EmiPacketSequenceNumber largestSNSoFar) {
-        if (0 == _sendingRate) {
-            // We're in the slow start phase.
-            
-            if (-1 == _remoteLinkCapacity ||
-                -1 == _remoteDataArrivalRate) {
-                // We got a NAK, but we have not yet received
-                // data about the link capacity and the arrival
-                // rate. Ignore this packet.
-                return;
-            }
-            
-            endSlowStartPhase();
-        }
-        else {
-            // We're not in the slow start phase
-            
-            static const float SENDING_RATE_DECREASE = 1.125;
-            
-            if (nak > _lastDecSeq) {
-                // This NAK starts a new congestion period
-                
-                _sendingRate /= SENDING_RATE_DECREASE;
-                
-                static const float SMOOTH = 0.125;
-                _avgNakCount = (1-SMOOTH)*_avgNakCount + SMOOTH*_nakCount;
-                _nakCount = 1;
-                _decRandom = EmiNetRandom<Binding>::randomUniform(((int)std::floor(_avgNakCount))+1) + 1;
-                _decCount = 1;
-                _lastDecSeq = largestSNSoFar;
-            }
-            else {
-                // This NAK does not start a new congestion period
-                if (_decCount <= 5 && _nakCount == _decCount*_decRandom) {
-                    // The _decCount <= 5 ensures that the sending rate is not
-                    // decreased by more than 50% per congestion period (1.125^6≈2)
-                    
-                    _sendingRate /= SENDING_RATE_DECREASE;
-                    _decCount++;
-                    _lastDecSeq = largestSNSoFar;
-                }
-                
-                _nakCount++;
-            }
+    // An estimate of the number of bytes that have been sent but not
+    // yet acked
+    size_t bytesInFlight() const {
+        if (-1 == _newestSentSN) {
+            return 0;
         }
+        
+        // /2 because presumably half of the packets are
+        // in transit, the other half's ACKs are in transit
+        int packetsInTransit = EmiNetUtil::cyclicDifference<EMI_PACKET_SEQUENCE_NUMBER_LENGTH>(_newestSentSN,
+                                                                                               _newestSeenAckSN)/2;
+        return static_cast<size_t>(packetsInTransit*_avgPacketSize);
+    }
+    
+    EmiCongestionControlPolicy::State state(const EmiConnTime& connTime) const {
+        EmiCongestionControlPolicy::State state;
+        state.rtt = connTime.getRtt();
+        state.minRtt = connTime.getMinRtt();
+        state.remoteLinkCapacity = _remoteLinkCapacity;
+        state.remoteDataArrivalRate = _remoteDataArrivalRate;
+        state.bytesInFlight = bytesInFlight();
+        return state;
     }
     
 public:
-    EmiCongestionControl() :
-    _congestionWindow(EMI_MIN_CONGESTION_WINDOW),
-    _sendingRate(0),
-    _totalDataSentInSlowStart(0),
+    EmiCongestionControl(const EmiSockConfig& config, EmiObjectPool& pool) :
+    _pool(pool),
+    _policy(NULL),
+    _policySize(0),
     
     _linkCapacity(),
     _dataArrivalRate(),
     
     _avgPacketSize(-1),
     
-    _avgNakCount(1),
-    _nakCount(1),
-    _decRandom(2),
-    _decCount(1),
-    _lastDecSeq(-1),
-    
     _newestSentSN(-1),
     _newestSeenAckSN(-1),
     
@@ -172,13 +122,42 @@ public:
     _newestSentAckSN(-1),
     
     _remoteLinkCapacity(-1),
-    _remoteDataArrivalRate(-1) {}
+    _remoteDataArrivalRate(-1) {
+        switch (config.congestionControl) {
+            case EMI_CONGESTION_CONTROL_BBR:
+                allocatePolicy<EmiBbrCongestionControl>();
+                break;
+            case EMI_CONGESTION_CONTROL_LOW_LATENCY:
+                allocatePolicy<EmiDelayCongestionControl>(config.targetQueueingDelay);
+                break;
+            case EMI_CONGESTION_CONTROL_SCAVENGER:
+                allocatePolicy<EmiLedbatCongestionControl>(config.scavengerTargetQueueingDelay);
+                break;
+            case EMI_CONGESTION_CONTROL_UDT:
+            default:
+                allocatePolicy<EmiUdtCongestionControl<Binding> >();
+                break;
+        }
+    }
     
-    void gotPacket(EmiTimeInterval now, EmiTimeInterval rtt,
+    ~EmiCongestionControl() {
+        _policy->~EmiCongestionControlPolicy();
+        _pool.deallocate(_policy, _policySize);
+    }
+    
+    // gotRttResponse should be true if the packet gave connTime a new
+    // RTT measurement
+    void gotPacket(EmiTimeInterval now, const EmiConnTime& connTime, bool gotRttResponse,
                    EmiPacketSequenceNumber largestSNSoFar,
                    const EmiPacketHeader& packetHeader, size_t packetLength) {
         static const float SMOOTH = 0.125;
         
+        EmiTimeInterval rtt = connTime.getRtt();
+        if (-1 != rtt) {
+            _linkCapacity.setWindow(EMI_RATE_ESTIMATE_WINDOW_RTTS*rtt);
+            _dataArrivalRate.setWindow(EMI_RATE_ESTIMATE_WINDOW_RTTS*rtt);
+        }
+        
         _linkCapacity.gotPacket(now, packetHeader.sequenceNumber, packetLength);
         _dataArrivalRate.gotPacket(now, packetLength);
         
@@ -202,6 +181,12 @@ public:
             else {
                 _remoteDataArrivalRate = (1-SMOOTH)*_remoteDataArrivalRate + SMOOTH*packetHeader.arrivalRate;
             }
+            
+            _policy->onDataArrivalRateSample(now, packetHeader.arrivalRate);
+        }
+        
+        if (gotRttResponse) {
+            _policy->onRttSample(now, connTime.getLatestRtt(), state(connTime));
         }
         
         if (packetHeader.flags & EMI_ACK_PACKET_FLAG) {
@@ -216,11 +201,18 @@ public:
                     _newestSeenAckSN = packetHeader.ack;
                 }
             
-            onAck(rtt);
+            _policy->onAck(now, state(connTime));
         }
         
         if (packetHeader.flags & EMI_NAK_PACKET_FLAG) {
-            onNak(packetHeader.nak, largestSNSoFar);
+            // Each range is a separate loss event, like the NAKs that a
+            // UDT receiver sends as soon as it sees a gap. This makes a
+            // burst of losses that is reported in one packet count as
+            // much as if the ranges had been reported one by one.
+            EmiCongestionControlPolicy::State currentState(state(connTime));
+            for (size_t i=0; i<packetHeader.nakRangeCount; i++) {
+                _policy->onNak(now, packetHeader.nakRanges[i].oldest, largestSNSoFar, currentState);
+            }
         }
         
         if (packetHeader.flags & EMI_SEQUENCE_NUMBER_PACKET_FLAG) {
@@ -237,19 +229,37 @@ public:
     }
     
     void onRto() {
-        _sendingRate /= 2;
+        _policy->onRto();
+    }
+    
+    // Invoked when the other host has moved to a new network path
+    // (that is, a new IP address). What we know about the capacity of
+    // the old path says nothing about the new one, so the policy starts
+    // over. The sequence number state is kept, because the packets in
+    // flight are still part of the same connection.
+    void onPathChange() {
+        _linkCapacity = EmiLinkCapacity();
+        _dataArrivalRate = EmiDataArrivalRate();
+        
+        _remoteLinkCapacity = -1;
+        _remoteDataArrivalRate = -1;
+        
+        _policy->onPathChange();
+    }
+    
+    // Returns the newest packet sequence number that has been received
+    // from the other host, or -1 if no packet has been received.
+    inline EmiPacketSequenceNumber newestSeenSequenceNumber() const {
+        return _newestSeenSN;
     }
     
-    void onDataSent(EmiPacketSequenceNumber sequenceNumber, size_t size) {
+    void onDataSent(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber, size_t size) {
         if (-1 == _newestSentSN) {
             _newestSeenAckSN = ((sequenceNumber-1) & EMI_PACKET_SEQUENCE_NUMBER_MASK);
         }
         _newestSentSN = sequenceNumber;
         
-        if (0 == _sendingRate) {
-            // We're in slow start mode
-            _totalDataSentInSlowStart += size;
-        }
+        _policy->onPacketSent(now, sequenceNumber, size);
         
         if (-1 == _avgPacketSize) {
             _avgPacketSize = size;
@@ -260,19 +270,20 @@ public:
         }
     }
     
-    // This method is intended to be called once per tick. It returns
-    // the newest seen sequence number, or -1 if no sequence number
-    // has been seen or if the newest sequence number seen has already
-    // been returned once by this method.
-    EmiPacketSequenceNumber ack() {
+    // Returns the packet ack to send, or -1 if there is nothing new to
+    // ack. Call ackWasSent once the ack has actually been sent.
+    EmiPacketSequenceNumber ack() const {
         if (_newestSeenSN == _newestSentAckSN) {
             return -1;
         }
         
-        _newestSentAckSN = _newestSeenSN;
         return _newestSeenSN;
     }
     
+    void ackWasSent(EmiPacketSequenceNumber ack) {
+        _newestSentAckSN = ack;
+    }
+    
     inline float linkCapacity() const {
         return _linkCapacity.calculate();
     }
@@ -283,20 +294,10 @@ public:
     
     // Returns the number of bytes we are allowed to send per tick.
     size_t tickAllowance() const {
-        int packetsInTransit;
-        
-        if (-1 == _newestSentSN) {
-            packetsInTransit = 0;
-        }
-        else {
-            // /2 because presumably half of the packets are
-            // in transit, the other half's ACKs are in transit
-            packetsInTransit = EmiNetUtil::cyclicDifference<EMI_PACKET_SEQUENCE_NUMBER_LENGTH>(_newestSentSN,
-                                                                                               _newestSeenAckSN)/2;
-        }
-        
-        size_t cwndAllowance = static_cast<size_t>(_congestionWindow - packetsInTransit*_avgPacketSize);
-        size_t rateAllowance = static_cast<size_t>(_sendingRate * EMI_TICK_TIME);
+        size_t congestionWindow = _policy->congestionWindow();
+        size_t inFlight = bytesInFlight();
+        size_t cwndAllowance = (inFlight < congestionWindow ? congestionWindow-inFlight : 0);
+        size_t rateAllowance = static_cast<size_t>(_policy->pacingRate() * EMI_TICK_TIME);
         
         if (0 == rateAllowance) {
             return cwndAllowance;
@@ -0,0 +1,82 @@
+//
+//  EmiCongestionControlPolicy.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiCongestionControlPolicy_h
+#define eminet_EmiCongestionControlPolicy_h
+
+#include "EmiTypes.h"
+
+#include <cstddef>
+
+// The interface of the congestion control algorithms that
+// EmiCongestionControl can use, see EmiSockConfig::congestionControl.
+//
+// EmiCongestionControl does the bookkeeping that all algorithms need:
+// It measures the link capacity and the data arrival rate for the
+// other host, keeps track of what the other host reports about us, and
+// estimates how much data is in flight. A policy only decides how much
+// data may be sent, with a congestion window and a pacing rate.
+class EmiCongestionControlPolicy {
+public:
+    // What EmiCongestionControl knows about the connection when it
+    // invokes a policy.
+    struct State {
+        State() :
+        rtt(-1),
+        minRtt(-1),
+        remoteLinkCapacity(-1),
+        remoteDataArrivalRate(-1),
+        bytesInFlight(0) {}
+        
+        // The smoothed RTT. -1 if it is not known yet.
+        EmiTimeInterval rtt;
+        // The minimum RTT of the last few seconds, see
+        // EmiConnTime::getMinRtt. -1 if it is not known.
+        EmiTimeInterval minRtt;
+        // The link capacity and the data arrival rate, in bytes per
+        // second, as reported by the other host and smoothed. -1 if
+        // the other host has not reported them yet.
+        float remoteLinkCapacity;
+        float remoteDataArrivalRate;
+        // An estimate of the number of bytes that have been sent but
+        // not yet acked
+        size_t bytesInFlight;
+    };
+    
+    virtual ~EmiCongestionControlPolicy() {}
+    
+    virtual void onPacketSent(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber, size_t size) = 0;
+    // Invoked when a packet with a packet ack arrives
+    virtual void onAck(EmiTimeInterval now, const State& state) = 0;
+    // Invoked once for every reported range of lost packets. nak is the
+    // oldest packet of the range.
+    virtual void onNak(EmiTimeInterval now,
+                       EmiPacketSequenceNumber nak,
+                       EmiPacketSequenceNumber largestSNSoFar,
+                       const State& state) = 0;
+    // Invoked when a new RTT measurement has been made. Unlike
+    // State::rtt, rtt is not smoothed.
+    virtual void onRttSample(EmiTimeInterval now, EmiTimeInterval rtt, const State& state) = 0;
+    // Invoked when the other host reports the rate that it receives
+    // data from us at, in bytes per second. Unlike
+    // State::remoteDataArrivalRate, rate is not smoothed.
+    virtual void onDataArrivalRateSample(EmiTimeInterval now, float rate) = 0;
+    virtual void onRto() = 0;
+    // Invoked when the other host has moved to a new network path. What
+    // is known about the old path says nothing about the new one, so
+    // policies should start over.
+    virtual void onPathChange() = 0;
+    
+    // The maximum number of bytes in flight
+    virtual size_t congestionWindow() const = 0;
+    // The rate to send at, in bytes per second. 0 means that sending is
+    // only limited by the congestion window.
+    virtual float pacingRate() const = 0;
+};
+
+#endif
@@ -21,6 +21,9 @@
 #include "EmiConnTime.h"
 #include "EmiConnParams.h"
 #include "EmiUdpSocket.h"
+#include "EmiMpscQueue.h"
+#include "EmiSpscRing.h"
+#include "EmiObjectPool.h"
 #include "EmiMessageHandler.h"
 #include "EmiNetUtil.h"
 #include "EmiNetRandom.h"
@@ -28,6 +31,9 @@
 class EmiPacketHeader;
 class EmiMessageHeader;
 
+template<class SockDelegate, class ConnDelegate>
+class EmiSock;
+
 template<class SockDelegate, class ConnDelegate>
 class EmiConn {
     typedef typename SockDelegate::Binding   Binding;
@@ -38,6 +44,7 @@ class EmiConn {
     
     typedef typename SockDelegate::ConnectionOpenedCallbackCookie ConnectionOpenedCallbackCookie;
     
+    typedef EmiSock<SockDelegate, ConnDelegate>          ES;
     typedef EmiUdpSocket<Binding>                        EUS;
     typedef EmiMessage<Binding>                          EM;
     typedef EmiReceiverBuffer<SockDelegate, EmiConn>     ERB;
@@ -46,7 +53,7 @@ class EmiConn {
     typedef EmiMessageHandler<EmiConn, EmiConn, Binding> EMH;
     typedef EmiLogicalConnection<SockDelegate, ConnDelegate, ERB> ELC;
     
-    // For makeServerConnection
+    // For makeServerConnection and checkSynCookie
     friend class EmiMessageHandler<EmiConn, EmiConn, Binding>;
     
     ConnDelegate _delegate;
@@ -59,12 +66,23 @@ class EmiConn {
     const sockaddr_storage _originalRemoteAddress;
     sockaddr_storage       _remoteAddress;
     
+    // For server connections, this is the ID that EmiSock assigned to
+    // the connection. For client connections, it is the ID that the
+    // server gave us in the SYN-RST message. It is EMI_NO_CONNECTION_ID
+    // for P2P connections and when the server does not support
+    // connection IDs.
+    EmiConnectionId        _connectionId;
+    
     EMH  _messageHandler;
     EUS *_socket;
     
     EmiP2PData        _p2p;
     EmiConnectionType _type;
     
+    // This has to be declared before all members that allocate from
+    // it, so that it is destroyed after them
+    EmiObjectPool _pool;
+    
     ELC *_conn;
     EmiSenderBuffer<Binding> _senderBuffer;
     ERB _receiverBuffer;
@@ -74,12 +92,114 @@ class EmiConn {
     
     ECT _timers;
     typename Binding::Timer *_forceCloseTimer;
+    
+    // This is set for server connections of EmiSocks that tick all of
+    // their connections in one go, see EmiSock::scheduleConnectionTick.
+    // Such connections don't use the tick timer of _timers.
+    ES    *_tickingSock;
+    // The position of this connection in _tickingSock's list of
+    // connections to tick, or NO_SOCKET_TICK if it is not in the list.
+    // It lets EmiSock remove the connection from the list in O(1).
+    size_t _socketTickIndex;
+    static const size_t NO_SOCKET_TICK = (size_t)-1;
+    
+    // Messages that have been enqueued with enqueueSend, possibly from
+    // other threads. They are sent at the start of the next tick.
+    struct EnqueuedSend {
+        PersistentData      data;
+        EmiChannelQualifier channelQualifier;
+        EmiPriority         priority;
+        
+        EnqueuedSend() :
+        data(),
+        channelQualifier(EMI_CHANNEL_QUALIFIER_DEFAULT),
+        priority(EMI_PRIORITY_DEFAULT) {}
+        
+        EnqueuedSend(const PersistentData& data_,
+                     EmiChannelQualifier channelQualifier_,
+                     EmiPriority priority_) :
+        data(data_),
+        channelQualifier(channelQualifier_),
+        priority(priority_) {}
+    };
+    
+    EmiMpscQueue<EnqueuedSend> _enqueuedSends;
+    
+public:
+    // The maximal length of the data of one EmiMessage. Longer messages
+    // are split.
+    static size_t maxMessageLength() {
+        // Set to 1 to stress test message split code. For maximum effect,
+        // make sure to also disallow multiple messages per packet.
+#if 0
+        return 1;
+#else
+        return (EMI_MINIMAL_MTU -
+                EMI_UDP_HEADER_SIZE -
+                EMI_PACKET_HEADER_MAX_LENGTH -
+                EmiMessage<Binding>::maximalHeaderSize());
+#endif
+    }
+    
+    // The number of messages that a message of the given length will be
+    // split into
+    static size_t numMessagesForLength(size_t dataLength) {
+        // The -1 and +1 is to ensure we round up.
+        //
+        // The 0 == dataLength test is to avoid messed-up-ness with
+        // unsignedness and also to ensure that numMessages >= 1.
+        return (0 == dataLength ?
+                1 :
+                ((dataLength-1) / maxMessageLength())+1);
+    }
+    
+    // A message to be sent with sendMany
+    struct SendRequest {
+        PersistentData      data;
+        EmiChannelQualifier channelQualifier;
+        EmiPriority         priority;
+        
+        SendRequest() : data(), channelQualifier(EMI_CHANNEL_QUALIFIER_DEFAULT), priority(EMI_PRIORITY_DEFAULT) {}
+        SendRequest(const PersistentData& data_,
+                    EmiChannelQualifier channelQualifier_,
+                    EmiPriority priority_) :
+        data(data_),
+        channelQualifier(channelQualifier_),
+        priority(priority_) {}
+    };
+    
+    // A message that has been received in poll mode, see pollMessages
+    struct PolledMessage {
+        EmiChannelQualifier channelQualifier;
+        PersistentData      data;
+        // EMI_MESSAGE_PART_FIRST | EMI_MESSAGE_PART_LAST unless this is
+        // a part of a message that is delivered in streaming mode
+        EmiMessagePartFlags partFlags;
         
+        PolledMessage() : channelQualifier(0), data(), partFlags(0) {}
+        PolledMessage(EmiChannelQualifier channelQualifier_,
+                      const PersistentData& data_,
+                      EmiMessagePartFlags partFlags_) :
+        channelQualifier(channelQualifier_), data(data_), partFlags(partFlags_) {}
+    };
+    
+private:
+    // This is NULL unless config.pollQueueSize is non-zero
+    EmiSpscRing<PolledMessage> *_pollQueue;
+    // The number of messages that were dropped because _pollQueue was full
+    volatile size_t             _droppedPolledMessages;
+    
 private:
     // Private copy constructor and assignment operator
     inline EmiConn(const EmiConn& other);
     inline EmiConn& operator=(const EmiConn& other);
     
+    static void releaseSendRequests(const SendRequest *requests, size_t count) {
+        for (size_t i=0; i<count; i++) {
+            Binding::releasePersistentData(requests[i].data);
+        }
+    }
+    
     void deleteELC(ELC *elc) {
         if (_socket) {
             if (EMI_CONNECTION_TYPE_SERVER != _type) {
@@ -105,7 +225,7 @@ private:
         return _conn->enqueueCloseMessage(now, err);
     }
     
-    static void forceCloseTimeoutCallback(EmiTimeInterval now, typename Binding::Timer *timer, void *data) {
+    static void forceCloseTimeoutCallback(EmiTimeInterval /*now*/, typename Binding::Timer *timer, void *data) {
         EmiConn *conn = (EmiConn *)data;
         Binding::freeTimer(timer);
         conn->_forceCloseTimer = NULL;
@@ -140,10 +260,78 @@ private:
                                         data, offset, len);
     }
     
+    // Invoked for server connections when a packet arrives from another
+    // address than _remoteAddress. EmiSock only hands such packets to
+    // us when they carry our connection ID, which means that the client
+    // has moved, for instance because its NAT rebound it to a new port
+    // or because it switched networks.
+    //
+    // Returns true if the connection has moved to remoteAddress.
+    bool gotPacketFromNewPath(const sockaddr_storage& remoteAddress,
+                              const TemporaryData& data,
+                              size_t offset,
+                              size_t len) {
+        if (EMI_NO_CONNECTION_ID == _connectionId || !isOpen()) {
+            return false;
+        }
+        
+        EmiPacketHeader packetHeader;
+        if (!EmiPacketHeader::parse(Binding::extractData(data)+offset, len, &packetHeader, NULL)) {
+            return false;
+        }
+        
+        // The connection ID is not secret; anyone on the path can see
+        // it. To make it harder to hijack the connection by replaying
+        // an old packet from another address, we only move if the
+        // packet is newer than everything we have received so far. A
+        // stray late packet from the old address will not move us
+        // back either, because it is not from the new address and it
+        // is older than what we have seen.
+        EmiPacketSequenceNumber newestSeenSN = _congestionControl.newestSeenSequenceNumber();
+        if (!(packetHeader.extraFlags & EMI_CONNECTION_ID_EXTRA_PACKET_FLAG) ||
+            _connectionId != packetHeader.connectionId ||
+            !(packetHeader.flags & EMI_SEQUENCE_NUMBER_PACKET_FLAG) ||
+            (-1 != newestSeenSN &&
+             EmiNetUtil::cyclicDifferenceSigned<EMI_PACKET_SEQUENCE_NUMBER_LENGTH>(packetHeader.sequenceNumber,
+                                                                                   newestSeenSN) <= 0)) {
+            return false;
+        }
+        
+        if (!EmiNetUtil::ipsAreEqual(_remoteAddress, remoteAddress)) {
+            // The client is on a new network path. When only the port
+            // has changed, it is most likely a NAT rebinding, and the
+            // path, and thus the congestion state, is the same.
+            _congestionControl.onPathChange();
+            _timers.getTime().onPathChange();
+        }
+        
+        sockaddr_storage oldAddress(_remoteAddress);
+        _remoteAddress = remoteAddress;
+        
+        // Lets the EmiSock find us by our new address, and stop finding
+        // us by the old one
+        _delegate.emiConnMoved(oldAddress);
+        
+        return true;
+    }
+    
     // Invoked by _messageHandler
-    EmiConn *makeServerConnection(const sockaddr_storage& remoteAddress, uint16_t inboundPort) {
+    EmiConn *makeServerConnection(const sockaddr_storage& /*remoteAddress*/, uint16_t /*inboundPort*/) {
+        // This should never happen, because we never pass acceptConnections=true to onMessage
+        ASSERT(false && "Internal error");
+        return NULL;
+    }
+    
+    bool checkSynCookie(EmiTimeInterval /*now*/,
+                        EUS * /*socket*/,
+                        const sockaddr_storage& /*inboundAddress*/,
+                        const sockaddr_storage& /*remoteAddress*/,
+                        EmiSequenceNumber /*initialSequenceNumber*/,
+                        const uint8_t * /*cookie*/,
+                        size_t /*cookieLength*/) {
         // This should never happen, because we never pass acceptConnections=true to onMessage
         ASSERT(false && "Internal error");
+        return false;
     }
     
     void enqueueUnreliableMessage(EmiTimeInterval now,
@@ -168,21 +356,28 @@ public:
     EmiConn(const ConnDelegate& delegate,
             const EmiSockConfig& config_,
             const EmiConnParams<Binding>& params) :
+    _delegate(delegate),
     _inboundPort(params.inboundPort),
     _originalRemoteAddress(params.address),
     _remoteAddress(params.address),
-    _conn(NULL),
-    _delegate(delegate),
+    _connectionId(params.connectionId),
     _messageHandler(*this),
     _socket(params.socket),
-    _type(params.type),
     _p2p(params.p2p),
+    _type(params.type),
+    _pool(),
+    _conn(NULL),
     _senderBuffer(config_.senderBufferSize),
-    _receiverBuffer(config_.receiverBufferSize, *this),
-    _sendQueue(*this, config_.mtu),
-    _congestionControl(),
+    _receiverBuffer(config_.receiverBufferSize, config_.streamMessages, *this, _pool),
+    _sendQueue(*this, config_.mtu, _pool),
+    _congestionControl(config_, _pool),
     _timers(config_, _delegate.getTimerCookie(), *this),
     _forceCloseTimer(NULL),
+    _tickingSock(NULL),
+    _socketTickIndex(NO_SOCKET_TICK),
+    _enqueuedSends(EMI_ENQUEUED_SENDS_CAPACITY),
+    _pollQueue(config_.pollQueueSize ? new EmiSpscRing<PolledMessage>(config_.pollQueueSize) : NULL),
+    _droppedPolledMessages(0),
     config(config_) {
         EmiNetUtil::anyAddr(0, AF_INET, &_localAddress);
     }
@@ -192,7 +387,23 @@ public:
             Binding::freeTimer(_forceCloseTimer);
         }
         
+        EnqueuedSend es;
+        while (_enqueuedSends.pop(es)) {
+            Binding::releasePersistentData(es.data);
+        }
+        
         deleteELC(_conn);
+        
+        setTickingSocket(NULL);
+        
+        if (_pollQueue) {
+            PolledMessage msgs[32];
+            size_t count;
+            while (0 != (count = _pollQueue->pop(msgs, sizeof(msgs)/sizeof(*msgs)))) {
+                releasePolledMessages(msgs, count);
+            }
+            delete _pollQueue;
+        }
     }
     
     // Invoked by EmiReceiverBuffer
@@ -212,6 +423,11 @@ public:
                    const TemporaryData& data,
                    size_t offset,
                    size_t len) {
+        if (0 != EmiAddressCmp::compare(_remoteAddress, remoteAddress) &&
+            !gotPacketFromNewPath(remoteAddress, data, offset, len)) {
+            return;
+        }
+        
         _messageHandler.onMessage(/*acceptConnections:*/false,
                                   now, socket,
                                   /*unexpectedRemoteHost:*/false, this,
@@ -238,6 +454,7 @@ public:
             deleteELC(conn);
             
             _timers.deschedule();
+            descheduleSocketTick();
         }
     }
     
@@ -269,11 +486,16 @@ public:
             return false;
         }
         
-        _timers.gotPacket(packetHeader, now);
-        _congestionControl.gotPacket(now, _timers.getTime().getRtt(),
+        bool gotRttResponse = _timers.gotPacket(packetHeader, now);
+        _congestionControl.gotPacket(now, _timers.getTime(), gotRttResponse,
                                      _sendQueue.lastSentSequenceNumber(),
                                      packetHeader, packetLength);
         
+        if (packetHeader.extraFlags & EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG) {
+            _senderBuffer.setReceiveWindow(packetHeader.receiveWindow);
+            releaseHeldMessages(now);
+        }
+        
         if (packetHeader.flags & EMI_RTT_REQUEST_PACKET_FLAG) {
             _sendQueue.enqueueRttResponse(packetHeader.sequenceNumber, now);
             _timers.ensureTickTimeout();
@@ -289,6 +511,12 @@ public:
         }
     }
     
+    // Delegates to EmiReceiverBuffer. This is advertised to the other
+    // host in the packet header.
+    inline size_t receiveWindow() const {
+        return _receiverBuffer.freeSpace();
+    }
+    
     // Delegates to EmiSenderBuffer
     //
     // channelQualifier is int32_t to be able to contain -1, which
@@ -298,8 +526,11 @@ public:
                                     EmiNonWrappingSequenceNumber nonWrappingSequenceNumber) {
         _senderBuffer.deregisterReliableMessages(channelQualifier, nonWrappingSequenceNumber);
         
-        // This will clear the rto timeout if the sender buffer is empty
-        _timers.updateRtoTimeout();
+        // The acked messages are no longer in flight, so there might
+        // be room for more messages in the receive window of the other
+        // host. This also updates the rto timeout, which clears it if
+        // the sender buffer is empty.
+        releaseHeldMessages(now);
         
         if (_conn->isClosing()) {
             Error err;
@@ -357,6 +588,13 @@ public:
     // enqueueMessage assumes overship of the PersistentData object (unless
     // the pointer is NULL)
     //
+    // If fragments is not NULL, it is data already split into
+    // numMessagesForLength parts of at most maxMessageLength bytes, which
+    // are used instead of splitting data again. enqueueMessage assumes
+    // ownership of the fragments, just like of data, but only if it
+    // succeeds. This lets EmiSock::broadcast split a message once for
+    // all connections.
+    //
     // channelQualifier is int32_t and not EmiChannelQualifier because it
     // has to be capable of holding -1, the special SYN/RST message channel
     // as used by EmiSenderBuffer
@@ -368,17 +606,9 @@ public:
                           const PersistentData *data,
                           bool reliable,
                           bool allowSplit,
-                          Error& err) {
-        // Set to 1 to stress test message split code. For maximum effect,
-        // make sure to also disallow multiple messages per packet.
-#if 0
-        static const size_t MAX_MESSAGE_LENGTH = 1;
-#else
-        static const size_t MAX_MESSAGE_LENGTH = (EMI_MINIMAL_MTU -
-                                                  EMI_UDP_HEADER_SIZE -
-                                                  EMI_PACKET_HEADER_MAX_LENGTH -
-                                                  EmiMessage<Binding>::maximalHeaderSize());
-#endif
+                          Error& err,
+                          const PersistentData *fragments = NULL) {
+        const size_t MAX_MESSAGE_LENGTH = maxMessageLength();
         
         bool hasOwnershipOfDataObject = true;
         
@@ -388,13 +618,7 @@ public:
         // Make sure that we won't split a message when instructed not to allow that
         ASSERT(allowSplit || dataLength <= MAX_MESSAGE_LENGTH);
         
-        // The -1 and +1 is to ensure we round up.
-        //
-        // The 0 == dataLength test is to avoid messed-up-ness with
-        // unsignedness and also to ensure that numMessages >= 1.
-        size_t numMessages = (0 == dataLength ?
-                              1 :
-                              ((dataLength-1) / MAX_MESSAGE_LENGTH)+1);
+        size_t numMessages = numMessagesForLength(dataLength);
         
         // Make sure that the message(s) we will send fit into the sender buffer
         // if applicable.
@@ -403,24 +627,34 @@ public:
             return 0;
         }
         
-        for (int i=0; i<numMessages; i++) {
+        for (size_t i=0; i<numMessages; i++) {
             EmiMessage<Binding> *msg;
             
-            if (data && 1 == numMessages) {
+            if (data && 1 == numMessages &&
+                dataLength <= EmiMessage<Binding>::INLINE_DATA_CAPACITY) {
+                // Small messages are copied into the message object.
+                // The data object is released below.
+                msg = EmiMessage<Binding>::make(_pool, rawData, dataLength);
+            }
+            else if (data && 1 == numMessages) {
                 // Avoid copying data if we're not splitting the message
                 hasOwnershipOfDataObject = false;
-                msg = new EmiMessage<Binding>(*data);
+                msg = EmiMessage<Binding>::make(_pool, *data);
+            }
+            else if (data && fragments) {
+                // The message has already been split
+                msg = EmiMessage<Binding>::make(_pool, fragments[i]);
             }
             else if (data) {
                 // We're splitting the message
                 size_t offset = i*MAX_MESSAGE_LENGTH;
-                PersistentData dataObj(Binding::makePersistentData(rawData + offset,
-                                                                   (i == numMessages-1 ? dataLength-offset : MAX_MESSAGE_LENGTH)));
-                msg = new EmiMessage<Binding>(dataObj);
+                msg = EmiMessage<Binding>::make(_pool,
+                                                rawData + offset,
+                                                (i == numMessages-1 ? dataLength-offset : MAX_MESSAGE_LENGTH));
             }
             else {
                 // There are no message contents to split
-                msg = new EmiMessage<Binding>;
+                msg = EmiMessage<Binding>::make(_pool);
             }
             
             msg->priority = priority;
@@ -434,15 +668,21 @@ public:
                 // registerReliableMessage returns false when the message does not fit
                 // into the buffer. But we have already checked for that, so it should
                 // never happen.
-                ASSERT(_senderBuffer.registerReliableMessage(msg, err, now));
-                _timers.updateRtoTimeout();
+                //
+                // The message is sent by releaseHeldMessages below.
+                ASSERT(_senderBuffer.registerReliableMessage(msg, err));
+            }
+            else {
+                enqueueUnreliableMessage(now, msg);
             }
-            
-            enqueueUnreliableMessage(now, msg);
             
             msg->release();
         }
         
+        if (reliable) {
+            releaseHeldMessages(now);
+        }
+        
         if (hasOwnershipOfDataObject && data) {
             Binding::releasePersistentData(*data);
         }
@@ -482,7 +722,7 @@ public:
         ASSERT(EMI_CONNECTION_TYPE_CLIENT == _type ||
                EMI_CONNECTION_TYPE_P2P    == _type);
                 
-        _socket = EUS::open(_delegate.getSocketCookie(), onMessage, this, bindAddress, err);
+        _socket = EUS::open(_delegate.getSocketCookie(), onMessage, this, bindAddress, /*reusePortShards:*/0, err);
         
         if (!_socket) {
             return false;
@@ -530,6 +770,15 @@ public:
     inline void connectionRegained() {
         _delegate.emiConnLost();
     }
+    // Sends the reliable messages that fit into the receive window of
+    // the other host
+    void releaseHeldMessages(EmiTimeInterval now) {
+        _senderBuffer.releaseHeldMessages(now, *this);
+        _timers.updateRtoTimeout();
+    }
+    void releaseHeldMessagesIteration(EmiTimeInterval now, EmiMessage<Binding> *msg) {
+        enqueueUnreliableMessage(now, msg);
+    }
     void eachCurrentMessageIteration(EmiTimeInterval now, EmiMessage<Binding> *msg) {
         // We send this message as unreliable, because if the message is reliable,
         // it is already in the sender buffer and shouldn't be reinserted anyway
@@ -543,8 +792,8 @@ public:
     inline void enqueueHeartbeat() {
         _sendQueue.enqueueHeartbeat();
     }
-    inline void enqueueNak(EmiPacketSequenceNumber nak) {
-        _sendQueue.enqueueNak(nak);
+    inline void enqueueNaks(const EmiNakRange *naks, size_t numNaks) {
+        _sendQueue.enqueueNaks(naks, numNaks);
     }
     inline bool senderBufferIsEmpty() const {
         return _senderBuffer.empty();
@@ -602,11 +851,32 @@ public:
     // Delegates to EmiLogicalConnection
     bool gotSynRst(EmiTimeInterval now,
                    const sockaddr_storage& inboundAddr,
-                   EmiSequenceNumber otherHostInitialSequenceNumber) {
+                   EmiSequenceNumber otherHostInitialSequenceNumber,
+                   const uint8_t *data,
+                   size_t len) {
         _localAddress = inboundAddr;
+        
+        // This has to be set before _conn->gotSynRst, because that
+        // invokes the connection opened callback, which might send
+        // data.
+        if (EMI_CONNECTION_TYPE_CLIENT == _type &&
+            EMI_CONNECTION_ID_LENGTH == len &&
+            _conn && _conn->isOpening()) {
+            _connectionId = EmiNetUtil::read32(data);
+        }
+        
         return _conn && _conn->gotSynRst(now, inboundAddr, otherHostInitialSequenceNumber);
     }
     // Delegates to EmiLogicalConnection
+    bool gotSynAck(EmiTimeInterval now,
+                   EmiSequenceNumber ack,
+                   const uint8_t *data,
+                   size_t len) {
+        // Only servers send SYN cookies
+        return (EMI_CONNECTION_TYPE_CLIENT == _type &&
+                _conn && _conn->gotSynAck(now, ack, data, len));
+    }
+    // Delegates to EmiLogicalConnection
     bool gotMessage(EmiTimeInterval now,
                     const EmiMessageHeader& header,
                     const TemporaryData& data, size_t offset) {
@@ -614,6 +884,7 @@ public:
             return false;
         }
         else {
+            evictIncompleteMessages(now);
             return _receiverBuffer.gotMessage(now, header, data, offset);
         }
     }
@@ -636,8 +907,89 @@ public:
                         EmiSequenceNumber packetsLost) {
         _delegate.emiConnPacketLoss(channelQualifier, packetsLost);
     }
+    void pushPolledMessage(EmiChannelQualifier channelQualifier,
+                           const TemporaryData& data, size_t offset, size_t size,
+                           EmiMessagePartFlags partFlags) {
+        // data is only valid for the duration of this call, so it
+        // has to be copied.
+        PolledMessage msg(channelQualifier,
+                          Binding::makePersistentData(Binding::extractData(data)+offset, size),
+                          partFlags);
+        if (!_pollQueue->push(msg)) {
+            Binding::releasePersistentData(msg.data);
+            _droppedPolledMessages++;
+        }
+    }
     void emitMessage(EmiChannelQualifier channelQualifier, const TemporaryData& data, size_t offset, size_t size) {
-        _delegate.emiConnMessage(channelQualifier, data, offset, size);
+        if (_pollQueue) {
+            pushPolledMessage(channelQualifier, data, offset, size,
+                              EMI_MESSAGE_PART_FIRST | EMI_MESSAGE_PART_LAST);
+        }
+        else {
+            _delegate.emiConnMessage(channelQualifier, data, offset, size);
+        }
+    }
+    // Invoked instead of emitMessage for the parts of split messages
+    // in streaming mode, see EmiSockConfig::streamMessages
+    void emitMessagePart(EmiChannelQualifier channelQualifier,
+                         const TemporaryData& data, size_t offset, size_t size,
+                         EmiMessagePartFlags partFlags) {
+        if (_pollQueue) {
+            pushPolledMessage(channelQualifier, data, offset, size, partFlags);
+        }
+        else {
+            _delegate.emiConnMessagePart(channelQualifier, data, offset, size, partFlags);
+        }
+    }
+    
+    // In poll mode (when config.pollQueueSize is non-zero), received
+    // messages are put in a queue instead of being passed to
+    // ConnDelegate::emiConnMessage. This lets the application handle
+    // all messages at a fixed point of its own choosing, for instance
+    // once per frame in a game loop, without any reentrancy into the
+    // core.
+    //
+    // pollMessages copies at most maxCount messages to out, and returns
+    // the number of messages that were copied. It may be invoked from
+    // any thread, but only from one thread at a time. It does not take
+    // any locks. The caller owns the data of the returned messages, and
+    // must release it with releasePolledMessages.
+    //
+    // Messages are dropped when the queue is full, see
+    // droppedPolledMessages. In streaming mode, the parts of split
+    // messages are queued one by one, see PolledMessage::partFlags.
+    size_t pollMessages(PolledMessage *out, size_t maxCount) {
+        return _pollQueue ? _pollQueue->pop(out, maxCount) : 0;
+    }
+    
+    static void releasePolledMessages(PolledMessage *msgs, size_t count) {
+        for (size_t i=0; i<count; i++) {
+            Binding::releasePersistentData(msgs[i].data);
+        }
+    }
+    
+    // The number of received messages that were dropped because the
+    // poll queue was full. Because the messages have already been
+    // acked, not even reliable messages will be re-sent, so the queue
+    // must be made large enough for the application's poll frequency.
+    inline size_t droppedPolledMessages() const {
+        return _droppedPolledMessages;
+    }
+    
+    // Delegates to EmiReceiverBuffer. Invoked by EmiConnTimers and
+    // gotMessage.
+    void evictIncompleteMessages(EmiTimeInterval now) {
+        EmiTimeInterval timeout = std::max(config.incompleteMessageTimeout,
+                                           config.incompleteMessageTimeoutRtts*_timers.getTime().getRtt());
+        _receiverBuffer.evictIncompleteMessages(now, timeout);
+    }
+    
+    // The number of bytes of split messages on the channel that have
+    // been evicted from the receiver buffer because the rest of their
+    // message didn't arrive in time, see
+    // EmiSockConfig::incompleteMessageTimeout.
+    inline uint64_t evictedBytes(EmiChannelQualifier channelQualifier) const {
+        return _receiverBuffer.evictedBytes(channelQualifier);
     }
     void emitNatPunchthroughFinished(bool success) {
         _delegate.emiNatPunchthroughFinished(success);
@@ -685,9 +1037,57 @@ public:
     // Delegates to EmiSendQueue
     // Returns true if something has been sent since the last tick
     bool tick(EmiTimeInterval now) {
+        // Messages that other threads have enqueued are put in the
+        // sender buffer first, so that they go out in this tick. This
+        // is done before EmiSendQueue::tick, because send must not be
+        // invoked from within it.
+        drainEnqueuedSends(now);
+        
         return _sendQueue.tick(_congestionControl, _timers.getTime(), now);
     }
     
+    // Invoked by EmiConnTimers. Returns false if this connection is not
+    // ticked by its EmiSock, in which case it has to tick itself.
+    bool scheduleSocketTick() {
+        if (!_tickingSock) {
+            return false;
+        }
+        
+        if (NO_SOCKET_TICK == _socketTickIndex) {
+            _socketTickIndex = _tickingSock->scheduleConnectionTick(this);
+        }
+        
+        return true;
+    }
+    
+    void descheduleSocketTick() {
+        if (NO_SOCKET_TICK != _socketTickIndex) {
+            size_t index = _socketTickIndex;
+            _socketTickIndex = NO_SOCKET_TICK;
+            _tickingSock->descheduleConnectionTick(this, index);
+        }
+    }
+    
+    // Invoked by EmiSock, in place of the tick timer of _timers
+    void socketTick(EmiTimeInterval now) {
+        _socketTickIndex = NO_SOCKET_TICK;
+        _timers.tick(now);
+    }
+    
+    // Invoked by EmiSock when it moves the connection within its list
+    // of connections to tick
+    inline void setSocketTickIndex(size_t index) {
+        _socketTickIndex = index;
+    }
+    
+    // Invoked by EmiSock. Makes the connection rely on sock for
+    // ticking instead of having a tick timer of its own. Pass NULL to
+    // detach the connection from its EmiSock.
+    void setTickingSocket(ES *sock) {
+        descheduleSocketTick();
+        _tickingSock = sock;
+    }
+    
     // Delegates to EmiLogicalConnection
     //
     // This method assumes ownership over the data parameter, and will release it
@@ -705,6 +1105,157 @@ public:
         }
     }
     
+    // Used by EmiSock::broadcast. Like send, except that it does not
+    // release data or fragments when it fails; then the caller still owns
+    // them. See enqueueMessage for the meaning of fragments.
+    bool sendShared(EmiTimeInterval now,
+                    const PersistentData& data,
+                    const PersistentData *fragments,
+                    EmiChannelQualifier channelQualifier,
+                    EmiPriority priority,
+                    Error& err) {
+        if (!_conn || _conn->isClosing()) {
+            err = Binding::makeError("com.emilir.eminet.closed", 0);
+            return false;
+        }
+        else {
+            return _conn->send(data, now, channelQualifier, priority, err, fragments);
+        }
+    }
+    
+    // Sends several messages in one go. This is cheaper than invoking
+    // send for each of them: The messages are all validated up front,
+    // and the send queue decides how to bundle them into packets once,
+    // after all of them have been enqueued, instead of after each
+    // message. (Messages with EMI_PRIORITY_IMMEDIATE are thus flushed
+    // together at the end, see EmiSendQueue::beginBatch.)
+    //
+    // If the connection is closed, if any of the messages is empty, or if
+    // the reliable messages don't fit into the sender buffer together,
+    // nothing is sent and false is returned. The check for the sender
+    // buffer is conservative, in that it does not take into account
+    // that sending on a RELIABLE_SEQUENCED channel might free up space.
+    //
+    // Like send, this method assumes ownership over the data of all
+    // requests.
+    bool sendMany(EmiTimeInterval now, const SendRequest *requests, size_t count, Error& err) {
+        if (!_conn || _conn->isClosing()) {
+            err = Binding::makeError("com.emilir.eminet.closed", 0);
+            releaseSendRequests(requests, count);
+            return false;
+        }
+        
+        size_t reliableLength = 0;
+        size_t reliableMessages = 0;
+        for (size_t i=0; i<count; i++) {
+            const SendRequest& req(requests[i]);
+            size_t length = Binding::extractLength(req.data);
+            
+            if (0 == length) {
+                err = Binding::makeError("com.emilir.eminet.emptymessage", 0);
+                releaseSendRequests(requests, count);
+                return false;
+            }
+            
+            EmiChannelType channelType = EMI_CHANNEL_QUALIFIER_TYPE(req.channelQualifier);
+            if (EMI_CHANNEL_TYPE_RELIABLE_SEQUENCED == channelType ||
+                EMI_CHANNEL_TYPE_RELIABLE_ORDERED == channelType) {
+                reliableLength += length;
+                reliableMessages += numMessagesForLength(length);
+            }
+        }
+        
+        if (0 != reliableMessages &&
+            !_senderBuffer.fitsIntoBuffer(reliableLength, reliableMessages)) {
+            err = Binding::makeError("com.emilir.eminet.sendbufferoverflow", 0);
+            releaseSendRequests(requests, count);
+            return false;
+        }
+        
+        bool success = true;
+        
+        _sendQueue.beginBatch();
+        for (size_t i=0; i<count; i++) {
+            const SendRequest& req(requests[i]);
+            
+            // This should not fail, since the messages have been
+            // validated already. If it does anyway, report the first
+            // error and carry on with the rest of the messages.
+            Error sendErr;
+            if (!_conn->send(req.data, now, req.channelQualifier, req.priority, sendErr)) {
+                Binding::releasePersistentData(req.data);
+                if (success) {
+                    err = sendErr;
+                    success = false;
+                }
+            }
+        }
+        _sendQueue.endBatch(_congestionControl, _timers.getTime(), now);
+        
+        return success;
+    }
+    
+    // Like send, except that it may be invoked from any thread, and that
+    // the message is sent on the next tick instead of right away. It does
+    // not take any locks, so it is cheap to enqueue lots of messages.
+    //
+    // Returns true if the connection's thread has to be woken up. In
+    // that case, the caller must make sure that sendsWereEnqueued is
+    // invoked in the connection's thread, otherwise the messages might
+    // not be sent until something else makes the connection tick. When
+    // it returns false, someone else has already taken care of that.
+    //
+    // At most EMI_ENQUEUED_SENDS_CAPACITY messages can be waiting to be
+    // sent; when there are more, the message is dropped. Errors can't
+    // be reported back to the caller, so messages that can't be sent
+    // (for instance because the sender buffer is full or because the
+    // connection is closed) are dropped too.
+    bool enqueueSend(const PersistentData& data, EmiChannelQualifier channelQualifier, EmiPriority priority) {
+        bool wake;
+        if (!_enqueuedSends.push(EnqueuedSend(data, channelQualifier, priority), wake)) {
+            Binding::releasePersistentData(data);
+            return false;
+        }
+        return wake;
+    }
+    
+    // See enqueueSend. Must be invoked in the connection's thread.
+    //
+    // This schedules a tick even if the queue looks empty: A tick that
+    // ran between a producer's push and its wakeup might already have
+    // popped the message, but the producer's wakeup was still the one
+    // that set the pending flag. That flag has to be cleared here, or no
+    // later enqueueSend would wake the connection up again.
+    void sendsWereEnqueued() {
+        _enqueuedSends.clearPending();
+        _timers.ensureTickTimeout();
+    }
+    
+    // Invoked at the start of every tick. Hands the messages that have
+    // been enqueued with enqueueSend over to the normal send path.
+    void drainEnqueuedSends(EmiTimeInterval now) {
+        // The pending flag is cleared before the emptiness check, so
+        // that a stale flag can't suppress the wakeups of later pushes
+        _enqueuedSends.clearPending();
+        
+        if (_enqueuedSends.empty()) {
+            return;
+        }
+        
+        bool closed = (!_conn || _conn->isClosing());
+        
+        EnqueuedSend es;
+        while (_enqueuedSends.pop(es)) {
+            Error err;
+            // Unlike EmiConn::send, EmiLogicalConnection::send does not
+            // release the data when it fails, for instance because the
+            // sender buffer is full
+            if (closed || !_conn->send(es.data, now, es.channelQualifier, es.priority, err)) {
+                Binding::releasePersistentData(es.data);
+            }
+        }
+    }
+    
     inline ConnDelegate& getDelegate() {
         return _delegate;
     }
@@ -732,6 +1283,17 @@ public:
         return _remoteAddress;
     }
     
+    inline EmiConnectionId getConnectionId() const {
+        return _connectionId;
+    }
+    
+    // Returns the connection ID to put in the headers of the packets
+    // that we send. Only clients send it; the server knows who it is
+    // talking to anyway.
+    inline EmiConnectionId getPacketConnectionId() const {
+        return (EMI_CONNECTION_TYPE_CLIENT == _type ? _connectionId : EMI_NO_CONNECTION_ID);
+    }
+    
     inline bool issuedConnectionWarning() const {
         return _timers.issuedConnectionWarning();
     }
@@ -24,11 +24,13 @@
 template<class Binding>
 class EmiConnParams {
 public:
-    inline EmiConnParams(EmiUdpSocket<Binding> *socket_, const sockaddr_storage& address_, uint16_t inboundPort_) :
+    inline EmiConnParams(EmiUdpSocket<Binding> *socket_, const sockaddr_storage& address_, uint16_t inboundPort_,
+                         EmiConnectionId connectionId_) :
     socket(socket_),
     address(address_),
     inboundPort(inboundPort_),
     type(EMI_CONNECTION_TYPE_SERVER),
+    connectionId(connectionId_),
     p2p() {}
     
     inline EmiConnParams(const sockaddr_storage& address_,
@@ -38,12 +40,16 @@ public:
     address(address_),
     inboundPort(0),
     type(p2pCookie_ && sharedSecret_ ? EMI_CONNECTION_TYPE_P2P : EMI_CONNECTION_TYPE_CLIENT),
+    connectionId(EMI_NO_CONNECTION_ID),
     p2p(p2pCookie_, p2pCookieLength_, sharedSecret_, sharedSecretLength_) {}
     
     EmiUdpSocket<Binding>* const socket;
     const sockaddr_storage address;
     const uint16_t inboundPort; // This is set if socket != NULL
     const EmiConnectionType type;
+    // Server connections get their connection ID from EmiSock. Client
+    // connections get theirs from the server, in the SYN-RST message.
+    const EmiConnectionId connectionId;
     EmiP2PData p2p;
 };
 
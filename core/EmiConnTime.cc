@@ -14,7 +14,10 @@
 #include <algorithm>
 #include <cmath>
 
-void EmiConnTime::gotRttResponse(EmiTimeInterval rtt) {
+void EmiConnTime::gotRttResponse(EmiTimeInterval now, EmiTimeInterval rtt) {
+    _latestRtt = rtt;
+    _minRtt.pushValue(now, rtt);
+    
     if (-1 == _srtt || -1 == _rttvar) {
         _srtt = rtt;
         _rttvar = rtt/2;
@@ -34,7 +37,8 @@ void EmiConnTime::gotRttResponse(EmiTimeInterval rtt) {
 
 EmiConnTime::EmiConnTime() :
 _rto(EMI_INIT_RTO), _srtt(-1),
-_rttvar(-1), _expCount(0),
+_rttvar(-1), _latestRtt(-1),
+_minRtt(EMI_MIN_RTT_WINDOW), _expCount(0),
 _rttRequestSequenceNumber(-1),
 _rttRequestTime(-1) {}
 
@@ -48,7 +52,11 @@ void EmiConnTime::onRtoTimeout() {
     _expCount++;
 }
 
-void EmiConnTime::gotPacket(const EmiPacketHeader& header, EmiTimeInterval now) {
+void EmiConnTime::onPathChange() {
+    _minRtt.reset();
+}
+
+bool EmiConnTime::gotPacket(const EmiPacketHeader& header, EmiTimeInterval now) {
     _expCount = 0;
     
     if (header.flags & EMI_RTT_RESPONSE_PACKET_FLAG &&
@@ -60,8 +68,11 @@ void EmiConnTime::gotPacket(const EmiPacketHeader& header, EmiTimeInterval now)
             rtt = 0;
         }
         
-        gotRttResponse(rtt);
+        gotRttResponse(now, rtt);
+        return true;
     }
+    
+    return false;
 }
 
 bool EmiConnTime::rttRequest(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber) {
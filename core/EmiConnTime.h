@@ -10,6 +10,7 @@
 #define eminet_EmiConnTime_h
 
 #include "EmiTypes.h"
+#include "EmiWindowedFilter.h"
 
 #include <cstddef>
 
@@ -24,12 +25,17 @@ class EmiConnTime {
     EmiTimeInterval _rto;
     EmiTimeInterval _srtt; // -1 if not set
     EmiTimeInterval _rttvar; // -1 if not set
+    EmiTimeInterval _latestRtt; // -1 if not set
+    // The minimum RTT of the last few seconds. Queueing delay on the
+    // path only ever adds to the RTT, so this is an estimate of the
+    // RTT of the path when its queues are empty.
+    EmiWindowedFilter<EmiTimeInterval, std::less<EmiTimeInterval> > _minRtt;
     int _expCount; // Number of rto timeouts since last received packet
     
     EmiPacketSequenceNumber _rttRequestSequenceNumber;
     EmiTimeInterval         _rttRequestTime;
     
-    void gotRttResponse(EmiTimeInterval rtt);
+    void gotRttResponse(EmiTimeInterval now, EmiTimeInterval rtt);
     
 public:
     EmiConnTime();
@@ -37,7 +43,12 @@ public:
     void swap(EmiConnTime& other);
     
     void onRtoTimeout();
-    void gotPacket(const EmiPacketHeader& header, EmiTimeInterval now);
+    // Invoked when the other host has moved to a new network path. The
+    // minimum RTT of the old path says nothing about the new one.
+    void onPathChange();
+    // Returns true if the packet was a response to our latest RTT
+    // request, that is if it gave a new RTT measurement.
+    bool gotPacket(const EmiPacketHeader& header, EmiTimeInterval now);
     
     // Returns true if it is time to send an RTT request.
     //
@@ -51,6 +62,18 @@ public:
         return _srtt;
     }
     
+    // Returns the latest RTT measurement. Unlike getRtt, it is not
+    // smoothed.
+    inline EmiTimeInterval getLatestRtt() const {
+        return _latestRtt;
+    }
+    
+    // Returns the minimum RTT of the last EMI_MIN_RTT_WINDOW seconds,
+    // or -1 if no RTT has been measured during that time.
+    inline EmiTimeInterval getMinRtt() const {
+        return (_minRtt.empty() ? -1 : _minRtt.get());
+    }
+    
     EmiTimeInterval getRto() const;
     EmiTimeInterval getNak() const;
 };
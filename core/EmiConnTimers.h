@@ -44,30 +44,32 @@ private:
         return 1/sc.heartbeatFrequency * sc.heartbeatsBeforeConnectionWarning;
     }
     
-    static void nakTimeoutCallback(EmiTimeInterval now, Timer *timer, void *data) {
+    static void nakTimeoutCallback(EmiTimeInterval now, Timer * /*timer*/, void *data) {
         EmiConnTimers *timers = (EmiConnTimers *)data;
         
-        EmiPacketSequenceNumber nak = timers->_lossList.calculateNak(now, timers->_time.getRto());
+        EmiNakRange naks[EMI_MAX_NAK_RANGES];
+        size_t numNaks = timers->_lossList.calculateNaks(now, timers->_time.getRto(),
+                                                         naks, EMI_MAX_NAK_RANGES);
         
-        if (-1 != nak) {
-            timers->_delegate.enqueueNak(nak);
+        if (0 != numNaks) {
+            timers->_delegate.enqueueNaks(naks, numNaks);
             timers->ensureTickTimeout();
         }
         timers->ensureNakTimeout();
     }
     
-    static void tickTimeoutCallback(EmiTimeInterval now, Timer *timer, void *data) {
+    static void tickTimeoutCallback(EmiTimeInterval now, Timer * /*timer*/, void *data) {
         EmiConnTimers *timers = (EmiConnTimers *)data;
-        
-        // Tick returns true if a packet has been sent since the last tick
-        if (timers->_delegate.tick(now)) {
-            timers->resetHeartbeatTimeout();
-        }
+        timers->tick(now);
     }
     
-    static void heartbeatTimeoutCallback(EmiTimeInterval now, Timer *timer, void *data) {
+    static void heartbeatTimeoutCallback(EmiTimeInterval now, Timer * /*timer*/, void *data) {
         EmiConnTimers *timers = (EmiConnTimers *)data;
         
+        // gotMessage evicts incomplete messages too, but a connection
+        // that doesn't receive anything needs this to do it.
+        timers->_delegate.evictIncompleteMessages(now);
+        
         if (!timers->_sentDataSinceLastHeartbeat) {
             timers->_delegate.enqueueHeartbeat();
             timers->ensureTickTimeout();
@@ -104,10 +106,10 @@ public:
     EmiConnTimers(const EmiSockConfig& config,
                   const TimerCookie& timerCookie,
                   Delegate& delegate) :
+    _sentDataSinceLastHeartbeat(false),
     _delegate(delegate),
     _time(),
     _lossList(),
-    _sentDataSinceLastHeartbeat(false),
     _nakTimer(Binding::makeTimer(timerCookie)),
     _tickTimer(Binding::makeTimer(timerCookie)),
     _heartbeatTimer(Binding::makeTimer(timerCookie)),
@@ -135,10 +137,12 @@ public:
         _sentDataSinceLastHeartbeat = true;
     }
     
-    void gotPacket(const EmiPacketHeader& header, EmiTimeInterval now) {
-        _time.gotPacket(header, now);
+    // Returns true if the packet gave a new RTT measurement
+    bool gotPacket(const EmiPacketHeader& header, EmiTimeInterval now) {
+        bool gotRttResponse = _time.gotPacket(header, now);
         _lossList.gotPacket(now, header.sequenceNumber);
         _rtoTimer.gotPacket();
+        return gotRttResponse;
     }
     
     void resetHeartbeatTimeout() {
@@ -162,12 +166,24 @@ public:
     }
     
     void ensureTickTimeout() {
-        Binding::scheduleTimer(_tickTimer, tickTimeoutCallback, this,
-                               EMI_TICK_TIME,
-                               /*repeating:*/false, /*reschedule:*/false);
+        // Connections that are ticked by their EmiSock don't use _tickTimer
+        if (!_delegate.scheduleSocketTick()) {
+            Binding::scheduleTimer(_tickTimer, tickTimeoutCallback, this,
+                                   EMI_TICK_TIME,
+                                   /*repeating:*/false, /*reschedule:*/false);
+        }
         ensureNakTimeout();
     }
     
+    // Invoked by tickTimeoutCallback, or by the delegate when the
+    // connection is ticked by its EmiSock.
+    void tick(EmiTimeInterval now) {
+        // Tick returns true if a packet has been sent since the last tick
+        if (_delegate.tick(now)) {
+            resetHeartbeatTimeout();
+        }
+    }
+    
     inline void updateRtoTimeout() {
         _rtoTimer.updateRtoTimeout();
     }
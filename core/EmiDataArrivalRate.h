@@ -31,15 +31,18 @@ public:
     // method is fast.
     inline void gotPacket(EmiTimeInterval now, size_t packetLength) {
         if (-1 != _lastPacketTime) {
-            _medianFilter.pushValue(packetLength/(now-_lastPacketTime));
+            _medianFilter.pushValue(now, packetLength/(now-_lastPacketTime));
         }
         _lastPacketTime = now;
     }
     
+    // See EmiMedianFilter::setWindow
+    inline void setWindow(EmiTimeInterval window) {
+        _medianFilter.setWindow(window);
+    }
+    
     // Calculates the current data arrival rate, in
-    // bytes per second. Note that this method is
-    // a bit slow, and is not intended to be called
-    // as often as once per packet.
+    // bytes per second.
     inline float calculate() const {
         return _medianFilter.calculate();
     }
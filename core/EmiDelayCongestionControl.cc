@@ -0,0 +1,134 @@
+//
+//  EmiDelayCongestionControl.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiDelayCongestionControl.h"
+
+#include <algorithm>
+
+static const int   MIN_CWND_PACKETS = 2;
+// How much of the excess queueing delay the window is decreased by:
+// When the queueing delay is twice the target, the window is decreased
+// by BETA/2.
+static const float BETA = 0.8f;
+// The window is never decreased by more than this at a time
+static const float MAX_DECREASE = 0.5f;
+static const float LOSS_DECREASE = 0.125f;
+// The window grows by at most this many packets per RTT sample. RTT
+// samples are normally about one RTO apart, but can be further apart
+// when the connection has been idle.
+static const float MAX_INCREASE_PACKETS = 8;
+
+EmiDelayCongestionControl::EmiDelayCongestionControl(EmiTimeInterval targetQueueingDelay) :
+_targetQueueingDelay(targetQueueingDelay) {
+    onPathChange();
+}
+
+EmiDelayCongestionControl::~EmiDelayCongestionControl() {}
+
+size_t EmiDelayCongestionControl::minCongestionWindow() const {
+    return std::max(EMI_MIN_CONGESTION_WINDOW, MIN_CWND_PACKETS*_maxPacketSize);
+}
+
+void EmiDelayCongestionControl::decrease(EmiTimeInterval now, float factor) {
+    _congestionWindow = std::max(minCongestionWindow(), (size_t)(_congestionWindow*factor));
+    _slowStartThreshold = _congestionWindow;
+    _lastDecreaseTime = now;
+}
+
+void EmiDelayCongestionControl::onPacketSent(EmiTimeInterval /*now*/, EmiPacketSequenceNumber /*sequenceNumber*/, size_t size) {
+    _maxPacketSize = std::max(_maxPacketSize, size);
+    
+    if (inSlowStart()) {
+        _totalDataSentInSlowStart += size;
+    }
+}
+
+void EmiDelayCongestionControl::onAck(EmiTimeInterval /*now*/, const State& /*state*/) {
+    if (inSlowStart()) {
+        // Like in EmiUdtCongestionControl, the window grows by the
+        // amount of data that has been sent, which doubles it about
+        // once per RTT.
+        _congestionWindow = std::max(_congestionWindow, _totalDataSentInSlowStart);
+        _congestionWindow = std::min(_congestionWindow, _slowStartThreshold);
+        _congestionWindow = std::min(EMI_MAX_CONGESTION_WINDOW, _congestionWindow);
+    }
+}
+
+void EmiDelayCongestionControl::onNak(EmiTimeInterval now,
+                                      EmiPacketSequenceNumber /*nak*/,
+                                      EmiPacketSequenceNumber /*largestSNSoFar*/,
+                                      const State& /*state*/) {
+    // One packet can report several ranges of lost packets, so make
+    // sure that they only count once
+    if (-1 == _lastDecreaseTime || -1 == _rtt || now-_lastDecreaseTime >= _rtt) {
+        decrease(now, 1-LOSS_DECREASE);
+    }
+}
+
+void EmiDelayCongestionControl::onRttSample(EmiTimeInterval now, EmiTimeInterval rtt, const State& state) {
+    EmiTimeInterval timeSinceLastSample = (-1 == _rtt ? 0 : now-_rttSampleTime);
+    _rtt = rtt;
+    _rttSampleTime = now;
+    
+    if (-1 == state.minRtt) {
+        return;
+    }
+    
+    EmiTimeInterval queueingDelay = std::max((EmiTimeInterval)0, rtt-state.minRtt);
+    
+    if (queueingDelay > _targetQueueingDelay) {
+        if (-1 == _lastDecreaseTime || now-_lastDecreaseTime >= rtt) {
+            float amount = (float)(BETA*(queueingDelay-_targetQueueingDelay)/queueingDelay);
+            decrease(now, 1-std::min(amount, MAX_DECREASE));
+        }
+    }
+    else if (!inSlowStart()) {
+        // Grow by one packet per RTT
+        float packets = (float)(timeSinceLastSample/std::max(rtt, (EmiTimeInterval)EMI_TICK_TIME));
+        packets = std::min(packets, MAX_INCREASE_PACKETS);
+        
+        _congestionWindow += (size_t)(packets*_maxPacketSize);
+        _congestionWindow = std::min(EMI_MAX_CONGESTION_WINDOW, _congestionWindow);
+        _slowStartThreshold = _congestionWindow;
+    }
+}
+
+void EmiDelayCongestionControl::onDataArrivalRateSample(EmiTimeInterval /*now*/, float /*rate*/) {}
+
+void EmiDelayCongestionControl::onRto() {
+    _slowStartThreshold = std::max(minCongestionWindow(), _congestionWindow/2);
+    _congestionWindow = minCongestionWindow();
+    _totalDataSentInSlowStart = 0;
+}
+
+void EmiDelayCongestionControl::onPathChange() {
+    _congestionWindow = EMI_MIN_CONGESTION_WINDOW;
+    _slowStartThreshold = EMI_MAX_CONGESTION_WINDOW;
+    _totalDataSentInSlowStart = 0;
+    
+    _maxPacketSize = 0;
+    
+    _rtt = -1;
+    _rttSampleTime = 0;
+    _lastDecreaseTime = -1;
+}
+
+size_t EmiDelayCongestionControl::congestionWindow() const {
+    return _congestionWindow;
+}
+
+float EmiDelayCongestionControl::pacingRate() const {
+    // Spread the window evenly over an RTT, so that it isn't sent in
+    // bursts that build up a queue at the bottleneck
+    if (-1 == _rtt) {
+        return 0;
+    }
+    else {
+        return _congestionWindow/std::max(_rtt, (EmiTimeInterval)EMI_TICK_TIME);
+    }
+}
@@ -0,0 +1,83 @@
+//
+//  EmiDelayCongestionControl.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiDelayCongestionControl_h
+#define eminet_EmiDelayCongestionControl_h
+
+#include "EmiCongestionControlPolicy.h"
+
+// This class implements a congestion control algorithm that keeps the
+// queueing delay on the path below a target, rather than filling the
+// queue at the bottleneck until packets are dropped. This is for games
+// and other real-time traffic, where a consistently low RTT is worth
+// more than peak throughput. It is selected with
+// EMI_CONGESTION_CONTROL_LOW_LATENCY.
+//
+// The queueing delay is estimated as the difference between the latest
+// RTT and the minimum RTT, see EmiConnTime::getMinRtt. As long as it is
+// below the target, the congestion window grows by one packet per RTT.
+// When it is above the target, the window is decreased in proportion to
+// how far above the target it is, at most once per RTT. This is what
+// TCP Swift does.
+//
+// Lost packets decrease the window a little too, because a shallow
+// queue can overflow without the queueing delay ever reaching the
+// target. Like in TCP, the window starts out in slow start, and goes
+// back to it after an RTO.
+class EmiDelayCongestionControl : public EmiCongestionControlPolicy {
+    
+    EmiTimeInterval _targetQueueingDelay;
+    
+    size_t _congestionWindow;
+    // The congestion window grows like in slow start as long as it is
+    // smaller than this
+    size_t _slowStartThreshold;
+    size_t _totalDataSentInSlowStart;
+    
+    // The largest packet that has been sent. The window grows by this
+    // much per RTT.
+    size_t _maxPacketSize;
+    
+    // -1 until the first RTT sample
+    EmiTimeInterval _rtt;
+    EmiTimeInterval _rttSampleTime;
+    // -1 if the window has not been decreased
+    EmiTimeInterval _lastDecreaseTime;
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiDelayCongestionControl(const EmiDelayCongestionControl& other);
+    inline EmiDelayCongestionControl& operator=(const EmiDelayCongestionControl& other);
+    
+    inline bool inSlowStart() const {
+        return _congestionWindow < _slowStartThreshold;
+    }
+    
+    size_t minCongestionWindow() const;
+    void decrease(EmiTimeInterval now, float factor);
+    
+public:
+    explicit EmiDelayCongestionControl(EmiTimeInterval targetQueueingDelay);
+    virtual ~EmiDelayCongestionControl();
+    
+    virtual void onPacketSent(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber, size_t size);
+    virtual void onAck(EmiTimeInterval now, const State& state);
+    virtual void onNak(EmiTimeInterval now,
+                       EmiPacketSequenceNumber nak,
+                       EmiPacketSequenceNumber largestSNSoFar,
+                       const State& state);
+    virtual void onRttSample(EmiTimeInterval now, EmiTimeInterval rtt, const State& state);
+    virtual void onDataArrivalRateSample(EmiTimeInterval now, float rate);
+    virtual void onRto();
+    virtual void onPathChange();
+    
+    virtual size_t congestionWindow() const;
+    virtual float pacingRate() const;
+};
+
+#endif
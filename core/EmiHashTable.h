@@ -0,0 +1,238 @@
+//
+//  EmiHashTable.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiHashTable_h
+#define eminet_EmiHashTable_h
+
+#include "EmiSipHash.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// An open addressing hash table with linear probing, for looking up
+// connections by address or cookie on the hot path of every received
+// datagram. Compared to a std::map, a lookup is usually one hash
+// computation and a key comparison within the same cache line, instead
+// of a pointer chase and a comparison per level of the tree.
+//
+// Key must be default constructible, assignable and equality comparable,
+// and it must have a uint32_t hash(const EmiSipHash::Key& hashKey) const
+// method. Each table has a random hash key of its own. Keys that an
+// attacker can choose must be hashed with EmiSipHash, so that it is
+// infeasible to find keys that collide without knowing the hash key.
+//
+// Removal uses backward shift deletion, so there are no tombstones and
+// the probe sequences stay short even with lots of connection churn.
+//
+// The interface mimics the parts of std::map that EmiNet uses. Like
+// with std::map, inserting or erasing entries invalidates iterators.
+template<class Key, class Value>
+class EmiHashTable {
+public:
+    struct Entry {
+        Key      first;
+        Value    second;
+        // 0 means that the bucket is empty
+        uint32_t hash;
+        
+        Entry() : first(), second(), hash(0) {}
+    };
+    
+    class iterator {
+        friend class EmiHashTable;
+        
+        EmiHashTable *_table;
+        size_t        _idx;
+        
+        iterator(EmiHashTable *table, size_t idx) :
+        _table(table), _idx(idx) {
+            skipEmpty();
+        }
+        
+        inline void skipEmpty() {
+            while (_idx < _table->_buckets.size() && 0 == _table->_buckets[_idx].hash) {
+                _idx++;
+            }
+        }
+    
+    public:
+        inline Entry& operator*() const {
+            return _table->_buckets[_idx];
+        }
+        
+        inline Entry *operator->() const {
+            return &_table->_buckets[_idx];
+        }
+        
+        inline iterator& operator++() {
+            _idx++;
+            skipEmpty();
+            return *this;
+        }
+        
+        inline bool operator==(const iterator& other) const {
+            return _idx == other._idx;
+        }
+        
+        inline bool operator!=(const iterator& other) const {
+            return _idx != other._idx;
+        }
+    };
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiHashTable(const EmiHashTable& other);
+    inline EmiHashTable& operator=(const EmiHashTable& other);
+    
+    static const size_t MIN_BUCKETS = 16;
+    
+    // The size of _buckets is always 0 or a power of two
+    std::vector<Entry> _buckets;
+    size_t             _size;
+    EmiSipHash::Key    _hashKey;
+    
+    inline uint32_t hashKey(const Key& key) const {
+        // 0 is reserved for empty buckets
+        uint32_t hash = key.hash(_hashKey);
+        return 0 == hash ? 1 : hash;
+    }
+    
+    inline size_t mask() const {
+        return _buckets.size()-1;
+    }
+    
+    // Returns the index of the bucket that contains key, or of the
+    // empty bucket where it would be inserted. _buckets must not be
+    // empty.
+    inline size_t findBucket(const Key& key, uint32_t hash) const {
+        size_t m = mask();
+        size_t idx = hash & m;
+        while (true) {
+            const Entry& entry(_buckets[idx]);
+            if (0 == entry.hash ||
+                (hash == entry.hash && key == entry.first)) {
+                return idx;
+            }
+            idx = (idx+1) & m;
+        }
+    }
+    
+    void grow() {
+        std::vector<Entry> oldBuckets;
+        oldBuckets.swap(_buckets);
+        
+        _buckets.resize(oldBuckets.empty() ? MIN_BUCKETS : oldBuckets.size()*2);
+        
+        size_t m = mask();
+        for (size_t i=0; i<oldBuckets.size(); i++) {
+            const Entry& entry(oldBuckets[i]);
+            if (0 != entry.hash) {
+                size_t idx = entry.hash & m;
+                while (0 != _buckets[idx].hash) {
+                    idx = (idx+1) & m;
+                }
+                _buckets[idx] = entry;
+            }
+        }
+    }
+    
+public:
+    explicit EmiHashTable(const EmiSipHash::Key& hashKey) :
+    _buckets(), _size(0), _hashKey(hashKey) {}
+    virtual ~EmiHashTable() {}
+    
+    inline size_t size() const {
+        return _size;
+    }
+    
+    inline bool empty() const {
+        return 0 == _size;
+    }
+    
+    inline iterator begin() {
+        return iterator(this, 0);
+    }
+    
+    inline iterator end() {
+        return iterator(this, _buckets.size());
+    }
+    
+    // Returns a pointer to the value for key, or NULL if there is no
+    // such entry. The pointer is valid until the table is modified.
+    inline Value *find(const Key& key) {
+        if (0 == _size) {
+            return NULL;
+        }
+        
+        Entry& entry(_buckets[findBucket(key, hashKey(key))]);
+        return 0 == entry.hash ? NULL : &entry.second;
+    }
+    
+    inline size_t count(const Key& key) {
+        return find(key) ? 1 : 0;
+    }
+    
+    // Returns false, and does nothing, if there already is an entry
+    // for key.
+    bool insert(const Key& key, const Value& value) {
+        // Keep the load factor at most 1/2. Linear probing degrades
+        // quickly above that, and the buckets are small.
+        if ((_size+1)*2 > _buckets.size()) {
+            grow();
+        }
+        
+        uint32_t hash = hashKey(key);
+        Entry& entry(_buckets[findBucket(key, hash)]);
+        if (0 != entry.hash) {
+            return false;
+        }
+        
+        entry.first = key;
+        entry.second = value;
+        entry.hash = hash;
+        _size++;
+        
+        return true;
+    }
+    
+    // Returns the number of erased entries (0 or 1)
+    size_t erase(const Key& key) {
+        if (0 == _size) {
+            return 0;
+        }
+        
+        size_t m = mask();
+        size_t idx = findBucket(key, hashKey(key));
+        if (0 == _buckets[idx].hash) {
+            return 0;
+        }
+        
+        // Backward shift deletion: Move the entries after the hole back
+        // into it, until we reach an empty bucket or an entry that is
+        // already in its home bucket.
+        size_t next = (idx+1) & m;
+        while (0 != _buckets[next].hash) {
+            size_t home = _buckets[next].hash & m;
+            // The entry at next can be moved to idx iff its home bucket
+            // is not in the cyclic range (idx, next]
+            if (((next-home) & m) >= ((next-idx) & m)) {
+                _buckets[idx] = _buckets[next];
+                idx = next;
+            }
+            next = (next+1) & m;
+        }
+        
+        _buckets[idx] = Entry();
+        _size--;
+        
+        return 1;
+    }
+};
+
+#endif
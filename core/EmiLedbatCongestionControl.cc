@@ -0,0 +1,178 @@
+//
+//  EmiLedbatCongestionControl.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiLedbatCongestionControl.h"
+
+#include <algorithm>
+
+static const int   MIN_CWND_PACKETS = 2;
+// Slow start ends when the queueing delay reaches this much of the
+// target, like in LEDBAT++
+static const float SLOW_START_EXIT = 0.75f;
+// The window is never decreased by more than this at a time because of
+// queueing delay
+static const float MAX_DECREASE = 0.5f;
+static const float LOSS_DECREASE = 0.5f;
+// The window grows by at most this many packets per RTT sample, see
+// EmiDelayCongestionControl
+static const float MAX_INCREASE_PACKETS = 8;
+// A periodic slowdown lasts this many RTTs, and starts this many RTTs
+// after the previous one ended, so that the connection spends about a
+// tenth of its time in slowdowns or ramping back up after them.
+static const float SLOWDOWN_RTTS = 2;
+static const float SLOWDOWN_INTERVAL_RTTS = 18;
+
+EmiLedbatCongestionControl::EmiLedbatCongestionControl(EmiTimeInterval targetQueueingDelay) :
+_targetQueueingDelay(targetQueueingDelay) {
+    onPathChange();
+}
+
+EmiLedbatCongestionControl::~EmiLedbatCongestionControl() {}
+
+size_t EmiLedbatCongestionControl::minCongestionWindow() const {
+    return std::max(EMI_MIN_CONGESTION_WINDOW, MIN_CWND_PACKETS*_maxPacketSize);
+}
+
+bool EmiLedbatCongestionControl::mayDecrease(EmiTimeInterval now) const {
+    // Decrease at most once per RTT
+    return -1 == _lastDecreaseTime || -1 == _rtt || now-_lastDecreaseTime >= _rtt;
+}
+
+void EmiLedbatCongestionControl::decrease(EmiTimeInterval now, float factor) {
+    _congestionWindow = std::max(minCongestionWindow(), (size_t)(_congestionWindow*factor));
+    _slowStartThreshold = _congestionWindow;
+    _lastDecreaseTime = now;
+}
+
+void EmiLedbatCongestionControl::updateSlowdown(EmiTimeInterval now) {
+    if (inSlowdown()) {
+        if (now >= _slowdownEndTime) {
+            // Slow start back up to the window from before the
+            // slowdown
+            _slowdownEndTime = -1;
+            _slowStartThreshold = _windowBeforeSlowdown;
+            _totalDataSentInSlowStart = 0;
+            _nextSlowdownTime = now + SLOWDOWN_INTERVAL_RTTS*std::max(_rtt, (EmiTimeInterval)EMI_TICK_TIME);
+        }
+    }
+    else if (-1 != _nextSlowdownTime && now >= _nextSlowdownTime) {
+        _windowBeforeSlowdown = _congestionWindow;
+        _congestionWindow = minCongestionWindow();
+        _slowdownEndTime = now + SLOWDOWN_RTTS*std::max(_rtt, (EmiTimeInterval)EMI_TICK_TIME);
+    }
+}
+
+void EmiLedbatCongestionControl::onPacketSent(EmiTimeInterval /*now*/, EmiPacketSequenceNumber /*sequenceNumber*/, size_t size) {
+    _maxPacketSize = std::max(_maxPacketSize, size);
+    
+    if (inSlowStart()) {
+        _totalDataSentInSlowStart += size;
+    }
+}
+
+void EmiLedbatCongestionControl::onAck(EmiTimeInterval now, const State& /*state*/) {
+    updateSlowdown(now);
+    
+    if (!inSlowdown() && inSlowStart()) {
+        _congestionWindow = std::max(_congestionWindow, _totalDataSentInSlowStart);
+        _congestionWindow = std::min(_congestionWindow, _slowStartThreshold);
+        _congestionWindow = std::min(EMI_MAX_CONGESTION_WINDOW, _congestionWindow);
+    }
+}
+
+void EmiLedbatCongestionControl::onNak(EmiTimeInterval now,
+                                       EmiPacketSequenceNumber /*nak*/,
+                                       EmiPacketSequenceNumber /*largestSNSoFar*/,
+                                       const State& /*state*/) {
+    if (!inSlowdown() && mayDecrease(now)) {
+        decrease(now, 1-LOSS_DECREASE);
+    }
+}
+
+void EmiLedbatCongestionControl::onRttSample(EmiTimeInterval now, EmiTimeInterval rtt, const State& state) {
+    EmiTimeInterval timeSinceLastSample = (-1 == _rtt ? 0 : now-_rttSampleTime);
+    _rtt = rtt;
+    _rttSampleTime = now;
+    
+    updateSlowdown(now);
+    
+    if (inSlowdown() || -1 == state.minRtt) {
+        return;
+    }
+    
+    EmiTimeInterval queueingDelay = std::max((EmiTimeInterval)0, rtt-state.minRtt);
+    
+    if (inSlowStart() && queueingDelay > SLOW_START_EXIT*_targetQueueingDelay) {
+        _slowStartThreshold = _congestionWindow;
+    }
+    
+    if (queueingDelay > _targetQueueingDelay) {
+        if (mayDecrease(now)) {
+            float amount = (float)((queueingDelay-_targetQueueingDelay)/_targetQueueingDelay);
+            decrease(now, 1-std::min(amount, MAX_DECREASE));
+        }
+    }
+    else if (!inSlowStart()) {
+        // Grow by up to one packet per RTT, less the closer the
+        // queueing delay is to the target
+        float offTarget = (float)((_targetQueueingDelay-queueingDelay)/_targetQueueingDelay);
+        float packets = (float)(offTarget*timeSinceLastSample/std::max(rtt, (EmiTimeInterval)EMI_TICK_TIME));
+        packets = std::min(packets, MAX_INCREASE_PACKETS);
+        
+        _congestionWindow += (size_t)(packets*_maxPacketSize);
+        _congestionWindow = std::min(EMI_MAX_CONGESTION_WINDOW, _congestionWindow);
+        _slowStartThreshold = _congestionWindow;
+    }
+    
+    if (!inSlowStart() && -1 == _nextSlowdownTime) {
+        // The first slowdown is two RTTs after slow start ends
+        _nextSlowdownTime = now + SLOWDOWN_RTTS*rtt;
+    }
+}
+
+void EmiLedbatCongestionControl::onDataArrivalRateSample(EmiTimeInterval /*now*/, float /*rate*/) {}
+
+void EmiLedbatCongestionControl::onRto() {
+    if (inSlowdown()) {
+        _slowdownEndTime = -1;
+        _congestionWindow = _windowBeforeSlowdown;
+    }
+    
+    _slowStartThreshold = std::max(minCongestionWindow(), _congestionWindow/2);
+    _congestionWindow = minCongestionWindow();
+    _totalDataSentInSlowStart = 0;
+}
+
+void EmiLedbatCongestionControl::onPathChange() {
+    _congestionWindow = EMI_MIN_CONGESTION_WINDOW;
+    _slowStartThreshold = EMI_MAX_CONGESTION_WINDOW;
+    _totalDataSentInSlowStart = 0;
+    
+    _maxPacketSize = 0;
+    
+    _rtt = -1;
+    _rttSampleTime = 0;
+    _lastDecreaseTime = -1;
+    
+    _nextSlowdownTime = -1;
+    _slowdownEndTime = -1;
+    _windowBeforeSlowdown = 0;
+}
+
+size_t EmiLedbatCongestionControl::congestionWindow() const {
+    return _congestionWindow;
+}
+
+float EmiLedbatCongestionControl::pacingRate() const {
+    if (-1 == _rtt) {
+        return 0;
+    }
+    else {
+        return _congestionWindow/std::max(_rtt, (EmiTimeInterval)EMI_TICK_TIME);
+    }
+}
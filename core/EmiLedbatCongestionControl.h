@@ -0,0 +1,96 @@
+//
+//  EmiLedbatCongestionControl.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiLedbatCongestionControl_h
+#define eminet_EmiLedbatCongestionControl_h
+
+#include "EmiCongestionControlPolicy.h"
+
+// This class implements a scavenger congestion control algorithm,
+// modeled after LEDBAT and LEDBAT++. It is for background transfers,
+// like patches and telemetry, that should only use the capacity that
+// other connections leave unused. It is selected with
+// EMI_CONGESTION_CONTROL_SCAVENGER.
+//
+// Like EmiDelayCongestionControl, it estimates the queueing delay as
+// the difference between the latest RTT and the minimum RTT, but it
+// yields to other traffic much sooner:
+//
+// * Its target queueing delay should be lower than that of any
+//   foreground connection, so that it backs off first.
+// * When the queueing delay is above the target, the window is
+//   decreased in proportion to how far above the target it is, and it
+//   is halved on loss.
+// * Slow start ends when the queueing delay reaches 3/4 of the target.
+// * Every now and then, the window is cut to its minimum for two RTTs.
+//   This lets the queue drain, so that the minimum RTT stays accurate.
+//   Otherwise, a connection that starts while the queue is already
+//   building up would mistake that queue for the base RTT of the path.
+class EmiLedbatCongestionControl : public EmiCongestionControlPolicy {
+    
+    EmiTimeInterval _targetQueueingDelay;
+    
+    size_t _congestionWindow;
+    size_t _slowStartThreshold;
+    size_t _totalDataSentInSlowStart;
+    
+    // The largest packet that has been sent
+    size_t _maxPacketSize;
+    
+    // -1 until the first RTT sample
+    EmiTimeInterval _rtt;
+    EmiTimeInterval _rttSampleTime;
+    // -1 if the window has not been decreased
+    EmiTimeInterval _lastDecreaseTime;
+    
+    // When the next periodic slowdown starts, or -1 if it is not
+    // scheduled yet
+    EmiTimeInterval _nextSlowdownTime;
+    // When the current slowdown ends, or -1 if there is no slowdown
+    EmiTimeInterval _slowdownEndTime;
+    // The window before the current slowdown, to go back to after it
+    size_t _windowBeforeSlowdown;
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiLedbatCongestionControl(const EmiLedbatCongestionControl& other);
+    inline EmiLedbatCongestionControl& operator=(const EmiLedbatCongestionControl& other);
+    
+    inline bool inSlowStart() const {
+        return _congestionWindow < _slowStartThreshold;
+    }
+    
+    inline bool inSlowdown() const {
+        return -1 != _slowdownEndTime;
+    }
+    
+    size_t minCongestionWindow() const;
+    bool mayDecrease(EmiTimeInterval now) const;
+    void decrease(EmiTimeInterval now, float factor);
+    void updateSlowdown(EmiTimeInterval now);
+    
+public:
+    explicit EmiLedbatCongestionControl(EmiTimeInterval targetQueueingDelay);
+    virtual ~EmiLedbatCongestionControl();
+    
+    virtual void onPacketSent(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber, size_t size);
+    virtual void onAck(EmiTimeInterval now, const State& state);
+    virtual void onNak(EmiTimeInterval now,
+                       EmiPacketSequenceNumber nak,
+                       EmiPacketSequenceNumber largestSNSoFar,
+                       const State& state);
+    virtual void onRttSample(EmiTimeInterval now, EmiTimeInterval rtt, const State& state);
+    virtual void onDataArrivalRateSample(EmiTimeInterval now, float rate);
+    virtual void onRto();
+    virtual void onPathChange();
+    
+    virtual size_t congestionWindow() const;
+    virtual float pacingRate() const;
+};
+
+#endif
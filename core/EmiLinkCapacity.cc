@@ -36,7 +36,7 @@ void EmiLinkCapacity::gotPacket(EmiTimeInterval now, EmiPacketSequenceNumber seq
         
         EmiTimeInterval timeDifference = now-_lastPacketTime;
         if (0 != timeDifference) {
-            _medianFilter.pushValue(packetLength/timeDifference);
+            _medianFilter.pushValue(now, packetLength/timeDifference);
         }
         
         // We only want to count this packet pair once.
@@ -30,10 +30,13 @@ public:
     
     void gotPacket(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber, size_t packetLength);
     
+    // See EmiMedianFilter::setWindow
+    inline void setWindow(EmiTimeInterval window) {
+        _medianFilter.setWindow(window);
+    }
+    
     // Calculates the current estimated link capaticy, in
-    // bytes per second. Note that this method is a bit
-    // slow, and is not intended to be called as often as
-    // once per packet.
+    // bytes per second.
     inline float calculate() const {
         return _medianFilter.calculate();
     }
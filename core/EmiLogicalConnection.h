@@ -17,6 +17,7 @@
 #include "EmiP2PEndpoints.h"
 
 #include <map>
+#include <cstring>
 
 template<class Data>
 class EmiMessage;
@@ -50,6 +51,11 @@ class EmiLogicalConnection {
     ConnectionOpenedCallbackCookie _connectionOpenedCallbackCookie;
     bool _sendingSyn;
     
+    // The SYN cookie that the server has challenged us with, if any.
+    // When we have one, it is sent along with the SYN message.
+    uint8_t _synCookie[EMI_SYN_COOKIE_LENGTH];
+    size_t  _synCookieLength;
+    
     // _sequenceMemo is a map that contains the sequence number that
     // the next message in each channel should have. If the map has
     // no value for a particular channel, it means that the sequence
@@ -156,7 +162,8 @@ public:
     _closing(false), _conn(connection),
     _p2pEndpoints(),
     _otherHostInitialSequenceNumber(sequenceNumber),
-    _sendingSyn(false), _connectionOpenedCallbackCookie() {
+    _connectionOpenedCallbackCookie(), _sendingSyn(false),
+    _synCookieLength(0) {
         ASSERT(EMI_CONNECTION_TYPE_SERVER == _conn->getType());
         
         commonInit();
@@ -177,7 +184,8 @@ public:
     _closing(false), _conn(connection),
     _p2pEndpoints(),
     _otherHostInitialSequenceNumber(0),
-    _sendingSyn(true), _connectionOpenedCallbackCookie(connectionOpenedCallbackCookie) {
+    _connectionOpenedCallbackCookie(connectionOpenedCallbackCookie), _sendingSyn(true),
+    _synCookieLength(0) {
         ASSERT(EMI_CONNECTION_TYPE_SERVER != _conn->getType());
         
         commonInit();
@@ -207,13 +215,27 @@ public:
         
         uint8_t *data = NULL;
         size_t dataLen = 0;
+        uint8_t connectionIdBuf[EMI_CONNECTION_ID_LENGTH];
         
         if (_sendingSyn) {
-            data    = _conn->getP2PData().p2pCookie;
-            dataLen = _conn->getP2PData().p2pCookieLength;
+            if (_synCookieLength) {
+                data    = _synCookie;
+                dataLen = _synCookieLength;
+            }
+            else {
+                data    = _conn->getP2PData().p2pCookie;
+                dataLen = _conn->getP2PData().p2pCookieLength;
+            }
             
             _reliableHandshakeMsgSn = _initialSequenceNumber;
         }
+        else if (EMI_NO_CONNECTION_ID != _conn->getConnectionId()) {
+            // Tell the client which connection ID to put in its packets.
+            // Clients that don't know about connection IDs ignore this.
+            EmiNetUtil::write32(connectionIdBuf, _conn->getConnectionId());
+            data    = connectionIdBuf;
+            dataLen = sizeof(connectionIdBuf);
+        }
         
         if (!_conn->enqueueControlMessage(now,
                                           _initialSequenceNumber,
@@ -441,6 +463,27 @@ public:
         return true;
     }
     
+    // Returns false if the SYN-ACK message is not valid
+    bool gotSynAck(EmiTimeInterval now,
+                   EmiSequenceNumber ack,
+                   const uint8_t *cookie,
+                   size_t cookieLength) {
+        // A SYN-ACK that doesn't ack our initial sequence number is not
+        // a reply to our SYN, so it might be spoofed.
+        if (!_sendingSyn || !isOpening() ||
+            _initialSequenceNumber != ack ||
+            EMI_SYN_COOKIE_LENGTH != cookieLength) {
+            return false;
+        }
+        
+        memcpy(_synCookie, cookie, cookieLength);
+        _synCookieLength = cookieLength;
+        
+        // Re-send the SYN right away, this time with the cookie
+        Error err;
+        return sendInitMessage(now, err);
+    }
+    
     bool initiateCloseProcess(EmiTimeInterval now, Error& err) {
         if (_closing || !_conn) {
             // We're already closing or closed; no need to initiate a new close process
@@ -510,7 +553,10 @@ public:
     // Returns false if the sender buffer was full and the message couldn't be sent
     //
     // send assumes ownership of the data PersistentData object
-    bool send(const PersistentData& data, EmiTimeInterval now, EmiChannelQualifier channelQualifier, EmiPriority priority, Error& err) {
+    //
+    // fragments is passed on to EmiConn::enqueueMessage
+    bool send(const PersistentData& data, EmiTimeInterval now, EmiChannelQualifier channelQualifier, EmiPriority priority, Error& err,
+              const PersistentData *fragments = NULL) {
         // This has to be called before we increment _sequenceMemo[cq]
         EmiNonWrappingSequenceNumber prevSeqMemo = sequenceMemoForChannelQualifier(channelQualifier);
         
@@ -537,7 +583,8 @@ public:
                                                         &data,
                                                         reliable,
                                                         /*allowSplit:*/true,
-                                                        err);
+                                                        err,
+                                                        fragments);
         
         if (0 == enqueuedMessages) {
             // enqueueMessage failed
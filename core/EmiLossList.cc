@@ -10,12 +10,41 @@
 
 #include "EmiNetUtil.h"
 
+#include <algorithm>
+
 EmiLossList::EmiLossList() :
 _newestSequenceNumber(-1),
-_newestSequenceNumberTime(0),
-_lossSet() {}
+_numLost(0),
+_lastFeedbackTimes(NULL),
+_numFeedbacks(NULL) {
+    // Nothing is lost before the first packet has been received
+    std::fill(_received, _received+NUM_WORDS, ~((uint64_t)0));
+}
+
+EmiLossList::~EmiLossList() {
+    delete [] _lastFeedbackTimes;
+    delete [] _numFeedbacks;
+}
+
+void EmiLossList::markLost(EmiTimeInterval now, size_t idx) {
+    if (!_lastFeedbackTimes) {
+        _lastFeedbackTimes = new EmiTimeInterval[CAPACITY];
+        _numFeedbacks = new uint8_t[CAPACITY];
+    }
+    
+    _received[idx/64] &= ~(((uint64_t)1) << (idx%64));
+    _numLost++;
+    
+    _lastFeedbackTimes[idx] = now;
+    _numFeedbacks[idx] = 0;
+}
 
-EmiLossList::~EmiLossList() {}
+void EmiLossList::markNotLost(size_t idx) {
+    ASSERT(!isReceived(idx));
+    
+    setReceived(idx);
+    _numLost--;
+}
 
 void EmiLossList::gotPacket(EmiTimeInterval now, EmiPacketSequenceNumber wrappedSequenceNumber) {
     
@@ -38,95 +67,114 @@ void EmiLossList::gotPacket(EmiTimeInterval now, EmiPacketSequenceNumber wrapped
         }
     }
     
-    if (-1 == _newestSequenceNumber ||
-        expectedSn == guessedNonWrappedSequenceNumber) {
-        // We received the expected sequence number.
-        // No need to do anything with the loss set.
+    if (-1 == _newestSequenceNumber) {
+        // This is the first packet. Nothing before it is lost.
     }
-    else if (_newestSequenceNumber > guessedNonWrappedSequenceNumber) {
+    else if (_newestSequenceNumber >= guessedNonWrappedSequenceNumber) {
         // We received an old sequence number, which presumably
-        // arrived out of order. Remove it from the loss set if
-        // it's present.
-        
-        LossSetIter iter = _lossSet.lower_bound(LostPacketRange(0, 0, guessedNonWrappedSequenceNumber));
-        
-        if (_lossSet.end() == iter) {
-            // We did not find any matching LostPacketRange
-            return;
+        // arrived out of order, or a duplicate. If it was lost, it
+        // isn't anymore.
+        if (_newestSequenceNumber-guessedNonWrappedSequenceNumber < (EmiNonWrappingPacketSequenceNumber)CAPACITY) {
+            size_t idx = indexOf(guessedNonWrappedSequenceNumber);
+            if (!isReceived(idx)) {
+                markNotLost(idx);
+            }
         }
         
-        const LostPacketRange& lpr(*iter);
-        
-        if (lpr.oldestSequenceNumber > guessedNonWrappedSequenceNumber) {
-            // The LostPacketRange we found doesn't contain this sequence number
-            return;
+        return;
+    }
+    else {
+        // We received a newer sequence number than what we had. The
+        // packets in between are lost. Their slots in the bitmap held
+        // packets that are now too old to keep track of, so these are
+        // forgotten. When the sequence number jumps by more than
+        // CAPACITY, all of the slots are reused.
+        EmiNonWrappingPacketSequenceNumber firstSn = std::max(_newestSequenceNumber+1,
+                                                              guessedNonWrappedSequenceNumber+1-(EmiNonWrappingPacketSequenceNumber)CAPACITY);
+        for (EmiNonWrappingPacketSequenceNumber sn = firstSn; sn < guessedNonWrappedSequenceNumber; sn++) {
+            size_t idx = indexOf(sn);
+            if (!isReceived(idx)) {
+                markNotLost(idx);
+            }
+            markLost(now, idx);
         }
         
-        // We only have a reference to lp, so we must use it before
-        // we erase it from _lossSet.
-        LostPacketRange lowerBound(lpr);
-        lowerBound.newestSequenceNumber = guessedNonWrappedSequenceNumber-1;
-        LostPacketRange upperBound(lpr);
-        upperBound.oldestSequenceNumber = guessedNonWrappedSequenceNumber+1;
-        upperBound.numFeedbacks = 0;
-        
-        // To make sure that we don't get problems with duplicates in the set,
-        // we must erase lp before we insert the split versions of it.
-        _lossSet.erase(iter);
-        
-        if (lowerBound.oldestSequenceNumber <= lowerBound.newestSequenceNumber) {
-            _lossSet.insert(lowerBound);
-        }
-        if (upperBound.oldestSequenceNumber <= upperBound.newestSequenceNumber) {
-            _lossSet.insert(upperBound);
+        size_t idx = indexOf(guessedNonWrappedSequenceNumber);
+        if (!isReceived(idx)) {
+            markNotLost(idx);
         }
     }
-    else if (guessedNonWrappedSequenceNumber - _newestSequenceNumber > 1) {
-        // We received a newer sequence number than what we
-        // expected. Add the lost range to the loss set.
-        
-        LostPacketRange lpr(now, 
-                            _newestSequenceNumber+1,
-                            guessedNonWrappedSequenceNumber-1);
-        _lossSet.insert(lpr);
-    }
     
     _newestSequenceNumber = guessedNonWrappedSequenceNumber;
-    _newestSequenceNumberTime = now;
 }
 
-EmiPacketSequenceNumber EmiLossList::calculateNak(EmiTimeInterval now, EmiTimeInterval rtt) {
-    LossSetRIter iter = _lossSet.rbegin();
-    LossSetRIter end  = _lossSet.rend();
+size_t EmiLossList::calculateNaks(EmiTimeInterval now, EmiTimeInterval rtt,
+                                  EmiNakRange *ranges, size_t maxRanges) {
+    if (0 == _numLost || 0 == maxRanges) {
+        return 0;
+    }
     
-    while (iter != end) {
-        const LostPacketRange& lpr(*iter);
+    size_t numRanges = 0;
+    
+    EmiNonWrappingPacketSequenceNumber oldestTrackedSn = std::max((EmiNonWrappingPacketSequenceNumber)0,
+                                                                  _newestSequenceNumber+1-(EmiNonWrappingPacketSequenceNumber)CAPACITY);
+    
+    // Scan from the newest packet and back. The newest packet is never
+    // lost, so start right before it.
+    EmiNonWrappingPacketSequenceNumber sn = _newestSequenceNumber-1;
+    while (sn >= oldestTrackedSn && 0 != _numLost) {
+        size_t idx = indexOf(sn);
+        size_t bit = idx%64;
         
-        if (lpr.lastFeedbackTime + rtt*(2+lpr.numFeedbacks) > now) {
-            // Bingo! We found the LostPacket we wanted.
-            LostPacketRange newLpr(lpr);
-            newLpr.numFeedbacks++;
-            newLpr.oldestSequenceNumber = newLpr.oldestSequenceNumber+1;
-            newLpr.lastFeedbackTime = now;
-            EmiNonWrappingPacketSequenceNumber nak = lpr.oldestSequenceNumber;
-            
-            // Remove all LostPackets that are older or as old as lpr in _lossSet
-            _lossSet.erase(_lossSet.begin(), ++_lossSet.find(*iter));
+        // The lost packets of this word that are not newer than sn
+        uint64_t mask = (63 == bit ? ~((uint64_t)0) : (((uint64_t)1) << (bit+1))-1);
+        uint64_t lost = ~_received[idx/64] & mask;
+        
+        if (0 == lost) {
+            // Skip the rest of the word
+            sn -= bit+1;
+            continue;
+        }
+        
+        // Move to the newest lost packet in the word
+        size_t lostBit = 63-__builtin_clzll(lost);
+        sn -= bit-lostBit;
+        if (sn < oldestTrackedSn) {
+            break;
+        }
+        idx = indexOf(sn);
+        
+        if (0 == _numFeedbacks[idx] ||
+            _lastFeedbackTimes[idx] + rtt*(1+_numFeedbacks[idx]) <= now) {
+            EmiPacketSequenceNumber wrappedSn = (EmiPacketSequenceNumber)(sn & EMI_PACKET_SEQUENCE_NUMBER_MASK);
             
-            // Replace lp with a new object with incremented
-            // numFeedbacks and oldestSequenceNumber, and updated
-            // lastFeedbackTime
-            if (newLpr.oldestSequenceNumber <= newLpr.newestSequenceNumber) {
-                _lossSet.insert(newLpr);
+            if (0 != numRanges &&
+                ranges[numRanges-1].oldest == ((wrappedSn+1) & EMI_PACKET_SEQUENCE_NUMBER_MASK)) {
+                // This packet is right before the range we're building
+                ranges[numRanges-1].oldest = wrappedSn;
+            }
+            else if (maxRanges == numRanges) {
+                // The rest is reported at the next NAK timeout
+                break;
+            }
+            else {
+                ranges[numRanges].oldest = wrappedSn;
+                ranges[numRanges].newest = wrappedSn;
+                numRanges++;
             }
             
-            // Exit the loop early and return the sequence number we found
-            return nak & EMI_PACKET_SEQUENCE_NUMBER_MASK;
+            _lastFeedbackTimes[idx] = now;
+            _numFeedbacks[idx]++;
+            if (MAX_FEEDBACKS <= _numFeedbacks[idx]) {
+                markNotLost(idx);
+            }
         }
         
-        ++iter;
+        sn--;
     }
     
-    // We did not find any applicable packet.
-    return -1;
+    // The ranges were found from the newest to the oldest
+    std::reverse(ranges, ranges+numRanges);
+    
+    return numRanges;
 }
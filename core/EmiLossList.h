@@ -10,75 +10,91 @@
 #define eminet_EmiLossList_h
 
 #include "EmiTypes.h"
-#include "EmiNetUtil.h"
+#include "EmiPacketHeader.h"
 
-#include <set>
+#include <cstddef>
 
 // This class implements the logic required to know which NAKs to
 // send out, if any.
 //
-// The NAK to send out is the oldest packet's sequence number that
-// is in the newest packet range recorded to have been lost (we
-// have received a newer packet) whose last feedback time is at
-// least RTT*k ago, where k is initialized as 2 and increased by 1
-// each time the number is fed back.
+// It keeps a ring bitmap of the packets that have been received,
+// going back CAPACITY packets from the newest one. A packet is lost
+// when a newer packet has been received, but it has not. Lost packets
+// that are older than that are forgotten.
 //
-// Also, once a NAK has been sent, we will never send an older
-// sequence number as a NAK. This allows EmiLossList to prune old
-// lost packets.
+// A lost packet is reported at the first NAK timeout after it was
+// found to be lost. After that it is reported again when its last
+// feedback time is at least RTT*k ago, where k is initialized as 2 and
+// increased by 1 each time the number is fed back, until it has been
+// reported MAX_FEEDBACKS times. Lost packets are never re-sent with
+// the same sequence number, so a report is only needed to survive that
+// the packet that carries it is lost too.
 class EmiLossList {
+    // Must be a power of two, and a multiple of 64
+    static const size_t CAPACITY = 1024;
+    static const size_t NUM_WORDS = CAPACITY/64;
+    static const uint8_t MAX_FEEDBACKS = 3;
     
-    struct LostPacketRange {
-        LostPacketRange(EmiTimeInterval lastFeedbackTime_,
-                        EmiNonWrappingPacketSequenceNumber oldestSequenceNumber_,
-                        EmiNonWrappingPacketSequenceNumber newestSequenceNumber_) :
-        oldestSequenceNumber(oldestSequenceNumber_),
-        newestSequenceNumber(newestSequenceNumber_),
-        lastFeedbackTime(lastFeedbackTime_),
-        numFeedbacks(0) {}
-        
-        EmiNonWrappingPacketSequenceNumber oldestSequenceNumber;
-        EmiNonWrappingPacketSequenceNumber newestSequenceNumber;
-        EmiTimeInterval                    lastFeedbackTime;
-        uint32_t                           numFeedbacks;
-        
-        inline bool operator<(const LostPacketRange& other) const {
-            // TODO What happens here when the sequence number has wrapped?
-            return newestSequenceNumber < other.newestSequenceNumber;
-        }
-    };
+    EmiNonWrappingPacketSequenceNumber _newestSequenceNumber;
+    // One bit per packet, indexed by sequenceNumber & (CAPACITY-1).
+    // A bit is clear when the packet is lost. Lost packets that have
+    // been reported MAX_FEEDBACKS times get their bit set, as if they
+    // had arrived.
+    uint64_t _received[NUM_WORDS];
+    // The number of clear bits in _received. This lets calculateNaks
+    // return right away when nothing is lost, which is the common case.
+    size_t _numLost;
     
-    typedef std::set<LostPacketRange> LossSet;
-    typedef LossSet::iterator         LossSetIter;
-    typedef LossSet::reverse_iterator LossSetRIter;
+    // The feedback state of each lost packet, indexed like _received.
+    // These are only allocated once a packet is lost, since most
+    // connections never need them.
+    EmiTimeInterval *_lastFeedbackTimes;
+    uint8_t *_numFeedbacks;
     
-    EmiNonWrappingPacketSequenceNumber _newestSequenceNumber;
-    EmiTimeInterval _newestSequenceNumberTime;
-    // EmiLossList maintains the invariant that any oldestSequenceNumber
-    // of a LostPacketRange in the set is greater than the previous
-    // LostPacketRange's newestSequenceNumber.
-    LossSet _lossSet;
+private:
+    // Private copy constructor and assignment operator
+    inline EmiLossList(const EmiLossList& other);
+    inline EmiLossList& operator=(const EmiLossList& other);
+    
+    inline static size_t indexOf(EmiNonWrappingPacketSequenceNumber sequenceNumber) {
+        return (size_t)(sequenceNumber & (CAPACITY-1));
+    }
+    
+    inline bool isReceived(size_t idx) const {
+        return !!(_received[idx/64] & (((uint64_t)1) << (idx%64)));
+    }
+    
+    inline void setReceived(size_t idx) {
+        _received[idx/64] |= (((uint64_t)1) << (idx%64));
+    }
+    
+    void markLost(EmiTimeInterval now, size_t idx);
+    void markNotLost(size_t idx);
     
 public:
     EmiLossList();
     virtual ~EmiLossList();
     
-    // Amortized complexity of this method is at worst O(log n) where
-    // n is the size of _lossSet. When all packets arrive exactly once
-    // and in order, complexity is O(1).
+    // This is O(1), except when the sequence number jumps forward by
+    // many packets, in which case it is at worst O(CAPACITY).
     void gotPacket(EmiTimeInterval now, EmiPacketSequenceNumber sequenceNumber);
     
-    // Should be called on NAK timeouts. Calculates the current value
-    // to send as NAK. Returns -1 if no NAK should be sent.
+    // Should be called on NAK timeouts. Writes the ranges of lost
+    // packets that should be reported to ranges, ordered from the
+    // oldest to the newest, and returns the number of ranges. Returns
+    // 0 if no NAK should be sent.
+    //
+    // If there are more than maxRanges ranges to report, the newest
+    // ones are reported, and the rest are left for the next NAK
+    // timeout.
     //
-    // This method is potentially rather slow. It's intended to be
-    // invoked exactly once per NAK timeout.
+    // The bitmap is scanned a 64 bit word at a time, so the words
+    // without lost packets are skipped quickly.
     //
-    // Note that this method is not free of side effects; it increases
-    // the numFeedbacks field of the LostPacketRange object in question.
-    // It also prunes LostPacketRanges that are older than the one
-    // returned.
-    EmiPacketSequenceNumber calculateNak(EmiTimeInterval now, EmiTimeInterval rtt);
+    // Note that this method is not free of side effects; it updates
+    // the feedback state of the packets that it reports.
+    size_t calculateNaks(EmiTimeInterval now, EmiTimeInterval rtt,
+                         EmiNakRange *ranges, size_t maxRanges);
 };
 
 #endif
@@ -9,43 +9,100 @@
 #ifndef eminet_EmiMedianFilter_h
 #define eminet_EmiMedianFilter_h
 
+#include "EmiTypes.h"
+
 #include <algorithm>
 #include <cmath>
+#include <limits>
 
 // This class implements a simple algorithm for a non-linear
 // median filter, as used for calculating packet arrival rate
 // and link capacity in the UDT congestion control algorithm.
+//
+// It keeps the last BUFFER_SIZE values, and optionally only those that
+// were pushed during the last window seconds. Values are pushed once
+// per packet, but calculate is only invoked about once per RTT, so
+// pushing is kept O(1), and calculate finds the median with
+// std::nth_element, in linear time, instead of sorting the values.
 template<typename Element, int BUFFER_SIZE = 64, int TOLERANCE = 8>
 class EmiMedianFilter {
     
-    Element _elms[BUFFER_SIZE];
-    size_t  _frontIdx; // This is the index to the value just ahead of the newest element
+    // When the filter has a time window, it doesn't drop values that
+    // are too old when that would leave it with fewer than this many
+    // values. One noisy value is not a good estimate, even if it is the
+    // only recent one.
+    static const size_t MIN_VALUES = BUFFER_SIZE/8;
+    
+    // The values and the times they were pushed at, in the order they
+    // were pushed. The value at _oldestIdx is the oldest one.
+    EmiTimeInterval _times[BUFFER_SIZE];
+    Element         _elms[BUFFER_SIZE];
+    size_t          _oldestIdx;
+    size_t          _count;
+    // 0 if the filter has no time window
+    EmiTimeInterval _window;
     
 public:
+    // The filter starts out with BUFFER_SIZE copies of defaultValue.
+    // They are older than any time window, so with a time window, they
+    // are pushed out as soon as there are enough real values.
     explicit EmiMedianFilter(Element defaultValue) :
-    _frontIdx(0) {
+    _oldestIdx(0),
+    _count(BUFFER_SIZE),
+    _window(0) {
+        std::fill(_times, _times+BUFFER_SIZE, -std::numeric_limits<EmiTimeInterval>::max());
         std::fill(_elms, _elms+BUFFER_SIZE, defaultValue);
     }
     
     virtual ~EmiMedianFilter() {}
     
-    inline void pushValue(Element value) {
-        _elms[_frontIdx] = value;
-        _frontIdx = (_frontIdx+1) % BUFFER_SIZE;
+    // Makes the filter only use the values that were pushed during the
+    // last window seconds. 0 means that the filter uses the last
+    // BUFFER_SIZE values, regardless of how old they are.
+    //
+    // Values are only dropped for being too old when a new value is
+    // pushed. When nothing is pushed, the filter keeps its old estimate
+    // rather than falling back to the default value.
+    inline void setWindow(EmiTimeInterval window) {
+        _window = window;
+    }
+    
+    inline void pushValue(EmiTimeInterval now, Element value) {
+        if (0 != _window) {
+            while (_count > MIN_VALUES && _times[_oldestIdx] < now-_window) {
+                _oldestIdx = (_oldestIdx+1) % BUFFER_SIZE;
+                _count--;
+            }
+        }
+        
+        if ((size_t)BUFFER_SIZE == _count) {
+            _oldestIdx = (_oldestIdx+1) % BUFFER_SIZE;
+            _count--;
+        }
+        
+        size_t idx = (_oldestIdx+_count) % BUFFER_SIZE;
+        _times[idx] = now;
+        _elms[idx] = value;
+        _count++;
     }
     
     Element calculate() const {
-        Element sortedElms[BUFFER_SIZE];
-        std::copy(_elms, _elms+BUFFER_SIZE, sortedElms);
-        std::sort(sortedElms, sortedElms+BUFFER_SIZE);
+        Element elms[BUFFER_SIZE];
+        
+        // Copy the values out of the ring buffer
+        size_t firstPart = std::min(_count, BUFFER_SIZE-_oldestIdx);
+        std::copy(_elms+_oldestIdx, _elms+_oldestIdx+firstPart, elms);
+        std::copy(_elms, _elms+(_count-firstPart), elms+firstPart);
         
-        Element median = sortedElms[BUFFER_SIZE/2];
+        Element *medianElm = elms+_count/2;
+        std::nth_element(elms, medianElm, elms+_count);
+        Element median = *medianElm;
         
         Element sum = 0;
         int count = 0;
         
-        for (int i=0; i<BUFFER_SIZE; i++) {
-            Element elm = sortedElms[i];
+        for (size_t i=0; i<_count; i++) {
+            Element elm = elms[i];
             
             if (TOLERANCE < ((elm > median) ? elm/median : median/elm)) {
                 continue;
@@ -13,6 +13,7 @@
 #include "EmiConnTime.h"
 #include "EmiNetUtil.h"
 #include "EmiPacketHeader.h"
+#include "EmiObjectPool.h"
 
 #include <cmath>
 #include <algorithm>
@@ -20,6 +21,12 @@
 // A message, as it is represented in the sender side of the pipeline
 template<class Binding>
 class EmiMessage {
+public:
+    // Payloads of at most this many bytes are kept in the message
+    // object itself instead of in a PersistentData object. Many
+    // messages, like the state updates of games, are this small.
+    static const size_t INLINE_DATA_CAPACITY = 64;
+    
 private:
     typedef typename Binding::PersistentData PersistentData;
     
@@ -28,9 +35,19 @@ private:
     inline EmiMessage& operator=(const EmiMessage& other);
     
     size_t _refCount;
+    // The pool that the message was allocated from, or NULL if it was
+    // allocated with new
+    EmiObjectPool *_pool;
+    // Small payloads are kept here instead of in data; see
+    // INLINE_DATA_CAPACITY. _inlineLength is 0 when the payload is in
+    // data.
+    size_t  _inlineLength;
+    uint8_t _inlineData[INLINE_DATA_CAPACITY];
     
     inline void commonInit() {
         _refCount = 1;
+        _pool = NULL;
+        _inlineLength = 0;
         registrationTime = 0;
         channelQualifier = EMI_CHANNEL_QUALIFIER_DEFAULT;
         nonWrappingSequenceNumber = 0;
@@ -77,10 +94,56 @@ public:
     
     inline void release() {
         _refCount--;
-        if (0 == _refCount) delete this;
+        if (0 == _refCount) {
+            if (_pool) {
+                EmiObjectPool *pool = _pool;
+                this->~EmiMessage();
+                pool->deallocate(this, sizeof(EmiMessage));
+            }
+            else {
+                delete this;
+            }
+        }
+    }
+    
+    // Like new EmiMessage(data), except that the message is allocated
+    // from pool. release returns it to the pool.
+    static EmiMessage *make(EmiObjectPool& pool, PersistentData data_) {
+        EmiMessage *msg = new (pool.allocate(sizeof(EmiMessage))) EmiMessage(data_);
+        msg->_pool = &pool;
+        return msg;
+    }
+    
+    static EmiMessage *make(EmiObjectPool& pool) {
+        EmiMessage *msg = new (pool.allocate(sizeof(EmiMessage))) EmiMessage;
+        msg->_pool = &pool;
+        return msg;
+    }
+    
+    // Makes a message with a copy of the given data. Payloads of at
+    // most INLINE_DATA_CAPACITY bytes are copied into the message
+    // itself, which saves the allocation of a PersistentData object;
+    // larger payloads are copied into a new PersistentData object.
+    static EmiMessage *make(EmiObjectPool& pool, const uint8_t *data_, size_t length) {
+        if (length > INLINE_DATA_CAPACITY) {
+            return make(pool, Binding::makePersistentData(data_, length));
+        }
+        
+        EmiMessage *msg = make(pool);
+        memcpy(msg->_inlineData, data_, length);
+        msg->_inlineLength = length;
+        return msg;
     }
     
-    static inline const size_t maximalHeaderSize() {
+    inline const uint8_t *getData() const {
+        return (0 != _inlineLength ? _inlineData : Binding::extractData(data));
+    }
+    
+    inline size_t getLength() const {
+        return (0 != _inlineLength ? _inlineLength : Binding::extractLength(data));
+    }
+    
+    static inline size_t maximalHeaderSize() {
         // + 3 for the sequence number
         // + 3 for the possibility of adding ACK data to the message
         return EMI_MESSAGE_HEADER_MIN_LENGTH + 3 + 3;
@@ -90,7 +153,7 @@ public:
     // on the wire. Note that EmiSendQueue relies on this method to
     // always return the same value given the same message.
     size_t approximateSize() const {
-        return maximalHeaderSize() + Binding::extractLength(data);
+        return maximalHeaderSize() + getLength();
     }
     
     // THIS FIELD IS INTENDED TO BE USED ONLY BY EmiSenderBuffer!
@@ -104,6 +167,8 @@ public:
     EmiNonWrappingSequenceNumber nonWrappingSequenceNumber;
     EmiMessageFlags flags;
     EmiPriority priority;
+    // The payload of the message, unless it is small enough to be kept
+    // inline. Use getData and getLength to access the payload.
     const PersistentData data;
     
     // Returns 0 if buffer was not big enough to accomodate the message
@@ -143,7 +208,7 @@ public:
         
         *((uint8_t*)  (buf+pos)) = flags; pos += 1;
         *((uint8_t*)  (buf+pos)) = std::max(0, channelQualifier); pos += 1; // channelQualifier == -1 means SYN/RST message
-        *((uint16_t*) (buf+pos)) = htons(dataLength); pos += 2;
+        EmiNetUtil::write16(buf+pos, dataLength); pos += 2;
         if (sequenceNumberFieldSize) {
             EmiNetUtil::write24(buf+pos, sequenceNumber); pos += sequenceNumberFieldSize;
         }
@@ -165,7 +230,9 @@ public:
     static size_t writeControlPacketWithData(EmiMessageFlags flags,
                                              uint8_t *buf, size_t bufSize,
                                              const uint8_t *data, size_t dataLength,
-                                             EmiSequenceNumber sequenceNumber) {
+                                             EmiSequenceNumber sequenceNumber,
+                                             bool hasAck,
+                                             EmiSequenceNumber ack) {
         // Zero out the packet header
         size_t tlen;
         if (!EmiPacketHeader::writeEmpty(buf, bufSize, &tlen)) {
@@ -177,8 +244,8 @@ public:
         plen = writeMsg(buf, /* buf */
                         bufSize, /* bufSize */
                         tlen, /* offset */
-                        false, /* hasAck */
-                        0, /* ack */
+                        hasAck, /* hasAck */
+                        ack, /* ack */
                         -1, /* channelQualifier */
                         sequenceNumber,
                         data,
@@ -192,6 +259,14 @@ public:
         return tlen+plen;
     }
     
+    // Returns the size of the packet, or 0 if the buffer was not large enough
+    static size_t writeControlPacketWithData(EmiMessageFlags flags,
+                                             uint8_t *buf, size_t bufSize,
+                                             const uint8_t *data, size_t dataLength,
+                                             EmiSequenceNumber sequenceNumber) {
+        return writeControlPacketWithData(flags, buf, bufSize, data, dataLength, sequenceNumber, false, 0);
+    }
+    
     // Returns the size of the packet, or 0 if the buffer was not large enough
     static size_t writeControlPacketWithData(EmiMessageFlags flags,
                                              uint8_t *buf, size_t bufSize,
@@ -155,15 +155,27 @@ private:
                 return false;
             }
         }
+        else if (synFlag && !rstFlag && ackFlag) {
+            // This is a SYN cookie challenge from a server
+            ASSERT(!unexpectedRemoteHost);
+            ENSURE(!sackFlag, "Got SYN-ACK message with SACK flag");
+            ENSURE_CONN("SYN-ACK");
+            ENSURE(conn->isOpening(), "Got SYN-ACK message for open connection");
+            
+            if (!conn->gotSynAck(now, header.ack,
+                                 rawData+actualRawDataOffset, header.length)) {
+                err = "Failed to process SYN-ACK message";
+                return false;
+            }
+        }
         else if (synFlag && !rstFlag) {
             // This is an initiate connection message
             ASSERT(!unexpectedRemoteHost);
-            ENSURE(0 == header.length,
-                   "Got SYN message with message length != 0");
-            ENSURE(!ackFlag, "Got SYN message with ACK flag");
+            ENSURE(0 == header.length || EMI_SYN_COOKIE_LENGTH == header.length,
+                   "Got SYN message with invalid message length");
             ENSURE(!sackFlag, "Got SYN message with SACK flag");
             
-            if (conn && conn->isOpen() && conn->getOtherHostInitialSequenceNumber() != header.sequenceNumber) {
+            if (conn && conn->isOpen() && conn->getOtherHostInitialSequenceNumber() != (EmiSequenceNumber)header.sequenceNumber) {
                 // The connection is already open, and we get a SYN message with a
                 // different initial sequence number. This probably means that the
                 // other host has forgot about the connection we have open. Force
@@ -188,6 +200,14 @@ private:
                            "Got SYN but this socket doesn't \
                            accept incoming connections");
                     
+                    if (!_delegate.checkSynCookie(now, sock,
+                                                  inboundAddress, remoteAddress,
+                                                  header.sequenceNumber,
+                                                  rawData+actualRawDataOffset, header.length)) {
+                        // The other host has been sent a SYN cookie
+                        return true;
+                    }
+                    
                     conn = _delegate.makeServerConnection(remoteAddress, inboundPort);
                 }
                 
@@ -221,7 +241,8 @@ private:
                 ENSURE_CONN("SYN-RST");
                 ENSURE(conn->isOpening(), "Got SYN-RST message for open connection");
                 
-                if (!conn->gotSynRst(now, inboundAddress, header.sequenceNumber)) {
+                if (!conn->gotSynRst(now, inboundAddress, header.sequenceNumber,
+                                     rawData+actualRawDataOffset, header.length)) {
                     err = "Failed to process SYN-RST message";
                     return false;
                 }
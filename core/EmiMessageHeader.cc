@@ -14,7 +14,7 @@ bool EmiMessageHeader::parse(const uint8_t *buf, size_t bufSize, EmiMessageHeade
     if (bufSize < EMI_MESSAGE_HEADER_MIN_LENGTH) return false;
     
     uint8_t connByte = buf[0];
-    uint16_t length = ntohs(*((uint16_t *)(buf+2)));
+    uint16_t length = EmiNetUtil::read16(buf+2);
     
     bool prxFlag = connByte & EMI_PRX_FLAG;
     bool rstFlag = connByte & EMI_RST_FLAG;
@@ -0,0 +1,199 @@
+//
+//  EmiMpscQueue.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiMpscQueue_h
+#define eminet_EmiMpscQueue_h
+
+#include <stddef.h>
+
+// A fixed size lock free multiple producer, single consumer queue. Any
+// thread may push values onto it, but only one thread at a time may pop
+// them. When it is full, push fails.
+//
+// This is Dmitry Vyukov's bounded queue: Every cell has a sequence
+// number that tells whether it is free for the producer that claims
+// the position or holds a value for the consumer. Producers claim
+// positions with a compare and swap, so they don't have to allocate
+// anything. The cells are allocated by the first push, so queues that
+// are never used don't cost more than the queue object itself.
+//
+// The queue also keeps track of whether the consumer has to be woken
+// up: push returns wake=true for the first value that is pushed after
+// the consumer has invoked clearPending.
+//
+// This uses the GCC __sync builtins, which are supported by both GCC
+// and clang, and which are full memory barriers.
+template<class T>
+class EmiMpscQueue {
+    struct Cell {
+        volatile size_t sequence;
+        T               value;
+    };
+    
+    Cell *volatile  _cells;
+    const size_t    _capacity;
+    const size_t    _mask;
+    // The position that the next producer claims
+    volatile size_t _enqueuePos;
+    // The position of the next value to pop. Only the consumer touches
+    // this.
+    size_t          _dequeuePos;
+    // Nonzero when the consumer has been told that there are values to
+    // pop
+    volatile int    _pending;
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiMpscQueue(const EmiMpscQueue& other);
+    inline EmiMpscQueue& operator=(const EmiMpscQueue& other);
+    
+    static size_t roundUpToPowerOfTwo(size_t size) {
+        size_t result = 1;
+        while (result < size) {
+            result *= 2;
+        }
+        return result;
+    }
+    
+    Cell *getCells() {
+        Cell *cells = _cells;
+        if (cells) {
+            return cells;
+        }
+        
+        cells = new Cell[_capacity];
+        for (size_t i=0; i<_capacity; i++) {
+            cells[i].sequence = i;
+        }
+        
+        Cell *oldCells = __sync_val_compare_and_swap(&_cells, (Cell *)NULL, cells);
+        if (oldCells) {
+            // Another producer got there first
+            delete [] cells;
+            return oldCells;
+        }
+        return cells;
+    }
+    
+public:
+    // The capacity is rounded up to the nearest power of two
+    explicit EmiMpscQueue(size_t capacity) :
+    _cells(NULL),
+    _capacity(roundUpToPowerOfTwo(capacity)),
+    _mask(_capacity-1),
+    _enqueuePos(0),
+    _dequeuePos(0),
+    _pending(0) {}
+    
+    virtual ~EmiMpscQueue() {
+        delete [] _cells;
+    }
+    
+    // May be invoked from any thread. Returns false if the queue is
+    // full. Otherwise, wake is set to true if the consumer has to be
+    // woken up; when it is false, the consumer has already been told
+    // that there are values to pop.
+    bool push(const T& value, bool& wake) {
+        Cell *cells = getCells();
+        
+        size_t pos = _enqueuePos;
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos & _mask];
+            size_t sequence = cell->sequence;
+            __sync_synchronize();
+            
+            ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+            if (0 == diff) {
+                // The cell is free. Try to claim it.
+                size_t oldPos = __sync_val_compare_and_swap(&_enqueuePos, pos, pos+1);
+                if (oldPos == pos) {
+                    break;
+                }
+                pos = oldPos;
+            }
+            else if (diff < 0) {
+                // The consumer has not popped the value that was pushed
+                // to this cell one lap ago
+                wake = false;
+                return false;
+            }
+            else {
+                // Another producer claimed the position
+                pos = _enqueuePos;
+            }
+        }
+        
+        cell->value = value;
+        // Make sure that the value is written before it is published
+        __sync_synchronize();
+        cell->sequence = pos+1;
+        
+        // This must come after the value is published, otherwise the
+        // consumer might clear the flag and find nothing to pop
+        wake = (0 == __sync_lock_test_and_set(&_pending, 1));
+        return true;
+    }
+    
+    // May only be invoked from the consumer thread. The consumer should
+    // invoke this before it pops the values, so that the values that
+    // are pushed after that wake it up again. It should also invoke it
+    // when it is woken up, even if the queue is empty by then: The push
+    // that woke it up might have set the flag after its value was
+    // popped.
+    void clearPending() {
+        __sync_synchronize();
+        _pending = 0;
+        __sync_synchronize();
+    }
+    
+    // May only be invoked from the consumer thread. Returns false if
+    // there is no value to pop. Values that are pushed by the same
+    // thread are popped in the order they were pushed.
+    bool pop(T& out) {
+        Cell *cells = _cells;
+        if (!cells) {
+            return false;
+        }
+        
+        Cell& cell(cells[_dequeuePos & _mask]);
+        size_t sequence = cell.sequence;
+        // Make sure that we don't read the value before it has been
+        // published
+        __sync_synchronize();
+        
+        if (sequence != _dequeuePos+1) {
+            return false;
+        }
+        
+        out = cell.value;
+        // Don't keep references to the value around until the cell is
+        // reused
+        cell.value = T();
+        
+        // Make sure that we are done with the cell before the producers
+        // are allowed to reuse it
+        __sync_synchronize();
+        cell.sequence = _dequeuePos+_capacity;
+        _dequeuePos++;
+        
+        return true;
+    }
+    
+    // This is only a hint when other threads push values concurrently
+    inline bool empty() const {
+        Cell *cells = _cells;
+        return !cells || cells[_dequeuePos & _mask].sequence != _dequeuePos+1;
+    }
+    
+    inline size_t capacity() const {
+        return _capacity;
+    }
+};
+
+#endif
@@ -123,7 +123,7 @@ private:
     }
     
     // Invoked by EmiRtoTimer
-    inline void rtoTimeout(EmiTimeInterval now, EmiTimeInterval rtoWhenRtoTimerWasScheduled) {
+    inline void rtoTimeout(EmiTimeInterval /*now*/, EmiTimeInterval /*rtoWhenRtoTimerWasScheduled*/) {
         if (_isInProxyTeardownPhase) {
             // It seems like the PRX-RST packet we sent got lost.
             // Try re-sending it.
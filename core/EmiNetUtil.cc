@@ -144,6 +144,19 @@ size_t EmiNetUtil::extractIp(const sockaddr_storage& address, uint8_t *buf, size
     }
 }
 
+bool EmiNetUtil::ipsAreEqual(const sockaddr_storage& a, const sockaddr_storage& b) {
+    if (a.ss_family != b.ss_family) {
+        return false;
+    }
+    
+    uint8_t aIp[24];
+    uint8_t bIp[24];
+    size_t ipLen = extractIp(a, aIp, sizeof(aIp));
+    extractIp(b, bIp, sizeof(bIp));
+    
+    return 0 == memcmp(aIp, bIp, ipLen);
+}
+
 void EmiNetUtil::makeAddress(int family, const uint8_t *ip, size_t ipLen, uint16_t port, sockaddr_storage *out) {
     if (AF_INET6 == family) {
         ASSERT(16 == ipLen);
@@ -167,7 +180,7 @@ void EmiNetUtil::makeAddress(int family, const uint8_t *ip, size_t ipLen, uint16
 #endif
         addr.sin_family      = AF_INET;
         addr.sin_port        = port;
-        addr.sin_addr.s_addr = *((uint32_t *)ip);
+        memcpy(&addr.sin_addr.s_addr, ip, sizeof(addr.sin_addr.s_addr));
         memset(&(addr.sin_zero), 0, sizeof(addr.sin_zero));
     }
     else {
@@ -35,13 +35,13 @@ public:
     
     template<int NUM_BYTES>
     inline static int32_t cyclicDifference(int32_t a, int32_t b) {
-        return (a>=b ? a-b : ((1 << (8*NUM_BYTES))-1)-b+a) & ((1 << (8*NUM_BYTES))-1);
+        return (a-b) & ((1 << (8*NUM_BYTES))-1);
     }
     
     template<int NUM_BYTES>
     inline static int32_t cyclicDifferenceSigned(int32_t a, int32_t b) {
         int32_t res = cyclicDifference<NUM_BYTES>(a, b);
-        return res > ((1 << (8*NUM_BYTES))-1)/2 ? res-((1 << (8*NUM_BYTES))-1) : res;
+        return res > ((1 << (8*NUM_BYTES))-1)/2 ? res-(1 << (8*NUM_BYTES)) : res;
     }
     
     template<int NUM_BYTES>
@@ -64,6 +64,35 @@ public:
         buf[2] = (num >> 16);
     }
     
+    // Reads a 16 bit integer in network byte order. Like the other
+    // read and write methods, it does not require buf to be aligned.
+    inline static uint16_t read16(const uint8_t *buf) {
+        return ((buf[0] << 8) |
+                (buf[1] << 0));
+    }
+    
+    // Writes a 16 bit integer in network byte order
+    inline static void write16(uint8_t *buf, uint16_t num) {
+        buf[0] = (num >> 8);
+        buf[1] = (num >> 0);
+    }
+    
+    // Reads a 32 bit integer in network byte order
+    inline static uint32_t read32(const uint8_t *buf) {
+        return (((uint32_t)buf[0] << 24) |
+                ((uint32_t)buf[1] << 16) |
+                ((uint32_t)buf[2] <<  8) |
+                ((uint32_t)buf[3] <<  0));
+    }
+    
+    // Writes a 32 bit integer in network byte order
+    inline static void write32(uint8_t *buf, uint32_t num) {
+        buf[0] = (num >> 24);
+        buf[1] = (num >> 16);
+        buf[2] = (num >>  8);
+        buf[3] = (num >>  0);
+    }
+    
     // port should be in host byte order
     static void addrSetPort(sockaddr_storage& ss, uint16_t port);
     
@@ -86,6 +115,10 @@ public:
     // Saves the IP address in buf, in network byte order. Returns the length of the IP address.
     static size_t extractIp(const sockaddr_storage& address, uint8_t *buf, size_t bufSize);
     
+    // Returns true if the addresses have the same family and IP
+    // address. The port numbers are not compared.
+    static bool ipsAreEqual(const sockaddr_storage& a, const sockaddr_storage& b);
+    
     // The IP and port number should be in network byte order
     static void makeAddress(int family, const uint8_t *ip, size_t ipLen, uint16_t port, sockaddr_storage *out);
     
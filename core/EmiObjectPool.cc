@@ -0,0 +1,45 @@
+//
+//  EmiObjectPool.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiObjectPool.h"
+
+#include "EmiNetUtil.h"
+
+#include <cstdlib>
+
+EmiObjectPool::EmiObjectPool() :
+_chunks(),
+_chunkPos(NULL),
+_chunkRemaining(0) {
+    for (size_t i=0; i<NUM_SIZE_CLASSES; i++) {
+        _freeLists[i] = NULL;
+    }
+}
+
+EmiObjectPool::~EmiObjectPool() {
+    for (size_t i=0; i<_chunks.size(); i++) {
+        free(_chunks[i]);
+    }
+}
+
+void *EmiObjectPool::allocateFromChunk(size_t blockSize) {
+    if (_chunkRemaining < blockSize) {
+        // The rest of the current chunk is wasted. It is always smaller
+        // than MAX_BLOCK_SIZE.
+        _chunkPos = (uint8_t *)malloc(CHUNK_SIZE);
+        ASSERT(_chunkPos);
+        _chunkRemaining = CHUNK_SIZE;
+        _chunks.push_back(_chunkPos);
+    }
+    
+    void *block = _chunkPos;
+    _chunkPos += blockSize;
+    _chunkRemaining -= blockSize;
+    
+    return block;
+}
@@ -0,0 +1,173 @@
+//
+//  EmiObjectPool.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiObjectPool_h
+#define eminet_EmiObjectPool_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+
+// A pool of small memory blocks. Each EmiConn owns one, and allocates
+// its EmiMessages, EmiReceiverBuffer entries and the nodes of its
+// std::set, std::map and std::deque containers from it (the containers
+// do that through EmiPoolAllocator).
+//
+// Blocks are carved out of CHUNK_SIZE byte chunks, and are rounded up to
+// a multiple of GRANULARITY bytes. Freed blocks are kept in one free
+// list per block size, and are reused before any new chunk is
+// allocated. Once a connection has warmed up, sending and receiving
+// thus doesn't hit malloc. Larger blocks are passed on to operator new.
+//
+// The chunks are freed when the pool is destroyed, so everything that
+// is allocated from a pool must be deallocated before the pool is
+// destroyed. EmiObjectPool is not thread safe.
+class EmiObjectPool {
+private:
+    static const size_t GRANULARITY = 16;
+    static const size_t NUM_SIZE_CLASSES = 32;
+    static const size_t CHUNK_SIZE = 8192;
+    
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    
+    FreeBlock          *_freeLists[NUM_SIZE_CLASSES];
+    std::vector<void *> _chunks;
+    uint8_t            *_chunkPos;
+    size_t              _chunkRemaining;
+    
+    // Private copy constructor and assignment operator
+    inline EmiObjectPool(const EmiObjectPool& other);
+    inline EmiObjectPool& operator=(const EmiObjectPool& other);
+    
+    inline static size_t sizeClass(size_t size) {
+        return (size+GRANULARITY-1)/GRANULARITY - 1;
+    }
+    
+    void *allocateFromChunk(size_t blockSize);
+    
+public:
+    // Blocks larger than this are not pooled
+    static const size_t MAX_BLOCK_SIZE = NUM_SIZE_CLASSES*GRANULARITY;
+    
+    EmiObjectPool();
+    virtual ~EmiObjectPool();
+    
+    inline void *allocate(size_t size) {
+        if (0 == size || size > MAX_BLOCK_SIZE) {
+            return ::operator new(size);
+        }
+        
+        size_t sc = sizeClass(size);
+        FreeBlock *block = _freeLists[sc];
+        if (block) {
+            _freeLists[sc] = block->next;
+            return block;
+        }
+        
+        return allocateFromChunk((sc+1)*GRANULARITY);
+    }
+    
+    // size must be the same as the size that was given to allocate
+    inline void deallocate(void *ptr, size_t size) {
+        if (!ptr) {
+            return;
+        }
+        
+        if (0 == size || size > MAX_BLOCK_SIZE) {
+            ::operator delete(ptr);
+            return;
+        }
+        
+        size_t sc = sizeClass(size);
+        FreeBlock *block = (FreeBlock *)ptr;
+        block->next = _freeLists[sc];
+        _freeLists[sc] = block;
+    }
+    
+    // The number of chunks that the pool has allocated. This is mostly
+    // useful for checking that a connection has stopped allocating.
+    inline size_t numChunks() const {
+        return _chunks.size();
+    }
+};
+
+// A standard library allocator that allocates from an EmiObjectPool. An
+// allocator without a pool uses operator new and operator delete, like
+// std::allocator does; this is what containers that are default
+// constructed get.
+template<class T>
+class EmiPoolAllocator {
+    template<class U> friend class EmiPoolAllocator;
+    
+    EmiObjectPool *_pool;
+    
+public:
+    typedef T              value_type;
+    typedef T*             pointer;
+    typedef const T*       const_pointer;
+    typedef T&             reference;
+    typedef const T&       const_reference;
+    typedef size_t         size_type;
+    typedef ptrdiff_t      difference_type;
+    
+    template<class U>
+    struct rebind {
+        typedef EmiPoolAllocator<U> other;
+    };
+    
+    EmiPoolAllocator() : _pool(NULL) {}
+    explicit EmiPoolAllocator(EmiObjectPool *pool) : _pool(pool) {}
+    EmiPoolAllocator(const EmiPoolAllocator& other) : _pool(other._pool) {}
+    template<class U>
+    EmiPoolAllocator(const EmiPoolAllocator<U>& other) : _pool(other._pool) {}
+    
+    inline pointer address(reference x) const { return &x; }
+    inline const_pointer address(const_reference x) const { return &x; }
+    
+    inline pointer allocate(size_type n, const void * = NULL) {
+        return (pointer)(_pool ?
+                         _pool->allocate(n*sizeof(T)) :
+                         ::operator new(n*sizeof(T)));
+    }
+    
+    inline void deallocate(pointer p, size_type n) {
+        if (_pool) {
+            _pool->deallocate(p, n*sizeof(T));
+        }
+        else {
+            ::operator delete(p);
+        }
+    }
+    
+    inline size_type max_size() const {
+        return ((size_type)-1)/sizeof(T);
+    }
+    
+    inline void construct(pointer p, const T& val) {
+        new ((void *)p) T(val);
+    }
+    
+    inline void destroy(pointer p) {
+        p->~T();
+    }
+    
+    template<class U>
+    inline bool operator==(const EmiPoolAllocator<U>& other) const {
+        return _pool == other._pool;
+    }
+    
+    template<class U>
+    inline bool operator!=(const EmiPoolAllocator<U>& other) const {
+        return _pool != other._pool;
+    }
+};
+
+#endif
@@ -15,6 +15,7 @@
 #include "EmiMessage.h"
 #include "EmiRtoTimer.h"
 #include "EmiAddressCmp.h"
+#include "EmiSipHash.h"
 #include "EmiUdpSocket.h"
 
 template<class Binding, class Delegate, int EMI_P2P_RAND_NUM_SIZE>
@@ -25,6 +26,11 @@ public:
     public:
         uint8_t randNum[EMI_P2P_RAND_NUM_SIZE];
         
+        // For EmiHashTable
+        ConnCookieRandNum() {
+            memset(randNum, 0, sizeof(randNum));
+        }
+        
         ConnCookieRandNum(const uint8_t *cookie_, size_t cookieLength) {
             ASSERT(cookieLength >= EMI_P2P_RAND_NUM_SIZE);
             memcpy(randNum, cookie_, sizeof(randNum));
@@ -35,11 +41,26 @@ public:
         }
         inline ConnCookieRandNum& operator=(const ConnCookieRandNum& other) {
             memcpy(randNum, other.randNum, sizeof(randNum));
+            return *this;
         }
         
         inline bool operator<(const ConnCookieRandNum& rhs) const {
             return 0 > memcmp(randNum, rhs.randNum, sizeof(randNum));
         }
+        
+        inline bool operator==(const ConnCookieRandNum& rhs) const {
+            return 0 == memcmp(randNum, rhs.randNum, sizeof(randNum));
+        }
+        
+        // The random numbers are generated by the mediator and signed
+        // with the cookie, so they are well distributed as they are.
+        inline uint32_t hash(const EmiSipHash::Key& hashKey) const {
+            uint32_t h = (uint32_t)hashKey.k0;
+            for (size_t i=0; i<sizeof(randNum); i++) {
+                h = (h << 8 | h >> 24) ^ randNum[i];
+            }
+            return h;
+        }
     };
     
 private:
@@ -107,7 +107,7 @@ public:
         
         EmiNetUtil::makeAddress(family,
                                 dataPtr, ipLen,
-                                *((uint16_t *)(dataPtr+ipLen)),
+                                htons(EmiNetUtil::read16(dataPtr+ipLen)),
                                 addr);
         
     }
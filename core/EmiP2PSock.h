@@ -15,14 +15,14 @@
 #include "EmiP2PConn.h"
 #include "EmiMessageHeader.h"
 #include "EmiMessage.h"
-#include "EmiAddressCmp.h"
+#include "EmiAddressKey.h"
+#include "EmiHashTable.h"
 #include "EmiUdpSocket.h"
 #include "EmiPacketHeader.h"
 #include "EmiNetRandom.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
 #include <utility>
 
 static const EmiTimeInterval EMI_P2P_COOKIE_RESOLUTION  = 5*60; // In seconds
@@ -47,10 +47,9 @@ protected:
     
     typedef EmiP2PSockConfig                                 SockConfig;
     typedef typename Conn::ConnCookieRandNum                 ConnCookieRandNum;
-    typedef std::map<sockaddr_storage, Conn*, EmiAddressCmp> ConnMap;
+    typedef EmiHashTable<EmiAddressKey, Conn*>               ConnMap;
     typedef typename ConnMap::iterator                       ConnMapIter;
-    typedef std::map<ConnCookieRandNum, Conn*>               ConnCookieMap;
-    typedef typename ConnCookieMap::iterator                 ConnCookieMapIter;
+    typedef EmiHashTable<ConnCookieRandNum, Conn*>           ConnCookieMap;
     
 private:
     // Private copy constructor and assignment operator
@@ -69,6 +68,12 @@ private:
     ConnMap       _conns;
     ConnCookieMap _connCookies;
     
+    // The connection that the last datagram was for. Most datagrams
+    // come in bursts from the same peer, so this saves a lot of
+    // hash table lookups.
+    EmiAddressKey _lastPeerKey;
+    Conn         *_lastPeerConn;
+    
     inline bool shouldArtificiallyDropPacket() const {
         if (0 == config.fabricatedPacketDropRate) return false;
         
@@ -142,8 +147,19 @@ private:
     }
     
     Conn *findConn(const sockaddr_storage& address) {
-        ConnMapIter cur = _conns.find(address);
-        return _conns.end() == cur ? NULL : (*cur).second;
+        EmiAddressKey key(address);
+        if (_lastPeerConn && key == _lastPeerKey) {
+            return _lastPeerConn;
+        }
+        
+        Conn **entry = _conns.find(key);
+        if (!entry) {
+            return NULL;
+        }
+        
+        _lastPeerKey = key;
+        _lastPeerConn = *entry;
+        return *entry;
     }
     
     void gotConnectionOpen(EmiTimeInterval now,
@@ -177,12 +193,12 @@ private:
             // Check to see if we have a connection with this cookie
             ConnCookieRandNum cc(cookie, cookieLength);
             
-            ConnCookieMapIter cur = _connCookies.find(cc);
+            Conn **cookieEntry = _connCookies.find(cc);
             
-            if (_connCookies.end() != cur) {
+            if (cookieEntry) {
                 // There was a connection open with this cookie
                 
-                conn = (*cur).second;
+                conn = *cookieEntry;
                 
                 if (conn->firstPeerHadComplementaryCookie() == cookieIsComplementary) {
                     // This happens if we get a SYN message with the same cookie data
@@ -197,7 +213,7 @@ private:
                 }
                 
                 // We don't need to save the cookie anymore
-                _connCookies.erase(cur);
+                _connCookies.erase(cc);
                 
                 conn->gotOtherAddress(inboundAddress, remoteAddress, initialSequenceNumber);
             }
@@ -211,10 +227,10 @@ private:
                                 config.connectionTimeout,
                                 config.initialConnectionTimeout,
                                 config.rateLimit);
-                _connCookies.insert(std::make_pair(cc, conn));
+                _connCookies.insert(cc, conn);
             }
             
-            _conns.insert(std::make_pair(remoteAddress, conn));
+            _conns.insert(EmiAddressKey(remoteAddress), conn);
         }
         
         // Regardless of whether we had an EmiP2PConn object set up
@@ -241,7 +257,7 @@ private:
         
         EmiNetUtil::makeAddress(remoteAddress.ss_family,
                                 rawData, ipLen,
-                                *((uint16_t *)(rawData+ipLen)),
+                                htons(EmiNetUtil::read16(rawData+ipLen)),
                                 &innerAddress);
         
         conn->gotInnerAddress(remoteAddress, innerAddress);
@@ -271,10 +287,14 @@ public:
     // conn might be NULL. In that case, this is a no-op
     void removeConnection(Conn *conn) {
         if (conn) {
-            _conns.erase(conn->getFirstAddress());
-            _conns.erase(conn->getOtherAddress());
+            _conns.erase(EmiAddressKey(conn->getFirstAddress()));
+            _conns.erase(EmiAddressKey(conn->getOtherAddress()));
             _connCookies.erase(conn->cookie);
             
+            if (_lastPeerConn == conn) {
+                _lastPeerConn = NULL;
+            }
+            
             delete conn;
         }
     }
@@ -282,7 +302,11 @@ public:
     const SockConfig config;
     
     EmiP2PSock(const SockConfig& config_, const TimerCookie& timerCookie) :
-    _timerCookie(timerCookie), _socket(NULL), config(config_) {
+    _timerCookie(timerCookie), _socket(NULL),
+    _conns(EmiSipHash::randomKey<Binding>()),
+    _connCookies(EmiSipHash::randomKey<Binding>()),
+    _lastPeerKey(), _lastPeerConn(NULL),
+    config(config_) {
         Binding::randomBytes(_serverSecret, sizeof(_serverSecret));
     }
     virtual ~EmiP2PSock() {
@@ -312,6 +336,7 @@ public:
                                 onMessage,
                                 this,
                                 _address,
+                                /*reusePortShards:*/0,
                                 err);
             if (!_socket) return false;
         }
@@ -22,6 +22,9 @@ inline static void extractFlagsAndSize(EmiPacketFlags flags,
                                        bool *hasArrivalRate, 
                                        bool *hasRttRequest,
                                        bool *hasRttResponse,
+                                       bool *hasConnectionId,
+                                       bool *hasReceiveWindow,
+                                       bool *hasNakRanges,
                                        size_t *fillerSizePtr, // Can be NULL
                                        size_t *expectedSize) {
     size_t fillerSize = 0;
@@ -34,6 +37,9 @@ inline static void extractFlagsAndSize(EmiPacketFlags flags,
     *hasRttRequest     = !!(flags & EMI_RTT_REQUEST_PACKET_FLAG);
     *hasRttResponse    = !!(flags & EMI_RTT_RESPONSE_PACKET_FLAG);
     bool hasExtraFlags = !!(flags & EMI_EXTRA_FLAGS_PACKET_FLAG);
+    *hasConnectionId   = hasExtraFlags && (extraFlags & EMI_CONNECTION_ID_EXTRA_PACKET_FLAG);
+    *hasReceiveWindow  = hasExtraFlags && (extraFlags & EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG);
+    *hasNakRanges      = *hasNak && hasExtraFlags && (extraFlags & EMI_NAK_RANGES_EXTRA_PACKET_FLAG);
     
     // 1 for the flags byte
     *expectedSize = sizeof(EmiPacketFlags);
@@ -41,10 +47,10 @@ inline static void extractFlagsAndSize(EmiPacketFlags flags,
     if (hasExtraFlags) {
         *expectedSize += 1; // The packet extra flags byte
         
-        if (flags & EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG) {
+        if (extraFlags & EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG) {
             fillerSize = 1;
         }
-        else if (flags & EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG) {
+        else if (extraFlags & EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG) {
             fillerSize = 2;
         }
         else {
@@ -58,23 +64,31 @@ inline static void extractFlagsAndSize(EmiPacketFlags flags,
         *fillerSizePtr = fillerSize;
     }
     
+    *expectedSize += (*hasConnectionId   ? EMI_CONNECTION_ID_LENGTH : 0);
     *expectedSize += (*hasSequenceNumber ? EMI_PACKET_SEQUENCE_NUMBER_LENGTH : 0);
     *expectedSize += (*hasAck            ? EMI_PACKET_SEQUENCE_NUMBER_LENGTH : 0);
-    *expectedSize += (*hasNak            ? EMI_PACKET_SEQUENCE_NUMBER_LENGTH : 0);
+    // The size of the NAK ranges themselves depends on the count byte,
+    // so it is not included here
+    *expectedSize += (*hasNakRanges      ? 1 :
+                      *hasNak            ? EMI_PACKET_SEQUENCE_NUMBER_LENGTH : 0);
     *expectedSize += (*hasLinkCapacity   ? sizeof(float) : 0);
     *expectedSize += (*hasArrivalRate    ? sizeof(float) : 0);
     *expectedSize += (*hasRttResponse    ? EMI_PACKET_SEQUENCE_NUMBER_LENGTH+sizeof(uint8_t) : 0);
+    *expectedSize += (*hasReceiveWindow  ? sizeof(uint32_t) : 0);
 }
 
 EmiPacketHeader::EmiPacketHeader() :
 flags(0),
+extraFlags(0),
+connectionId(EMI_NO_CONNECTION_ID),
 sequenceNumber(0),
 ack(0),
-nak(0),
+nakRangeCount(0),
 linkCapacity(0),
 arrivalRate(0),
 rttResponse(0),
-rttResponseDelay(0) {}
+rttResponseDelay(0),
+receiveWindow(0) {}
 
 EmiPacketHeader::~EmiPacketHeader() {}
 
@@ -86,12 +100,13 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
     EmiPacketFlags flags = buf[0];
     
     EmiPacketExtraFlags extraFlags = (EmiPacketExtraFlags) 0;
-    if (bufSize >= 1) {
+    if (bufSize > 1 && (flags & EMI_EXTRA_FLAGS_PACKET_FLAG)) {
         extraFlags = (EmiPacketExtraFlags) buf[1];
     }
     
     bool hasSequenceNumber, hasAck, hasNak, hasLinkCapacity;
-    bool hasArrivalRate, hasRttRequest, hasRttResponse;
+    bool hasArrivalRate, hasRttRequest, hasRttResponse, hasConnectionId;
+    bool hasReceiveWindow, hasNakRanges;
     size_t expectedSize, fillerSize;
     extractFlagsAndSize(flags,
                         extraFlags,
@@ -102,6 +117,9 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
                         &hasArrivalRate, 
                         &hasRttRequest,
                         &hasRttResponse,
+                        &hasConnectionId,
+                        &hasReceiveWindow,
+                        &hasNakRanges,
                         &fillerSize,
                         &expectedSize);
     
@@ -111,7 +129,7 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
         if (4 > bufSize) {
             return false;
         }
-        uint16_t twoByteFillerSize = ntohs(*((uint16_t *)(buf+2)));
+        uint16_t twoByteFillerSize = EmiNetUtil::read16(buf+2);
         fillerSize += twoByteFillerSize;
         expectedSize += twoByteFillerSize;
     }
@@ -121,13 +139,16 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
     }
     
     header->flags = flags;
+    header->extraFlags = extraFlags;
+    header->connectionId = EMI_NO_CONNECTION_ID;
     header->sequenceNumber = 0;
     header->ack = 0;
-    header->nak = 0;
+    header->nakRangeCount = 0;
     header->linkCapacity = 0.0f;
     header->arrivalRate = 0.0f;
     header->rttResponse = 0;
     header->rttResponseDelay = 0;
+    header->receiveWindow = 0;
     
     const uint8_t *bufCur = buf+sizeof(header->flags);
     
@@ -136,6 +157,11 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
         bufCur += fillerSize;
     }
     
+    if (hasConnectionId) {
+        header->connectionId = EmiNetUtil::read32(bufCur);
+        bufCur += EMI_CONNECTION_ID_LENGTH;
+    }
+    
     if (hasSequenceNumber) {
         header->sequenceNumber = EmiNetUtil::read24(bufCur);
         bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
@@ -146,20 +172,43 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
         bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
     }
     
-    if (hasNak) {
-        header->nak = EmiNetUtil::read24(bufCur);
+    if (hasNakRanges) {
+        size_t nakRangeCount = *bufCur;
+        bufCur += 1;
+        
+        if (0 == nakRangeCount || EMI_MAX_NAK_RANGES < nakRangeCount) {
+            return false;
+        }
+        
+        expectedSize += nakRangeCount*2*EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
+        if (bufSize < expectedSize) {
+            return false;
+        }
+        
+        for (size_t i=0; i<nakRangeCount; i++) {
+            header->nakRanges[i].oldest = EmiNetUtil::read24(bufCur);
+            bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
+            header->nakRanges[i].newest = EmiNetUtil::read24(bufCur);
+            bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
+        }
+        header->nakRangeCount = nakRangeCount;
+    }
+    else if (hasNak) {
+        header->nakRanges[0].oldest = EmiNetUtil::read24(bufCur);
+        header->nakRanges[0].newest = header->nakRanges[0].oldest;
+        header->nakRangeCount = 1;
         bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
     }
     
     if (hasLinkCapacity) {
-        uint32_t linkCapacityInt = ntohl(*reinterpret_cast<const uint32_t *>(bufCur));
-        header->linkCapacity = *reinterpret_cast<float *>(&linkCapacityInt);
+        uint32_t linkCapacityInt = EmiNetUtil::read32(bufCur);
+        memcpy(&header->linkCapacity, &linkCapacityInt, sizeof(header->linkCapacity));
         bufCur += sizeof(header->linkCapacity);
     }
     
     if (hasArrivalRate) {
-        uint32_t arrivalRateInt = ntohl(*reinterpret_cast<const uint32_t *>(bufCur));
-        header->arrivalRate = *reinterpret_cast<float *>(&arrivalRateInt);
+        uint32_t arrivalRateInt = EmiNetUtil::read32(bufCur);
+        memcpy(&header->arrivalRate, &arrivalRateInt, sizeof(header->arrivalRate));
         bufCur += sizeof(header->arrivalRate);
     }
     
@@ -171,6 +220,11 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
         bufCur += sizeof(header->rttResponseDelay);
     }
     
+    if (hasReceiveWindow) {
+        header->receiveWindow = EmiNetUtil::read32(bufCur);
+        bufCur += sizeof(header->receiveWindow);
+    }
+    
     if (headerLength) {
         *headerLength = expectedSize;
     }
@@ -178,16 +232,62 @@ bool EmiPacketHeader::parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader
     return true;
 }
 
+bool EmiPacketHeader::parseConnectionId(const uint8_t *buf, size_t bufSize, EmiConnectionId *connectionId) {
+    if (2 > bufSize ||
+        !(buf[0] & EMI_EXTRA_FLAGS_PACKET_FLAG) ||
+        !(buf[1] & EMI_CONNECTION_ID_EXTRA_PACKET_FLAG)) {
+        return false;
+    }
+    
+    // The connection ID is right after the filler
+    size_t offset = 2;
+    if (buf[1] & EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG) {
+        offset += 1;
+    }
+    else if (buf[1] & EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG) {
+        if (4 > bufSize) {
+            return false;
+        }
+        offset += 2 + EmiNetUtil::read16(buf+2);
+    }
+    
+    if (bufSize < offset+EMI_CONNECTION_ID_LENGTH) {
+        return false;
+    }
+    
+    *connectionId = EmiNetUtil::read32(buf+offset);
+    return true;
+}
+
 bool EmiPacketHeader::write(uint8_t *buf, size_t bufSize, const EmiPacketHeader& header, size_t *headerLength) {
     if (0 >= bufSize) {
         return false;
     }
     
+    // Filler is added by addFillerBytes, not by this method
+    uint8_t extraFlags = (header.extraFlags &
+                          ~(EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG |
+                            EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG |
+                            EMI_NAK_RANGES_EXTRA_PACKET_FLAG));
+    
+    if (header.flags & EMI_NAK_PACKET_FLAG) {
+        ASSERT(0 < header.nakRangeCount && EMI_MAX_NAK_RANGES >= header.nakRangeCount);
+        
+        if (1 != header.nakRangeCount ||
+            header.nakRanges[0].oldest != header.nakRanges[0].newest) {
+            extraFlags |= EMI_NAK_RANGES_EXTRA_PACKET_FLAG;
+        }
+    }
+    EmiPacketFlags flags = (0 != extraFlags ?
+                            header.flags |  EMI_EXTRA_FLAGS_PACKET_FLAG :
+                            header.flags & ~EMI_EXTRA_FLAGS_PACKET_FLAG);
+    
     bool hasSequenceNumber, hasAck, hasNak, hasLinkCapacity;
-    bool hasArrivalRate, hasRttRequest, hasRttResponse;
+    bool hasArrivalRate, hasRttRequest, hasRttResponse, hasConnectionId;
+    bool hasReceiveWindow, hasNakRanges;
     size_t expectedSize;
-    extractFlagsAndSize(header.flags,
-                        (EmiPacketExtraFlags)0,
+    extractFlagsAndSize(flags,
+                        (EmiPacketExtraFlags)extraFlags,
                         &hasSequenceNumber,
                         &hasAck,
                         &hasNak,
@@ -195,18 +295,35 @@ bool EmiPacketHeader::write(uint8_t *buf, size_t bufSize, const EmiPacketHeader&
                         &hasArrivalRate, 
                         &hasRttRequest,
                         &hasRttResponse,
+                        &hasConnectionId,
+                        &hasReceiveWindow,
+                        &hasNakRanges,
                         /*fillerSize:*/NULL,
                         &expectedSize);
     
+    if (hasNakRanges) {
+        expectedSize += header.nakRangeCount*2*EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
+    }
+    
     if (bufSize < expectedSize) {
         return false;
     }
     
     memset(buf, 0, expectedSize);
-    buf[0] = header.flags;
+    buf[0] = flags;
     
     uint8_t *bufCur = buf+sizeof(EmiPacketFlags);
     
+    if (flags & EMI_EXTRA_FLAGS_PACKET_FLAG) {
+        *bufCur = extraFlags;
+        bufCur += 1;
+    }
+    
+    if (hasConnectionId) {
+        EmiNetUtil::write32(bufCur, header.connectionId);
+        bufCur += EMI_CONNECTION_ID_LENGTH;
+    }
+    
     if (hasSequenceNumber) {
         EmiNetUtil::write24(bufCur, header.sequenceNumber);
         bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
@@ -217,18 +334,33 @@ bool EmiPacketHeader::write(uint8_t *buf, size_t bufSize, const EmiPacketHeader&
         bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
     }
     
-    if (hasNak) {
-        EmiNetUtil::write24(bufCur, header.nak);
+    if (hasNakRanges) {
+        *bufCur = (uint8_t)header.nakRangeCount;
+        bufCur += 1;
+        
+        for (size_t i=0; i<header.nakRangeCount; i++) {
+            EmiNetUtil::write24(bufCur, header.nakRanges[i].oldest);
+            bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
+            EmiNetUtil::write24(bufCur, header.nakRanges[i].newest);
+            bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
+        }
+    }
+    else if (hasNak) {
+        EmiNetUtil::write24(bufCur, header.nakRanges[0].oldest);
         bufCur += EMI_PACKET_SEQUENCE_NUMBER_LENGTH;
     }
     
     if (hasLinkCapacity) {
-        *((int32_t *)bufCur) = htonl(*reinterpret_cast<const uint32_t *>(&header.linkCapacity));
+        uint32_t linkCapacityInt;
+        memcpy(&linkCapacityInt, &header.linkCapacity, sizeof(linkCapacityInt));
+        EmiNetUtil::write32(bufCur, linkCapacityInt);
         bufCur += sizeof(header.linkCapacity);
     }
     
     if (hasArrivalRate) {
-        *((int32_t *)bufCur) = htonl(*reinterpret_cast<const uint32_t *>(&header.arrivalRate));
+        uint32_t arrivalRateInt;
+        memcpy(&arrivalRateInt, &header.arrivalRate, sizeof(arrivalRateInt));
+        EmiNetUtil::write32(bufCur, arrivalRateInt);
         bufCur += sizeof(header.arrivalRate);
     }
     
@@ -240,6 +372,11 @@ bool EmiPacketHeader::write(uint8_t *buf, size_t bufSize, const EmiPacketHeader&
         bufCur += sizeof(header.rttResponseDelay);
     }
     
+    if (hasReceiveWindow) {
+        EmiNetUtil::write32(bufCur, header.receiveWindow);
+        bufCur += sizeof(header.receiveWindow);
+    }
+    
     if (headerLength) {
         *headerLength = expectedSize;
     }
@@ -266,11 +403,14 @@ void EmiPacketHeader::addFillerBytes(uint8_t *buf, size_t packetSize, uint16_t f
         return;
     }
     
-    // Move the packet data
-    std::copy_backward(buf+1, buf+packetSize, buf+packetSize+fillerSize);
+    // The filler goes right after the extra flags byte, so move
+    // everything after that (or after where it will be).
+    bool hadExtraFlags = !!(buf[0] & EMI_EXTRA_FLAGS_PACKET_FLAG);
+    size_t dataOffset = (hadExtraFlags ? 2 : 1);
+    std::copy_backward(buf+dataOffset, buf+packetSize, buf+packetSize+fillerSize);
     
     // Make sure we have the extra flags byte
-    if (!(buf[0] & EMI_EXTRA_FLAGS_PACKET_FLAG)) {
+    if (!hadExtraFlags) {
         buf[0] |= EMI_EXTRA_FLAGS_PACKET_FLAG;
         buf[1] = 0;
         
@@ -292,7 +432,7 @@ void EmiPacketHeader::addFillerBytes(uint8_t *buf, size_t packetSize, uint16_t f
     else {
         buf[1] |= EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG;
         
-        *((uint16_t *)(buf+2)) = htons(fillerSize - 2);
+        EmiNetUtil::write16(buf+2, fillerSize - 2);
         
         memset(buf+4, 0, fillerSize-2);
     }
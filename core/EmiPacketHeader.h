@@ -16,6 +16,12 @@
 
 static const uint32_t EMI_PACKET_HEADER_MAX_RESPONSE_DELAY = 255;
 
+// A range of lost packets, as reported in a NAK. Both ends are inclusive.
+struct EmiNakRange {
+    EmiPacketSequenceNumber oldest;
+    EmiPacketSequenceNumber newest;
+};
+
 // A message header, as it is represented in the receiver side of things,
 // in a computation friendly format (the actual wire format is more
 // condensed)
@@ -25,9 +31,21 @@ public:
     virtual ~EmiPacketHeader();
     
     EmiPacketFlags flags;
+    // Set if (flags & EMI_EXTRA_FLAGS_PACKET_FLAG). write ignores the
+    // filler flags; use addFillerBytes to add filler.
+    uint8_t extraFlags;
+    EmiConnectionId connectionId; // Set if (extraFlags & EMI_CONNECTION_ID_EXTRA_PACKET_FLAG)
     EmiPacketSequenceNumber sequenceNumber; // Set if (flags & EMI_SEQUENCE_NUMBER_PACKET_FLAG)
     EmiPacketSequenceNumber ack; // Set if (flags & EMI_ACK_PACKET_FLAG)
-    EmiPacketSequenceNumber nak; // Set if (flags & EMI_NAK_PACKET_FLAG)
+    // Set if (flags & EMI_NAK_PACKET_FLAG). The ranges are ordered from
+    // the oldest to the newest.
+    //
+    // A NAK of one lost packet is written as just its sequence number.
+    // Anything else is written with EMI_NAK_RANGES_EXTRA_PACKET_FLAG, as
+    // a count byte followed by the ranges; write sets that flag when it
+    // is needed.
+    EmiNakRange nakRanges[EMI_MAX_NAK_RANGES];
+    size_t nakRangeCount;
     float linkCapacity; // Set if (flags & EMI_LINK_CAPACITY_PACKET_FLAG)
     float arrivalRate; // Set if (flags & EMI_ARRIVAL_RATE_PACKET_FLAG)
     EmiPacketSequenceNumber rttResponse; // Set if (flags & EMI_RTT_RESPONSE_PACKET_FLAG)
@@ -38,6 +56,11 @@ public:
     // is 10 ms.
     uint8_t rttResponseDelay; // Set if (flags & EMI_RTT_RESPONSE_PACKET_FLAG)
     
+    // The number of bytes that the sender of the packet has free in
+    // its receiver buffer. The other host uses this to not send more
+    // reliable data than what can be buffered.
+    uint32_t receiveWindow; // Set if (extraFlags & EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG)
+    
     // Returns true if the parse was successful
     //
     // Note that this method does not check that the entire
@@ -47,6 +70,14 @@ public:
     // can be NULL, in which case it's not set.
     static bool parse(const uint8_t *buf, size_t bufSize, EmiPacketHeader *header, size_t *headerLength);
     
+    // Extracts only the connection ID from a packet, without parsing
+    // the rest of the header. This is used to find the connection of
+    // a packet before it is handed to the connection.
+    //
+    // Returns false if the packet has no connection ID or if the
+    // header is invalid.
+    static bool parseConnectionId(const uint8_t *buf, size_t bufSize, EmiConnectionId *connectionId);
+    
     // Returns true if the write was successful
     // 
     // headerLength will be set to the header length. headerLength
@@ -11,10 +11,11 @@
 
 #include "EmiNetUtil.h"
 #include "EmiMessageHeader.h"
+#include "EmiObjectPool.h"
 
-#include <set>
 #include <map>
 #include <vector>
+#include <algorithm>
 
 template<class SockDelegate, class Receiver>
 class EmiReceiverBuffer {
@@ -23,274 +24,292 @@ class EmiReceiverBuffer {
     typedef typename Binding::TemporaryData  TemporaryData;
     
     typedef std::map<EmiChannelQualifier, EmiNonWrappingSequenceNumber> EmiNonWrappingSequenceNumberMemo;
+    typedef std::map<EmiChannelQualifier, uint64_t> EvictedBytesMap;
     
-    // The purpose of this class is to encapsulate an efficient
-    // algorithm for handling split messages.
+    // The buffered messages of one channel.
     //
-    // The class provides a fast way to know whether a split message
-    // that arrives is the last one in the split, so we can reconstruct
-    // the message and emit it.
+    // The messages are kept in a circular array of slots that is indexed
+    // by sequence number: The message with sequence number sn is in slot
+    // sn & (capacity-1). The capacity is a power of two, and the array
+    // grows when a message arrives that doesn't fit in it, up to
+    // MAX_CAPACITY slots.
     //
-    // See http://avdongre.wordpress.com/2011/12/06/disjoint-set-data-structure-c/
-    // and http://en.wikipedia.org/wiki/Disjoint-set_data_structure
+    // The parts of a split message have consecutive sequence numbers, so
+    // the split flags of each slot are enough to know whether a split
+    // group is complete: It is complete when the slots from its first
+    // part to its last part are all filled. Finding that out, and
+    // flushing messages in order, are walks over adjacent slots rather
+    // than lookups in a tree.
     //
-    // In addition to the conventional disjoint set data structure,
-    // this class keeps track of whether the first and last messages
-    // are present in the set.
+    // The window never accepts messages that are older than its floor.
+    // Advancing the floor releases the older messages.
     //
-    // This extra data is required to quickly be able to determine
-    // whether a disjoint set contains all messages in a split.
-    class DisjointMessageSets {
-        
-        enum {
-            DISJOINT_SET_HAS_FIRST_MESSAGE = 0x1,
-            DISJOINT_SET_HAS_LAST_MESSAGE  = 0x2
-        } DisjointSetFlags;
-        
-        struct DisjointSet {
-            EmiNonWrappingSequenceNumber parent;
-            unsigned rank;
-            int flags;
-            EmiNonWrappingSequenceNumber firstMessage; // The smallest sequence number in this set
-            EmiNonWrappingSequenceNumber lastMessage;  // The largest  sequence number in this set
-            size_t size; // The total size, in bytes, of the messages in this set
-            
-            DisjointSet(EmiNonWrappingSequenceNumber i) :
-            parent(i),
-            rank(0),
+    // The array of slots takes up room in the receiver buffer, just like
+    // the messages do, so a message that is far ahead of the others can't
+    // make the window take more memory than the receiver buffer is
+    // allowed to. The array shrinks back to its initial capacity when
+    // the window becomes empty.
+    class ReorderWindow {
+    public:
+        struct Slot {
+            Slot() :
+            used(false),
             flags(0),
-            firstMessage(EMI_NON_WRAPPING_SEQUENCE_NUMBER_MAX),
-            lastMessage(0),
-            size(0) { }
+            size(0),
+            arrivalTime(0),
+            data() {}
+            
+            bool            used;
+            EmiMessageFlags flags;
+            // The number of bytes that the message takes up in the
+            // receiver buffer
+            size_t          size;
+            EmiTimeInterval arrivalTime;
+            PersistentData  data;
         };
         
-        typedef std::pair<EmiChannelQualifier, EmiNonWrappingSequenceNumber> ForestKey;
+        static const size_t MAX_CAPACITY = 65536;
+    
+    private:
+        static const size_t INITIAL_CAPACITY = 16;
         
-        struct ForestCmp {
-            inline bool operator()(const ForestKey& a, const ForestKey& b) const {
-                return (a.first  != b.first ?
-                        a.first  <  b.first :
-                        a.second <  b.second);
-            }
-        };
+        typedef std::vector<Slot, EmiPoolAllocator<Slot> > SlotVector;
         
-        typedef std::map<ForestKey, DisjointSet, ForestCmp> ForestMap;
-        typedef typename ForestMap::iterator ForestIter;
+        SlotVector _slots;
+        size_t _count;
+        // All used slots are between _base and _newest
+        EmiNonWrappingSequenceNumber _base;
+        EmiNonWrappingSequenceNumber _newest;
+        EmiNonWrappingSequenceNumber _floor;
+        // The total size of the buffered messages and the slot arrays
+        // of all channels, and the maximum that it may grow to
+        size_t& _bufferSize;
+        const size_t _maxBufferSize;
         
-        ForestMap _forest;
+        // Private copy constructor and assignment operator
+        inline ReorderWindow(const ReorderWindow& other);
+        inline ReorderWindow& operator=(const ReorderWindow& other);
         
-        typedef std::pair<ForestKey, DisjointSet*> FindResult;
+        inline Slot& slotFor(EmiNonWrappingSequenceNumber sn) {
+            return _slots[sn & (_slots.size()-1)];
+        }
         
-        FindResult find(EmiChannelQualifier cq,
-                        EmiNonWrappingSequenceNumber sn,
-                        bool createIfMissing = true) {
-            ForestKey key(cq, sn);
+        void releaseSlot(Slot& slot) {
+            Binding::releasePersistentData(slot.data);
+            slot.data = PersistentData();
+            slot.used = false;
+            _bufferSize -= slot.size;
+            _count--;
+        }
+        
+        inline static size_t slotArraySize(size_t capacity) {
+            return capacity*sizeof(Slot);
+        }
+        
+        // Makes sure that the sequence numbers from base to newest fit
+        // in the array. Returns false if they can't, or if growing the
+        // array would leave no room for a message of size bytes in the
+        // receiver buffer.
+        bool reserve(EmiNonWrappingSequenceNumber base, EmiNonWrappingSequenceNumber newest, size_t size) {
+            size_t span = newest-base+1;
+            if (span > MAX_CAPACITY) {
+                return false;
+            }
             
-            ForestIter iter = _forest.find(key);
-            ForestIter end  = _forest.end();
-            if (iter == end) {
-                if (!createIfMissing) {
-                    return std::make_pair(key, (DisjointSet *)NULL);
-                }
-                
-                // If there is no entry for this sequence number and
-                // channel qualifier, create one.
-                iter = _forest.insert(make_pair(key, DisjointSet(sn))).first;
+            size_t oldCapacity = _slots.size();
+            if (span <= oldCapacity) {
+                return true;
             }
             
-            DisjointSet& ds = (*iter).second;
+            size_t capacity = oldCapacity;
+            while (capacity < span) {
+                capacity *= 2;
+            }
             
-            if (ds.parent == sn) {
-                return std::make_pair(key, &ds);
+            size_t growth = slotArraySize(capacity)-slotArraySize(oldCapacity);
+            if (_bufferSize + growth + size > _maxBufferSize) {
+                return false;
             }
-            else {
-                FindResult result = find(cq, ds.parent);
-                ds.parent = result.first.second;
-                return result;
+            _bufferSize += growth;
+            
+            SlotVector slots(capacity, Slot(), _slots.get_allocator());
+            if (0 != _count) {
+                for (EmiNonWrappingSequenceNumber sn = _base; sn <= _newest; sn++) {
+                    Slot& slot = _slots[sn & (oldCapacity-1)];
+                    if (slot.used) {
+                        slots[sn & (capacity-1)] = slot;
+                    }
+                }
             }
+            _slots.swap(slots);
+            
+            return true;
         }
         
-        // Returns the new root
-        FindResult merge(EmiChannelQualifier cq,
-                         EmiNonWrappingSequenceNumber i,
-                         EmiNonWrappingSequenceNumber j) {
-            FindResult findIResult = find(cq, i);
-            FindResult findJResult = find(cq, j);
-            
-            EmiNonWrappingSequenceNumber rootISn = findIResult.first.second;
-            EmiNonWrappingSequenceNumber rootJSn = findJResult.first.second;
+        // Gives back the memory of an array that has grown, once the
+        // window is empty
+        void shrinkIfEmpty() {
+            if (0 != _count || INITIAL_CAPACITY == _slots.size()) {
+                return;
+            }
             
-            DisjointSet& rootI = *(findIResult.second);
-            DisjointSet& rootJ = *(findJResult.second);
+            _bufferSize -= slotArraySize(_slots.size())-slotArraySize(INITIAL_CAPACITY);
             
-            if (rootISn != rootJSn) {
-                bool iIsTheNewRoot = rootI.rank > rootJ.rank;
-                
-                EmiNonWrappingSequenceNumber newRootSn = (iIsTheNewRoot ? rootISn : rootJSn);
-                
-                DisjointSet& newRoot = (iIsTheNewRoot ? rootI : rootJ);
-                DisjointSet& nonRoot = (iIsTheNewRoot ? rootJ : rootI);
-                
-                if (rootI.rank == rootJ.rank) {
-                    newRoot.rank += 1;
+            SlotVector slots(INITIAL_CAPACITY, Slot(), _slots.get_allocator());
+            _slots.swap(slots);
+        }
+    
+    public:
+        ReorderWindow(size_t& bufferSize,
+                      size_t maxBufferSize,
+                      EmiObjectPool& pool,
+                      EmiNonWrappingSequenceNumber floor) :
+        _slots(INITIAL_CAPACITY, Slot(), EmiPoolAllocator<Slot>(&pool)),
+        _count(0),
+        _base(floor),
+        _newest(floor),
+        _floor(floor),
+        _bufferSize(bufferSize),
+        _maxBufferSize(maxBufferSize) {
+            _bufferSize += slotArraySize(INITIAL_CAPACITY);
+        }
+        
+        virtual ~ReorderWindow() {
+            for (size_t i=0; i<_slots.size() && 0 != _count; i++) {
+                if (_slots[i].used) {
+                    releaseSlot(_slots[i]);
                 }
-                
-                nonRoot.parent = newRootSn;
-                newRoot.flags |= nonRoot.flags;
-                newRoot.firstMessage = std::min(newRoot.firstMessage,
-                                                nonRoot.firstMessage);
-                newRoot.lastMessage  = std::max(newRoot.lastMessage,
-                                                nonRoot.lastMessage);
-                newRoot.size += nonRoot.size;
-                
-                return (iIsTheNewRoot ? findIResult : findJResult);
-            }
-            else {
-                return findIResult;
             }
+            
+            _bufferSize -= slotArraySize(_slots.size());
         }
         
-    public:
-        typedef std::pair<bool, std::pair<EmiNonWrappingSequenceNumber, size_t> > MessageData;
-        
-        // This method must be called exactly once per message,
-        // otherwise the message size data will get messed up.
-        void gotMessage(EmiChannelQualifier cq,
-                        EmiNonWrappingSequenceNumber i,
-                        EmiMessageFlags messageFlags,
-                        size_t messageSize) {
-            
-            bool first = !(messageFlags & EMI_SPLIT_NOT_FIRST_FLAG);
-            bool last  = !(messageFlags & EMI_SPLIT_NOT_LAST_FLAG);
-            
-            if (first && last) {
-                // This is a non-split message; there's no need to store
-                // it in the forest since we already know that it is
-                // complete.
-                return;
+        inline bool empty() const {
+            return 0 == _count;
+        }
+        
+        inline EmiNonWrappingSequenceNumber floor() const {
+            return _floor;
+        }
+        
+        // Returns NULL if there is no buffered message with the
+        // sequence number sn
+        inline const Slot *get(EmiNonWrappingSequenceNumber sn) const {
+            if (0 == _count || sn < _base || sn > _newest) {
+                return NULL;
             }
             
-            // Merge the message with sequence number i with the following
-            // message, but only for messages that are not last in a split.
-            DisjointSet& root = *(last ?
-                                  find(cq, i).second :
-                                  merge(cq, i, i+1).second);
-            
-            if (first) root.flags |= DISJOINT_SET_HAS_FIRST_MESSAGE;
-            if (last)  root.flags |= DISJOINT_SET_HAS_LAST_MESSAGE;
-            
-            root.firstMessage = std::min(i, root.firstMessage);
-            root.lastMessage  = std::max(i, root.lastMessage);
-            root.size += messageSize;
+            const Slot& slot = _slots[sn & (_slots.size()-1)];
+            return slot.used ? &slot : NULL;
         }
         
-        // This method returns a pair of (whether a full set of split messages
-        // have been received, [a pair of (the largest sequence number in this
-        // set, the total size of the messages in this set in bytes)])
-        MessageData getMessageData(EmiChannelQualifier cq,
-                                   EmiNonWrappingSequenceNumber i,
-                                   EmiMessageFlags messageFlags,
-                                   size_t messageSize) {
+        // Reserves a slot for the message with sequence number sn. The
+        // caller is responsible for filling in the data of the slot.
+        //
+        // Returns NULL if the message is older than the floor, if it
+        // is too far away from the other buffered messages, if it
+        // doesn't fit in the receiver buffer or if it is already
+        // buffered.
+        Slot *insert(EmiNonWrappingSequenceNumber sn, EmiMessageFlags flags, size_t size) {
+            if (sn < _floor) {
+                return NULL;
+            }
             
-            if (!(messageFlags & EMI_SPLIT_NOT_FIRST_FLAG) &&
-                !(messageFlags & EMI_SPLIT_NOT_LAST_FLAG)) {
-                // This is a non-split message; there's no need to store
-                // it in the forest since we already know that it is
-                // complete.
-                return std::make_pair(true, std::make_pair(i, messageSize));
+            if (0 == _count) {
+                _base = sn;
+                _newest = sn;
             }
-            else {
-                DisjointSet& root = *(find(cq, i).second);
-                
-                return std::make_pair(((root.flags & DISJOINT_SET_HAS_FIRST_MESSAGE) &&
-                                       (root.flags & DISJOINT_SET_HAS_LAST_MESSAGE)),
-                                      std::make_pair(root.lastMessage,
-                                                     root.size));
+            
+            EmiNonWrappingSequenceNumber base   = std::min(_base, sn);
+            EmiNonWrappingSequenceNumber newest = std::max(_newest, sn);
+            if (!reserve(base, newest, size)) {
+                return NULL;
             }
-        }
-        
-        // Removes a message from the disjoint sets data structure.
-        // Also removes all older messages than the specified message.
-        // The sequence number parameter can be the sequence number
-        // of any message that is in the split group to be removed.
-        //
-        // Note: This method must only be used for messages that are
-        // complete, that is, all parts of the split group have been
-        // registered.
-        void removeMessageAndOlderMessages(EmiChannelQualifier cq, EmiNonWrappingSequenceNumber i) {
-            DisjointSet *root = find(cq, i, /*createIfMissing:*/false).second;
+            _base = base;
+            _newest = newest;
             
-            ASSERT(!root ||
-                   ((root->flags & DISJOINT_SET_HAS_FIRST_MESSAGE) &&
-                    (root->flags & DISJOINT_SET_HAS_LAST_MESSAGE)));
+            Slot& slot = slotFor(sn);
+            if (slot.used) {
+                return NULL;
+            }
             
-            _forest.erase(_forest.lower_bound(ForestKey(cq, 0)),
-                          _forest.upper_bound(ForestKey(cq, root ? root->lastMessage : i)));
-        }
-        
-        EmiNonWrappingSequenceNumber getLastSequenceNumberInSet(EmiChannelQualifier cq,
-                                                                EmiNonWrappingSequenceNumber i) {
-            FindResult findResult(find(cq, i, /*createIfMissing:*/false));
-            return (findResult.second ?
-                    findResult.second->lastMessage :
-                    i);
+            slot.used = true;
+            slot.flags = flags;
+            slot.size = size;
+            _bufferSize += size;
+            _count++;
+            
+            return &slot;
         }
         
-        EmiNonWrappingSequenceNumber getFirstSequenceNumberInSet(EmiChannelQualifier cq,
-                                                                 EmiNonWrappingSequenceNumber i) {
-            FindResult findResult(find(cq, i, /*createIfMissing:*/false));
-            return (findResult.second ?
-                    findResult.second->firstMessage :
-                    i);
+        // Releases all messages that are older than sn
+        void releaseOlderThan(EmiNonWrappingSequenceNumber sn) {
+            for (EmiNonWrappingSequenceNumber i = _base; i < sn && i <= _newest && 0 != _count; i++) {
+                Slot& slot = slotFor(i);
+                if (slot.used) {
+                    releaseSlot(slot);
+                }
+            }
+            
+            _base = std::max(_base, sn);
+            
+            shrinkIfEmpty();
         }
-    };
-    
-    class Entry {
-    private:
-        // Private copy constructor and assignment operator
-        inline Entry(const Entry& other);
-        inline Entry& operator=(const Entry& other);
-        
-    public:
-        Entry(EmiNonWrappingSequenceNumber guessedNonWrappedSequenceNumber_,
-              const EmiMessageHeader& header_,
-              const TemporaryData &data_,
-              size_t offset,
-              size_t length) :
-        guessedNonWrappedSequenceNumber(guessedNonWrappedSequenceNumber_),
-        header(header_),
-        data(Binding::makePersistentData(Binding::extractData(data_)+offset, length)) {}
         
-        Entry() :
-        guessedNonWrappedSequenceNumber(0) {}
-        
-        ~Entry() {
-            Binding::releasePersistentData(data);
+        // Releases all messages that arrived before time. Returns the
+        // number of bytes of message data that were released.
+        //
+        // If any messages are left, *oldestArrivalTime is set to the
+        // arrival time of the one that arrived first. Otherwise, it
+        // is left untouched.
+        size_t releaseArrivedBefore(EmiTimeInterval time, EmiTimeInterval *oldestArrivalTime) {
+            size_t releasedBytes = 0;
+            
+            for (EmiNonWrappingSequenceNumber i = _base; i <= _newest && 0 != _count; i++) {
+                Slot& slot = slotFor(i);
+                if (!slot.used) {
+                    continue;
+                }
+                
+                if (slot.arrivalTime < time) {
+                    releasedBytes += Binding::extractLength(slot.data);
+                    releaseSlot(slot);
+                }
+                else {
+                    *oldestArrivalTime = std::min(*oldestArrivalTime, slot.arrivalTime);
+                }
+            }
+            
+            shrinkIfEmpty();
+            
+            return releasedBytes;
         }
         
-        EmiNonWrappingSequenceNumber guessedNonWrappedSequenceNumber;
-        EmiMessageHeader header;
-        PersistentData data;
-    };
-    
-    struct BufferTreeCmp {
-        inline bool operator()(Entry *a, Entry *b) const {
-            EmiChannelQualifier acq = a->header.channelQualifier;
-            EmiChannelQualifier bcq = b->header.channelQualifier;
+        // Releases all messages that are older than sn, and makes the
+        // window reject them from now on
+        void advanceTo(EmiNonWrappingSequenceNumber sn) {
+            if (sn <= _floor) {
+                return;
+            }
+            _floor = sn;
             
-            return (acq != bcq ?
-                    acq < bcq :
-                    a->guessedNonWrappedSequenceNumber < b->guessedNonWrappedSequenceNumber);
+            releaseOlderThan(sn);
         }
     };
     
-    typedef std::set<Entry *, BufferTreeCmp> BufferTree;
-    typedef typename BufferTree::iterator    BufferTreeIter;
+    typedef typename ReorderWindow::Slot Slot;
+    typedef std::pair<const EmiChannelQualifier, ReorderWindow*> WindowMapValue;
+    typedef std::map<EmiChannelQualifier, ReorderWindow*,
+                     std::less<EmiChannelQualifier>,
+                     EmiPoolAllocator<WindowMapValue> > WindowMap;
+    typedef typename WindowMap::iterator WindowMapIter;
+    
     // Buffer max size
     size_t _size;
+    // See EmiSockConfig::streamMessages
+    bool _streamMessages;
     
-    DisjointMessageSets _messageSets;
-    BufferTree _tree;
+    WindowMap _windows;
     size_t _bufferSize;
     
     // This is a map that contains the next message's expected
@@ -298,15 +317,16 @@ class EmiReceiverBuffer {
     //
     // For RELIABLE_SEQUENCED channels, this map contains not the
     // next message's expected sequence number, but a sequence
-    // number in the split group (the disjoint set that contains the
-    // first message of the group) of the next expected message.
+    // number in the split group (the run of received messages that
+    // contains the first message of the group) of the next expected
+    // message.
     //
     // The reason for this seemingly odd thing for those channels
     // is to be able to know which ACK to send when receiving split
     // messages:
     //
     // The ack to be sent on each received reliable sequenced
-    // message is the newest sequence number of the message set that
+    // message is the newest sequence number of the message run that
     // contains the most recently received message that is the first
     // part of a split.
     //
@@ -318,7 +338,34 @@ class EmiReceiverBuffer {
     // algorithm, which also uses _expectedSnMemo.
     EmiNonWrappingSequenceNumberMemo _expectedSnMemo;
     
+    // Parts of split messages on unreliable channels are never resent,
+    // so when one part is lost, the other parts would stay in the
+    // buffer until a newer message on the channel pushes them out.
+    // evictIncompleteMessages evicts them when they have waited too
+    // long for the rest of their message.
+    //
+    // _oldestUnreliablePartTime is no later than the arrival time of
+    // the oldest buffered part on an unreliable channel. It is only
+    // valid if _hasUnreliableParts is true. It lets
+    // evictIncompleteMessages know when there is nothing to evict
+    // without looking at the buffered messages.
+    bool _hasUnreliableParts;
+    EmiTimeInterval _oldestUnreliablePartTime;
+    // The number of bytes of message data that have been evicted, per
+    // channel
+    EvictedBytesMap _evictedBytes;
+    
+    // emitGroup merges the parts of split messages into this buffer.
+    // It is kept from one message to the next, and only ever grows, so
+    // that completing a split group doesn't allocate.
+    TemporaryData _mergeBuffer;
+    uint8_t *_mergeBufferData;
+    size_t _mergeBufferCapacity;
+    
     Receiver &_receiver;
+    // The ReorderWindows and the nodes of _windows are allocated
+    // from this pool
+    EmiObjectPool &_pool;
     
 private:
     // Private copy constructor and assignment operator
@@ -336,7 +383,36 @@ private:
         return (end == cur ? _receiver.getOtherHostInitialSequenceNumber() : (*cur).second);
     }
     
-    void bufferMessage(EmiNonWrappingSequenceNumber guessedNonWrappedSequenceNumber,
+    ReorderWindow *findWindow(EmiChannelQualifier channelQualifier) {
+        WindowMapIter iter = _windows.find(channelQualifier);
+        return (_windows.end() == iter ? NULL : (*iter).second);
+    }
+    
+    // floor is only used if the channel doesn't have a window yet
+    ReorderWindow& window(EmiChannelQualifier channelQualifier,
+                          EmiNonWrappingSequenceNumber floor) {
+        ReorderWindow *window = findWindow(channelQualifier);
+        if (!window) {
+            window = new (_pool.allocate(sizeof(ReorderWindow))) ReorderWindow(_bufferSize, _size, _pool, floor);
+            _windows.insert(std::make_pair(channelQualifier, window));
+        }
+        return *window;
+    }
+    
+    void freeWindow(ReorderWindow *window) {
+        window->~ReorderWindow();
+        _pool.deallocate(window, sizeof(ReorderWindow));
+    }
+    
+    inline static bool isUnreliableChannelType(EmiChannelType channelType) {
+        return (EMI_CHANNEL_TYPE_UNRELIABLE == channelType ||
+                EMI_CHANNEL_TYPE_UNRELIABLE_SEQUENCED == channelType);
+    }
+    
+    // Returns false if the message was not buffered
+    bool bufferMessage(EmiTimeInterval now,
+                       ReorderWindow& window,
+                       EmiNonWrappingSequenceNumber guessedNonWrappedSequenceNumber,
                        const EmiMessageHeader& header,
                        const TemporaryData& buf,
                        size_t offset,
@@ -344,351 +420,387 @@ private:
         size_t msgSize = EmiReceiverBuffer::bufferEntrySize(header.headerLength, header.length);
         
         // Discard the message if it doesn't fit in the buffer
-        if (_bufferSize + msgSize <= _size) {
-            Entry *entry = new Entry(guessedNonWrappedSequenceNumber, header, buf, offset, length);
-            
-            bool wasInserted = _tree.insert(entry).second;
-            
-            // Only increment this._bufferSize if the message wasn't already in the buffer
-            if (wasInserted) {
-                _bufferSize += msgSize;
-                
-                _messageSets.gotMessage(entry->header.channelQualifier,
-                                        entry->guessedNonWrappedSequenceNumber,
-                                        entry->header.flags,
-                                        /*messageSize:*/entry->header.length);
-            }
-            else {
-                delete entry;
-            }
+        if (_bufferSize + msgSize > _size) {
+            return false;
         }
-    }
-    
-    void remove(BufferTreeIter begin, BufferTreeIter end) {
-        BufferTreeIter iter = begin;
-        while (iter != end) {
-            Entry *entry = *iter;
-            
-            _bufferSize -= EmiReceiverBuffer::bufferEntrySize(entry->header.headerLength,
-                                                              entry->header.length);
-            
-            delete entry;
-            
-            ++iter;
+        
+        // insert returns NULL if the message was already in the buffer
+        Slot *slot = window.insert(guessedNonWrappedSequenceNumber, header.flags, msgSize);
+        if (!slot) {
+            return false;
+        }
+        
+        slot->arrivalTime = now;
+        slot->data = Binding::makePersistentData(Binding::extractData(buf)+offset, length);
+        
+        if (!_hasUnreliableParts &&
+            isUnreliableChannelType(EMI_CHANNEL_QUALIFIER_TYPE(header.channelQualifier))) {
+            _hasUnreliableParts = true;
+            _oldestUnreliablePartTime = now;
         }
         
-        _tree.erase(begin, end);
+        return true;
     }
     
-    // Processes a set of messages in a split that is known to be complete.
-    // This method iterates through the messages and fills buf so that it
-    // is a continuous buffer of the data of the messages.
+    // Emits the split group that consists of the buffered messages from
+    // first to last. length is the total length of their data. The
+    // parts are copied straight into _mergeBuffer, which only has to
+    // be valid while the message is emitted.
     //
-    // iter must point to the first Entry of the message set.
-    //
-    // The return value is an iterator pointing to the first entry that is
-    // in the buffer that is not part of the message set. Note that the
-    // return value can be _tree.end() or an iterator to a message with a
-    // different channelQualifier.
-    BufferTreeIter processMessageSetData(EmiChannelQualifier channelQualifier,
-                                         EmiNonWrappingSequenceNumber largestSequenceNumberInSet,
-                                         BufferTreeIter iter,
-                                         uint8_t *buf, size_t bufSize) {
-        BufferTreeIter end = _tree.end();
-        Entry *entry = *iter;
+    // This does not remove the messages from the window.
+    void emitGroup(EmiChannelQualifier channelQualifier,
+                   const ReorderWindow& window,
+                   EmiNonWrappingSequenceNumber first,
+                   EmiNonWrappingSequenceNumber last,
+                   size_t length) {
+        if (first == last) {
+            // The group consists of just one message
+            //
+            // This special case is purely an optimization, to avoid
+            // copying the data when it's possible to just use the
+            // slot's data right away.
+            const Slot *slot = window.get(first);
+            ASSERT(slot);
+            
+            _receiver.emitMessage(channelQualifier,
+                                  Binding::castToTemporary(slot->data),
+                                  /*offset:*/0,
+                                  Binding::extractLength(slot->data));
+            return;
+        }
+        
+        if (length > _mergeBufferCapacity) {
+            _mergeBuffer = Binding::makeTemporaryData(length, &_mergeBufferData);
+            _mergeBufferCapacity = length;
+        }
+        
         size_t bufPos = 0;
         
-        // This loop increments iter until we are past the message set
-        // we just processed, and marks all messages we pass for removal.
-        do {
-            size_t edlen = Binding::extractLength(entry->data);
-            ASSERT(bufPos + edlen <= bufSize);
-            memcpy(buf+bufPos, Binding::extractData(entry->data), edlen);
-            bufPos += edlen;
+        for (EmiNonWrappingSequenceNumber sn = first; sn <= last; sn++) {
+            const Slot *slot = window.get(sn);
+            ASSERT(slot);
             
-            ++iter;
-        } while (iter != end &&
-                 (entry = *iter) &&
-                 entry->guessedNonWrappedSequenceNumber <= largestSequenceNumberInSet);
+            size_t slotLength = Binding::extractLength(slot->data);
+            ASSERT(bufPos + slotLength <= length);
+            memcpy(_mergeBufferData+bufPos, Binding::extractData(slot->data), slotLength);
+            bufPos += slotLength;
+        }
         
-        ASSERT(bufPos == bufSize);
+        ASSERT(bufPos == length);
         
-        return iter;
+        _receiver.emitMessage(channelQualifier,
+                              _mergeBuffer,
+                              /*offset:*/0,
+                              length);
     }
     
-    // This method iterates through the buffer and emits as many
-    // complete messages as it can find, while still enforcing
-    // strict message ordering (no skipped messages).
-    //
-    // The search begins in iter.
-    //
-    // The return value is an iterator that points to the message
-    // after the last one that was processed by processBuffer. Note
-    // that the return value can be _tree.end() or an iterator to a
-    // message with a different channelQualifier.
-    BufferTreeIter processBuffer(EmiChannelQualifier channelQualifier,
-                                 BufferTreeIter iter,
-                                 int64_t *largestProcessedMessageSet,
-                                 EmiNonWrappingSequenceNumber *largestProcessedSn) {
-        
-        if (largestProcessedMessageSet) {
-            *largestProcessedMessageSet = -1;
-        }
-        if (largestProcessedSn) {
-            *largestProcessedSn = -1;
+    // Returns the newest sequence number of the run of received
+    // messages of a split group that contains sn. If sn has not been
+    // received, but is the next part of a split whose previous part
+    // has, this is the sequence number of that part. If neither is
+    // buffered, this returns sn.
+    EmiNonWrappingSequenceNumber lastSequenceNumberInRun(const ReorderWindow& window,
+                                                         EmiNonWrappingSequenceNumber sn) {
+        const Slot *slot = window.get(sn);
+        
+        if (!slot) {
+            const Slot *prev = (0 == sn ? NULL : window.get(sn-1));
+            return ((prev && (prev->flags & EMI_SPLIT_NOT_LAST_FLAG)) ? sn-1 : sn);
         }
         
-        BufferTreeIter end = _tree.end();
-        
-        if (iter == end) {
-            return iter;
+        const Slot *next;
+        while ((slot->flags & EMI_SPLIT_NOT_LAST_FLAG) &&
+               (next = window.get(sn+1))) {
+            slot = next;
+            sn++;
         }
         
-        Entry *entry = *iter;
-        
-        if (entry->header.flags & EMI_SPLIT_NOT_FIRST_FLAG) {
-            // The first message is in the middle of a split.
-            // That means that there is no complete message that
-            // we can process.
-            //
-            // This check is needed in order to ensure that we
-            // don't invoke processMessageSetData with an
-            // incomplete message set.
-            return iter;
-        }
-        
-        EmiNonWrappingSequenceNumber expectedSequenceNumber = entry->guessedNonWrappedSequenceNumber;
-        
-        while (iter != end &&
-               (entry = *iter) &&
-               entry->header.channelQualifier == channelQualifier &&
-               entry->guessedNonWrappedSequenceNumber <= expectedSequenceNumber) {
-            
-            // Search for a message set that contains entry->guessedNonWrappedSequenceNumber
-            typename DisjointMessageSets::MessageData messageData;
-            messageData = _messageSets.getMessageData(channelQualifier,
-                                                      entry->guessedNonWrappedSequenceNumber,
-                                                      entry->header.flags,
-                                                      /*messageSize:*/entry->header.length);
-            bool setIsComplete = messageData.first;
-            EmiNonWrappingSequenceNumber largestSequenceNumberInSet = messageData.second.first;
-            size_t totalSizeOfSet = messageData.second.second;
-            
-            // Update the expected sequence number to the largest sequence
-            // number in the set, and enqueue an acknowledgment to the other
-            // host that we have received all data up to that point.
-            expectedSequenceNumber = largestSequenceNumberInSet+1;
-            if (largestProcessedSn) {
-                *largestProcessedSn = largestSequenceNumberInSet;
-            }
-            
-            // If the set is not complete, we can not continue from here;
-            // we need to wait for it to be completed.
-            if (!setIsComplete) {
-                break;
+        return sn;
+    }
+    
+    static EmiMessagePartFlags partFlags(EmiMessageFlags flags) {
+        return ((flags & EMI_SPLIT_NOT_FIRST_FLAG ? 0 : EMI_MESSAGE_PART_FIRST) |
+                (flags & EMI_SPLIT_NOT_LAST_FLAG  ? 0 : EMI_MESSAGE_PART_LAST));
+    }
+    
+    // Emits a message that has arrived in order on a RELIABLE_ORDERED
+    // channel. The parts of split messages are only passed to this in
+    // streaming mode, and are emitted one by one.
+    void emitOrderedMessage(EmiChannelQualifier channelQualifier,
+                             EmiMessageFlags flags,
+                             const TemporaryData& data, size_t offset, size_t length) {
+        if (flags & (EMI_SPLIT_NOT_FIRST_FLAG | EMI_SPLIT_NOT_LAST_FLAG)) {
+            _receiver.emitMessagePart(channelQualifier, data, offset, length, partFlags(flags));
+        }
+        else {
+            _receiver.emitMessage(channelQualifier, data, offset, length);
+        }
+    }
+    
+    // This is works with RELIABLE_ORDERED channels.
+    //
+    // It walks the window from its floor, which is the first message
+    // that has not been emitted yet, emits all messages that are
+    // complete, and removes the emitted messages from the buffer.
+    //
+    // The floor of the window is left at the first part of the split
+    // group that is not complete yet, if any, because its parts stay
+    // in the buffer until the rest of them arrive.
+    void flushBuffer(EmiChannelQualifier channelQualifier) {
+        ReorderWindow *window = findWindow(channelQualifier);
+        if (!window || window->empty()) return;
+        
+        EmiNonWrappingSequenceNumber groupStart = window->floor();
+        EmiNonWrappingSequenceNumber sn = groupStart;
+        size_t groupLength = 0;
+        
+        bool processedAny = false;
+        EmiNonWrappingSequenceNumber largestProcessedSn = 0;
+        
+        const Slot *slot;
+        while ((slot = window->get(sn))) {
+            if (_streamMessages) {
+                // In streaming mode, every part is emitted as soon as
+                // all parts before it have been.
+                emitOrderedMessage(channelQualifier, slot->flags,
+                                    Binding::castToTemporary(slot->data),
+                                    /*offset:*/0, Binding::extractLength(slot->data));
+                
+                processedAny = true;
+                largestProcessedSn = sn;
+                groupStart = ++sn;
+                continue;
             }
             
-            if (largestSequenceNumberInSet == entry->guessedNonWrappedSequenceNumber) {
-                // The message set consists of just one message
-                //
-                // This special case is purely an optimization, to avoid
-                // the overhead of allocating a new TemporaryData buffer
-                // when it's possible to just use entry->data right away.
-                
-                _receiver.emitMessage(channelQualifier,
-                                      Binding::castToTemporary(entry->data),
-                                      /*offset:*/0,
-                                      entry->header.length);
-                
-                ++iter;
+            if (sn == groupStart && (slot->flags & EMI_SPLIT_NOT_FIRST_FLAG)) {
+                // The message is in the middle of a split, even though
+                // it should be the first one. That split can never be
+                // completed, so there is nothing that we can process.
+                break;
             }
-            else {
-                // The message set contains more than one message
-                
-                uint8_t *mergedDataBuf;
-                TemporaryData mergedData = Binding::makeTemporaryData(totalSizeOfSet, &mergedDataBuf);
-                
-                iter = processMessageSetData(channelQualifier,
-                                             largestSequenceNumberInSet,
-                                             iter,
-                                             /*buf:*/mergedDataBuf,
-                                             /*bufSize:*/Binding::extractLength(mergedData));
+            
+            processedAny = true;
+            largestProcessedSn = sn;
+            groupLength += Binding::extractLength(slot->data);
+            
+            if (!(slot->flags & EMI_SPLIT_NOT_LAST_FLAG)) {
+                emitGroup(channelQualifier, *window, groupStart, sn, groupLength);
                 
-                _receiver.emitMessage(channelQualifier,
-                                      mergedData,
-                                      /*offset:*/0,
-                                      Binding::extractLength(mergedData));
+                groupStart = sn+1;
+                groupLength = 0;
             }
             
-            if (largestProcessedMessageSet) {
-                *largestProcessedMessageSet = largestSequenceNumberInSet;
-            }
-        }
-        
-        return iter;
-    }
-    
-    // This is works with RELIABLE_ORDERED channels.
-    //
-    // It goes through the receiver buffer, emits all messages
-    // that are ready, and removes the emitted messages from the
-    // buffer.
-    void flushBuffer(EmiChannelQualifier channelQualifier,
-                     EmiNonWrappingSequenceNumber expectedSequenceNumber) {
-        if (_tree.empty()) return;
-        
-        Entry mockEntry;
-        mockEntry.guessedNonWrappedSequenceNumber = 0;
-        mockEntry.header.channelQualifier = channelQualifier;
-        
-        BufferTreeIter iter = _tree.lower_bound(&mockEntry);
-        
-        if (_tree.end() == iter) {
-            // We found nothing.
-            return;
+            sn++;
         }
         
-        Entry *foundEntry = *iter;
-        if (foundEntry->header.channelQualifier != channelQualifier ||
-            foundEntry->guessedNonWrappedSequenceNumber > expectedSequenceNumber) {
-            // The entry we found was either not in the expected channel qualifier,
-            // or it was newer than the newest permissible message to process.
-            return;
-        }
-        
-        int64_t largestProcessedMessageSet;
-        EmiNonWrappingSequenceNumber largestProcessedSn;
-        BufferTreeIter end = processBuffer(channelQualifier,
-                                           iter,
-                                           &largestProcessedMessageSet,
-                                           &largestProcessedSn);
-        
-        if (-1 != largestProcessedSn) {
+        if (processedAny) {
             _receiver.enqueueAck(channelQualifier, largestProcessedSn & EMI_HEADER_SEQUENCE_NUMBER_MASK);
             _expectedSnMemo[channelQualifier] = largestProcessedSn+1;
         }
         
-        // We have now processed and emitted messages. The next
-        // step is to remove those from the buffer data structure.
-        //
-        // To do this correctly, we need to remove data from both
-        // _messageSets and _tree.
-        
-        if (-1 != largestProcessedMessageSet) {
-            _messageSets.removeMessageAndOlderMessages(channelQualifier,
-                                                       largestProcessedMessageSet);
+        window->advanceTo(groupStart);
+    }
+    
+    // Removes the messages that are older than sn from the window of a
+    // channel that is not RELIABLE_ORDERED. Sequenced channels drop late
+    // messages anyway, so their windows stop accepting them. Unreliable
+    // channels still deliver late messages, so their windows keep
+    // accepting them, in case a late split group is completed.
+    static void discardOlderMessages(ReorderWindow& window,
+                                     EmiChannelType channelType,
+                                     EmiNonWrappingSequenceNumber sn) {
+        if (EMI_CHANNEL_TYPE_UNRELIABLE == channelType) {
+            window.releaseOlderThan(sn);
+        }
+        else {
+            window.advanceTo(sn);
         }
-        remove(iter, end);
     }
     
-    void processUnorderedMessage(EmiNonWrappingSequenceNumber guessedNonWrappedSequenceNumber,
+    void processUnorderedMessage(EmiTimeInterval now,
+                                 EmiNonWrappingSequenceNumber guessedNonWrappedSequenceNumber,
                                  const EmiMessageHeader& header,
                                  const TemporaryData& data, size_t offset) {
-        EmiChannelType channelType = EMI_CHANNEL_QUALIFIER_TYPE(header.channelQualifier);
+        EmiChannelQualifier channelQualifier = header.channelQualifier;
+        EmiChannelType channelType = EMI_CHANNEL_QUALIFIER_TYPE(channelQualifier);
         
         if (0 == (header.flags & (EMI_SPLIT_NOT_FIRST_FLAG | EMI_SPLIT_NOT_LAST_FLAG))) {
             // This is a non-split message, so we don't need to worry
             // about reconstructing the split etc.
             
-            _receiver.emitMessage(header.channelQualifier, data, offset, header.length);
-            
-            // Remove older messages from _tree and _messageSets
-            _messageSets.removeMessageAndOlderMessages(header.channelQualifier,
-                                                       guessedNonWrappedSequenceNumber);
-            
-            Entry mockEntry1;
-            mockEntry1.guessedNonWrappedSequenceNumber = 0;
-            mockEntry1.header.channelQualifier = header.channelQualifier;
+            _receiver.emitMessage(channelQualifier, data, offset, header.length);
             
-            Entry mockEntry2;
-            mockEntry2.guessedNonWrappedSequenceNumber = guessedNonWrappedSequenceNumber;
-            mockEntry2.header.channelQualifier = header.channelQualifier;
-            
-            remove(_tree.lower_bound(&mockEntry1),
-                   _tree.upper_bound(&mockEntry2));
-            
-            // Enqueue ack if this is a reliable sequenced channel
-            if (EMI_CHANNEL_TYPE_RELIABLE_SEQUENCED == channelType) {
-                _expectedSnMemo[header.channelQualifier] = guessedNonWrappedSequenceNumber;
-                _receiver.enqueueAck(header.channelQualifier, header.sequenceNumber);
+            // Remove older messages from the buffer
+            ReorderWindow *window = findWindow(channelQualifier);
+            if (window) {
+                discardOlderMessages(*window, channelType, guessedNonWrappedSequenceNumber+1);
             }
-        }
-        else {
-            bufferMessage(guessedNonWrappedSequenceNumber,
-                          header, data, offset, header.length);
-            
-            EmiNonWrappingSequenceNumber firstSequenceNumberInSet = _messageSets.getFirstSequenceNumberInSet(header.channelQualifier,
-                                                                                                             guessedNonWrappedSequenceNumber);
-            
-            Entry mockEntry1;
-            mockEntry1.guessedNonWrappedSequenceNumber = firstSequenceNumberInSet;
-            mockEntry1.header.channelQualifier = header.channelQualifier;
-            BufferTreeIter iter = _tree.find(&mockEntry1);
             
-            // Enqueue ack if this is a reliable sequenced channel.
-            // Note that this needs to be done before we flush _messageSets.
-            //
-            // Also, we want to enqueue the ack before we do the sanity
-            // checks that might return from the function, because the other
-            // host is entitled to get an ack even if our receiver buffer is
-            // full or if this happens to be a message that doesn't complete
-            // a message group.
+            // Enqueue ack if this is a reliable sequenced channel
             if (EMI_CHANNEL_TYPE_RELIABLE_SEQUENCED == channelType) {
-                EmiNonWrappingSequenceNumber sn = _messageSets.getLastSequenceNumberInSet(header.channelQualifier,
-                                                                                          _expectedSnMemo[header.channelQualifier]);
-                _expectedSnMemo[header.channelQualifier] = sn;
-                _receiver.enqueueAck(header.channelQualifier, sn & EMI_HEADER_SEQUENCE_NUMBER_MASK);
+                _expectedSnMemo[channelQualifier] = guessedNonWrappedSequenceNumber;
+                _receiver.enqueueAck(channelQualifier, header.sequenceNumber);
             }
             
-            if (_tree.end() == iter) {
-                // This happens when the receiver buffer is full. Fail.
-                return;
-            }
-            
-            if ((*iter)->header.flags & EMI_SPLIT_NOT_FIRST_FLAG) {
-                // The message we found is not the first in the set.
-                // This means that the set is not complete. Fail.
-                //
-                // In fact, it is really important to not continue
-                // here, because otherwise we would be removing
-                // parts of still-in-use message groups later on.
+            return;
+        }
+        
+        ReorderWindow& window(this->window(channelQualifier, /*floor:*/0));
+        
+        // Messages on these channels may be dropped, so instead of
+        // refusing a message that is too far ahead of the oldest
+        // buffered message, give up on the oldest messages.
+        if (guessedNonWrappedSequenceNumber >= ReorderWindow::MAX_CAPACITY) {
+            discardOlderMessages(window, channelType,
+                                 guessedNonWrappedSequenceNumber+1-ReorderWindow::MAX_CAPACITY);
+        }
+        
+        bufferMessage(now, window, guessedNonWrappedSequenceNumber,
+                      header, data, offset, header.length);
+        
+        // Enqueue ack if this is a reliable sequenced channel.
+        //
+        // We want to enqueue the ack before we do the sanity checks
+        // that might return from the function, because the other
+        // host is entitled to get an ack even if our receiver buffer is
+        // full or if this happens to be a message that doesn't complete
+        // a message group.
+        if (EMI_CHANNEL_TYPE_RELIABLE_SEQUENCED == channelType) {
+            EmiNonWrappingSequenceNumber sn = lastSequenceNumberInRun(window,
+                                                                      _expectedSnMemo[channelQualifier]);
+            _expectedSnMemo[channelQualifier] = sn;
+            _receiver.enqueueAck(channelQualifier, sn & EMI_HEADER_SEQUENCE_NUMBER_MASK);
+        }
+        
+        // Walk backwards to the first part of the split group.
+        //
+        // slot is NULL if the message could not be buffered because the
+        // receiver buffer is full. The walk then starts at the previous
+        // part of the split, if we have it: If that part belongs to a
+        // split whose first part we have, the older messages are
+        // discarded below, which frees up space in the buffer.
+        EmiNonWrappingSequenceNumber first = guessedNonWrappedSequenceNumber;
+        const Slot *slot = window.get(first);
+        while (!slot || (slot->flags & EMI_SPLIT_NOT_FIRST_FLAG)) {
+            const Slot *prev = (0 == first ? NULL : window.get(first-1));
+            if (!prev || !(prev->flags & EMI_SPLIT_NOT_LAST_FLAG)) {
+                // We don't have the first part of the split, so the
+                // split is not complete. Fail.
                 return;
             }
             
-            int64_t largestProcessedMessageSet;
-            
-            BufferTreeIter processEnd = processBuffer(header.channelQualifier,
-                                                      iter,
-                                                      &largestProcessedMessageSet,
-                                                      /*largestProcessedSn:*/NULL);
+            slot = prev;
+            first--;
+        }
+        
+        // Walk forwards to the last part of the split group
+        EmiNonWrappingSequenceNumber last = first;
+        size_t length = 0;
+        while (true) {
+            length += Binding::extractLength(slot->data);
             
-            // Remove processed and older messages from _tree and _messageSets
-            if (-1 != largestProcessedMessageSet) {
-                _messageSets.removeMessageAndOlderMessages(header.channelQualifier,
-                                                           largestProcessedMessageSet);
+            if (!(slot->flags & EMI_SPLIT_NOT_LAST_FLAG)) {
+                break;
             }
             
-            Entry mockEntry2;
-            mockEntry2.guessedNonWrappedSequenceNumber = 0;
-            mockEntry2.header.channelQualifier = header.channelQualifier;
-            BufferTreeIter removeFrom = _tree.lower_bound(&mockEntry2);
+            slot = window.get(last+1);
+            if (!slot) {
+                // The split is not complete. Messages that are older
+                // than it will never be emitted, so we might as well
+                // drop them now.
+                discardOlderMessages(window, channelType, first);
+                return;
+            }
             
-            remove(removeFrom, processEnd);
+            last++;
         }
+        
+        emitGroup(channelQualifier, window, first, last, length);
+        
+        // Remove the emitted and older messages from the buffer
+        discardOlderMessages(window, channelType, last+1);
     }
     
 public:
     
-    EmiReceiverBuffer(size_t size, Receiver &receiver) :
-    _size(size), _bufferSize(0), _receiver(receiver) {}
+    EmiReceiverBuffer(size_t size, bool streamMessages, Receiver &receiver, EmiObjectPool& pool) :
+    _size(size),
+    _streamMessages(streamMessages),
+    _windows(std::less<EmiChannelQualifier>(), EmiPoolAllocator<WindowMapValue>(&pool)),
+    _bufferSize(0),
+    _hasUnreliableParts(false),
+    _oldestUnreliablePartTime(0),
+    _mergeBuffer(),
+    _mergeBufferData(NULL),
+    _mergeBufferCapacity(0),
+    _receiver(receiver),
+    _pool(pool) {}
     
     virtual ~EmiReceiverBuffer() {
-        remove(_tree.begin(), _tree.end());
+        WindowMapIter iter = _windows.begin();
+        WindowMapIter end  = _windows.end();
+        while (iter != end) {
+            freeWindow((*iter).second);
+            ++iter;
+        }
+        _windows.clear();
         
         _size = 0;
         _bufferSize = 0;
     }
     
+    // Evicts the parts of split messages on unreliable channels that
+    // arrived more than timeout ago. They are parts of messages that
+    // will never be complete, since the messages would otherwise have
+    // been emitted by now.
+    //
+    // This is cheap to invoke often; it only looks at the buffered
+    // messages when the oldest of them might be due for eviction.
+    void evictIncompleteMessages(EmiTimeInterval now, EmiTimeInterval timeout) {
+        if (!_hasUnreliableParts || now-_oldestUnreliablePartTime <= timeout) {
+            return;
+        }
+        
+        EmiTimeInterval oldestArrivalTime = now;
+        _hasUnreliableParts = false;
+        
+        WindowMapIter iter = _windows.begin();
+        WindowMapIter end  = _windows.end();
+        while (iter != end) {
+            EmiChannelQualifier channelQualifier = (*iter).first;
+            ReorderWindow *window = (*iter).second;
+            
+            if (isUnreliableChannelType(EMI_CHANNEL_QUALIFIER_TYPE(channelQualifier)) &&
+                !window->empty()) {
+                size_t evictedBytes = window->releaseArrivedBefore(now-timeout, &oldestArrivalTime);
+                if (0 != evictedBytes) {
+                    _evictedBytes[channelQualifier] += evictedBytes;
+                }
+                
+                if (!window->empty()) {
+                    _hasUnreliableParts = true;
+                }
+            }
+            
+            ++iter;
+        }
+        
+        _oldestUnreliablePartTime = oldestArrivalTime;
+    }
+    
+    // The number of bytes of message data on the channel that have
+    // been evicted by evictIncompleteMessages
+    uint64_t evictedBytes(EmiChannelQualifier channelQualifier) const {
+        typename EvictedBytesMap::const_iterator iter = _evictedBytes.find(channelQualifier);
+        return (_evictedBytes.end() == iter ? 0 : (*iter).second);
+    }
+    
+    // The number of bytes that are free in the buffer. This is
+    // advertised to the other host as our receive window.
+    size_t freeSpace() const {
+        return (_bufferSize < _size ? _size-_bufferSize : 0);
+    }
+    
 #define EMI_GOT_INVALID_MESSAGE(err) do { /* NSLog(err); */ return false; } while (1)
     bool gotMessage(EmiTimeInterval now,
                     const EmiMessageHeader& header,
@@ -705,7 +817,7 @@ public:
             // positive diff means older than expected
             int32_t diff = EmiNetUtil::cyclicDifferenceSigned<EMI_HEADER_SEQUENCE_NUMBER_LENGTH>(expectedSn & EMI_HEADER_SEQUENCE_NUMBER_MASK,
                                                                                                  header.sequenceNumber);
-            if (diff > 0 && diff > expectedSn) {
+            if (diff > 0 && (EmiNonWrappingSequenceNumber)diff > expectedSn) {
                 // Don't allow a negative guessedNonWrappedSequenceNumber
                 guessedNonWrappedSequenceNumber = header.sequenceNumber;
             }
@@ -750,6 +862,16 @@ public:
                                          static_cast<EmiSequenceNumber>(llabs(snDiff)));
             }
         }
+        else if (EMI_CHANNEL_TYPE_UNRELIABLE == channelType &&
+                 -1 != header.sequenceNumber) {
+            // Unreliable channels don't drop old messages, but the
+            // sequence number wrapping guess still needs to follow the
+            // channel. Otherwise the split messages on the channel would
+            // end up below the floor of the channel's ReorderWindow once
+            // the sequence number wraps.
+            _expectedSnMemo[channelQualifier] = std::max(expectedSn,
+                                                         guessedNonWrappedSequenceNumber+1);
+        }
         
         if (EMI_CHANNEL_TYPE_UNRELIABLE == channelType ||
             EMI_CHANNEL_TYPE_UNRELIABLE_SEQUENCED == channelType ||
@@ -767,7 +889,8 @@ public:
             }
             
             if (0 != header.length) {
-                processUnorderedMessage(guessedNonWrappedSequenceNumber,
+                processUnorderedMessage(now,
+                                        guessedNonWrappedSequenceNumber,
                                         header,
                                         data, offset);
             }
@@ -795,28 +918,38 @@ public:
                                           expectedSn-1) & EMI_HEADER_SEQUENCE_NUMBER_MASK);
                 }
                 
-                if (0 == seqDiff && 0 == (header.flags & (EMI_SPLIT_NOT_FIRST_FLAG | EMI_SPLIT_NOT_LAST_FLAG))) {
+                if (0 == seqDiff &&
+                    (_streamMessages ||
+                     0 == (header.flags & (EMI_SPLIT_NOT_FIRST_FLAG | EMI_SPLIT_NOT_LAST_FLAG)))) {
                     // This is purely an optimization.
                     //
                     // When we receive a message that is not split, and that has
                     // the expected sequence number, we can bypass the buffering
                     // mechanism and emit it immediately, without touching the
-                    // message split mechanism.
+                    // message split mechanism. In streaming mode, the same goes
+                    // for the parts of split messages.
                     
                     EmiSequenceNumber newExpectedSn = static_cast<EmiSequenceNumber>(expectedSn+1);
                     _expectedSnMemo[channelQualifier] = newExpectedSn;
                     
-                    _receiver.emitMessage(channelQualifier, data, offset, header.length);
+                    ReorderWindow *window = findWindow(channelQualifier);
+                    if (window) {
+                        window->advanceTo(newExpectedSn);
+                    }
+                    
+                    emitOrderedMessage(channelQualifier, header.flags, data, offset, header.length);
                     
                     // The connection might have been closed when invoking emitMessage
                     if (!_receiver.isClosed()) {
-                        flushBuffer(channelQualifier, newExpectedSn);
+                        flushBuffer(channelQualifier);
                     }
                 }
                 else if (seqDiff <= 0) {
-                    bufferMessage(guessedNonWrappedSequenceNumber,
+                    bufferMessage(now,
+                                  this->window(channelQualifier, /*floor:*/expectedSn),
+                                  guessedNonWrappedSequenceNumber,
                                   header, data, offset, header.length);
-                    flushBuffer(channelQualifier, expectedSn);
+                    flushBuffer(channelQualifier);
                 }
             }
         }
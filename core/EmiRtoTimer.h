@@ -36,7 +36,7 @@ private:
     inline EmiRtoTimer(const EmiRtoTimer& other);
     inline EmiRtoTimer& operator=(const EmiRtoTimer& other);
     
-    static void rtoTimeoutCallback(EmiTimeInterval now, Timer *timer, void *data) {
+    static void rtoTimeoutCallback(EmiTimeInterval now, Timer * /*timer*/, void *data) {
         EmiRtoTimer *ert = (EmiRtoTimer *)data;
         
         ert->_delegate.rtoTimeout(now, ert->_rtoWhenRtoTimerWasScheduled);
@@ -46,7 +46,7 @@ private:
         ert->updateRtoTimeout();
     }
     
-    static void connectionTimeoutCallback(EmiTimeInterval now, Timer *timer, void *data) {
+    static void connectionTimeoutCallback(EmiTimeInterval /*now*/, Timer * /*timer*/, void *data) {
         EmiRtoTimer *ert = (EmiRtoTimer *)data;
         
         ert->_delegate.connectionTimeout();
@@ -56,7 +56,7 @@ private:
         return _connectionOpen ? _connectionTimeout : _initialConnectionTimeout;
     }
     
-    static void connectionWarningCallback(EmiTimeInterval now, Timer *timer, void *data) {
+    static void connectionWarningCallback(EmiTimeInterval /*now*/, Timer * /*timer*/, void *data) {
         EmiRtoTimer *ert = (EmiRtoTimer *)data;
         
         ert->_issuedConnectionWarning = true;
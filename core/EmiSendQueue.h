@@ -10,6 +10,7 @@
 #define eminet_EmiSendQueue_h
 
 #include "EmiMessage.h"
+#include "EmiObjectPool.h"
 #include "EmiNetUtil.h"
 #include "EmiNetRandom.h"
 #include "EmiPacketHeader.h"
@@ -37,9 +38,14 @@ class EmiSendQueue {
     typedef EmiMessage<Binding>              EM;
     typedef EmiCongestionControl<Binding>    ECC;
     
-    typedef std::map<EmiChannelQualifier, EmiSequenceNumber> SendQueueAcksMap;
+    typedef std::pair<const EmiChannelQualifier, EmiSequenceNumber> SendQueueAcksMapValue;
+    typedef std::map<EmiChannelQualifier, EmiSequenceNumber,
+                     std::less<EmiChannelQualifier>,
+                     EmiPoolAllocator<SendQueueAcksMapValue> > SendQueueAcksMap;
     typedef typename SendQueueAcksMap::iterator SendQueueAcksMapIter;
-    typedef std::set<EmiChannelQualifier> SendQueueAcksSet;
+    typedef std::set<EmiChannelQualifier,
+                     std::less<EmiChannelQualifier>,
+                     EmiPoolAllocator<EmiChannelQualifier> > SendQueueAcksSet;
     typedef EmiConn<SockDelegate, ConnDelegate> EC;
     
     // The purpose of BytesSentTheLastNTicks is to increase the
@@ -115,10 +121,13 @@ class EmiSendQueue {
         inline SendQueue(const SendQueue& other);
         inline SendQueue& operator=(const SendQueue& other);
         
-        typedef std::deque<EM *> SendQueueDeque;
+        typedef std::deque<EM *, EmiPoolAllocator<EM *> > SendQueueDeque;
         typedef typename SendQueueDeque::iterator SendQueueDequeIter;
         
-        SendQueueDeque _queues[EMI_NUMBER_OF_PRIORITIES];
+        // One deque per priority. This is a vector rather than an array
+        // so that the deques can be copy constructed from one that uses
+        // the connection's pool.
+        std::vector<SendQueueDeque> _queues;
         size_t _queueSize;
         
     public:
@@ -202,14 +211,16 @@ class EmiSendQueue {
             }
         };
         
-        SendQueue() : _queueSize(0) {}
+        SendQueue(EmiObjectPool& pool) :
+        _queues(EMI_NUMBER_OF_PRIORITIES, SendQueueDeque(EmiPoolAllocator<EM *>(&pool))),
+        _queueSize(0) {}
         
         void eraseUntil(const iterator& iter) {
             for (int i=0; i<EMI_NUMBER_OF_PRIORITIES; i++) {
                 SendQueueDeque &queue(_queues[i]);
                 
                 SendQueueDequeIter dequeIter = queue.begin();
-                for (int j=0; j<iter._prioIndices[i]; j++) {
+                for (uint32_t j=0; j<iter._prioIndices[i]; j++) {
                     EM *msg = *dequeIter;
                     
                     _queueSize -= msg->approximateSize();
@@ -285,8 +296,18 @@ class EmiSendQueue {
     uint8_t *_otherBuf;
     bool _enqueueHeartbeat;
     bool _enqueuePacketAck; // This helps to make sure that we only send one packet ACK per tick
-    EmiPacketSequenceNumber _enqueuedNak;
+    // The lost packet ranges to report in the next packet
+    EmiNakRange _enqueuedNaks[EMI_MAX_NAK_RANGES];
+    size_t _numEnqueuedNaks;
+    // The receive window that was last sent to the other host
+    int64_t _advertisedReceiveWindow;
     BytesSentTheLastNTicks<100> _bytesSentCounter;
+    // See beginBatch
+    bool _batching;
+    bool _flushAfterBatch;
+    // Used by fillPacket. It is an ivar and not a local so that its
+    // memory can be reused between packets.
+    std::vector<EmiChannelQualifier> _acksToErase;
     
 private:
     // Private copy constructor and assignment operator
@@ -297,18 +318,18 @@ private:
         _packetSequenceNumber = (_packetSequenceNumber+1) & EMI_PACKET_SEQUENCE_NUMBER_MASK;
     }
     
-    void sendDatagram(ECC& congestionControl,
+    void sendDatagram(ECC& congestionControl, EmiTimeInterval now,
                       const uint8_t *buf, size_t bufSize) {
-        congestionControl.onDataSent(_packetSequenceNumber, bufSize);
+        congestionControl.onDataSent(now, _packetSequenceNumber, bufSize);
         
         _conn.sendDatagram(buf, bufSize);
         
         _bytesSentCounter.sendData(bufSize);
     }
     
-    void sendMessageInSeparatePacket(ECC& congestionControl, const EM *msg) {
-        const uint8_t *data = Binding::extractData(msg->data);
-        size_t dataLen = Binding::extractLength(msg->data);
+    void sendMessageInSeparatePacket(ECC& congestionControl, EmiTimeInterval now, const EM *msg) {
+        const uint8_t *data = msg->getData();
+        size_t dataLen = msg->getLength();
         
         uint8_t packetBuf[128];
         size_t size = EM::writeControlPacketWithData(msg->flags,
@@ -320,9 +341,13 @@ private:
         ASSERT(0 != size); // size == 0 when the buffer was too small
         
         // Actually send the packet
-        sendDatagram(congestionControl, packetBuf, size);
+        sendDatagram(congestionControl, now, packetBuf, size);
     }
     
+    // Fills packetHeader with what should go into the next packet.
+    // The acks, NAKs, receive window and RTT response that it puts in
+    // the header are not consumed until packetHeaderWasSent is called,
+    // so that they are not lost if the packet is never sent.
     void fillPacketHeaderData(EmiTimeInterval now,
                               ECC& congestionControl,
                               EmiConnTime& connTime,
@@ -330,19 +355,35 @@ private:
         packetHeader.flags |= EMI_SEQUENCE_NUMBER_PACKET_FLAG;
         packetHeader.sequenceNumber = _packetSequenceNumber;
         
+        EmiConnectionId connectionId = _conn.getPacketConnectionId();
+        if (EMI_NO_CONNECTION_ID != connectionId) {
+            packetHeader.extraFlags |= EMI_CONNECTION_ID_EXTRA_PACKET_FLAG;
+            packetHeader.connectionId = connectionId;
+        }
+        
         if (_enqueuePacketAck) {
-            _enqueuePacketAck = false;
-            
             EmiPacketSequenceNumber ack = congestionControl.ack();
             if (-1 != ack) {
                 packetHeader.flags |= EMI_ACK_PACKET_FLAG;
                 packetHeader.ack = ack;
             }
+            
+            // The receive window is sent along with packet acks, because
+            // that's when the other host is sending to us, and whenever
+            // it has changed, so that the other host learns about it
+            // when it opens up again. Like packet acks, it's sent at most
+            // once per tick.
+            uint32_t receiveWindow = (uint32_t)std::min(_conn.receiveWindow(), (size_t)0xffffffff);
+            if (-1 != ack || receiveWindow != _advertisedReceiveWindow) {
+                packetHeader.extraFlags |= EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG;
+                packetHeader.receiveWindow = receiveWindow;
+            }
         }
         
-        if (-1 != _enqueuedNak) {
+        if (0 != _numEnqueuedNaks) {
             packetHeader.flags |= EMI_NAK_PACKET_FLAG;
-            packetHeader.nak = _enqueuedNak;
+            std::copy(_enqueuedNaks, _enqueuedNaks+_numEnqueuedNaks, packetHeader.nakRanges);
+            packetHeader.nakRangeCount = _numEnqueuedNaks;
         }
         
         // Note that we only send RTT requests if a packet would be sent anyways.
@@ -375,7 +416,32 @@ private:
             if (delay > EMI_PACKET_HEADER_MAX_RESPONSE_DELAY) delay = EMI_PACKET_HEADER_MAX_RESPONSE_DELAY;
             
             packetHeader.rttResponseDelay = (uint8_t) std::floor(delay);
-            
+        }
+    }
+    
+    // Consumes what fillPacketHeaderData put in packetHeader, once the
+    // packet has been written and is going to be sent.
+    void packetHeaderWasSent(ECC& congestionControl,
+                             const EmiPacketHeader& packetHeader) {
+        // Packet acks and the receive window are sent at most once per
+        // tick, even when there was no ack to send
+        _enqueuePacketAck = false;
+        
+        if (packetHeader.flags & EMI_ACK_PACKET_FLAG) {
+            congestionControl.ackWasSent(packetHeader.ack);
+        }
+        
+        if (packetHeader.extraFlags & EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG) {
+            _advertisedReceiveWindow = packetHeader.receiveWindow;
+        }
+        
+        if (packetHeader.flags & EMI_NAK_PACKET_FLAG) {
+            // Like packet acks, NAKs are sent once. EmiLossList
+            // reports them again if they are still lost later on.
+            _numEnqueuedNaks = 0;
+        }
+        
+        if (packetHeader.flags & EMI_RTT_RESPONSE_PACKET_FLAG) {
             _rttResponseSequenceNumber = -1;
             _rttResponseRegisterTime = 0;
         }
@@ -449,11 +515,11 @@ private:
                                           bufLength, /* bufSize */
                                           pos, /* offset */
                                           hasAck, /* hasAck */
-                                          hasAck && (*curAck).second, /* ack */
+                                          (hasAck ? (*curAck).second : 0), /* ack */
                                           msg->channelQualifier,
                                           msg->nonWrappingSequenceNumber & EMI_HEADER_SEQUENCE_NUMBER_MASK,
-                                          Binding::extractData(msg->data),
-                                          Binding::extractLength(msg->data),
+                                          msg->getData(),
+                                          msg->getLength(),
                                           msg->flags);
             
             // msgSize is 0 if the message did not fit in the buffer
@@ -480,7 +546,7 @@ private:
         /// enqueued but was not sent along with actual data.
         SendQueueAcksMapIter ackIter = _acks.begin();
         SendQueueAcksMapIter ackEnd = _acks.end();
-        std::vector<EmiChannelQualifier> acksToErase;
+        _acksToErase.clear();
         while (ackIter != ackEnd) {
             EmiChannelQualifier cq = (*ackIter).first;
             
@@ -509,15 +575,15 @@ private:
                 pos += msgSize;
                 _acksSentInThisTick.insert(cq);
                 // We can't _acks.erase(cq), because that invalidates ackIter
-                acksToErase.push_back(cq);
+                _acksToErase.push_back(cq);
             }
             
             ++ackIter;
         }
         
         {
-            std::vector<EmiChannelQualifier>::iterator iter = acksToErase.begin();
-            std::vector<EmiChannelQualifier>::iterator end  = acksToErase.end();
+            std::vector<EmiChannelQualifier>::iterator iter = _acksToErase.begin();
+            std::vector<EmiChannelQualifier>::iterator end  = _acksToErase.end();
             while (iter != end) {
                 EmiChannelQualifier cq = *iter;
                 _acks.erase(cq);
@@ -529,6 +595,7 @@ private:
             ASSERT(pos <= bufLength);
             
             _queue.eraseUntil(iter);
+            packetHeaderWasSent(congestionControl, packetHeader);
             
             // Return non-zero to signify that a packet was written
             return pos;
@@ -549,7 +616,7 @@ private:
             return false;
         }
         else {
-            sendDatagram(congestionControl, _buf, packetSize);
+            sendDatagram(congestionControl, now, _buf, packetSize);
             incrementSequenceNumber();
             
             return true;
@@ -558,15 +625,22 @@ private:
     
 public:
     
-    EmiSendQueue(EC& conn, size_t mtu) :
+    EmiSendQueue(EC& conn, size_t mtu, EmiObjectPool& pool) :
     _conn(conn),
     _packetSequenceNumber(EmiNetRandom<Binding>::random() & EMI_PACKET_SEQUENCE_NUMBER_MASK),
     _rttResponseSequenceNumber(-1),
     _rttResponseRegisterTime(0),
+    _queue(pool),
+    _acks(std::less<EmiChannelQualifier>(), EmiPoolAllocator<SendQueueAcksMapValue>(&pool)),
+    _acksSentInThisTick(std::less<EmiChannelQualifier>(), EmiPoolAllocator<EmiChannelQualifier>(&pool)),
     _enqueueHeartbeat(false),
     _enqueuePacketAck(false),
-    _enqueuedNak(-1),
-    _bytesSentCounter() {
+    _numEnqueuedNaks(0),
+    _advertisedReceiveWindow(-1),
+    _bytesSentCounter(),
+    _batching(false),
+    _flushAfterBatch(false),
+    _acksToErase() {
         _bufLength = mtu;
         _buf = (uint8_t *)malloc(_bufLength*2);
         _otherBuf = _buf+_bufLength;
@@ -587,8 +661,12 @@ public:
         _enqueueHeartbeat = true;
     }
     
-    void enqueueNak(EmiPacketSequenceNumber nak) {
-        _enqueuedNak = nak;
+    // Replaces any NAKs that have been enqueued but not yet sent
+    void enqueueNaks(const EmiNakRange *naks, size_t numNaks) {
+        ASSERT(EMI_MAX_NAK_RANGES >= numNaks);
+        
+        std::copy(naks, naks+numNaks, _enqueuedNaks);
+        _numEnqueuedNaks = numNaks;
     }
     
     // Returns the number of bytes sent
@@ -598,12 +676,16 @@ public:
         EmiPacketHeader ph;
         fillPacketHeaderData(now, congestionControl, connTime, ph);
         
-        uint8_t buf[32];
+        uint8_t buf[EMI_PACKET_HEADER_MAX_LENGTH];
         size_t packetLength;
-        EmiPacketHeader::write(buf, sizeof(buf), ph, &packetLength);
+        if (!EmiPacketHeader::write(buf, sizeof(buf), ph, &packetLength)) {
+            ASSERT(false && "The heartbeat header didn't fit in its buffer");
+            return 0;
+        }
         
         if (_conn.isOpen()) {
-            sendDatagram(congestionControl, buf, packetLength);
+            packetHeaderWasSent(congestionControl, ph);
+            sendDatagram(congestionControl, now, buf, packetLength);
             incrementSequenceNumber();
         }
         
@@ -651,7 +733,7 @@ public:
                 if (0 == secondPacketSize) {
                     // There was no data to send for the second packet. Don't
                     // send a packet pair.
-                    sendDatagram(congestionControl, _buf, firstPacketSize);
+                    sendDatagram(congestionControl, now, _buf, firstPacketSize);
                 }
                 else {
                     // Increment the sequence number, to account for the second packet
@@ -670,8 +752,8 @@ public:
                                                         biggestPacketSize-smallestPacketSize);
                     }
                     
-                    sendDatagram(congestionControl, _buf,      biggestPacketSize);
-                    sendDatagram(congestionControl, _otherBuf, biggestPacketSize);
+                    sendDatagram(congestionControl, now, _buf,      biggestPacketSize);
+                    sendDatagram(congestionControl, now, _otherBuf, biggestPacketSize);
                 }
                 
                 return true;
@@ -723,13 +805,13 @@ public:
                         ECC& congestionControl,
                         EmiConnTime& connTime,
                         EmiTimeInterval now,
-                        Error& err) {
+                        Error& /*err*/) {
         if (msg->flags & (EMI_PRX_FLAG | EMI_RST_FLAG | EMI_SYN_FLAG)) {
             // This is a control message, one that cannot be bundled with
             // other messages. We might just as well send it right away.
             //
             // Control messages are not congestion controlled.
-            sendMessageInSeparatePacket(congestionControl, msg);
+            sendMessageInSeparatePacket(congestionControl, now, msg);
         }
         else {
             size_t msgSize = msg->approximateSize();
@@ -741,16 +823,44 @@ public:
             // mss is short for maximum segment size.
             size_t mss = _bufLength - EMI_PACKET_HEADER_MAX_LENGTH - EMI_UDP_HEADER_SIZE;
             if (_queue.sizeInBytes() + msgSize >= mss ||
-                EMI_PRIORITY_IMMEDIATE == msg->priority ||
                 FORCE_ONE_MESSAGE_PER_PACKET) {
                 flush(congestionControl, connTime, now);
             }
+            else if (EMI_PRIORITY_IMMEDIATE == msg->priority) {
+                if (_batching) {
+                    _flushAfterBatch = true;
+                }
+                else {
+                    flush(congestionControl, connTime, now);
+                }
+            }
             
             _queue.push(msg);
         }
         
         return true;
     }
+    
+    // Between beginBatch and endBatch, enqueueMessage only flushes the
+    // queue when a packet is full. Messages with EMI_PRIORITY_IMMEDIATE
+    // don't cause a flush of their own; instead, endBatch flushes once
+    // if any of them were enqueued. This lets a batch of messages be
+    // bundled into as few packets as possible.
+    void beginBatch() {
+        _batching = true;
+        _flushAfterBatch = false;
+    }
+    
+    void endBatch(ECC& congestionControl,
+                  EmiConnTime& connTime,
+                  EmiTimeInterval now) {
+        _batching = false;
+        
+        if (_flushAfterBatch) {
+            _flushAfterBatch = false;
+            flush(congestionControl, connTime, now);
+        }
+    }
 };
 
 #endif
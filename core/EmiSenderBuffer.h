@@ -12,94 +12,346 @@
 #include "EmiMessage.h"
 #include "EmiNetUtil.h"
 
-#include <set>
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
+// The sender buffer keeps every reliable message that has been sent but
+// not yet acked.
+//
+// Messages are kept in one ring buffer per channel. Messages on a
+// channel are registered in sequence number order and acks always
+// remove a prefix of a channel ("everything up to and including this
+// sequence number"), so registering and deregistering a message are
+// both O(1).
+//
+// Reliable messages are not sent as soon as they are registered; they
+// are held in a queue until the other host's receive window (the free
+// space in its receiver buffer, which it advertises in the packet
+// header) has room for them. Messages that don't fit into the other
+// host's receiver buffer would be dropped by it and would have to be
+// resent on RTO, which the congestion control would take as a sign of
+// congestion. A message that has been released from the queue is said
+// to be in flight until it is acked.
+//
+// Only the oldest message of each channel is a candidate for
+// retransmission. These messages are kept in a timing wheel that is
+// bucketed on the time the message was last (re)sent. This lets
+// eachCurrentMessage find the messages that have timed out without
+// scanning or rebalancing anything.
 template<class Binding>
 class EmiSenderBuffer {
     typedef typename Binding::Error Error;
     typedef EmiMessage<Binding>     EM;
     
-    struct NextMsgTreeCmp {
-        inline bool operator()(const EM *a, const EM *b) const {
-            EmiTimeInterval art = a->registrationTime;
-            EmiTimeInterval brt = b->registrationTime;
-            
-            if (art != brt) return art < brt;
-            else {
-                int32_t acq = a->channelQualifier;
-                int32_t bcq = b->channelQualifier;
-                
-                if (acq != bcq) return acq < bcq;
-                else {
-                    return a->nonWrappingSequenceNumber < b->nonWrappingSequenceNumber;
-                }
+    // All EmiChannelQualifier values, plus EMI_CONTROL_CHANNEL
+    static const size_t NUM_CHANNEL_QUALIFIERS = 257;
+    
+    // The timing wheel has WHEEL_SIZE buckets, each wheelGranularity()
+    // seconds wide. Messages that are further into the future than the
+    // wheel spans simply share bucket with earlier messages; they are
+    // skipped until they are due. WHEEL_SIZE must be a power of two.
+    static const size_t WHEEL_SIZE = 64;
+    static const int16_t NO_CHANNEL = -1;
+    inline static EmiTimeInterval wheelGranularity() {
+        return EMI_MIN_RTO/4;
+    }
+    
+    // A circular buffer of messages. It is used for the unacked messages
+    // of each channel, sorted by sequence number, and for the held
+    // messages. Once it has grown to its working size, pushing and
+    // popping messages doesn't allocate memory, unlike std::deque.
+    class MessageRing {
+        std::vector<EM *> _buf;
+        size_t _start;
+        size_t _count;
+        
+        void grow() {
+            std::vector<EM *> newBuf(_buf.empty() ? 8 : _buf.size()*2, (EM *)NULL);
+            for (size_t i=0; i<_count; i++) {
+                newBuf[i] = at(i);
             }
+            _buf.swap(newBuf);
+            _start = 0;
         }
-    };
     
-    struct SendBufferCmp {
-        inline bool operator()(const EM *a, const EM *b) const {
-            int32_t acq = a->channelQualifier;
-            int32_t bcq = b->channelQualifier;
-            
-            if (acq != bcq) return acq < bcq;
-            else {
-                return a->nonWrappingSequenceNumber < b->nonWrappingSequenceNumber;
+    public:
+        MessageRing() : _buf(), _start(0), _count(0) {}
+        
+        inline size_t size() const { return _count; }
+        inline bool empty() const { return 0 == _count; }
+        
+        inline EM *at(size_t idx) const {
+            return _buf[(_start+idx) & (_buf.size()-1)];
+        }
+        inline EM *front() const { return at(0); }
+        inline EM *back() const { return at(_count-1); }
+        
+        inline void pushBack(EM *msg) {
+            if (_count == _buf.size()) grow();
+            _buf[(_start+_count) & (_buf.size()-1)] = msg;
+            _count++;
+        }
+        
+        inline EM *popFront() {
+            EM *msg = front();
+            _buf[_start] = NULL;
+            _start = (_start+1) & (_buf.size()-1);
+            _count--;
+            return msg;
+        }
+        
+        // Inserts msg at position idx, moving the messages after
+        // it one step towards the back. This is O(n), but it is only
+        // used when messages are registered out of order, which the
+        // rest of the code does not do.
+        void insert(size_t idx, EM *msg) {
+            pushBack(msg);
+            for (size_t i=_count-1; i>idx; i--) {
+                _buf[(_start+i) & (_buf.size()-1)] = at(i-1);
             }
+            _buf[(_start+idx) & (_buf.size()-1)] = msg;
         }
     };
     
-    typedef std::vector<EM *> EmiMessageVector;
-    typedef std::set<EM *, NextMsgTreeCmp>      NextMsgTree;
-    typedef std::set<EM *, SendBufferCmp>       SendBuffer;
-    typedef typename EmiMessageVector::iterator EmiMessageVectorIter;
-    typedef typename NextMsgTree::iterator      NextMsgTreeIter;
-    typedef typename SendBuffer::iterator       SendBufferIter;
+    struct Channel {
+        Channel(int32_t channelQualifier_) :
+        channelQualifier(channelQualifier_),
+        messages(),
+        wheelBucket(0),
+        wheelPrev(NO_CHANNEL),
+        wheelNext(NO_CHANNEL) {}
+        
+        int32_t channelQualifier;
+        MessageRing messages;
+        
+        // Timing wheel linkage. Only valid when messages is not empty.
+        size_t  wheelBucket;
+        int16_t wheelPrev;
+        int16_t wheelNext;
+    };
+    
+    typedef std::vector<Channel>      ChannelVector;
+    typedef std::vector<int16_t>      ChannelIdxVector;
+    typedef typename ChannelIdxVector::iterator ChannelIdxVectorIter;
     
     // Buffer max size
     size_t _size;
-    
-    // Contains at most one message per channel. It is sorted by regTime
-    NextMsgTree _nextMsgTree;
-    // contains all messages in the reliable buffer. It is sorted by
-    // channelQualifier and sequenceNumber
-    SendBuffer _sendBuffer;
     size_t _sendBufferSize;
+    size_t _numMessages;
+    
+    // Messages that are registered but have not been released yet,
+    // oldest first. See releaseHeldMessages.
+    MessageRing _heldMessages;
+    // The part of _sendBufferSize that is in flight
+    size_t _inFlightSize;
+    // The latest receive window that the other host advertised.
+    // (size_t)-1 until it has advertised one.
+    size_t _receiveWindow;
+    
+    // Only the channels that have been used are allocated. _channelIndices
+    // maps channelQualifier+1 to an index in _channels, or NO_CHANNEL.
+    ChannelVector _channels;
+    int16_t _channelIndices[NUM_CHANNEL_QUALIFIERS];
+    
+    // Each bucket is a doubly linked list of channel indices
+    int16_t _wheel[WHEEL_SIZE];
+    // No channel in the wheel has a bucket time that is earlier than
+    // this. Measured in units of wheelGranularity().
+    int64_t _wheelTick;
+    size_t  _wheelCount;
+    
+    // Used by eachCurrentMessage. It is an ivar and not a local so that
+    // its memory can be reused between invocations.
+    ChannelIdxVector _toBePushedToTheEnd;
     
 private:
     // Private copy constructor and assignment operator
     inline EmiSenderBuffer(const EmiSenderBuffer& other);
     inline EmiSenderBuffer& operator=(const EmiSenderBuffer& other);
     
-    EM *messageSearch(EM *messageStub) {
-        SendBufferIter iter = _sendBuffer.lower_bound(messageStub);
-        SendBufferIter end  = _sendBuffer.end();
+    size_t messageSize(size_t dataSize, size_t numMessages = 1) {
+        return dataSize + numMessages*EM::maximalHeaderSize();
+    }
+    
+    inline static int64_t timeToTick(EmiTimeInterval time) {
+        return (int64_t)std::floor(time/wheelGranularity());
+    }
+    
+    // Returns NULL if the channel has not been used
+    Channel *findChannel(int32_t channelQualifier) {
+        ASSERT(channelQualifier >= -1 && channelQualifier < (int32_t)NUM_CHANNEL_QUALIFIERS-1);
         
-        // We need to look at both *iter and *(++iter), and of course
-        // also guard for if we reach end. That's what this loop does.
-        for (int i=0; iter != end && i<2; i++) {
-            if (messageStub->channelQualifier == (*iter)->channelQualifier) return *iter;
-            ++iter;
+        int16_t idx = _channelIndices[channelQualifier+1];
+        return (NO_CHANNEL == idx ? NULL : &_channels[idx]);
+    }
+    
+    int16_t channelIndexForChannelQualifier(int32_t channelQualifier) {
+        ASSERT(channelQualifier >= -1 && channelQualifier < (int32_t)NUM_CHANNEL_QUALIFIERS-1);
+        
+        int16_t& idx(_channelIndices[channelQualifier+1]);
+        if (NO_CHANNEL == idx) {
+            idx = _channels.size();
+            _channels.push_back(Channel(channelQualifier));
+        }
+        return idx;
+    }
+    
+    inline int16_t channelIndex(const Channel& channel) const {
+        return &channel - &_channels[0];
+    }
+    
+    // Inserts the channel into the timing wheel, based on the
+    // registrationTime of the oldest message of the channel.
+    void wheelInsert(int16_t idx) {
+        Channel& channel(_channels[idx]);
+        ASSERT(!channel.messages.empty());
+        
+        int64_t tick = timeToTick(channel.messages.front()->registrationTime);
+        if (0 == _wheelCount) {
+            _wheelTick = tick;
+        }
+        else if (tick < _wheelTick) {
+            // This happens when the oldest message of a channel is
+            // acked, and the new oldest message was sent before
+            // the time that the wheel has already passed. It is then
+            // overdue, so it is put in the first bucket to be looked at.
+            tick = _wheelTick;
+        }
+        
+        size_t bucket = tick & (WHEEL_SIZE-1);
+        channel.wheelBucket = bucket;
+        channel.wheelPrev = NO_CHANNEL;
+        channel.wheelNext = _wheel[bucket];
+        if (NO_CHANNEL != _wheel[bucket]) {
+            _channels[_wheel[bucket]].wheelPrev = idx;
         }
+        _wheel[bucket] = idx;
         
-        return NULL;
+        _wheelCount++;
     }
     
-    size_t messageSize(size_t dataSize, size_t numMessages = 1) {
-        return dataSize + numMessages*EM::maximalHeaderSize();
+    void wheelRemove(int16_t idx) {
+        Channel& channel(_channels[idx]);
+        
+        if (NO_CHANNEL == channel.wheelPrev) {
+            ASSERT(idx == _wheel[channel.wheelBucket]);
+            _wheel[channel.wheelBucket] = channel.wheelNext;
+        }
+        else {
+            _channels[channel.wheelPrev].wheelNext = channel.wheelNext;
+        }
+        
+        if (NO_CHANNEL != channel.wheelNext) {
+            _channels[channel.wheelNext].wheelPrev = channel.wheelPrev;
+        }
+        
+        channel.wheelPrev = NO_CHANNEL;
+        channel.wheelNext = NO_CHANNEL;
+        
+        ASSERT(0 != _wheelCount);
+        _wheelCount--;
+    }
+    
+    // This is O(n) in the number of held messages
+    void deregisterHeldMessages(int32_t channelQualifier,
+                                EmiNonWrappingSequenceNumber nonWrappingSequenceNumber) {
+        // Rotate through the ring once, putting back the messages that
+        // are kept. That keeps their order.
+        size_t numHeldMessages = _heldMessages.size();
+        for (size_t i=0; i<numHeldMessages; i++) {
+            EM *msg = _heldMessages.popFront();
+            
+            if (msg->channelQualifier == channelQualifier &&
+                msg->nonWrappingSequenceNumber <= nonWrappingSequenceNumber) {
+                _sendBufferSize -= messageSize(msg->getLength());
+                _numMessages--;
+                
+                msg->release();
+            }
+            else {
+                _heldMessages.pushBack(msg);
+            }
+        }
+    }
+    
+    // Inserts a message that is released from _heldMessages into the
+    // ring of its channel. Returns false if the message is already in
+    // the ring.
+    bool insertInFlightMessage(EM *message, EmiTimeInterval now) {
+        message->registrationTime = now;
+        
+        int16_t idx = channelIndexForChannelQualifier(message->channelQualifier);
+        MessageRing& messages(_channels[idx].messages);
+        EmiNonWrappingSequenceNumber sn = message->nonWrappingSequenceNumber;
+        
+        if (messages.empty()) {
+            messages.pushBack(message);
+            wheelInsert(idx);
+        }
+        else if (messages.back()->nonWrappingSequenceNumber < sn) {
+            // This is the common case
+            messages.pushBack(message);
+        }
+        else {
+            // Find the position of the message, searching from the back
+            size_t pos = messages.size();
+            while (pos > 0 && messages.at(pos-1)->nonWrappingSequenceNumber >= sn) {
+                if (messages.at(pos-1)->nonWrappingSequenceNumber == sn) {
+                    return false;
+                }
+                pos--;
+            }
+            
+            if (0 == pos) {
+                // The message becomes the oldest message of the
+                // channel, so its position in the wheel changes
+                wheelRemove(idx);
+                messages.insert(pos, message);
+                wheelInsert(idx);
+            }
+            else {
+                messages.insert(pos, message);
+            }
+        }
+        
+        return true;
     }
     
 public:
     
-    EmiSenderBuffer(size_t size) : _size(size), _sendBufferSize(0) {}
+    EmiSenderBuffer(size_t size) :
+    _size(size),
+    _sendBufferSize(0),
+    _numMessages(0),
+    _heldMessages(),
+    _inFlightSize(0),
+    _receiveWindow((size_t)-1),
+    _channels(),
+    _wheelTick(0),
+    _wheelCount(0),
+    _toBePushedToTheEnd() {
+        for (size_t i=0; i<NUM_CHANNEL_QUALIFIERS; i++) {
+            _channelIndices[i] = NO_CHANNEL;
+        }
+        for (size_t i=0; i<WHEEL_SIZE; i++) {
+            _wheel[i] = NO_CHANNEL;
+        }
+    }
     virtual ~EmiSenderBuffer() {
-        SendBufferIter iter = _sendBuffer.begin();
-        SendBufferIter end  = _sendBuffer.end();
+        typename ChannelVector::iterator iter = _channels.begin();
+        typename ChannelVector::iterator end  = _channels.end();
         while (iter != end) {
-            (*iter)->release();
+            MessageRing& messages((*iter).messages);
+            while (!messages.empty()) {
+                messages.popFront()->release();
+            }
             ++iter;
         }
+        
+        while (!_heldMessages.empty()) {
+            _heldMessages.popFront()->release();
+        }
     }
     
     bool fitsIntoBuffer(size_t dataSize, size_t numMessages) {
@@ -107,143 +359,166 @@ public:
     }
     
     // Returns false if the buffer didn't have space for the message
-    bool registerReliableMessage(EM *message, Error& err, EmiTimeInterval now) {
-        size_t msgSize = messageSize(Binding::extractLength(message->data));
+    //
+    // The message is held until releaseHeldMessages releases it.
+    bool registerReliableMessage(EM *message, Error& err) {
+        size_t msgSize = messageSize(message->getLength());
         
         if (_sendBufferSize+msgSize > _size) {
             err = Binding::makeError("com.emilir.eminet.sendbufferoverflow", 0);
             return false;
         }
         
-        message->registrationTime = now;
-        
-        // Check if there already is a message with this channel qualifier in the buffer
-        if (NULL == messageSearch(message)) {
-            // Only add to _nextMsgTree if there wasn't already a message for that connection id
-            // and channel id in the system.
-            _nextMsgTree.insert(message);
-        }
-        
-        bool wasInserted = _sendBuffer.insert(message).second;
-        if (wasInserted) {
-            message->retain();
-            _sendBufferSize += msgSize;
-        }
+        message->retain();
+        _heldMessages.pushBack(message);
+        _sendBufferSize += msgSize;
+        _numMessages++;
         
         return true;
     }
     
-    // Deregisters all messages on the particular channelQualifier
-    // whose sequenceNumber <= sequenceNumber
+    // Releases held messages, oldest first, for as long as they fit into
+    // the other host's receive window. Invokes
+    // delegate.releaseHeldMessagesIteration(now, msg) for each message,
+    // which is expected to send it.
     //
-    // channelQualifier is int32_t to be able to contain -1, which
-    // is a special control message channel.
-    void deregisterReliableMessages(int32_t channelQualifier,
-                                    EmiNonWrappingSequenceNumber nonWrappingSequenceNumber) {
-        EM msgStub;
-        msgStub.channelQualifier          = channelQualifier;
-        msgStub.nonWrappingSequenceNumber = nonWrappingSequenceNumber;
-        
-        SendBufferIter begin = _sendBuffer.begin();
-        SendBufferIter iter  = _sendBuffer.lower_bound(&msgStub);
-        
-        if (iter == _sendBuffer.end()) return;
-        
-        EmiMessageVector toBeRemoved;
-        do {
-            EM *msg = *iter;
+    // One message is always allowed to be in flight, even if it's larger
+    // than the receive window. Otherwise, a connection whose receive
+    // window is smaller than a message would never be able to send it.
+    // It also makes sure that the other host will eventually send us a
+    // new receive window if it has advertised a window of 0.
+    template<class Delegate>
+    void releaseHeldMessages(EmiTimeInterval now, Delegate& delegate) {
+        while (!_heldMessages.empty()) {
+            EM *message = _heldMessages.front();
+            size_t msgSize = messageSize(message->getLength());
             
-            if (channelQualifier != msg->channelQualifier) {
+            if (0 != _inFlightSize && _inFlightSize+msgSize > _receiveWindow) {
                 break;
             }
-            if (msg->nonWrappingSequenceNumber > nonWrappingSequenceNumber) {
-                // This can happen because we used lower_bound.
-                // It should not happen more than once, though.
-                //
-                // We do not continue; here, because that would
-                // iterate the loop without decrementing iter,
-                // resulting in an infinite loop.
+            
+            _heldMessages.popFront();
+            
+            bool inserted = insertInFlightMessage(message, now);
+            if (inserted) {
+                // The channel's ring now owns the held reference
+                _inFlightSize += msgSize;
             }
             else {
-                toBeRemoved.push_back(msg);
+                // The message was already in flight
+                _sendBufferSize -= msgSize;
+                _numMessages--;
             }
             
-            if (iter == begin) break;
+            delegate.releaseHeldMessagesIteration(now, message);
             
-            --iter;
-        } while (1);
+            if (!inserted) {
+                message->release();
+            }
+        }
+    }
+    
+    // Sets the other host's receive window, as advertised in the packet
+    // header. releaseHeldMessages should be invoked after this.
+    void setReceiveWindow(size_t receiveWindow) {
+        _receiveWindow = receiveWindow;
+    }
+    
+    // Deregisters all messages on the particular channelQualifier
+    // whose sequenceNumber <= sequenceNumber
+    //
+    // channelQualifier is int32_t to be able to contain -1, which
+    // is a special control message channel.
+    void deregisterReliableMessages(int32_t channelQualifier,
+                                    EmiNonWrappingSequenceNumber nonWrappingSequenceNumber) {
+        if (!_heldMessages.empty()) {
+            // This happens on reliable sequenced channels, whose older
+            // messages are deregistered when a new message is sent.
+            // There is no point in sending them anymore.
+            deregisterHeldMessages(channelQualifier, nonWrappingSequenceNumber);
+        }
         
-        bool wasInReliableTree = false;
+        Channel *channel = findChannel(channelQualifier);
+        if (!channel) return;
         
-        EmiMessageVectorIter viter = toBeRemoved.begin();
-        EmiMessageVectorIter vend = toBeRemoved.end();
-        while (viter != vend) {
-            EM *msg = *viter;
-            
-            bool wasRemovedFromSendBuffer = (0 != _sendBuffer.erase(msg));
-            ASSERT(wasRemovedFromSendBuffer);
-            
-            _sendBufferSize -= messageSize(Binding::extractLength(msg->data));
+        MessageRing& messages(channel->messages);
+        if (messages.empty() ||
+            messages.front()->nonWrappingSequenceNumber > nonWrappingSequenceNumber) {
+            return;
+        }
+        
+        int16_t idx = channelIndex(*channel);
+        wheelRemove(idx);
+        
+        while (!messages.empty() &&
+               messages.front()->nonWrappingSequenceNumber <= nonWrappingSequenceNumber) {
+            EM *msg = messages.popFront();
             
-            bool wasRemovedFromNextMsgTree = 0 != _nextMsgTree.erase(msg);
-            wasInReliableTree = wasRemovedFromNextMsgTree || wasInReliableTree;
+            size_t msgSize = messageSize(msg->getLength());
+            _sendBufferSize -= msgSize;
+            _inFlightSize -= msgSize;
+            _numMessages--;
             
             msg->release();
-            
-            ++viter;
         }
         
-        if (wasInReliableTree) {
-            EM *newMsg = messageSearch(&msgStub);
-            if (newMsg) _nextMsgTree.insert(newMsg);
+        if (!messages.empty()) {
+            wheelInsert(idx);
         }
     }
     
     bool empty() const {
-        return _nextMsgTree.empty();
+        return 0 == _numMessages;
     }
     
     template<class Delegate>
     void eachCurrentMessage(EmiTimeInterval now, EmiTimeInterval rto,
                             Delegate& delegate) {
-        NextMsgTreeIter iter = _nextMsgTree.begin();
-        NextMsgTreeIter end = _nextMsgTree.end();
+        if (0 == _wheelCount) return;
         
-        EmiMessageVector toBePushedToTheEnd;
+        // Messages that were sent at or before this tick might be due
+        // for retransmission. The bucket of _wheelTick is always looked
+        // at, because it might contain overdue messages; see wheelInsert.
+        int64_t lastTick = timeToTick(now-rto);
+        int64_t numTicks = std::min((int64_t)WHEEL_SIZE,
+                                    std::max((int64_t)0, lastTick-_wheelTick)+1);
         
-        while (iter != end) {
-            EM *msg = *iter;
+        _toBePushedToTheEnd.clear();
+        
+        for (int64_t tick=_wheelTick; tick<_wheelTick+numTicks; tick++) {
+            int16_t idx = _wheel[tick & (WHEEL_SIZE-1)];
             
-            if (rto > now-msg->registrationTime) {
-                // This message was sent less than RTO ago
-                break;
+            while (NO_CHANNEL != idx) {
+                Channel& channel(_channels[idx]);
+                int16_t nextIdx = channel.wheelNext;
+                
+                EM *msg = channel.messages.front();
+                if (rto <= now-msg->registrationTime) {
+                    // Since we're iterating the wheel, we
+                    // can't reinsert the channel here. Do it later.
+                    wheelRemove(idx);
+                    _toBePushedToTheEnd.push_back(idx);
+                    
+                    delegate.eachCurrentMessageIteration(now, msg);
+                }
+                
+                idx = nextIdx;
             }
-            
-            // Since we're iterating _nextMsgTree, we
-            // can't modify it here. Do it later.
-            toBePushedToTheEnd.push_back(msg);
-            
-            delegate.eachCurrentMessageIteration(now, msg);
-            
-            ++iter;
         }
         
-        EmiMessageVectorIter viter = toBePushedToTheEnd.begin();
-        EmiMessageVectorIter vend  = toBePushedToTheEnd.end();
+        // No message in the wheel that was registered before lastTick
+        // can remain in it now.
+        if (lastTick > _wheelTick) {
+            _wheelTick = lastTick;
+        }
+        
+        ChannelIdxVectorIter viter = _toBePushedToTheEnd.begin();
+        ChannelIdxVectorIter vend  = _toBePushedToTheEnd.end();
         while (viter != vend) {
-            EM *msg = *viter;
-            
-            // We want to update msg->registrationTime, but because
-            // _nextMsgTree's ordering depends on it, we can't change
-            // it while the object is in _nextMsgTree
-            
-            bool wasRemovedFromNextMsgTree = 0 != _nextMsgTree.erase(msg);
-            ASSERT(wasRemovedFromNextMsgTree);
-            
-            msg->registrationTime = now;
+            int16_t idx = *viter;
             
-            bool wasInserted = _nextMsgTree.insert(msg).second;
-            ASSERT(wasInserted);
+            _channels[idx].messages.front()->registrationTime = now;
+            wheelInsert(idx);
             
             ++viter;
         }
@@ -0,0 +1,102 @@
+//
+//  EmiSipHash.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiSipHash_h
+#define eminet_EmiSipHash_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+
+// SipHash-2-4, the keyed pseudorandom function by Jean-Philippe Aumasson
+// and Daniel J. Bernstein. It is used to hash keys that an attacker can
+// choose, such as the remote address of a datagram. Without knowing
+// the key, it is not feasible to find inputs whose hashes collide, so
+// hash tables that are keyed with a random key can't be flooded with
+// colliding entries.
+class EmiSipHash {
+public:
+    // The 128 bit key
+    struct Key {
+        uint64_t k0;
+        uint64_t k1;
+        
+        Key() : k0(0), k1(0) {}
+        Key(uint64_t k0_, uint64_t k1_) : k0(k0_), k1(k1_) {}
+    };
+    
+    // Returns a key made with Binding::randomBytes
+    template<class Binding>
+    static Key randomKey() {
+        uint8_t buf[16];
+        Binding::randomBytes(buf, sizeof(buf));
+        return Key(read64(buf), read64(buf+8));
+    }
+    
+private:
+    inline EmiSipHash();
+    
+    inline static uint64_t rotl(uint64_t x, int b) {
+        return (x << b) | (x >> (64-b));
+    }
+    
+    // Little endian, regardless of the byte order of the host
+    inline static uint64_t read64(const uint8_t *buf) {
+        return (((uint64_t)buf[0] <<  0) |
+                ((uint64_t)buf[1] <<  8) |
+                ((uint64_t)buf[2] << 16) |
+                ((uint64_t)buf[3] << 24) |
+                ((uint64_t)buf[4] << 32) |
+                ((uint64_t)buf[5] << 40) |
+                ((uint64_t)buf[6] << 48) |
+                ((uint64_t)buf[7] << 56));
+    }
+    
+    inline static void round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    }
+    
+public:
+    inline static uint64_t hash(const Key& key, const uint8_t *data, size_t length) {
+        uint64_t v0 = key.k0 ^ 0x736f6d6570736575ULL;
+        uint64_t v1 = key.k1 ^ 0x646f72616e646f6dULL;
+        uint64_t v2 = key.k0 ^ 0x6c7967656e657261ULL;
+        uint64_t v3 = key.k1 ^ 0x7465646279746573ULL;
+        
+        const uint8_t *end = data + (length & ~(size_t)7);
+        for (; data != end; data += 8) {
+            uint64_t m = read64(data);
+            v3 ^= m;
+            round(v0, v1, v2, v3);
+            round(v0, v1, v2, v3);
+            v0 ^= m;
+        }
+        
+        // The last block holds the remaining bytes and the length
+        uint8_t last[8] = { 0 };
+        memcpy(last, data, length & 7);
+        uint64_t m = read64(last) | ((uint64_t)length << 56);
+        v3 ^= m;
+        round(v0, v1, v2, v3);
+        round(v0, v1, v2, v3);
+        v0 ^= m;
+        
+        v2 ^= 0xff;
+        round(v0, v1, v2, v3);
+        round(v0, v1, v2, v3);
+        round(v0, v1, v2, v3);
+        round(v0, v1, v2, v3);
+        
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+};
+
+#endif
@@ -13,15 +13,18 @@
 #include "EmiSendQueue.h"
 #include "EmiSockConfig.h"
 #include "EmiConnParams.h"
-#include "EmiAddressCmp.h"
+#include "EmiAddressKey.h"
+#include "EmiHashTable.h"
 #include "EmiUdpSocket.h"
 #include "EmiNetUtil.h"
 #include "EmiNetRandom.h"
 #include "EmiMessageHandler.h"
 
-#include <map>
 #include <set>
+#include <vector>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <netinet/in.h>
 
 // About thread safety in EmiNet:
@@ -59,26 +62,69 @@
 //    EmiSock thread. (This does not happen automatically, because
 //    deregisterServerConnection should be called from
 //    ConnDelegate::invalidate, which is invoked in an EmiConn thread)
+//    The same goes for EmiSock::serverConnectionMoved, which should be
+//    called from ConnDelegate::emiConnMoved.
 // 3) SockDelegate::connectionGotMessage must invoke EmiConn::onMessage
 //    in the EmiConn thread, preferably asynchronously (or the
 //    performance gain will be lost).
+// 4) SockDelegate::batchConnectionTicks may only return true if the
+//    server connections are accessed from the EmiSock thread, because
+//    the EmiSock will then tick its server connections itself.
+//
+// To use more than one core for a server, open one EmiSock per thread
+// (or process) on the same port, with config.reusePort set. The kernel
+// steers each flow to one of the EmiSocks by a hash of its addresses
+// and ports, so each EmiSock has its own connections, and a connection
+// never moves between EmiSocks. The EmiSocks don't share any state, so
+// this does not require any locking.
+//
+// The exception is clients that change address. The hash of their new
+// address will most likely steer their datagrams to another EmiSock.
+// To let them migrate, config.reusePortShards must be set to the
+// number of EmiSocks that share the port, and config.reusePortShard to
+// a number of each one's own, from 0 up. An EmiSock only hands out
+// connection IDs that are its shard number modulo the number of
+// shards, and the binding steers datagrams that carry a connection ID
+// to socket number (connection ID % reusePortShards) of the port (on
+// Linux, the node binding does this with SO_ATTACH_REUSEPORT_CBPF).
+// The kernel numbers the sockets in the order they were bound, so the
+// EmiSocks must be opened in the order of their shard numbers, and an
+// EmiSock that is closed must be replaced before any other is opened.
+//
+// Where the binding can't steer datagrams like this, a datagram that
+// carries the connection ID of another shard is dropped, because
+// replying with a SYN-RST-ACK would make the client close a connection
+// that is alive. Clients that change address then time out instead of
+// being able to migrate.
 template<class SockDelegate, class ConnDelegate>
 class EmiSock {
     typedef typename SockDelegate::Binding     Binding;
     typedef typename Binding::Error            Error;
     typedef typename Binding::TemporaryData    TemporaryData;
+    typedef typename Binding::PersistentData   PersistentData;
     typedef typename Binding::SocketHandle     SocketHandle;
     typedef typename SockDelegate::ConnectionOpenedCallbackCookie  ConnectionOpenedCallbackCookie;
     
-    struct AddressKey {
+    struct ConnectionIdKey {
     public:
-        explicit AddressKey(const sockaddr_storage& address_) :
-        address(address_) {}
+        ConnectionIdKey() : connectionId(EMI_NO_CONNECTION_ID) {}
+        explicit ConnectionIdKey(EmiConnectionId connectionId_) :
+        connectionId(connectionId_) {}
+        
+        EmiConnectionId connectionId;
         
-        sockaddr_storage address;
+        inline bool operator==(const ConnectionIdKey& rhs) const {
+            return connectionId == rhs.connectionId;
+        }
         
-        inline bool operator<(const AddressKey& rhs) const {
-            return 0 > EmiAddressCmp::compare(address, rhs.address);
+        // The IDs are random, but all IDs of a socket are congruent to its
+        // shard modulo the number of shards (see generateConnectionId),
+        // so their low bits are all the same when there are several
+        // shards. And the IDs of incoming packets are chosen by whoever
+        // sends them. So they are hashed with SipHash, like the
+        // addresses in EmiAddressKey.
+        inline uint32_t hash(const EmiSipHash::Key& hashKey) const {
+            return (uint32_t)EmiSipHash::hash(hashKey, (const uint8_t *)&connectionId, sizeof(connectionId));
         }
     };
     
@@ -88,10 +134,12 @@ class EmiSock {
     typedef EmiUdpSocket<Binding>                   EUS;
     typedef EmiMessageHandler<EC, EmiSock, Binding> EMH;
     
-    typedef std::map<AddressKey, EC*>              ServerConnectionMap;
+    typedef EmiHashTable<EmiAddressKey, EC*>       ServerConnectionMap;
+    typedef EmiHashTable<ConnectionIdKey, EC*>     ConnectionIdMap;
     typedef typename ServerConnectionMap::iterator ServerConnectionMapIter;
+    typedef std::vector<EC*>                       ConnectionVector;
     
-    // For makeServerConnection
+    // For makeServerConnection and checkSynCookie
     friend class EmiMessageHandler<EC, EmiSock, Binding>;
     
 private:
@@ -101,9 +149,46 @@ private:
     
     EMH                   _messageHandler;
     EUS                  *_serverSocket;
+    // Server connections are found by the connection ID of the
+    // packet when it has one, and otherwise by the remote address.
+    // _serverConns is keyed by the current remote address of the
+    // connection; when a client moves, serverConnectionMoved re-keys
+    // its entry.
     ServerConnectionMap   _serverConns;
+    ConnectionIdMap       _connIds;
     SockDelegate          _delegate;
     
+    // Datagrams tend to arrive in bursts from the same remote host, so
+    // we remember the connection that the last datagram was for. This
+    // saves us the hash table lookup for most packets.
+    EmiAddressKey         _lastPeerKey;
+    EC                   *_lastPeerConn;
+    
+    // When SockDelegate::batchConnectionTicks returns true, the server
+    // connections don't have tick timers of their own. Instead, the
+    // connections that have something to send are put in _dirtyConns,
+    // and all of them are ticked at once when _tickTimer fires. This
+    // saves a lot of timer callbacks on busy servers, and it means that
+    // the packets of all connections are sent in one batch.
+    ConnectionVector         _dirtyConns;
+    // The connections that are being ticked right now
+    ConnectionVector         _tickingConns;
+    typename Binding::Timer *_tickTimer;
+    
+    // SYN cookies let the server answer a SYN without allocating a
+    // connection, so that a flood of SYNs from spoofed addresses can't
+    // exhaust its memory. To keep connection setup at one round trip in
+    // the normal case, cookies are only required when connections are
+    // opened at a higher rate than config.synCookieThreshold, which is
+    // enforced with a token bucket.
+    uint8_t                  _synCookieSecret[Binding::HMAC_HASH_SIZE];
+    EmiTimeInterval          _synTokens;
+    EmiTimeInterval          _synTokensTime;
+    
+    // Kept as ivars to avoid allocating vectors on every broadcast
+    std::vector<PersistentData> _broadcastFragments;
+    std::vector<PersistentData> _broadcastConnFragments;
+    
     // SockDelegate::connectionOpened will be called on the cookie iff this function returns true.
     bool connectHelper(EmiTimeInterval now, const sockaddr_storage& remoteAddress,
                        const uint8_t *p2pCookie, size_t p2pCookieLength,
@@ -139,8 +224,27 @@ private:
         
         ASSERT(sock->_serverSocket == socket);
         
-        ServerConnectionMapIter cur(sock->_serverConns.find(AddressKey(remoteAddress)));
-        EC *conn = (sock->_serverConns.end() == cur ? NULL : (*cur).second);
+        EC *conn = NULL;
+        
+        EmiConnectionId connectionId = EMI_NO_CONNECTION_ID;
+        if (EmiPacketHeader::parseConnectionId(Binding::extractData(data)+offset, len, &connectionId)) {
+            // If the client has moved, this is how we find its
+            // connection. EmiConn decides whether to accept the new
+            // address or not.
+            conn = sock->findServerConnection(connectionId);
+        }
+        
+        if (!conn) {
+            conn = sock->findServerConnection(EmiAddressKey(remoteAddress));
+            
+            if (!conn && EMI_NO_CONNECTION_ID != connectionId && !sock->ownsConnectionId(connectionId)) {
+                // The connection is owned by another EmiSock that shares
+                // this port, but the binding could not steer the datagram
+                // to it. Replying with a SYN-RST-ACK would make the
+                // client close it.
+                return;
+            }
+        }
         
         if (conn) {
             // The purpose of connectionGotMessage is to give the bindings
@@ -161,15 +265,200 @@ private:
         }
     }
     
+    inline EC *findServerConnection(const EmiAddressKey& key) {
+        if (_lastPeerConn && key == _lastPeerKey) {
+            return _lastPeerConn;
+        }
+        
+        EC **entry = _serverConns.find(key);
+        if (!entry) {
+            return NULL;
+        }
+        
+        _lastPeerKey = key;
+        _lastPeerConn = *entry;
+        return *entry;
+    }
+    
+    inline EC *findServerConnection(EmiConnectionId connectionId) {
+        // A server connection's ID never changes, so it is safe to
+        // read it from this thread.
+        if (_lastPeerConn && connectionId == _lastPeerConn->getConnectionId()) {
+            return _lastPeerConn;
+        }
+        
+        EC **entry = _connIds.find(ConnectionIdKey(connectionId));
+        return entry ? *entry : NULL;
+    }
+    
+    inline size_t numShards() const {
+        return config.reusePort ? std::max(config.reusePortShards, (size_t)1) : 1;
+    }
+    
+    // Returns true if connectionId is one that this EmiSock could have
+    // handed out
+    inline bool ownsConnectionId(EmiConnectionId connectionId) const {
+        return config.reusePortShard == connectionId % numShards();
+    }
+    
+    EmiConnectionId generateConnectionId() {
+        const uint64_t shards = numShards();
+        ASSERT(config.reusePortShard < shards);
+        
+        uint64_t connectionId;
+        do {
+            // Round the random number down to one that belongs to this shard
+            uint64_t random = (uint32_t)EmiNetRandom<Binding>::random();
+            connectionId = random - random%shards + config.reusePortShard;
+        } while (connectionId > 0xffffffffULL ||
+                 EMI_NO_CONNECTION_ID == connectionId ||
+                 _connIds.count(ConnectionIdKey((EmiConnectionId)connectionId)));
+        return (EmiConnectionId)connectionId;
+    }
+    
+    static void tickTimeoutCallback(EmiTimeInterval now, typename Binding::Timer * /*timer*/, void *data) {
+        EmiSock *sock = (EmiSock *)data;
+        
+        // Connections that become dirty while we are ticking will be
+        // ticked in the next socket tick, just like they would have been
+        // if they had tick timers of their own.
+        //
+        // The connections keep their positions, so their socket tick
+        // indices are still valid; they now refer to _tickingConns.
+        sock->_tickingConns.swap(sock->_dirtyConns);
+        
+        // This loop uses an index instead of an iterator, because
+        // descheduleConnectionTick might modify _tickingConns while we
+        // are ticking.
+        for (size_t i=0; i<sock->_tickingConns.size(); i++) {
+            EC *conn = sock->_tickingConns[i];
+            if (conn) {
+                conn->socketTick(now);
+            }
+        }
+        
+        sock->_tickingConns.clear();
+    }
+    
+    // Erases the _serverConns entry for key, unless it has been taken
+    // over by another connection, see serverConnectionMoved
+    void eraseServerConnection(EC *conn, const EmiAddressKey& key) {
+        EC **entry = _serverConns.find(key);
+        if (entry && conn == *entry) {
+            _serverConns.erase(key);
+        }
+    }
+    
     EC *makeServerConnection(const sockaddr_storage& remoteAddress, uint16_t inboundPort) {
-        EC *conn = _delegate.makeConnection(ECP(_serverSocket, remoteAddress, inboundPort));
-        ASSERT(0 == _serverConns.count(AddressKey(remoteAddress)));
-        _serverConns.insert(std::make_pair(AddressKey(remoteAddress), conn));
+        EmiConnectionId connectionId = generateConnectionId();
+        EC *conn = _delegate.makeConnection(ECP(_serverSocket, remoteAddress, inboundPort, connectionId));
+        if (_delegate.batchConnectionTicks()) {
+            conn->setTickingSocket(this);
+        }
+        ASSERT(0 == _serverConns.count(EmiAddressKey(remoteAddress)));
+        _serverConns.insert(EmiAddressKey(remoteAddress), conn);
+        _connIds.insert(ConnectionIdKey(connectionId), conn);
         _delegate.gotServerConnection(*conn);
         
         return conn;
     }
     
+    // Writes the SYN cookie for the given remote address and initial
+    // sequence number in the time bucket bucket to buf, which must be
+    // EMI_SYN_COOKIE_LENGTH bytes long.
+    void makeSynCookie(uint64_t bucket,
+                       const sockaddr_storage& remoteAddress,
+                       EmiSequenceNumber initialSequenceNumber,
+                       uint8_t *buf) const {
+        EmiAddressKey key(remoteAddress);
+        
+        uint8_t data[sizeof(bucket)+sizeof(key)+sizeof(initialSequenceNumber)];
+        memcpy(data, &bucket, sizeof(bucket));
+        memcpy(data+sizeof(bucket), &key, sizeof(key));
+        memcpy(data+sizeof(bucket)+sizeof(key), &initialSequenceNumber, sizeof(initialSequenceNumber));
+        
+        uint8_t hashBuf[Binding::HMAC_HASH_SIZE];
+        Binding::hmacHash(_synCookieSecret, sizeof(_synCookieSecret),
+                          data, sizeof(data),
+                          hashBuf, sizeof(hashBuf));
+        
+        memcpy(buf, hashBuf, EMI_SYN_COOKIE_LENGTH);
+    }
+    
+    // Returns true if a connection may be opened without a SYN cookie
+    bool takeSynToken(EmiTimeInterval now) {
+        EmiTimeInterval threshold = config.synCookieThreshold;
+        if (threshold < 0) {
+            return true;
+        }
+        else if (0 == threshold) {
+            return false;
+        }
+        
+        // _synTokensTime is 0 at first, which fills the bucket
+        _synTokens = std::min(std::max(threshold, 1.0),
+                              _synTokens + (now-_synTokensTime)*threshold);
+        _synTokensTime = now;
+        
+        if (_synTokens < 1) {
+            return false;
+        }
+        
+        _synTokens -= 1;
+        return true;
+    }
+    
+    // Invoked by the message handler when it gets a SYN message for
+    // a connection that does not exist. Returns true if the connection
+    // may be opened. Otherwise, it replies with a SYN-ACK message that
+    // contains a SYN cookie, without storing anything. The client then
+    // sends its SYN again, with the cookie, which proves that it can
+    // receive packets on the address that it claims to have.
+    bool checkSynCookie(EmiTimeInterval now,
+                        EUS *socket,
+                        const sockaddr_storage& inboundAddress,
+                        const sockaddr_storage& remoteAddress,
+                        EmiSequenceNumber initialSequenceNumber,
+                        const uint8_t *cookie,
+                        size_t cookieLength) {
+        uint64_t bucket = (uint64_t)(now/EMI_SYN_COOKIE_RESOLUTION);
+        uint8_t expectedCookie[EMI_SYN_COOKIE_LENGTH];
+        
+        if (EMI_SYN_COOKIE_LENGTH == cookieLength) {
+            // Cookies from the previous time bucket are accepted too,
+            // otherwise a cookie could expire right after we hand it out.
+            makeSynCookie(bucket, remoteAddress, initialSequenceNumber, expectedCookie);
+            if (0 == memcmp(cookie, expectedCookie, sizeof(expectedCookie))) {
+                return true;
+            }
+            
+            makeSynCookie(bucket-1, remoteAddress, initialSequenceNumber, expectedCookie);
+            if (0 == memcmp(cookie, expectedCookie, sizeof(expectedCookie))) {
+                return true;
+            }
+        }
+        else if (takeSynToken(now)) {
+            return true;
+        }
+        
+        makeSynCookie(bucket, remoteAddress, initialSequenceNumber, expectedCookie);
+        
+        // The SYN-ACK acks the client's initial sequence number, so that
+        // the client can tell that the cookie is for its current SYN.
+        uint8_t buf[64];
+        size_t size = EM::writeControlPacketWithData(EMI_SYN_FLAG | EMI_ACK_FLAG,
+                                                     buf, sizeof(buf),
+                                                     expectedCookie, sizeof(expectedCookie),
+                                                     /*sequenceNumber:*/0,
+                                                     /*hasAck:*/true,
+                                                     /*ack:*/initialSequenceNumber);
+        ASSERT(0 != size); // size == 0 when the buffer was too small
+        
+        socket->sendData(inboundAddress, remoteAddress, buf, size);
+        
+        return false;
+    }
+    
     inline bool shouldArtificiallyDropPacket() const {
         if (0 == config.fabricatedPacketDropRate) return false;
         
@@ -180,18 +469,43 @@ public:
     const EmiSockConfig config;
     
     EmiSock(const EmiSockConfig& config_, const SockDelegate& delegate) :
-    config(config_),
     _messageHandler(*this),
+    _serverSocket(NULL),
+    _serverConns(EmiSipHash::randomKey<Binding>()),
+    _connIds(EmiSipHash::randomKey<Binding>()),
     _delegate(delegate),
-    _serverSocket(NULL) {}
+    _lastPeerKey(),
+    _lastPeerConn(NULL),
+    _dirtyConns(),
+    _tickingConns(),
+    _tickTimer(NULL),
+    _synTokens(0),
+    _synTokensTime(0),
+    _broadcastFragments(),
+    _broadcastConnFragments(),
+    config(config_) {
+        Binding::randomBytes(_synCookieSecret, sizeof(_synCookieSecret));
+    }
     
     virtual ~EmiSock() {
         /// EmiSock should not be deleted before all open connections are closed,
         /// but just to be sure, we close all remaining connections.
         
-        size_t numConns = _serverConns.size();
         ServerConnectionMapIter iter = _serverConns.begin();
         ServerConnectionMapIter end  = _serverConns.end();
+        while (iter != end) {
+            // The connections might outlive this object, so they must
+            // not rely on it for ticking anymore.
+            (*iter).second->setTickingSocket(NULL);
+            ++iter;
+        }
+        
+        if (_tickTimer) {
+            Binding::freeTimer(_tickTimer);
+        }
+        
+        size_t numConns = _serverConns.size();
+        iter = _serverConns.begin();
         while (iter != end) {
             // This will remove the connection from _conns
             (*iter).second->forceClose();
@@ -227,7 +541,8 @@ public:
             sockaddr_storage ss(config.address);
             EmiNetUtil::addrSetPort(ss, config.port);
             
-            _serverSocket = EUS::open(_delegate.getSocketCookie(), onMessage, this, ss, err);
+            _serverSocket = EUS::open(_delegate.getSocketCookie(), onMessage, this, ss,
+                                      config.reusePort ? numShards() : 0, err);
             
             if (!_serverSocket) {
                 return false;
@@ -236,7 +551,7 @@ public:
         
         return true;
     }
-        
+    
     // SockDelegate::connectionOpened will be called on the cookie iff this function returns true.
     bool connect(EmiTimeInterval now,
                  const sockaddr_storage& remoteAddress,
@@ -259,6 +574,76 @@ public:
                              callbackCookie, err);
     }
     
+    // Sends the same message on each of the given connections. Each
+    // connection gets EmiMessages of its own, with its own sequence
+    // numbers, but they all refer to the same payload (see
+    // Binding::sharePersistentData) instead of to copies of it. A message
+    // that is too long for one EmiMessage is split once, and the pieces
+    // are shared in the same way. What is left to do per connection is
+    // thus sequence numbering and packetization.
+    //
+    // Connections that are closed, or that don't have space for the
+    // message in their sender buffer, are skipped. Returns the number of
+    // connections the message was enqueued on.
+    //
+    // This method assumes ownership over the data parameter. Like
+    // EmiConn::send, it must be invoked on the connections' thread.
+    size_t broadcast(EmiTimeInterval now,
+                     EC *const *conns,
+                     size_t numConns,
+                     const PersistentData& data,
+                     EmiChannelQualifier channelQualifier,
+                     EmiPriority priority) {
+        const uint8_t *rawData = Binding::extractData(data);
+        size_t dataLength = Binding::extractLength(data);
+        size_t numFragments = EC::numMessagesForLength(dataLength);
+        
+        _broadcastFragments.clear();
+        if (1 != numFragments) {
+            size_t maxLength = EC::maxMessageLength();
+            for (size_t i=0; i<numFragments; i++) {
+                size_t offset = i*maxLength;
+                _broadcastFragments.push_back(Binding::makePersistentData(rawData+offset,
+                                                                          std::min(maxLength, dataLength-offset)));
+            }
+        }
+        
+        size_t numSent = 0;
+        for (size_t i=0; i<numConns; i++) {
+            PersistentData connData(Binding::sharePersistentData(data));
+            
+            _broadcastConnFragments.clear();
+            for (size_t j=0; j<_broadcastFragments.size(); j++) {
+                _broadcastConnFragments.push_back(Binding::sharePersistentData(_broadcastFragments[j]));
+            }
+            
+            Error err;
+            if (conns[i]->sendShared(now,
+                                     connData,
+                                     _broadcastConnFragments.empty() ? NULL : &_broadcastConnFragments[0],
+                                     channelQualifier,
+                                     priority,
+                                     err)) {
+                numSent++;
+            }
+            else {
+                Binding::releasePersistentData(connData);
+                for (size_t j=0; j<_broadcastConnFragments.size(); j++) {
+                    Binding::releasePersistentData(_broadcastConnFragments[j]);
+                }
+            }
+        }
+        
+        Binding::releasePersistentData(data);
+        for (size_t i=0; i<_broadcastFragments.size(); i++) {
+            Binding::releasePersistentData(_broadcastFragments[i]);
+        }
+        _broadcastFragments.clear();
+        _broadcastConnFragments.clear();
+        
+        return numSent;
+    }
+    
     // Should be invoked by ConnDelegate::invalidate for server
     // connections.
     // 
@@ -269,7 +654,92 @@ public:
     void deregisterServerConnection(EC *conn) {
         ASSERT(EMI_CONNECTION_TYPE_SERVER == conn->getType());
         
-        _serverConns.erase(AddressKey(conn->getRemoteAddress()));
+        conn->setTickingSocket(NULL);
+        eraseServerConnection(conn, EmiAddressKey(conn->getRemoteAddress()));
+        _connIds.erase(ConnectionIdKey(conn->getConnectionId()));
+        
+        if (_lastPeerConn == conn) {
+            _lastPeerConn = NULL;
+        }
+    }
+    
+    // Should be invoked by ConnDelegate::emiConnMoved for server
+    // connections. It has the same threading requirements as
+    // deregisterServerConnection.
+    //
+    // Moves the connection's entry in _serverConns from oldAddress to
+    // the connection's new remote address. Otherwise, a new client that
+    // is given the old address, for instance by a NAT, would be taken
+    // for the connection that has moved away from it, and its SYN would
+    // be dropped.
+    void serverConnectionMoved(EC *conn, const sockaddr_storage& oldAddress) {
+        ASSERT(EMI_CONNECTION_TYPE_SERVER == conn->getType());
+        
+        eraseServerConnection(conn, EmiAddressKey(oldAddress));
+        
+        EmiAddressKey key(conn->getRemoteAddress());
+        EC **entry = _serverConns.find(key);
+        if (entry) {
+            // Another connection was opened from the new address, and
+            // its client has since moved on without us noticing. That
+            // connection can still be found by its connection ID.
+            *entry = conn;
+        }
+        else {
+            _serverConns.insert(key, conn);
+        }
+        
+        // Clients rarely move, so we don't bother to check whether the
+        // cached entry is affected
+        _lastPeerConn = NULL;
+    }
+    
+    // Invoked by EC, for connections that are ticked by this socket.
+    // The connection will be ticked within EMI_TICK_TIME.
+    //
+    // Returns the position of the connection in the list of connections
+    // to tick, which the connection has to pass to
+    // descheduleConnectionTick. EmiSock updates it with
+    // EC::setSocketTickIndex when it moves the connection.
+    size_t scheduleConnectionTick(EC *conn) {
+        _dirtyConns.push_back(conn);
+        
+        if (!_tickTimer) {
+            _tickTimer = Binding::makeTimer(_delegate.getSocketCookie());
+        }
+        Binding::scheduleTimer(_tickTimer, tickTimeoutCallback, this,
+                               EMI_TICK_TIME,
+                               /*repeating:*/false, /*reschedule:*/false);
+        
+        return _dirtyConns.size()-1;
+    }
+    
+    // Invoked by EC, for connections that have a scheduled tick
+    // but must not be ticked, for instance because they have been
+    // closed. index is the value that scheduleConnectionTick returned,
+    // or that was last passed to EC::setSocketTickIndex.
+    void descheduleConnectionTick(EC *conn, size_t index) {
+        if (index < _dirtyConns.size() && conn == _dirtyConns[index]) {
+            // The order of the connections does not matter, so the last
+            // connection is moved into the hole.
+            EC *last = _dirtyConns.back();
+            _dirtyConns[index] = last;
+            _dirtyConns.pop_back();
+            if (last != conn) {
+                last->setSocketTickIndex(index);
+            }
+            
+            if (_dirtyConns.empty()) {
+                Binding::descheduleTimer(_tickTimer);
+            }
+        }
+        else {
+            // The connection is waiting to be ticked by the ongoing
+            // tickTimeoutCallback. The connections are ticked in order,
+            // so the hole can't be filled; the loop skips it instead.
+            ASSERT(index < _tickingConns.size() && conn == _tickingConns[index]);
+            _tickingConns[index] = NULL;
+        }
     }
 };
 
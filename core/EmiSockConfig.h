@@ -25,6 +25,17 @@ public:
     receiverBufferSize(EMI_DEFAULT_RECEIVER_BUFFER_SIZE),
     senderBufferSize(EMI_DEFAULT_SENDER_BUFFER_SIZE),
     acceptConnections(false),
+    synCookieThreshold(EMI_DEFAULT_SYN_COOKIE_THRESHOLD),
+    reusePort(false),
+    reusePortShard(0),
+    reusePortShards(1),
+    pollQueueSize(0),
+    streamMessages(false),
+    incompleteMessageTimeout(EMI_DEFAULT_INCOMPLETE_MESSAGE_TIMEOUT),
+    incompleteMessageTimeoutRtts(EMI_DEFAULT_INCOMPLETE_MESSAGE_TIMEOUT_RTTS),
+    congestionControl(EMI_CONGESTION_CONTROL_UDT),
+    targetQueueingDelay(EMI_DEFAULT_TARGET_QUEUEING_DELAY),
+    scavengerTargetQueueingDelay(EMI_DEFAULT_SCAVENGER_TARGET_QUEUEING_DELAY),
     port(0),
     fabricatedPacketDropRate(0) {
         EmiNetUtil::anyAddr(0, AF_INET, &address);
@@ -38,6 +49,67 @@ public:
     size_t receiverBufferSize;
     size_t senderBufferSize;
     bool acceptConnections;
+    // In connections per second. 0 means that SYN cookies are always
+    // required, a negative value means that they are never required.
+    float synCookieThreshold;
+    // When this is true, the server socket is opened with SO_REUSEPORT,
+    // so that several EmiSocks, typically one per thread or process, can
+    // share the port. See the thread safety notes in EmiSock.h.
+    bool reusePort;
+    // When reusePort is set, the EmiSocks that share the port are
+    // numbered from 0 to reusePortShards-1, and reusePortShard is the
+    // number of this one. The connection IDs that an EmiSock hands out
+    // are reusePortShard modulo reusePortShards, so that datagrams can
+    // be steered to the EmiSock that owns their connection even when
+    // the client has changed address. See EmiSock.h.
+    size_t reusePortShard;
+    size_t reusePortShards;
+    // When this is non-zero, each connection puts received messages in
+    // a queue of this size, to be polled with EmiConn::pollMessages,
+    // instead of passing them to ConnDelegate::emiConnMessage.
+    size_t pollQueueSize;
+    // When this is true, the parts of split messages on reliable ordered
+    // channels are delivered one by one, in order, as soon as they can
+    // be, with ConnDelegate::emiConnMessagePart. They are not put back
+    // together first. The receiver buffer then only has to hold the
+    // parts that arrive out of order, so the receiver's
+    // receiverBufferSize no longer limits how large a message can be,
+    // and the receiver doesn't hold large messages in memory in their
+    // entirety.
+    //
+    // This only changes the receiving side. The sender still holds the
+    // whole message until it has been acked, so senderBufferSize on the
+    // sending side still limits how large a message can be.
+    //
+    // Messages that are not split are still delivered with
+    // ConnDelegate::emiConnMessage.
+    bool streamMessages;
+    // The parts of a split message on an unreliable channel are evicted
+    // from the receiver buffer when they have waited for the rest of
+    // the message for longer than incompleteMessageTimeout seconds and
+    // incompleteMessageTimeoutRtts RTTs. Parts of unreliable messages
+    // that are lost are never re-sent, so without this, the parts that
+    // did arrive would take up buffer space until newer messages on the
+    // channel push them out. See EmiConn::evictedBytes.
+    EmiTimeInterval incompleteMessageTimeout;
+    float incompleteMessageTimeoutRtts;
+    // The congestion control algorithm of the connections of the
+    // socket. EMI_CONGESTION_CONTROL_UDT, the default, backs off when
+    // packets are lost. EMI_CONGESTION_CONTROL_BBR paces packets at the
+    // bandwidth that it measures, and doesn't back off on random loss,
+    // which makes it better suited for lossy paths such as cellular
+    // links. See EmiBbrCongestionControl.
+    // EMI_CONGESTION_CONTROL_LOW_LATENCY keeps the queueing delay below
+    // targetQueueingDelay seconds, at some cost in throughput. See
+    // EmiDelayCongestionControl.
+    // EMI_CONGESTION_CONTROL_SCAVENGER is for background transfers. It
+    // backs off as soon as the queueing delay reaches
+    // scavengerTargetQueueingDelay seconds, so that it only uses the
+    // capacity that other connections leave unused. See
+    // EmiLedbatCongestionControl.
+    EmiCongestionControlType congestionControl;
+    EmiTimeInterval targetQueueingDelay;
+    EmiTimeInterval scavengerTargetQueueingDelay;
     uint16_t port;
     sockaddr_storage address;
     float fabricatedPacketDropRate;
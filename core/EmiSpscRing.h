@@ -0,0 +1,115 @@
+//
+//  EmiSpscRing.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiSpscRing_h
+#define eminet_EmiSpscRing_h
+
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+
+// A fixed size lock free single producer, single consumer ring buffer.
+// One thread may push while another thread pops, without locking. The
+// ring never allocates after it has been created; when it is full, push
+// fails.
+//
+// _head and _tail are never wrapped around; only the slot indices are.
+// That makes it possible to tell a full ring from an empty one without
+// wasting a slot. This uses the GCC __sync builtins for the memory
+// barriers, which are supported by both GCC and clang.
+template<class T>
+class EmiSpscRing {
+private:
+    // Private copy constructor and assignment operator
+    inline EmiSpscRing(const EmiSpscRing& other);
+    inline EmiSpscRing& operator=(const EmiSpscRing& other);
+    
+    std::vector<T> _slots;
+    size_t         _mask;
+    // The number of values that have been popped. Only the consumer
+    // writes to this.
+    volatile size_t _head;
+    // The number of values that have been pushed. Only the producer
+    // writes to this.
+    volatile size_t _tail;
+    
+    static size_t roundUpToPowerOfTwo(size_t size) {
+        size_t result = 1;
+        while (result < size) {
+            result *= 2;
+        }
+        return result;
+    }
+    
+public:
+    // The capacity is rounded up to the nearest power of two
+    explicit EmiSpscRing(size_t capacity) :
+    _slots(roundUpToPowerOfTwo(capacity)),
+    _mask(_slots.size()-1),
+    _head(0),
+    _tail(0) {}
+    
+    virtual ~EmiSpscRing() {}
+    
+    // May only be invoked from the producer thread. Returns false if
+    // the ring is full.
+    bool push(const T& value) {
+        size_t tail = _tail;
+        if (tail-_head == _slots.size()) {
+            return false;
+        }
+        // Make sure that the consumer is done with the slot before we
+        // overwrite it
+        __sync_synchronize();
+        
+        _slots[tail & _mask] = value;
+        
+        // Make sure that the value is written before it is published
+        __sync_synchronize();
+        _tail = tail+1;
+        
+        return true;
+    }
+    
+    // May only be invoked from the consumer thread. Copies at most
+    // maxCount values to out, and returns the number of values that
+    // were copied.
+    size_t pop(T *out, size_t maxCount) {
+        size_t head = _head;
+        size_t count = std::min((size_t)(_tail-head), maxCount);
+        // Make sure that we don't read the values before they have
+        // been published
+        __sync_synchronize();
+        
+        for (size_t i=0; i<count; i++) {
+            T& slot(_slots[(head+i) & _mask]);
+            out[i] = slot;
+            // Don't keep references to the values around until the
+            // slot is reused
+            slot = T();
+        }
+        
+        // Make sure that we are done with the slots before the producer
+        // is allowed to reuse them
+        __sync_synchronize();
+        _head = head+count;
+        
+        return count;
+    }
+    
+    // This is only a hint when the other thread is active
+    inline bool empty() const {
+        return _head == _tail;
+    }
+    
+    inline size_t capacity() const {
+        return _slots.size();
+    }
+};
+
+#endif
@@ -0,0 +1,292 @@
+//
+//  EmiTimerWheel.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTimerWheel.h"
+
+#include "EmiNetUtil.h"
+
+#include <cmath>
+#include <algorithm>
+
+EmiTimerWheelTimer::EmiTimerWheelTimer() :
+_prev(this),
+_next(this),
+_level(NOT_IN_SLOT),
+_slot(0),
+_expires(0),
+_interval(0),
+_callback(NULL),
+_data(NULL) {}
+
+EmiTimerWheelTimer::~EmiTimerWheelTimer() {}
+
+EmiTimerWheel::EmiTimerWheel(EmiTimeInterval granularity) :
+_granularity(granularity),
+_current(0),
+_count(0) {
+    for (size_t level=0; level<LEVELS; level++) {
+        _occupied[level] = 0;
+    }
+}
+
+EmiTimerWheel::~EmiTimerWheel() {
+    // Make sure that no timer points into the wheel
+    for (size_t level=0; level<LEVELS; level++) {
+        for (size_t slot=0; slot<SLOTS; slot++) {
+            Timer& sentinel(_slots[level][slot]);
+            while (sentinel.isScheduled()) {
+                Timer *timer = sentinel._next;
+                timer->unlink();
+                timer->_level = Timer::NOT_IN_SLOT;
+            }
+        }
+    }
+}
+
+inline uint64_t EmiTimerWheel::timeToTick(EmiTimeInterval time) const {
+    return (uint64_t)std::floor(time/_granularity);
+}
+
+inline uint64_t EmiTimerWheel::timeToTickRoundingUp(EmiTimeInterval time) const {
+    // The epsilon is there to make sure that floating point rounding
+    // errors don't make for instance 0.068/0.001 round up to 69.
+    return (uint64_t)std::ceil(time/_granularity - 1e-6);
+}
+
+void EmiTimerWheel::add(Timer *timer) {
+    ASSERT(!timer->isScheduled());
+    
+    // Timers that have already expired fire on the next tick
+    uint64_t expires = std::max(timer->_expires, _current);
+    uint64_t delta = expires-_current;
+    
+    size_t level = 0;
+    while (level < LEVELS-1 && delta >= (1ULL << (SLOT_BITS*(level+1)))) {
+        level++;
+    }
+    
+    if (delta >= (1ULL << (SLOT_BITS*LEVELS))) {
+        // The timer expires further into the future than the wheel
+        // spans. Put it in the last slot; it will be re-added when
+        // it is cascaded.
+        expires = _current + (1ULL << (SLOT_BITS*LEVELS)) - 1;
+    }
+    
+    size_t slot = (expires >> (SLOT_BITS*level)) & SLOT_MASK;
+    Timer& sentinel(_slots[level][slot]);
+    
+    timer->_level = level;
+    timer->_slot = slot;
+    timer->_prev = sentinel._prev;
+    timer->_next = &sentinel;
+    sentinel._prev->_next = timer;
+    sentinel._prev = timer;
+    
+    _occupied[level] |= (1ULL << slot);
+}
+
+void EmiTimerWheel::remove(Timer *timer) {
+    if (Timer::NOT_IN_SLOT != timer->_level) {
+        Timer& sentinel(_slots[timer->_level][timer->_slot]);
+        timer->unlink();
+        
+        if (!sentinel.isScheduled()) {
+            _occupied[timer->_level] &= ~(1ULL << timer->_slot);
+        }
+        
+        timer->_level = Timer::NOT_IN_SLOT;
+    }
+    else {
+        // The timer is in a temporary list in advance or cascade
+        timer->unlink();
+    }
+}
+
+void EmiTimerWheel::detach(size_t level, size_t slot, Timer& list) {
+    Timer& sentinel(_slots[level][slot]);
+    
+    if (sentinel.isScheduled()) {
+        // Splice the slot's list into list
+        list._next = sentinel._next;
+        list._prev = sentinel._prev;
+        list._next->_prev = &list;
+        list._prev->_next = &list;
+        
+        sentinel._next = &sentinel;
+        sentinel._prev = &sentinel;
+        
+        Timer *timer = list._next;
+        while (timer != &list) {
+            timer->_level = Timer::NOT_IN_SLOT;
+            timer = timer->_next;
+        }
+    }
+    
+    _occupied[level] &= ~(1ULL << slot);
+}
+
+void EmiTimerWheel::cascade(size_t level, size_t slot) {
+    Timer list;
+    detach(level, slot, list);
+    
+    while (list.isScheduled()) {
+        Timer *timer = list._next;
+        timer->unlink();
+        add(timer);
+    }
+}
+
+size_t EmiTimerWheel::distanceToOccupiedSlot(size_t level, size_t slot) const {
+    uint64_t occupied = _occupied[level];
+    if (0 == occupied) {
+        return SLOTS;
+    }
+    
+    // Rotate the bitmap so that slot becomes bit 0
+    uint64_t rotated = (0 == slot ?
+                        occupied :
+                        (occupied >> slot) | (occupied << (SLOTS-slot)));
+    return __builtin_ctzll(rotated);
+}
+
+void EmiTimerWheel::schedule(Timer *timer, EmiTimeInterval now,
+                             Timer::Callback *callback, void *data,
+                             EmiTimeInterval interval, bool repeating) {
+    if (timer->isScheduled()) {
+        deschedule(timer);
+    }
+    
+    if (0 == _count) {
+        // Don't make advance catch up with the time that has passed
+        // since the wheel was last used.
+        _current = timeToTick(now);
+    }
+    
+    timer->_callback = callback;
+    timer->_data = data;
+    // Round the expiration time up, so that timers never fire early
+    timer->_expires = timeToTickRoundingUp(now+interval);
+    timer->_interval = (repeating ? std::max(timeToTickRoundingUp(interval), (uint64_t)1) : 0);
+    
+    add(timer);
+    _count++;
+}
+
+void EmiTimerWheel::deschedule(Timer *timer) {
+    if (!timer->isScheduled()) {
+        return;
+    }
+    
+    remove(timer);
+    
+    ASSERT(0 != _count);
+    _count--;
+}
+
+void EmiTimerWheel::advance(EmiTimeInterval now) {
+    uint64_t nowTick = timeToTick(now);
+    
+    while (_count && _current <= nowTick) {
+        size_t slot = _current & SLOT_MASK;
+        
+        if (0 == slot) {
+            // Cascade timers from the higher levels. The higher level
+            // slots are only cascaded when the slots of all lower
+            // levels have wrapped around.
+            for (size_t level=1; level<LEVELS; level++) {
+                size_t levelSlot = (_current >> (SLOT_BITS*level)) & SLOT_MASK;
+                cascade(level, levelSlot);
+                if (0 != levelSlot) break;
+            }
+        }
+        
+        Timer list;
+        detach(0, slot, list);
+        
+        // _current is incremented before the callbacks are invoked, so
+        // that timers that are scheduled from the callbacks don't end up
+        // in the slot that was just detached.
+        _current++;
+        
+        while (list.isScheduled()) {
+            Timer *timer = list._next;
+            
+            if (timer->_expires >= _current) {
+                // The timer was put in this slot because it expires
+                // further into the future than the wheel spans.
+                timer->unlink();
+                add(timer);
+                continue;
+            }
+            
+            if (timer->_interval) {
+                // Repeating timers are rescheduled before the callback
+                // is invoked, so that the callback can deschedule or
+                // delete the timer.
+                timer->unlink();
+                timer->_expires = _current-1+timer->_interval;
+                add(timer);
+            }
+            else {
+                remove(timer);
+                _count--;
+            }
+            
+            timer->_callback(now, timer, timer->_data);
+        }
+        
+        if (_current <= nowTick) {
+            // Skip ahead to the next time something can happen, which is
+            // either the next non-empty slot on level 0, when level 0 wraps
+            // around or when we catch up with now.
+            uint64_t nextSlot = _current+distanceToOccupiedSlot(0, _current & SLOT_MASK);
+            uint64_t nextWrap = (_current+SLOT_MASK) & ~SLOT_MASK;
+            _current = std::min(std::min(nextSlot, nextWrap), nowTick+1);
+        }
+    }
+    
+    if (0 == _count) {
+        _current = nowTick+1;
+    }
+}
+
+bool EmiTimerWheel::nextTimeout(EmiTimeInterval now, EmiTimeInterval& timeout) const {
+    if (0 == _count) {
+        return false;
+    }
+    
+    static const uint64_t NO_TICK = (uint64_t)-1;
+    uint64_t next = NO_TICK;
+    
+    size_t distance = distanceToOccupiedSlot(0, _current & SLOT_MASK);
+    if (SLOTS != distance) {
+        next = _current+distance;
+    }
+    
+    for (size_t level=1; level<LEVELS; level++) {
+        uint64_t shift = SLOT_BITS*level;
+        uint64_t levelTick = _current >> shift;
+        
+        // When _current is not at a slot boundary on this level, the
+        // current slot of this level has already been cascaded, so any
+        // timers in it are one turn of the level into the future.
+        bool atBoundary = (0 == (_current & ((1ULL << shift)-1)));
+        size_t startSlot = (levelTick + (atBoundary ? 0 : 1)) & SLOT_MASK;
+        
+        distance = distanceToOccupiedSlot(level, startSlot);
+        if (SLOTS != distance) {
+            uint64_t cascadeTick = (levelTick + (atBoundary ? 0 : 1) + distance) << shift;
+            next = std::min(next, cascadeTick);
+        }
+    }
+    
+    ASSERT(NO_TICK != next);
+    
+    timeout = std::max(0.0, next*_granularity - now);
+    return true;
+}
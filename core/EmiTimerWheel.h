@@ -0,0 +1,145 @@
+//
+//  EmiTimerWheel.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiTimerWheel_h
+#define eminet_EmiTimerWheel_h
+
+#include "EmiTypes.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+class EmiTimerWheel;
+
+// A timer that is scheduled on an EmiTimerWheel. The timer does not
+// own any resources of its own, so it is cheap to create lots of them.
+class EmiTimerWheelTimer {
+    friend class EmiTimerWheel;
+public:
+    typedef void (Callback)(EmiTimeInterval now, EmiTimerWheelTimer *timer, void *data);
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiTimerWheelTimer(const EmiTimerWheelTimer& other);
+    inline EmiTimerWheelTimer& operator=(const EmiTimerWheelTimer& other);
+    
+    // The timer is a node in a circular doubly linked list. When the
+    // timer is not scheduled, _prev and _next point to the timer itself.
+    EmiTimerWheelTimer *_prev;
+    EmiTimerWheelTimer *_next;
+    
+    static const uint8_t NOT_IN_SLOT = 0xff;
+    
+    // The wheel level and slot the timer is in, or NOT_IN_SLOT if it is
+    // not linked into the wheel itself (because it is not scheduled
+    // or because it is about to fire).
+    uint8_t _level;
+    uint8_t _slot;
+    
+    // In ticks
+    uint64_t _expires;
+    // In ticks, 0 when the timer is not repeating
+    uint64_t _interval;
+    
+    Callback *_callback;
+    void     *_data;
+    
+    inline void unlink() {
+        _prev->_next = _next;
+        _next->_prev = _prev;
+        _prev = this;
+        _next = this;
+    }
+    
+public:
+    EmiTimerWheelTimer();
+    virtual ~EmiTimerWheelTimer();
+    
+    inline bool isScheduled() const {
+        return _next != this;
+    }
+};
+
+// A hierarchical timer wheel, in the spirit of the classic BSD and Linux
+// kernel timer wheels. It lets one backing timer drive an arbitrary
+// number of timers, with O(1) schedule and deschedule operations.
+//
+// The wheel has LEVELS levels of SLOTS slots each. A timer that expires
+// less than SLOTS ticks from now is put directly in the slot of its
+// expiration tick on level 0. Timers further into the future are put on
+// higher levels, and are moved ("cascaded") to lower levels as the wheel
+// turns. Timers that expire further into the future than the wheel
+// spans are cascaded more than once.
+//
+// EmiTimerWheel is not thread safe.
+class EmiTimerWheel {
+public:
+    typedef EmiTimerWheelTimer Timer;
+    
+private:
+    static const size_t   LEVELS = 4;
+    static const size_t   SLOT_BITS = 6;
+    static const size_t   SLOTS = 1 << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS-1;
+    
+    EmiTimeInterval _granularity;
+    
+    // The next tick to process
+    uint64_t _current;
+    size_t   _count;
+    
+    // The slots are sentinel nodes of circular linked lists
+    Timer    _slots[LEVELS][SLOTS];
+    // One bit per slot that is set when the slot is not empty
+    uint64_t _occupied[LEVELS];
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiTimerWheel(const EmiTimerWheel& other);
+    inline EmiTimerWheel& operator=(const EmiTimerWheel& other);
+    
+    inline uint64_t timeToTick(EmiTimeInterval time) const;
+    inline uint64_t timeToTickRoundingUp(EmiTimeInterval time) const;
+    
+    void add(Timer *timer);
+    void remove(Timer *timer);
+    // Moves all timers in the given slot to list
+    void detach(size_t level, size_t slot, Timer& list);
+    void cascade(size_t level, size_t slot);
+    
+    // Returns the distance to the first non-empty slot at or after slot
+    // on the given level, or SLOTS if the level is empty.
+    size_t distanceToOccupiedSlot(size_t level, size_t slot) const;
+    
+public:
+    // granularity is the length of one tick, in seconds
+    EmiTimerWheel(EmiTimeInterval granularity);
+    virtual ~EmiTimerWheel();
+    
+    // Like Binding::scheduleTimer, except that it does not have a
+    // reschedule parameter; the caller can use Timer::isScheduled instead.
+    void schedule(Timer *timer, EmiTimeInterval now,
+                  Timer::Callback *callback, void *data,
+                  EmiTimeInterval interval, bool repeating);
+    void deschedule(Timer *timer);
+    
+    // Invokes the callbacks of all timers that have expired. It is safe to
+    // schedule, deschedule and delete timers from within the callbacks.
+    void advance(EmiTimeInterval now);
+    
+    // Returns false if there are no scheduled timers. Otherwise, it sets
+    // timeout to the number of seconds from now until advance should be
+    // invoked next.
+    bool nextTimeout(EmiTimeInterval now, EmiTimeInterval& timeout) const;
+    
+    inline bool empty() const {
+        return 0 == _count;
+    }
+};
+
+#endif
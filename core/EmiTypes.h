@@ -20,10 +20,33 @@
 // upper bound on how large a single message can be.
 #define EMI_DEFAULT_RECEIVER_BUFFER_SIZE (131072)
 #define EMI_DEFAULT_SENDER_BUFFER_SIZE   (8192)
+// The number of connections per second that a server lets clients
+// open without first proving that they own their address. Above that
+// rate, the server answers SYN messages with SYN cookies.
+#define EMI_DEFAULT_SYN_COOKIE_THRESHOLD (100)
+// The parts of split messages on unreliable channels are evicted from
+// the receiver buffer when they have waited for the rest of their
+// message for more than this many seconds, or this many RTTs,
+// whichever is longer.
+#define EMI_DEFAULT_INCOMPLETE_MESSAGE_TIMEOUT      (1)
+#define EMI_DEFAULT_INCOMPLETE_MESSAGE_TIMEOUT_RTTS (4)
+// The queueing delay, in seconds, that EMI_CONGESTION_CONTROL_LOW_LATENCY
+// tries to stay below
+#define EMI_DEFAULT_TARGET_QUEUEING_DELAY (0.02)
+// The queueing delay that EMI_CONGESTION_CONTROL_SCAVENGER backs off
+// at. It is lower than EMI_DEFAULT_TARGET_QUEUEING_DELAY, so that
+// scavenger connections yield to low latency connections.
+#define EMI_DEFAULT_SCAVENGER_TARGET_QUEUEING_DELAY (0.01)
 
 #define EMI_UDP_HEADER_SIZE           (8)
 #define EMI_MESSAGE_HEADER_MIN_LENGTH (4)
-#define EMI_PACKET_HEADER_MAX_LENGTH  (21)
+// The maximum number of lost packet ranges that one packet can report
+#define EMI_MAX_NAK_RANGES            (4)
+// Flags (1), extra flags (1), connection ID (4), sequence number (3),
+// ack (3), NAK ranges (1+6*EMI_MAX_NAK_RANGES), link capacity (4),
+// arrival rate (4), RTT response (4) and receive window (4). Filler is
+// not included.
+#define EMI_PACKET_HEADER_MAX_LENGTH  (29+6*EMI_MAX_NAK_RANGES)
 
 #define EMI_MIN_CONGESTION_WINDOW         ((size_t)(1024))
 #define EMI_MAX_CONGESTION_WINDOW         ((size_t)(1024*1024*10))
@@ -32,8 +55,22 @@
 #define EMI_PACKET_SEQUENCE_NUMBER_MASK   ((1 << (8*EMI_PACKET_SEQUENCE_NUMBER_LENGTH))-1)
 #define EMI_HEADER_SEQUENCE_NUMBER_LENGTH (3)
 #define EMI_HEADER_SEQUENCE_NUMBER_MASK   ((1 << (8*EMI_HEADER_SEQUENCE_NUMBER_LENGTH))-1)
+#define EMI_CONNECTION_ID_LENGTH          (4)
+#define EMI_NO_CONNECTION_ID              (0)
+#define EMI_SYN_COOKIE_LENGTH             (8)
+// SYN cookies are valid for between one and two times this, in seconds
+#define EMI_SYN_COOKIE_RESOLUTION         (30)
+// The maximum number of messages that other threads can have enqueued
+// on a connection with EmiConn::enqueueSend
+#define EMI_ENQUEUED_SENDS_CAPACITY       (1024)
 #define EMI_TICK_TIME        (0.01)
 #define EMI_MIN_RTO          (0.1)
+// The minimum RTT is the minimum of the RTTs that were measured during
+// this many seconds
+#define EMI_MIN_RTT_WINDOW   (10)
+// The link capacity and the data arrival rate are estimated from the
+// packets of the last this many RTTs (but at most the last 64 packets)
+#define EMI_RATE_ESTIMATE_WINDOW_RTTS (16)
 #define EMI_MAX_RTO          (20.0)
 #define EMI_INIT_RTO         (1.0)
 
@@ -86,6 +123,13 @@ typedef enum {
     EMI_P2P_STATE_FAILED           = 3
 } EmiP2PState;
 
+typedef enum {
+    EMI_CONGESTION_CONTROL_UDT = 0,
+    EMI_CONGESTION_CONTROL_BBR = 1,
+    EMI_CONGESTION_CONTROL_LOW_LATENCY = 2,
+    EMI_CONGESTION_CONTROL_SCAVENGER = 3
+} EmiCongestionControlType;
+
 // Represents a 24 bit number
 typedef uint32_t EmiSequenceNumber;
 // Like EmiSequenceNumber, but does not wrap at 24 bits. Its purpose is to
@@ -103,6 +147,10 @@ typedef uint8_t  EmiChannelQualifier;
 typedef uint16_t EmiTimestamp;
 typedef uint8_t  EmiMessageFlags;
 typedef uint8_t  EmiPacketFlags;
+typedef uint8_t  EmiMessagePartFlags;
+// Identifies a server connection independently of the remote address.
+// EMI_NO_CONNECTION_ID means no value
+typedef uint32_t EmiConnectionId;
 typedef double   EmiTimeInterval;
 
 typedef enum {
@@ -115,6 +163,14 @@ typedef enum {
     EMI_SACK_FLAG            = 0x01
 } EmiMessageFlag;
 
+// Tells where in its message a part that is delivered in streaming mode
+// (see EmiSockConfig::streamMessages) is. Messages that are delivered
+// whole have both flags.
+typedef enum {
+    EMI_MESSAGE_PART_FIRST = 0x01, // This part is the start of its message
+    EMI_MESSAGE_PART_LAST  = 0x02  // This part is the end of its message
+} EmiMessagePartFlag;
+
 typedef enum {
     EMI_SEQUENCE_NUMBER_PACKET_FLAG = 0x01,
     EMI_ACK_PACKET_FLAG             = 0x02,
@@ -127,8 +183,11 @@ typedef enum {
 } EmiPacketFlag;
 
 typedef enum {
-    EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG = 0x01,
-    EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG = 0x02
+    EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG  = 0x01,
+    EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG  = 0x02,
+    EMI_CONNECTION_ID_EXTRA_PACKET_FLAG  = 0x04,
+    EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG = 0x08,
+    EMI_NAK_RANGES_EXTRA_PACKET_FLAG     = 0x10
 } EmiPacketExtraFlags;
 
 #endif
@@ -69,7 +69,7 @@ private:
     }
     
     template<class SocketCookie>
-    bool init(SocketCookie socketCookie, const sockaddr_storage& address, Error& err) {
+    bool init(SocketCookie socketCookie, const sockaddr_storage& address, size_t reusePortShards, Error& err) {
         NetworkInterfaces ni;
         
         if (!Binding::getNetworkInterfaces(ni, err)) {
@@ -104,7 +104,7 @@ private:
             
             EmiNetUtil::addrSetPort(ifAddr, _localPort);
             
-            SocketHandle *handle = Binding::openSocket(socketCookie, onMessage, this, ifAddr, err);
+            SocketHandle *handle = Binding::openSocket(socketCookie, onMessage, this, ifAddr, reusePortShards, err);
             if (!handle) {
                 return false;
             }
@@ -140,15 +140,24 @@ public:
         }
     }
     
+    // If reusePortShards is non-zero, the sockets are opened with
+    // SO_REUSEPORT, which lets several EmiUdpSockets bind to the same
+    // port. reusePortShards is then the number of sockets that will
+    // share it. The kernel spreads the incoming datagrams over them by
+    // a hash of the source and destination addresses and ports, except
+    // that the binding steers datagrams that carry a connection ID to
+    // socket number (connection ID % reusePortShards), where the
+    // platform allows it.
     template<class SocketCookie>
     static EmiUdpSocket *open(SocketCookie socketCookie,
                               OnMessage *callback,
                               void *userData,
                               const sockaddr_storage& address,
+                              size_t reusePortShards,
                               Error& err) {
         EmiUdpSocket *sock = new EmiUdpSocket(callback, userData);
         
-        if (!sock->init(socketCookie, address, err)) {
+        if (!sock->init(socketCookie, address, reusePortShards, err)) {
             goto error;
         }
         
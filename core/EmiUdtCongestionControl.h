@@ -0,0 +1,187 @@
+//
+//  EmiUdtCongestionControl.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiUdtCongestionControl_h
+#define eminet_EmiUdtCongestionControl_h
+
+#include "EmiCongestionControlPolicy.h"
+#include "EmiNetRandom.h"
+
+#include <algorithm>
+#include <cmath>
+
+// This class implements the congestion control algorithm of UDT. It is
+// the default congestion control algorithm.
+//
+// The sending rate is increased on every ack, by an amount that depends
+// on how far below the link capacity it is. It is decreased by 1.125 at
+// the start of a congestion period, that is when a packet that was sent
+// after the last decrease is lost, and then randomly a few more times
+// during the period.
+template<class Binding>
+class EmiUdtCongestionControl : public EmiCongestionControlPolicy {
+    
+    size_t _congestionWindow;
+    // A sending rate of 0 means that we're in the slow start phase
+    float  _sendingRate;
+    size_t _totalDataSentInSlowStart;
+    
+    // The average number of NAKs in a congestion period.
+    float _avgNakCount;
+    // The number of NAKs in the current congestion period.
+    int _nakCount;
+    // The number of times the rate has been decreased in this
+    // congestion period
+    int _decCount;
+    int _decRandom;
+    // The biggest sequence number when last time the
+    // packet sending rate is decreased. Initially -1
+    EmiPacketSequenceNumber _lastDecSeq;
+    
+private:
+    // Private copy constructor and assignment operator
+    inline EmiUdtCongestionControl(const EmiUdtCongestionControl& other);
+    inline EmiUdtCongestionControl& operator=(const EmiUdtCongestionControl& other);
+    
+    void endSlowStartPhase(const State& state) {
+        _sendingRate = state.remoteDataArrivalRate;
+    }
+    
+public:
+    EmiUdtCongestionControl() :
+    _congestionWindow(EMI_MIN_CONGESTION_WINDOW),
+    _sendingRate(0),
+    _totalDataSentInSlowStart(0),
+    
+    _avgNakCount(1),
+    _nakCount(1),
+    _decCount(1),
+    _decRandom(2),
+    _lastDecSeq(-1) {}
+    
+    virtual ~EmiUdtCongestionControl() {}
+    
+    virtual void onPacketSent(EmiTimeInterval /*now*/, EmiPacketSequenceNumber /*sequenceNumber*/, size_t size) {
+        if (0 == _sendingRate) {
+            // We're in slow start mode
+            _totalDataSentInSlowStart += size;
+        }
+    }
+    
+    virtual void onAck(EmiTimeInterval /*now*/, const State& state) {
+        if (0 == _sendingRate) {
+            // We're in the slow start phase
+            _congestionWindow = std::max(EMI_MIN_CONGESTION_WINDOW, _totalDataSentInSlowStart);
+            
+            if (_congestionWindow >= EMI_MAX_CONGESTION_WINDOW) {
+                _congestionWindow = EMI_MAX_CONGESTION_WINDOW;
+                
+                endSlowStartPhase(state);
+            }
+        }
+        else {
+            // We're not in the slow start phase
+            
+            float inc = 1;
+            
+            if (state.remoteLinkCapacity > _sendingRate) {
+                // These are constants as specified by UDT. I have no
+                // idea of why they have this particular value.
+                static const double ALPHA = 8;
+                static const double BETA  = 0.0000015;
+                inc = std::max(std::pow(10, std::ceil(std::log10((state.remoteLinkCapacity-_sendingRate)*ALPHA))) * BETA,
+                               1.0);
+            }
+            
+            _sendingRate += inc/EMI_TICK_TIME;
+            
+            _congestionWindow = (size_t) (state.remoteDataArrivalRate * (state.rtt + EMI_TICK_TIME) + 10*1024);
+            _congestionWindow = std::min(EMI_MAX_CONGESTION_WINDOW, _congestionWindow);
+        }
+    }
+    
+    virtual void onNak(EmiTimeInterval /*now*/,
+                       EmiPacketSequenceNumber nak,
+                       EmiPacketSequenceNumber largestSNSoFar,
+                       const State& state) {
+        if (0 == _sendingRate) {
+            // We're in the slow start phase.
+            
+            if (-1 == state.remoteLinkCapacity ||
+                -1 == state.remoteDataArrivalRate) {
+                // We got a NAK, but we have not yet received
+                // data about the link capacity and the arrival
+                // rate. Ignore this packet.
+                return;
+            }
+            
+            endSlowStartPhase(state);
+        }
+        else {
+            // We're not in the slow start phase
+            
+            static const float SENDING_RATE_DECREASE = 1.125;
+            
+            if (nak > _lastDecSeq) {
+                // This NAK starts a new congestion period
+                
+                _sendingRate /= SENDING_RATE_DECREASE;
+                
+                static const float SMOOTH = 0.125;
+                _avgNakCount = (1-SMOOTH)*_avgNakCount + SMOOTH*_nakCount;
+                _nakCount = 1;
+                _decRandom = EmiNetRandom<Binding>::randomUniform(((int)std::floor(_avgNakCount))+1) + 1;
+                _decCount = 1;
+                _lastDecSeq = largestSNSoFar;
+            }
+            else {
+                // This NAK does not start a new congestion period
+                if (_decCount <= 5 && _nakCount == _decCount*_decRandom) {
+                    // The _decCount <= 5 ensures that the sending rate is not
+                    // decreased by more than 50% per congestion period (1.125^6≈2)
+                    
+                    _sendingRate /= SENDING_RATE_DECREASE;
+                    _decCount++;
+                    _lastDecSeq = largestSNSoFar;
+                }
+                
+                _nakCount++;
+            }
+        }
+    }
+    
+    virtual void onRttSample(EmiTimeInterval /*now*/, EmiTimeInterval /*rtt*/, const State& /*state*/) {}
+    
+    virtual void onDataArrivalRateSample(EmiTimeInterval /*now*/, float /*rate*/) {}
+    
+    virtual void onRto() {
+        _sendingRate /= 2;
+    }
+    
+    virtual void onPathChange() {
+        _congestionWindow = EMI_MIN_CONGESTION_WINDOW;
+        _sendingRate = 0;
+        _totalDataSentInSlowStart = 0;
+        
+        _avgNakCount = 1;
+        _nakCount = 1;
+        _decRandom = 2;
+        _decCount = 1;
+        _lastDecSeq = -1;
+    }
+    
+    virtual size_t congestionWindow() const {
+        return _congestionWindow;
+    }
+    
+    virtual float pacingRate() const {
+        return _sendingRate;
+    }
+};
+
+#endif
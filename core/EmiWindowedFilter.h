@@ -0,0 +1,123 @@
+//
+//  EmiWindowedFilter.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiWindowedFilter_h
+#define eminet_EmiWindowedFilter_h
+
+#include "EmiTypes.h"
+
+#include <functional>
+
+// This class keeps track of the maximum of the values that have been
+// pushed to it during the last window seconds. With Compare set to
+// std::less, it keeps track of the minimum instead.
+//
+// It doesn't store all of the values. It implements Kathleen Nichols'
+// algorithm, which is also what BBR uses for its estimates: It keeps
+// the best, the second best and the third best values of roughly
+// successive thirds of the window, so that when the best value gets too
+// old, there is another good value to replace it with.
+template<typename Element, typename Compare = std::greater<Element> >
+class EmiWindowedFilter {
+    
+    struct Sample {
+        EmiTimeInterval time;
+        Element         value;
+    };
+    
+    Sample _samples[3];
+    EmiTimeInterval _window;
+    bool _empty;
+    Compare _compare;
+    
+    // Returns true if a is at least as good as b
+    inline bool isAtLeastAsGood(const Element& a, const Element& b) const {
+        return !_compare(b, a);
+    }
+    
+    void resetTo(const Sample& sample) {
+        _samples[0] = _samples[1] = _samples[2] = sample;
+        _empty = false;
+    }
+    
+public:
+    explicit EmiWindowedFilter(EmiTimeInterval window) :
+    _window(window),
+    _empty(true),
+    _compare() {}
+    
+    inline void reset() {
+        _empty = true;
+    }
+    
+    inline bool empty() const {
+        return _empty;
+    }
+    
+    inline void setWindow(EmiTimeInterval window) {
+        _window = window;
+    }
+    
+    // The best value in the window. Must not be invoked when the filter
+    // is empty.
+    inline const Element& get() const {
+        return _samples[0].value;
+    }
+    
+    // The time when the value that get returns was pushed
+    inline EmiTimeInterval getTime() const {
+        return _samples[0].time;
+    }
+    
+    void pushValue(EmiTimeInterval now, const Element& value) {
+        Sample sample;
+        sample.time = now;
+        sample.value = value;
+        
+        if (_empty ||
+            isAtLeastAsGood(value, _samples[0].value) ||
+            now - _samples[2].time > _window) {
+            // The new value is the best one, or all of the values in
+            // the filter are too old
+            resetTo(sample);
+            return;
+        }
+        
+        if (isAtLeastAsGood(value, _samples[1].value)) {
+            _samples[1] = _samples[2] = sample;
+        }
+        else if (isAtLeastAsGood(value, _samples[2].value)) {
+            _samples[2] = sample;
+        }
+        
+        EmiTimeInterval age = now - _samples[0].time;
+        if (age > _window) {
+            // The best value is too old. Move the other values up.
+            _samples[0] = _samples[1];
+            _samples[1] = _samples[2];
+            _samples[2] = sample;
+            
+            if (now - _samples[0].time > _window) {
+                _samples[0] = _samples[1];
+                _samples[1] = _samples[2];
+            }
+        }
+        else if (_samples[1].time == _samples[0].time && age > _window/4) {
+            // A quarter of the window has passed without a second best
+            // value. Use this one.
+            _samples[1] = _samples[2] = sample;
+        }
+        else if (_samples[2].time == _samples[1].time && age > _window/2) {
+            // Half of the window has passed without a third best value.
+            // Use this one.
+            _samples[2] = sample;
+        }
+    }
+};
+
+#endif
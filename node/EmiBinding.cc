@@ -3,41 +3,19 @@
 #include "EmiBinding.h"
 
 #include "../core/EmiNetUtil.h"
+#include "../core/EmiTimerWheel.h"
 #include "EmiNodeUtil.h"
 #include "EmiConnection.h"
 #include "EmiSocket.h"
 #include "EmiObjectWrap.h"
 
 #include <node.h>
+#include <cmath>
 #include <openssl/rand.h>
 #include <openssl/hmac.h>
 
 using namespace v8;
 
-Persistent<Object> EmiBinding::makePersistentData(const uint8_t *data, size_t length) {
-    HandleScope scope;
-    
-    // TODO It would probably be better to use the slab allocator here
-    
-    // Copy the buffer
-    node::Buffer *buf(node::Buffer::New((char *)data, length));
-    
-    // Make a new persistent handle (do not just reuse the persistent buf->handle_ handle)
-    return Persistent<Object>::New(buf->handle_);
-}
-
-Local<Object> EmiBinding::makeTemporaryData(size_t size, uint8_t **outData) {
-    HandleScope scope;
-    
-    // TODO It would probably be better to use the slab allocator here
-    
-    node::Buffer *buf(node::Buffer::New(size));
-    
-    *outData = (uint8_t *)node::Buffer::Data(buf);
-    
-    return scope.Close(buf->handle_);
-}
-
 void EmiBinding::hmacHash(const uint8_t *key, size_t keyLength,
                           const uint8_t *data, size_t dataLength,
                           uint8_t *buf, size_t bufLen) {
@@ -50,50 +28,83 @@ void EmiBinding::randomBytes(uint8_t *buf, size_t bufSize) {
     ASSERT(RAND_bytes(buf, bufSize));
 }
 
-static void close_cb(uv_handle_t* handle) {
-    free(handle);
+// All timers are scheduled on one EmiTimerWheel, which in turn is
+// driven by one libuv timer. Every connection has a handful of timers,
+// and with lots of connections it is much cheaper to keep them in the
+// wheel than to have one uv_timer_t for each of them.
+static EmiTimerWheel *timerWheel = NULL;
+static uv_timer_t     timerWheelTimer;
+
+static void timer_wheel_cb(uv_timer_t *handle, int status);
+
+static EmiTimerWheel& getTimerWheel() {
+    if (!timerWheel) {
+        timerWheel = new EmiTimerWheel(1.0/EmiNodeUtil::MSECS_PER_SEC);
+        uv_timer_init(uv_default_loop(), &timerWheelTimer);
+    }
+    
+    return *timerWheel;
+}
+
+static void updateTimerWheelTimer(EmiTimeInterval now) {
+    EmiTimeInterval timeout;
+    if (getTimerWheel().nextTimeout(now, timeout)) {
+        uv_timer_start(&timerWheelTimer,
+                       timer_wheel_cb,
+                       static_cast<uint64_t>(std::ceil(timeout*EmiNodeUtil::MSECS_PER_SEC)),
+                       0);
+    }
+    else {
+        uv_timer_stop(&timerWheelTimer);
+    }
 }
 
-static void timer_cb(uv_timer_t *handle, int status) {
-    EmiBinding::TimerCb *timerCb = *(reinterpret_cast<EmiBinding::TimerCb**>(handle+1));
-    timerCb(EmiNodeUtil::now(), handle, handle->data);
+static void timer_wheel_cb(uv_timer_t *handle, int status) {
+    getTimerWheel().advance(EmiNodeUtil::now());
+    updateTimerWheelTimer(EmiNodeUtil::now());
 }
 
 EmiBinding::Timer *EmiBinding::makeTimer(void *timerCookie) {
-    EmiBinding::Timer *timer = (uv_timer_t *)malloc(sizeof(uv_timer_t)+sizeof(TimerCb*));
-    
-    uv_timer_init(uv_default_loop(), timer);
+    // Make sure that the timer wheel is initialized
+    getTimerWheel();
     
-    return timer;
+    return new EmiTimerWheelTimer;
+}
+
+// Stops the wheel's uv timer when there are no timers left, so that
+// the wheel doesn't keep the event loop alive.
+static void stopTimerWheelTimerIfEmpty() {
+    if (getTimerWheel().empty()) {
+        uv_timer_stop(&timerWheelTimer);
+    }
 }
 
 void EmiBinding::freeTimer(Timer *timer) {
-    uv_timer_stop(timer);
-    uv_close((uv_handle_t *)timer, close_cb);
+    // It is safe to do this from within the timer's callback
+    getTimerWheel().deschedule(timer);
+    stopTimerWheelTimerIfEmpty();
+    delete timer;
 }
 
 void EmiBinding::scheduleTimer(Timer *timer, TimerCb *timerCb, void *data, EmiTimeInterval interval,
                                bool repeating, bool reschedule) {
-    if (!reschedule && uv_is_active((uv_handle_t *)timer)) {
+    if (!reschedule && timer->isScheduled()) {
         // We were told not to re-schedule the timer. 
         // The timer is already active, so do nothing.
         return;
     }
     
-    uv_timer_stop(timer);
-    
-    *(reinterpret_cast<TimerCb**>(timer+1)) = timerCb;
-    
-    uint64_t timeout = static_cast<uint64_t>(interval*EmiNodeUtil::MSECS_PER_SEC);
-    timer->data = data;
-    uv_timer_start(timer,
-                   timer_cb,
-                   timeout,
-                   repeating ? timeout : 0);
+    EmiTimeInterval now(EmiNodeUtil::now());
+    getTimerWheel().schedule(timer, now, timerCb, data, interval, repeating);
+    updateTimerWheelTimer(now);
 }
 
 void EmiBinding::descheduleTimer(Timer *timer) {
-    uv_timer_stop(timer);
+    getTimerWheel().deschedule(timer);
+    // When there are other timers left, the uv timer is left as it is.
+    // It might fire earlier than it has to, but then it will notice that
+    // there is nothing to do yet and reschedule itself.
+    stopTimerWheelTimerIfEmpty();
 }
 
 // TODO Begin to use this code once stable node has libuv with uv_interface_address_t
@@ -205,8 +216,7 @@ struct EmiBindingSockData {
 static void recv_cb(uv_udp_t *socket,
                     const struct sockaddr_storage& addr,
                     ssize_t nread,
-                    const v8::Local<v8::Object>& slab,
-                    size_t offset) {
+                    const uint8_t *data) {
     HandleScope scope;
     
     EmiBindingSockData *ebsd = reinterpret_cast<EmiBindingSockData *>(socket->data);
@@ -225,8 +235,8 @@ static void recv_cb(uv_udp_t *socket,
                        ebsd->userData,
                        EmiNodeUtil::now(),
                        addr,
-                       slab,
-                       offset,
+                       EmiBufferRef(data, nread),
+                       /*offset:*/0,
                        nread);
     }
 }
@@ -251,6 +261,7 @@ uv_udp_t *EmiBinding::openSocket(EmiObjectWrap* jsObj,
                                  EmiOnMessage *callback,
                                  void *userData,
                                  const sockaddr_storage& address,
+                                 size_t reusePortShards,
                                  Error& err) {
     EmiBindingSockData *ebsd = (EmiBindingSockData *)malloc(sizeof(EmiBindingSockData));
     ebsd->callback = callback;
@@ -258,6 +269,7 @@ uv_udp_t *EmiBinding::openSocket(EmiObjectWrap* jsObj,
     ebsd->jsObj = jsObj;
     
     uv_udp_t *ret(EmiNodeUtil::openSocket(address,
+                                          reusePortShards,
                                           recv_cb, ebsd,
                                           err));
     
@@ -5,6 +5,8 @@
 #include "EmiError.h"
 
 #include "../core/EmiTypes.h"
+#include "../core/EmiTimerWheel.h"
+#include "../core/EmiBuffer.h"
 #include <node.h>
 #include <node_buffer.h>
 #include <uv.h>
@@ -19,6 +21,11 @@
 class EmiSockDelegate;
 class EmiObjectWrap;
 
+// Everything in the node.js binding, including EmiSock and EmiConn,
+// runs on the node.js thread, on uv_default_loop. The timer wheel,
+// EmiMessageBatch and the slab allocators are process wide and not
+// locked, and the delegates call straight into Javascript, so none of
+// it may be used from another thread.
 class EmiBinding {
 private:
     inline EmiBinding();
@@ -27,9 +34,13 @@ public:
     
     typedef EmiError                   Error;
     typedef uv_udp_t                   SocketHandle;
-    typedef v8::Local<v8::Object>      TemporaryData;
-    typedef v8::Persistent<v8::Object> PersistentData;
-    typedef uv_timer_t                 Timer;
+    // The data that the core holds on to is kept in native buffers rather
+    // than in node::Buffer objects, so that every queued or buffered
+    // message doesn't need a V8 object and a persistent handle. V8
+    // objects are made only when data is passed to Javascript.
+    typedef EmiBufferRef               TemporaryData;
+    typedef EmiBuffer*                 PersistentData;
+    typedef EmiTimerWheelTimer         Timer;
     typedef void*                      TimerCookie;
     typedef void (TimerCb)(EmiTimeInterval now, Timer *timer, void *data);
     
@@ -45,20 +56,41 @@ public:
         return EmiError(domain, code);
     }
     
-    static v8::Persistent<v8::Object> makePersistentData(const uint8_t *data, size_t length);
-    static v8::Local<v8::Object> makeTemporaryData(size_t size, uint8_t **outData);
-    inline static void releasePersistentData(v8::Persistent<v8::Object> buf) {
-        buf.Dispose();
+    inline static EmiBuffer *makePersistentData(const uint8_t *data, size_t length) {
+        return EmiBuffer::make(data, length);
     }
-    inline static v8::Local<v8::Object> castToTemporary(const v8::Persistent<v8::Object>& data) {
-        return v8::Local<v8::Object>::New(data);
+    inline static EmiBufferRef makeTemporaryData(size_t size, uint8_t **outData) {
+        EmiBuffer *buf(EmiBuffer::make(size));
+        *outData = buf->data();
+        
+        EmiBufferRef ref(buf);
+        buf->release();
+        return ref;
+    }
+    inline static void releasePersistentData(EmiBuffer *buf) {
+        if (buf) buf->release();
+    }
+    // Returns a new reference to the same buffer, without copying it.
+    // The references have to be released separately.
+    inline static EmiBuffer *sharePersistentData(EmiBuffer *buf) {
+        if (buf) buf->retain();
+        return buf;
+    }
+    inline static EmiBufferRef castToTemporary(EmiBuffer *buf) {
+        return EmiBufferRef(buf);
     }
     
-    inline static const uint8_t *extractData(v8::Handle<v8::Object> data) {
-        return (uint8_t *)(data.IsEmpty() ? NULL : node::Buffer::Data(data));
+    inline static const uint8_t *extractData(const EmiBufferRef& data) {
+        return data.data();
+    }
+    inline static size_t extractLength(const EmiBufferRef& data) {
+        return data.length();
+    }
+    inline static const uint8_t *extractData(const EmiBuffer *data) {
+        return data ? data->data() : NULL;
     }
-    inline static size_t extractLength(v8::Handle<v8::Object> data) {
-        return data.IsEmpty() ? 0 : node::Buffer::Length(data);
+    inline static size_t extractLength(const EmiBuffer *data) {
+        return data ? data->length() : 0;
     }
     
     static const size_t HMAC_HASH_SIZE = 32;
@@ -91,6 +123,7 @@ public:
                                 EmiOnMessage *callback,
                                 void *userData,
                                 const sockaddr_storage& address,
+                                size_t reusePortShards,
                                 Error& err);
     static void extractLocalAddress(uv_udp_t *socket, sockaddr_storage& address);
     static void sendData(uv_udp_t *socket,
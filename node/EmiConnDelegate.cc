@@ -2,6 +2,7 @@
 
 #include "EmiConnDelegate.h"
 #include "EmiNodeUtil.h"
+#include "EmiMessageBatch.h"
 
 #include "EmiSocket.h"
 #include "EmiConnection.h"
@@ -12,10 +13,29 @@ EmiConnDelegate::EmiConnDelegate(EmiConnection& conn) : _conn(conn) {
 }
 
 void EmiConnDelegate::invalidate() {
+    // The batch has a pointer to _conn
+    EmiMessageBatch::flush();
+    
     if (EMI_CONNECTION_TYPE_SERVER == _conn._conn.getType()) {
         _conn._es._sock.deregisterServerConnection(&_conn._conn);
     }
     
+    // A connection that Javascript has not called into, for instance
+    // because it failed to open, has no wrapper yet. It is wrapped here
+    // anyway, so that the EmiConnection is deleted by V8's GC, long
+    // after this method has returned, just like all other connections.
+    //
+    // The Javascript object of an accepted connection only has a
+    // v8::External until it is wrapped, and the External is about to
+    // become invalid, so it gets the wrapper now.
+    {
+        HandleScope scope;
+        Handle<Object> handle(_conn.getHandle());
+        if (!_conn._jsHandle.IsEmpty()) {
+            _conn._jsHandle->Set(EmiConnection::handleSymbol, handle);
+        }
+    }
+    
     // This allows V8's GC to reclaim the EmiConnection when it's been closed
     // The corresponding Ref is in EmiConnection::New
     //
@@ -26,14 +46,22 @@ void EmiConnDelegate::invalidate() {
     _conn.Unref();
 }
 
+void EmiConnDelegate::emiConnMoved(const sockaddr_storage& oldAddress) {
+    _conn._es._sock.serverConnectionMoved(&_conn._conn, oldAddress);
+}
+
 void EmiConnDelegate::emiConnPacketLoss(EmiChannelQualifier channelQualifier,
                                         EmiSequenceNumber packetsLost) {
+    // Don't let this event overtake messages that were received
+    // before it
+    EmiMessageBatch::flush();
+    
     HandleScope scope;
     
     const unsigned argc = 4;
     Handle<Value> argv[argc] = {
         _conn._jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : _conn._jsHandle,
-        _conn.handle_,
+        _conn.getHandleIfWrapped(),
         Number::New(channelQualifier),
         Number::New(packetsLost)
     };
@@ -41,64 +69,77 @@ void EmiConnDelegate::emiConnPacketLoss(EmiChannelQualifier channelQualifier,
 }
 
 void EmiConnDelegate::emiConnMessage(EmiChannelQualifier channelQualifier,
-                                     const v8::Local<v8::Object>& data,
+                                     const EmiBinding::TemporaryData& data,
                                      size_t offset,
                                      size_t size) {
-    HandleScope scope;
-    
-    const unsigned argc = 6;
-    Handle<Value> argv[argc] = {
-        _conn._jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : _conn._jsHandle,
-        _conn.handle_,
-        Number::New(channelQualifier),
-        data,
-        Number::New(offset),
-        Number::New(size)
-    };
-    EmiSocket::connectionMessage->Call(Context::GetCurrent()->Global(), argc, argv);
+    EmiMessageBatch::add(_conn,
+                         channelQualifier,
+                         EmiBinding::extractData(data)+offset,
+                         size,
+                         EMI_MESSAGE_PART_FIRST | EMI_MESSAGE_PART_LAST);
+}
+
+void EmiConnDelegate::emiConnMessagePart(EmiChannelQualifier channelQualifier,
+                                         const EmiBinding::TemporaryData& data,
+                                         size_t offset,
+                                         size_t size,
+                                         EmiMessagePartFlags partFlags) {
+    EmiMessageBatch::add(_conn,
+                         channelQualifier,
+                         EmiBinding::extractData(data)+offset,
+                         size,
+                         partFlags);
 }
 
 void EmiConnDelegate::emiConnLost() {
+    EmiMessageBatch::flush();
+    
     HandleScope scope;
     
     const unsigned argc = 2;
     Handle<Value> argv[argc] = {
         _conn._jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : _conn._jsHandle,
-        _conn.handle_
+        _conn.getHandleIfWrapped()
     };
     EmiSocket::connectionLost->Call(Context::GetCurrent()->Global(), argc, argv);
 }
 
 void EmiConnDelegate::emiConnRegained() {
+    EmiMessageBatch::flush();
+    
     HandleScope scope;
     
     const unsigned argc = 2;
     Handle<Value> argv[argc] = {
         _conn._jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : _conn._jsHandle,
-        _conn.handle_
+        _conn.getHandleIfWrapped()
     };
     EmiSocket::connectionRegained->Call(Context::GetCurrent()->Global(), argc, argv);
 }
 
 void EmiConnDelegate::emiConnDisconnect(EmiDisconnectReason reason) {
+    EmiMessageBatch::flush();
+    
     HandleScope scope;
     
     const unsigned argc = 3;
     Handle<Value> argv[argc] = {
         _conn._jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : _conn._jsHandle,
-        _conn.handle_,
+        _conn.getHandleIfWrapped(),
         Integer::New(reason) // TODO Give something better than just the error code
     };
     EmiSocket::connectionDisconnect->Call(Context::GetCurrent()->Global(), argc, argv);
 }
 
 void EmiConnDelegate::emiNatPunchthroughFinished(bool success) {
+    EmiMessageBatch::flush();
+    
     HandleScope scope;
     
     const unsigned argc = 3;
     Handle<Value> argv[argc] = {
         _conn._jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : _conn._jsHandle,
-        _conn.handle_,
+        _conn.getHandleIfWrapped(),
         Boolean::New(success)
     };
     EmiSocket::natPunchthroughFinished->Call(Context::GetCurrent()->Global(), argc, argv);
@@ -2,6 +2,8 @@
 #ifndef eminet_EmiConnDelegate_h
 #define eminet_EmiConnDelegate_h
 
+#include "EmiBinding.h"
+
 #include "../core/EmiTypes.h"
 #include <uv.h>
 #include <node.h>
@@ -16,13 +18,19 @@ public:
     EmiConnDelegate(EmiConnection& conn);
     
     void invalidate();
+    void emiConnMoved(const sockaddr_storage& oldAddress);
     
     void emiConnPacketLoss(EmiChannelQualifier channelQualifier,
                            EmiSequenceNumber packetsLost);
     void emiConnMessage(EmiChannelQualifier channelQualifier,
-                        const v8::Local<v8::Object>& data,
+                        const EmiBinding::TemporaryData& data,
                         size_t offset,
                         size_t size);
+    void emiConnMessagePart(EmiChannelQualifier channelQualifier,
+                            const EmiBinding::TemporaryData& data,
+                            size_t offset,
+                            size_t size,
+                            EmiMessagePartFlags partFlags);
     
     void scheduleConnectionWarning(EmiTimeInterval warningTimeout);
     
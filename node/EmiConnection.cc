@@ -3,16 +3,21 @@
 #include "EmiConnection.h"
 #include "EmiSocket.h"
 #include "EmiNodeUtil.h"
-#include "EmiConnectionParams.h"
 
 #include "../core/EmiNetUtil.h"
 
 #include <node.h>
+#include <algorithm>
+#include <vector>
 
 using namespace v8;
 
 Persistent<String>   EmiConnection::channelQualifierSymbol;
 Persistent<String>   EmiConnection::prioritySymbol;
+Persistent<String>   EmiConnection::dataSymbol;
+Persistent<String>   EmiConnection::firstSymbol;
+Persistent<String>   EmiConnection::lastSymbol;
+Persistent<String>   EmiConnection::handleSymbol;
 Persistent<Function> EmiConnection::constructor;
 
 EmiConnection::EmiConnection(EmiSocket& es, const ECP& params) :
@@ -27,7 +32,11 @@ void EmiConnection::Init(Handle<Object> target) {
 #define X(sym) sym##Symbol = Persistent<String>::New(String::NewSymbol(#sym));
     X(channelQualifier);
     X(priority);
+    X(data);
+    X(first);
+    X(last);
 #undef X
+    handleSymbol = Persistent<String>::New(String::NewSymbol("_handle"));
     
     // Prepare constructor template
     Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
@@ -42,6 +51,7 @@ void EmiConnection::Init(Handle<Object> target) {
     X(ForceClose,                 "forceClose");
     X(CloseOrForceClose,          "closeOrForceClose");
     X(Send,                       "send");
+    X(SendMany,                   "sendMany");
     X(HasIssuedConnectionWarning, "hasIssuedConnectionWarning");
     X(GetSocket,                  "getSocket");
     X(GetAddressType,             "getAddressType");
@@ -53,22 +63,30 @@ void EmiConnection::Init(Handle<Object> target) {
     X(IsOpen,                     "isOpen");
     X(IsOpening,                  "isOpening");
     X(GetP2PState,                "getP2PState");
+    X(PollMessages,               "pollMessages");
+    X(GetDroppedPolledMessages,   "getDroppedPolledMessages");
+    X(GetEvictedBytes,            "getEvictedBytes");
 #undef X
     
     constructor = Persistent<Function>::New(tpl->GetFunction());
+    
+    target->Set(String::NewSymbol("wrapConnection"),
+                FunctionTemplate::New(WrapConnection)->GetFunction());
 }
 
-Handle<Object> EmiConnection::NewInstance(EmiSocket& es,
-                                          const ECP& params) {
-    HandleScope scope;
-    
-    const unsigned argc = 1;
-    Handle<Value> argv[argc] = {
-        EmiConnectionParams::NewInstance(es, params)
-    };
-    Local<Object> instance = constructor->NewInstance(argc, argv);
+Handle<Object> EmiConnection::getHandle() {
+    if (handle_.IsEmpty()) {
+        HandleScope scope;
+        
+        // New wraps this object
+        const unsigned argc = 1;
+        Handle<Value> argv[argc] = {
+            External::New(this)
+        };
+        constructor->NewInstance(argc, argv);
+    }
     
-    return scope.Close(instance);
+    return handle_;
 }
 
 Handle<Value> EmiConnection::New(const Arguments& args) {
@@ -76,13 +94,11 @@ Handle<Value> EmiConnection::New(const Arguments& args) {
     
     ENSURE_NUM_ARGS(1, args);
     
-    EmiConnectionParams *ecp =
-    (EmiConnectionParams *)args[0]->ToObject()->GetPointerFromInternalField(0);
-    
-    EmiConnection *ec = new EmiConnection(ecp->es,
-                                          ecp->params);
+    if (!args[0]->IsExternal()) {
+        THROW_TYPE_ERROR("Wrong arguments");
+    }
     
-    delete ecp;
+    EmiConnection *ec = (EmiConnection *)External::Cast(*args[0])->Value();
     
     ec->Wrap(args.This());
     
@@ -93,6 +109,24 @@ Handle<Value> EmiConnection::New(const Arguments& args) {
     return args.This();
 }
 
+// Takes the v8::External that gotServerConnection gave to Javascript,
+// and returns the wrapper object of the connection. The External is
+// valid until the connection is invalidated; EmiConnDelegate::invalidate
+// makes sure that Javascript has the wrapper by then.
+Handle<Value> EmiConnection::WrapConnection(const Arguments& args) {
+    HandleScope scope;
+    
+    ENSURE_NUM_ARGS(1, args);
+    
+    if (!args[0]->IsExternal()) {
+        THROW_TYPE_ERROR("Wrong arguments");
+    }
+    
+    EmiConnection *ec = (EmiConnection *)External::Cast(*args[0])->Value();
+    
+    return scope.Close(ec->getHandle());
+}
+
 Handle<Value> EmiConnection::Close(const Arguments& args) {
     HandleScope scope;
     
@@ -182,7 +216,7 @@ Handle<Value> EmiConnection::Send(const Arguments& args) {
     
     EmiError err;
     if (!ec->_conn.send(EmiNodeUtil::now(),
-                        Persistent<Object>::New(args[0]->ToObject()),
+                        EmiNodeUtil::copyBuffer(args[0]->ToObject()),
                         channelQualifier,
                         priority,
                         err)) {
@@ -192,6 +226,91 @@ Handle<Value> EmiConnection::Send(const Arguments& args) {
     return scope.Close(Undefined());
 }
 
+Handle<Value> EmiConnection::SendMany(const Arguments& args) {
+    HandleScope scope;
+    
+    
+    /// Basic argument checks
+    
+    ENSURE_NUM_ARGS(1, args);
+    
+    if (!args[0]->IsArray()) {
+        THROW_TYPE_ERROR("Wrong arguments");
+    }
+    
+    
+    /// Extract and validate all messages before anything is sent
+    
+    Local<Array> messages(Local<Array>::Cast(args[0]));
+    uint32_t count = messages->Length();
+    
+    std::vector<EC::SendRequest> requests;
+    requests.reserve(count);
+    
+    for (uint32_t i=0; i<count; i++) {
+        Local<Value> message(messages->Get(i));
+        if (!message->IsArray()) {
+            THROW_TYPE_ERROR("Wrong arguments");
+        }
+        
+        // [buffer, channelQualifier, priority], where the last two
+        // are optional
+        Local<Array> fields(Local<Array>::Cast(message));
+        Local<Value> data(fields->Get(0));
+        Local<Value>  cqv(fields->Get(1));
+        Local<Value>   pv(fields->Get(2));
+        
+        // Note that we do not verify that the data is a Buffer object;
+        // we assume that the JS binding code ensures that.
+        if (!data->IsObject()) {
+            THROW_TYPE_ERROR("Wrong arguments");
+        }
+        
+        EmiChannelQualifier channelQualifier = EMI_CHANNEL_QUALIFIER_DEFAULT;
+        EmiPriority priority = EMI_PRIORITY_DEFAULT;
+        
+        if (!cqv.IsEmpty() && !cqv->IsUndefined()) {
+            if (!cqv->IsNumber()) {
+                THROW_TYPE_ERROR("Wrong channel quality argument");
+            }
+            
+            channelQualifier = (EmiChannelQualifier) cqv->Uint32Value();
+        }
+        
+        if (!pv.IsEmpty() && !pv->IsUndefined()) {
+            if (!pv->IsNumber()) {
+                THROW_TYPE_ERROR("Wrong priority argument");
+            }
+            
+            priority = (EmiPriority) pv->Uint32Value();
+        }
+        
+        // The data is copied later, so that nothing has to be cleaned up
+        // if one of the messages is invalid
+        requests.push_back(EC::SendRequest(NULL, channelQualifier, priority));
+    }
+    
+    for (uint32_t i=0; i<count; i++) {
+        Local<Array> fields(Local<Array>::Cast(messages->Get(i)));
+        requests[i].data = EmiNodeUtil::copyBuffer(fields->Get(0)->ToObject());
+    }
+    
+    
+    // Do the actual send
+    
+    UNWRAP(EmiConnection, ec, args);
+    
+    EmiError err;
+    if (!ec->_conn.sendMany(EmiNodeUtil::now(),
+                            requests.empty() ? NULL : &requests[0],
+                            requests.size(),
+                            err)) {
+        return err.raise("Failed to send messages");
+    }
+    
+    return scope.Close(Undefined());
+}
+
 Handle<Value> EmiConnection::HasIssuedConnectionWarning(const Arguments& args) {
     HandleScope scope;
     
@@ -310,3 +429,74 @@ Handle<Value> EmiConnection::GetP2PState(const Arguments& args) {
     
     return scope.Close(Integer::New(ec->_conn.getP2PState()));
 }
+
+Handle<Value> EmiConnection::PollMessages(const Arguments& args) {
+    HandleScope scope;
+    
+    size_t numArgs = args.Length();
+    if (!(0 == numArgs || 1 == numArgs)) {
+        THROW_TYPE_ERROR("Wrong number of arguments");
+    }
+    
+    if (1 == numArgs && !args[0]->IsNumber()) {
+        THROW_TYPE_ERROR("Wrong arguments");
+    }
+    
+    UNWRAP(EmiConnection, ec, args);
+    
+    size_t maxCount = (1 == numArgs ? args[0]->Uint32Value() : (size_t)-1);
+    
+    Local<Array> result(Array::New());
+    EC::PolledMessage msgs[32];
+    size_t total = 0;
+    
+    while (total < maxCount) {
+        size_t count = ec->_conn.pollMessages(msgs, std::min(maxCount-total, sizeof(msgs)/sizeof(*msgs)));
+        if (0 == count) {
+            break;
+        }
+        
+        for (size_t i=0; i<count; i++) {
+            Local<Object> msg(Object::New());
+            msg->Set(channelQualifierSymbol, Integer::New(msgs[i].channelQualifier));
+            // This is where the data gets a V8 object
+            node::Buffer *buf(node::Buffer::New((char *)EmiBinding::extractData(msgs[i].data),
+                                                EmiBinding::extractLength(msgs[i].data)));
+            msg->Set(dataSymbol, buf->handle_);
+            // Whole messages are both the first and the last part
+            msg->Set(firstSymbol, Boolean::New(!!(msgs[i].partFlags & EMI_MESSAGE_PART_FIRST)));
+            msg->Set(lastSymbol,  Boolean::New(!!(msgs[i].partFlags & EMI_MESSAGE_PART_LAST)));
+            result->Set(total+i, msg);
+        }
+        EC::releasePolledMessages(msgs, count);
+        
+        total += count;
+    }
+    
+    return scope.Close(result);
+}
+
+Handle<Value> EmiConnection::GetDroppedPolledMessages(const Arguments& args) {
+    HandleScope scope;
+    
+    ENSURE_ZERO_ARGS(args);
+    UNWRAP(EmiConnection, ec, args);
+    
+    return scope.Close(Number::New(ec->_conn.droppedPolledMessages()));
+}
+
+Handle<Value> EmiConnection::GetEvictedBytes(const Arguments& args) {
+    HandleScope scope;
+    
+    ENSURE_NUM_ARGS(1, args);
+    
+    if (!args[0]->IsNumber()) {
+        THROW_TYPE_ERROR("Wrong channel quality argument");
+    }
+    
+    UNWRAP(EmiConnection, ec, args);
+    
+    EmiChannelQualifier channelQualifier = (EmiChannelQualifier) args[0]->Uint32Value();
+    
+    return scope.Close(Number::New(ec->_conn.evictedBytes(channelQualifier)));
+}
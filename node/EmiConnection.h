@@ -5,11 +5,12 @@
 #include "EmiBinding.h"
 #include "EmiSockDelegate.h"
 #include "EmiConnDelegate.h"
+#include "EmiObjectWrap.h"
 
 #include "../core/EmiConn.h"
 #include <node.h>
 
-class EmiConnection : public node::ObjectWrap {
+class EmiConnection : public EmiObjectWrap {
     friend class EmiConnDelegate;
     friend class EmiSockDelegate;
     typedef EmiConn<EmiSockDelegate, EmiConnDelegate> EC;
@@ -22,6 +23,10 @@ private:
     
     static v8::Persistent<v8::String>   channelQualifierSymbol;
     static v8::Persistent<v8::String>   prioritySymbol;
+    static v8::Persistent<v8::String>   dataSymbol;
+    static v8::Persistent<v8::String>   firstSymbol;
+    static v8::Persistent<v8::String>   lastSymbol;
+    static v8::Persistent<v8::String>   handleSymbol;
     static v8::Persistent<v8::Function> constructor;
     
     // Private copy constructor and assignment operator
@@ -34,12 +39,28 @@ private:
 public:
     static void Init(v8::Handle<v8::Object> target);
     
-    static v8::Handle<v8::Object> NewInstance(EmiSocket& es,
-                                              const ECP& params);
+    // Returns the V8 object that wraps this connection. The object is
+    // made the first time this is invoked: EmiSockDelegate::makeConnection
+    // only makes the native object, and accepted connections are handed
+    // to Javascript as a v8::External, which Javascript turns into the
+    // wrapper with wrapConnection when it first uses the connection. That
+    // way, connections that Javascript never calls into don't cost a
+    // wrapper object.
+    v8::Handle<v8::Object> getHandle();
+    
+    // Returns the V8 object that wraps this connection, or undefined if
+    // it has not been made yet
+    inline v8::Handle<v8::Value> getHandleIfWrapped() const {
+        return handle_.IsEmpty() ? v8::Handle<v8::Value>(v8::Undefined()) : v8::Handle<v8::Value>(handle_);
+    }
     
     inline EC& getConn() { return _conn; }
     inline const EC& getConn() const { return _conn; }
     
+    inline v8::Handle<v8::Object> getJsHandle() const {
+        return _jsHandle;
+    }
+    
     inline void setJsHandle(v8::Handle<v8::Object> jsHandle) {
         _jsHandle.Dispose();
         _jsHandle = v8::Persistent<v8::Object>::New(jsHandle);
@@ -47,10 +68,12 @@ public:
     
 private:
     static v8::Handle<v8::Value> New(const v8::Arguments& args);
+    static v8::Handle<v8::Value> WrapConnection(const v8::Arguments& args);
     static v8::Handle<v8::Value> Close(const v8::Arguments& args);
     static v8::Handle<v8::Value> ForceClose(const v8::Arguments& args);
     static v8::Handle<v8::Value> CloseOrForceClose(const v8::Arguments& args);
     static v8::Handle<v8::Value> Send(const v8::Arguments& args);
+    static v8::Handle<v8::Value> SendMany(const v8::Arguments& args);
     
     static v8::Handle<v8::Value> HasIssuedConnectionWarning(const v8::Arguments& args);
     static v8::Handle<v8::Value> GetSocket(const v8::Arguments& args);
@@ -63,6 +86,9 @@ private:
     static v8::Handle<v8::Value> IsOpen(const v8::Arguments& args);
     static v8::Handle<v8::Value> IsOpening(const v8::Arguments& args);
     static v8::Handle<v8::Value> GetP2PState(const v8::Arguments& args);
+    static v8::Handle<v8::Value> PollMessages(const v8::Arguments& args);
+    static v8::Handle<v8::Value> GetDroppedPolledMessages(const v8::Arguments& args);
+    static v8::Handle<v8::Value> GetEvictedBytes(const v8::Arguments& args);
 };
 
 #endif
@@ -0,0 +1,137 @@
+#define BUILDING_NODE_EXTENSION
+
+#include "EmiMessageBatch.h"
+
+#include "EmiSocket.h"
+#include "EmiConnection.h"
+#include "slab_allocator.h"
+
+#include <node.h>
+#include <node_buffer.h>
+#include <cstring>
+#include <algorithm>
+
+using namespace v8;
+
+static const int SLAB_SIZE = 1024 * 1024;
+
+// This is not the slab allocator of EmiNodeUtil, because that one only
+// has one allocation at a time
+static node::SlabAllocator slab_allocator(SLAB_SIZE);
+
+char                               *EmiMessageBatch::_data = NULL;
+size_t                              EmiMessageBatch::_size = 0;
+size_t                              EmiMessageBatch::_capacity = 0;
+std::vector<EmiMessageBatch::Entry> EmiMessageBatch::_entries;
+uv_check_t                          EmiMessageBatch::_check;
+bool                                EmiMessageBatch::_checkInitialized = false;
+bool                                EmiMessageBatch::_hasParts = false;
+
+void EmiMessageBatch::checkCb(uv_check_t *handle, int status) {
+    flush();
+}
+
+void EmiMessageBatch::add(EmiConnection& conn,
+                          EmiChannelQualifier channelQualifier,
+                          const uint8_t *data,
+                          size_t length,
+                          EmiMessagePartFlags partFlags) {
+    // This is a loop, because Javascript might receive messages of its
+    // own while the batch is flushed
+    while (!_entries.empty() && length > _capacity-_size) {
+        flush();
+    }
+    
+    if (_entries.empty()) {
+        // The slab allocator hangs on to the slab until the batch is
+        // flushed and the unused part is given back
+        _capacity = std::max(length, (size_t)BUFFER_SIZE);
+        _data = slab_allocator.Allocate(Context::GetCurrent()->Global(), _capacity);
+        _size = 0;
+        
+        if (!_checkInitialized) {
+            uv_check_init(uv_default_loop(), &_check);
+            _checkInitialized = true;
+        }
+        
+        // The check handle is only active while there are messages to
+        // deliver, so it doesn't keep node.js alive.
+        uv_check_start(&_check, checkCb);
+    }
+    
+    Entry entry;
+    entry.conn = &conn;
+    entry.channelQualifier = channelQualifier;
+    entry.offset = _size;
+    entry.length = length;
+    entry.partFlags = partFlags;
+    _entries.push_back(entry);
+    
+    if ((EMI_MESSAGE_PART_FIRST | EMI_MESSAGE_PART_LAST) != partFlags) {
+        _hasParts = true;
+    }
+    
+    memcpy(_data+_size, data, length);
+    _size += length;
+}
+
+void EmiMessageBatch::flush() {
+    if (_entries.empty()) {
+        return;
+    }
+    
+    HandleScope scope;
+    
+    uv_check_stop(&_check);
+    
+    Local<Object> slab = slab_allocator.Shrink(Context::GetCurrent()->Global(),
+                                               _data,
+                                               _size);
+    // The batch starts this far into the slab
+    size_t base = _data - node::Buffer::Data(slab);
+    
+    size_t count = _entries.size();
+    Local<Array> conns(Array::New(count));
+    Local<Array> channelQualifiers(Array::New(count));
+    Local<Array> offsets(Array::New(count));
+    Local<Array> lengths(Array::New(count));
+    bool hasParts = _hasParts;
+    Local<Array> partFlags;
+    if (hasParts) {
+        partFlags = Array::New(count);
+    }
+    
+    for (size_t i=0; i<count; i++) {
+        const Entry& entry(_entries[i]);
+        Handle<Object> jsHandle(entry.conn->getJsHandle());
+        
+        conns->Set(i, jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : jsHandle);
+        channelQualifiers->Set(i, Integer::New(entry.channelQualifier));
+        offsets->Set(i, Integer::New(base+entry.offset));
+        lengths->Set(i, Integer::New(entry.length));
+        if (hasParts) {
+            partFlags->Set(i, Integer::New(entry.partFlags));
+        }
+    }
+    
+    // Javascript might receive more messages while it handles these
+    // (for instance if it closes a connection), so the batch must be
+    // empty before calling into it. clear() keeps the memory of
+    // _entries, so the next batch doesn't have to grow it again.
+    _entries.clear();
+    _hasParts = false;
+    _data = NULL;
+    _size = 0;
+    _capacity = 0;
+    
+    const unsigned argc = 6;
+    Handle<Value> argv[argc] = {
+        conns,
+        slab,
+        channelQualifiers,
+        offsets,
+        lengths,
+        hasParts ? Handle<Value>(partFlags) : Handle<Value>(Undefined())
+    };
+    EmiSocket::connectionMessages->Call(Context::GetCurrent()->Global(), argc, argv);
+}
@@ -0,0 +1,72 @@
+#define BUILDING_NODE_EXTENSION
+#ifndef eminet_EmiMessageBatch_h
+#define eminet_EmiMessageBatch_h
+
+#include "../core/EmiTypes.h"
+
+#include <stdint.h>
+#include <vector>
+#include <uv.h>
+
+class EmiConnection;
+
+// Calling into Javascript once for every received message is expensive
+// when there are lots of small messages. EmiMessageBatch collects the
+// messages that are received during one iteration of the event loop,
+// and passes them all to Javascript in one call, at the end of the
+// iteration (from a uv_check_t). The data of all messages is copied
+// once, straight into a Buffer that is taken from a slab allocator, and
+// the messages are given as arrays of connections, channel qualifiers,
+// offsets and lengths into it. When a message doesn't fit in what is
+// left of the Buffer, the batch is flushed early, so a message that is
+// larger than BUFFER_SIZE gets a batch of its own.
+//
+// When the socket streams large messages (see
+// EmiSockConfig::streamMessages), some of the entries are parts of
+// messages rather than whole messages. Their part flags are then given
+// as one more array. Batches without parts don't get that array, so
+// the common case doesn't pay for it.
+//
+// Other connection events must not overtake messages that were
+// received before them, so EmiConnDelegate flushes the batch before it
+// reports anything else to Javascript.
+class EmiMessageBatch {
+private:
+    // Private default constructor; this class only has static
+    // methods and is not intended to have any instances.
+    inline EmiMessageBatch();
+    
+    struct Entry {
+        EmiConnection      *conn;
+        EmiChannelQualifier channelQualifier;
+        size_t              offset;
+        size_t              length;
+        EmiMessagePartFlags partFlags;
+    };
+    
+    // The default size of the Buffer of a batch
+    static const size_t BUFFER_SIZE = 64*1024;
+    
+    // The memory of the batch's Buffer, NULL when there is no batch
+    static char                *_data;
+    static size_t               _size;
+    static size_t               _capacity;
+    static std::vector<Entry>   _entries;
+    static uv_check_t           _check;
+    static bool                 _checkInitialized;
+    // True if any of the entries is not a whole message
+    static bool                 _hasParts;
+    
+    static void checkCb(uv_check_t *handle, int status);
+    
+public:
+    static void add(EmiConnection& conn,
+                    EmiChannelQualifier channelQualifier,
+                    const uint8_t *data,
+                    size_t length,
+                    EmiMessagePartFlags partFlags);
+    
+    static void flush();
+};
+
+#endif
@@ -5,12 +5,32 @@
 #include "EmiError.h"
 #include "slab_allocator.h"
 
+#include "../core/EmiTypes.h"
 #include "../core/EmiNetUtil.h"
+#include "../core/EmiBuffer.h"
 #include <netinet/in.h>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <node_buffer.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
+// Old glibc headers don't define SO_REUSEPORT, even though Linux
+// supports it since 3.9
+#if defined(__linux__) && !defined(SO_REUSEPORT)
+#define SO_REUSEPORT 15
+#endif
+
+// Linux supports this since 4.5
+#if defined(__linux__) && !defined(SO_ATTACH_REUSEPORT_CBPF)
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
 
 using namespace v8;
 
@@ -18,6 +38,14 @@ static const int SLAB_SIZE = 1024 * 1024;
 
 static node::SlabAllocator slab_allocator(SLAB_SIZE);
 
+static inline int& socketFd(uv_udp_t *handle) {
+#if UV_VERSION_MAJOR == 0 && UV_VERSION_MINOR < 9
+    return handle->fd;
+#else
+    return handle->io_watcher.fd;
+#endif
+}
+
 static void close_cb(uv_handle_t* handle) {
     free(handle);
 }
@@ -27,14 +55,19 @@ static uv_buf_t alloc_cb(uv_handle_t* handle, size_t suggested_size) {
     return uv_buf_init(buf, suggested_size);
 }
 
-static void send_cb(uv_udp_send_t* req, int status) {
-    uv_buf_t *buf = (uv_buf_t *)&req[1];
+static void free_send_req(uv_udp_send_t* req) {
+    uv_buf_t   *buf = (uv_buf_t *)&req[1];
+    EmiBuffer **bufferPtr = (EmiBuffer **)&buf[1];
     
-    free(buf->base);
+    (*bufferPtr)->release();
     
     free(req);
 }
 
+static void send_cb(uv_udp_send_t* req, int status) {
+    free_send_req(req);
+}
+
 static void recv_cb(uv_udp_t *handle,
                     ssize_t nread,
                     uv_buf_t buf,
@@ -42,6 +75,8 @@ static void recv_cb(uv_udp_t *handle,
                     unsigned flags) {
     HandleScope scope;
     
+    // The handle to the slab keeps buf.base alive while recvCb runs. The
+    // core copies whatever it needs to hold on to.
     Local<Object> slab = slab_allocator.Shrink(Context::GetCurrent()->Global(),
                                                buf.base,
                                                nread < 0 ? 0 : nread);
@@ -56,8 +91,7 @@ static void recv_cb(uv_udp_t *handle,
         recvCb(handle,
                *((struct sockaddr_storage *)addr),
                nread,
-               slab,
-               buf.base - node::Buffer::Data(slab));
+               (const uint8_t *)buf.base);
     }
 }
 
@@ -121,11 +155,105 @@ Handle<String> EmiNodeUtil::errStr(uv_err_t err) {
     return scope.Close(errStr);
 }
 
+EmiBuffer *EmiNodeUtil::copyBuffer(Handle<Object> buffer) {
+    return EmiBuffer::make((const uint8_t *)node::Buffer::Data(buffer),
+                           node::Buffer::Length(buffer));
+}
+
+// The program is run by the kernel for each datagram to the port, on
+// the UDP payload, and returns the index of the socket that gets the
+// datagram. The sockets of the port are indexed in the order they were
+// bound. If the packet has a connection ID, the program returns the ID
+// modulo the number of shards, which is the shard that handed it out
+// (see EmiSock::generateConnectionId). Otherwise, it returns an index
+// that is out of range, and the kernel falls back to its hash.
+//
+// This has to be kept in sync with EmiPacketHeader::parseConnectionId.
+//
+// The program must be attached after the socket is bound; Linux refuses
+// to bind a socket to a port that is shared with other sockets if the
+// program was attached before.
+//
+// Returns 0 on success, or -1 with errno set. The program is optional:
+// without it, migrating clients are dropped, as documented in
+// EmiSock.h. Kernels older than 4.5 don't support it, so ENOPROTOOPT is
+// not treated as an error.
+static int attachReusePortProgram(int fd, size_t shards) {
+#ifdef __linux__
+    struct sock_filter code[] = {
+        // A = the packet flags
+        /* 0*/ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 0),
+        /* 1*/ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, EMI_EXTRA_FLAGS_PACKET_FLAG, 0, 13),
+        // A = the extra flags
+        /* 2*/ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 1),
+        /* 3*/ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, EMI_CONNECTION_ID_EXTRA_PACKET_FLAG, 0, 11),
+        // X = the offset of the connection ID, which is after the filler
+        /* 4*/ BPF_STMT(BPF_LDX | BPF_W   | BPF_IMM, 2),
+        /* 5*/ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG, 0, 2),
+        /* 6*/ BPF_STMT(BPF_LDX | BPF_W   | BPF_IMM, 3),
+        /* 7*/ BPF_JUMP(BPF_JMP | BPF_JA, 4, 0, 0),
+        /* 8*/ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, EMI_2_BYTE_FILLER_EXTRA_PACKET_FLAG, 0, 3),
+        /* 9*/ BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 2),
+        /*10*/ BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 4),
+        /*11*/ BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        // A = the connection ID % shards
+        /*12*/ BPF_STMT(BPF_LD  | BPF_W   | BPF_IND, 0),
+        /*13*/ BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)shards),
+        /*14*/ BPF_STMT(BPF_RET | BPF_A, 0),
+        // No connection ID
+        /*15*/ BPF_STMT(BPF_RET | BPF_K, 0xffffffff)
+    };
+    
+    struct sock_fprog prog;
+    prog.len = sizeof(code)/sizeof(*code);
+    prog.filter = code;
+    
+    if (-1 == setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) &&
+        ENOPROTOOPT != errno) {
+        return -1;
+    }
+#endif
+    
+    return 0;
+}
+
+// libuv has no way of setting socket options before the socket is
+// bound, because uv_udp_bind creates the socket and binds it in one go.
+// uv_udp_bind does however use the handle's socket if it already has
+// one, so this function creates the socket and sets SO_REUSEPORT on it
+// before it is bound.
+//
+// Returns 0 on success, or an errno value.
+static int prepareReusePortSocket(uv_udp_t *handle, int family) {
+#ifdef SO_REUSEPORT
+    int fd = ::socket(family, SOCK_DGRAM, 0);
+    if (-1 == fd) {
+        return errno;
+    }
+    
+    int yes = 1;
+    if (-1 == setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) ||
+        -1 == fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) ||
+        -1 == fcntl(fd, F_SETFD, FD_CLOEXEC)) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    
+    socketFd(handle) = fd;
+    
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+}
+
 void EmiNodeUtil::closeSocket(uv_udp_t *socket) {
     uv_close((uv_handle_t *)socket, close_cb);
 }
 
 uv_udp_t *EmiNodeUtil::openSocket(const sockaddr_storage& address,
+                                  size_t reusePortShards,
                                   EmiNodeUtilRecvCb *recvCb,
                                   void *data,
                                   EmiError& error) {
@@ -138,6 +266,14 @@ uv_udp_t *EmiNodeUtil::openSocket(const sockaddr_storage& address,
         goto error;
     }
     
+    if (reusePortShards) {
+        err = prepareReusePortSocket(socket, address.ss_family);
+        if (0 != err) {
+            error = EmiError("POSIX", err);
+            goto error;
+        }
+    }
+    
     if (AF_INET == address.ss_family) {
         struct sockaddr_in& addr(*((struct sockaddr_in *)&address));
         
@@ -162,6 +298,12 @@ uv_udp_t *EmiNodeUtil::openSocket(const sockaddr_storage& address,
         abort();
     }
     
+    if (1 < reusePortShards &&
+        -1 == attachReusePortProgram(socketFd(socket), reusePortShards)) {
+        error = EmiError("POSIX", errno);
+        goto error;
+    }
+    
     err = uv_udp_recv_start(socket, alloc_cb, recv_cb);
     if (0 != err) {
         goto error;
@@ -182,20 +324,18 @@ void EmiNodeUtil::sendData(uv_udp_t *socket,
                            size_t size) {
     uv_udp_send_t *req = (uv_udp_send_t *)malloc(sizeof(uv_udp_send_t)+
                                                  sizeof(uv_buf_t)+
-                                                 sizeof(size_t));
+                                                 sizeof(EmiBuffer *));
     uv_buf_t      *buf = (uv_buf_t *)&req[1];
-    size_t        *sizePtr = (size_t *)&buf[1];
+    EmiBuffer    **bufferPtr = (EmiBuffer **)&buf[1];
     
     // TODO This copies the packet data. We might want to redesign
     // this part of the code so that this is not required.
     //
-    // TODO It would probably be better and faster to use the slab
-    // allocator here.
-    char *bufData = (char *)malloc(size);
-    memcpy(bufData, data, size);
+    // The copy is taken from EmiBuffer's pool, so that sending doesn't
+    // have to malloc and free for every packet.
+    *bufferPtr = EmiBuffer::make(data, size);
     
-    *buf = uv_buf_init((char *)bufData, size);
-    *sizePtr = size;
+    *buf = uv_buf_init((char *)(*bufferPtr)->data(), size);
     
     if (AF_INET == address.ss_family) {
         if (0 != uv_udp_send(req,
@@ -204,7 +344,7 @@ void EmiNodeUtil::sendData(uv_udp_t *socket,
                              /*bufcnt:*/1,
                              *((struct sockaddr_in *)&address),
                              send_cb)) {
-            free(req);
+            free_send_req(req);
         }
     }
     else if (AF_INET6 == address.ss_family) {
@@ -214,7 +354,7 @@ void EmiNodeUtil::sendData(uv_udp_t *socket,
                               /*bufcnt:*/1,
                               *((struct sockaddr_in6 *)&address),
                               send_cb)) {
-            free(req);
+            free_send_req(req);
         }
     }
     else {
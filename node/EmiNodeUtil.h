@@ -11,6 +11,7 @@
 
 struct sockaddr_storage;
 class EmiError;
+class EmiBuffer;
 
 #define THROW_TYPE_ERROR(err)                                 \
   do {                                                        \
@@ -85,8 +86,7 @@ public:
     typedef void (EmiNodeUtilRecvCb)(uv_udp_t *socket,
                                      const struct sockaddr_storage& addr,
                                      ssize_t nread,
-                                     const v8::Local<v8::Object>& slab,
-                                     size_t offset);
+                                     const uint8_t *data);
     
     static const uint64_t NSECS_PER_SEC = 1000*1000*1000;
     static const uint64_t MSECS_PER_SEC = 1000;
@@ -101,8 +101,17 @@ public:
     
     static v8::Handle<v8::String> errStr(uv_err_t err);
     
+    // Copies the contents of a node::Buffer into a new EmiBuffer. This is
+    // how message data that is passed from Javascript enters the core.
+    static EmiBuffer *copyBuffer(v8::Handle<v8::Object> buffer);
+    
     static void closeSocket(uv_udp_t *socket);
+    // If reusePortShards is non-zero, the socket is opened with
+    // SO_REUSEPORT, to be shared with reusePortShards-1 other sockets.
+    // On Linux, datagrams that carry a connection ID are then steered
+    // to socket number (connection ID % reusePortShards) of the port.
     static uv_udp_t *openSocket(const sockaddr_storage& address,
+                                size_t reusePortShards,
                                 EmiNodeUtilRecvCb *recvCb,
                                 void *data,
                                 EmiError& error);
@@ -14,14 +14,9 @@ using namespace v8;
 EmiSockDelegate::EmiSockDelegate(EmiSocket& es) : _es(es) {}
 
 EmiSockDelegate::EC *EmiSockDelegate::makeConnection(const EmiConnParams<EmiBinding>& params) {
-    HandleScope scope;
-    
-    // TODO I think the HandleScope will dispose of EmiConnection after
-    // this function, which is not what we want... Exactly what will
-    // happen?
-    
-    Handle<Object> obj(EmiConnection::NewInstance(_es, params));
-    EmiConnection *ec = node::ObjectWrap::Unwrap<EmiConnection>(obj);
+    // The V8 object that wraps the connection is made lazily, see
+    // EmiConnection::getHandle
+    EmiConnection *ec = new EmiConnection(_es, params);
     return &ec->getConn();
 }
 
@@ -32,11 +27,13 @@ void EmiSockDelegate::gotServerConnection(EC& conn) {
     
     Handle<Value> jsHandle(ec._es._jsHandle);
     
+    // The connection is not wrapped here; Javascript does that with
+    // wrapConnection when it first calls into the connection
     const unsigned argc = 3;
     Handle<Value> argv[argc] = {
         jsHandle.IsEmpty() ? Handle<Value>(Undefined()) : jsHandle,
         ec._es.handle_,
-        ec.handle_
+        External::New(&ec)
     };
     Local<Value> ret = EmiSocket::gotConnection->Call(Context::GetCurrent()->Global(), argc, argv);
     
@@ -61,7 +58,7 @@ void EmiSockDelegate::connectionOpened(ConnectionOpenedCallbackCookie& cookie,
         argv[1] = Null();
     }
     else {
-        argv[1] = conn.getDelegate().getConnection().handle_;
+        argv[1] = conn.getDelegate().getConnection().getHandle();
     }
     
     Local<Value> ret = cookie->CallAsFunction(Context::GetCurrent()->Global(), argc, argv);
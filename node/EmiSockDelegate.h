@@ -58,6 +58,10 @@ public:
     inline const EmiSocket& getEmiSocket() const { return _es; }
     
     inline EmiObjectWrap *getSocketCookie() { return (EmiObjectWrap *)&_es; }
+    
+    // Everything runs in the node thread, so it is safe to let the
+    // EmiSock tick its server connections.
+    inline bool batchConnectionTicks() const { return true; }
 };
 
 #endif
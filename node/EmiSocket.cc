@@ -7,6 +7,7 @@
 
 #include <node.h>
 #include <stdlib.h>
+#include <vector>
 
 using namespace v8;
 
@@ -19,6 +20,17 @@ using namespace v8;
   EXPAND_SYM(receiverBufferSize);                          \
   EXPAND_SYM(senderBufferSize);                            \
   EXPAND_SYM(acceptConnections);                           \
+  EXPAND_SYM(synCookieThreshold);                          \
+  EXPAND_SYM(reusePort);                                   \
+  EXPAND_SYM(reusePortShard);                              \
+  EXPAND_SYM(reusePortShards);                             \
+  EXPAND_SYM(pollQueueSize);                               \
+  EXPAND_SYM(streamMessages);                              \
+  EXPAND_SYM(incompleteMessageTimeout);                    \
+  EXPAND_SYM(incompleteMessageTimeoutRtts);                \
+  EXPAND_SYM(congestionControl);                           \
+  EXPAND_SYM(targetQueueingDelay);                         \
+  EXPAND_SYM(scavengerTargetQueueingDelay);                \
   EXPAND_SYM(type);                                        \
   EXPAND_SYM(port);                                        \
   EXPAND_SYM(address);                                     \
@@ -30,7 +42,7 @@ EXPAND_SYMS
 
 Persistent<Function> EmiSocket::gotConnection;
 Persistent<Function> EmiSocket::connectionPacketLoss;
-Persistent<Function> EmiSocket::connectionMessage;
+Persistent<Function> EmiSocket::connectionMessages;
 Persistent<Function> EmiSocket::connectionLost;
 Persistent<Function> EmiSocket::connectionRegained;
 Persistent<Function> EmiSocket::connectionDisconnect;
@@ -65,6 +77,7 @@ void EmiSocket::Init(Handle<Object> target) {
       FunctionTemplate::New(sym)->GetFunction());
     X(Connect4,  "connect4");
     X(Connect6,  "connect6");
+    X(Broadcast, "broadcast");
 #undef X
     
     Persistent<Function> constructor = Persistent<Function>::New(tpl->GetFunction());
@@ -96,7 +109,7 @@ Handle<Value> EmiSocket::SetCallbacks(const Arguments& args) {
     
     X(gotConnection, 0);
     X(connectionPacketLoss, 1);
-    X(connectionMessage, 2);
+    X(connectionMessages, 2);
     X(connectionLost, 3);
     X(connectionRegained, 4);
     X(connectionDisconnect, 5);
@@ -146,6 +159,17 @@ Handle<Value> EmiSocket::New(const Arguments& args) {
     READ_CONFIG(sc, initialConnectionTimeout,          IsNumber,  EmiTimeInterval, NumberValue);
     READ_CONFIG(sc, senderBufferSize,                  IsNumber,  size_t,          Uint32Value);
     READ_CONFIG(sc, acceptConnections,                 IsBoolean, bool,            BooleanValue);
+    READ_CONFIG(sc, synCookieThreshold,                IsNumber,  float,           NumberValue);
+    READ_CONFIG(sc, reusePort,                         IsBoolean, bool,            BooleanValue);
+    READ_CONFIG(sc, reusePortShard,                    IsNumber,  size_t,          Uint32Value);
+    READ_CONFIG(sc, reusePortShards,                   IsNumber,  size_t,          Uint32Value);
+    READ_CONFIG(sc, pollQueueSize,                     IsNumber,  size_t,          Uint32Value);
+    READ_CONFIG(sc, streamMessages,                    IsBoolean, bool,            BooleanValue);
+    READ_CONFIG(sc, incompleteMessageTimeout,          IsNumber,  EmiTimeInterval, NumberValue);
+    READ_CONFIG(sc, incompleteMessageTimeoutRtts,      IsNumber,  float,           NumberValue);
+    READ_CONFIG(sc, congestionControl,                 IsNumber,  EmiCongestionControlType, Uint32Value);
+    READ_CONFIG(sc, targetQueueingDelay,               IsNumber,  EmiTimeInterval, NumberValue);
+    READ_CONFIG(sc, scavengerTargetQueueingDelay,      IsNumber,  EmiTimeInterval, NumberValue);
     READ_CONFIG(sc, port,                              IsNumber,  uint16_t,        Uint32Value);
     READ_CONFIG(sc, fabricatedPacketDropRate,          IsNumber,  EmiTimeInterval, NumberValue);
     
@@ -258,3 +282,84 @@ Handle<Value> EmiSocket::Connect4(const Arguments& args) {
 Handle<Value> EmiSocket::Connect6(const Arguments& args) {
     return DoConnect(args, AF_INET6);
 }
+
+Handle<Value> EmiSocket::Broadcast(const Arguments& args) {
+    HandleScope scope;
+    
+    
+    /// Basic argument checks
+    
+    size_t numArgs = args.Length();
+    if (numArgs < 2 || numArgs > 4) {
+        THROW_TYPE_ERROR("Wrong number of arguments");
+    }
+    
+    // Note that we do not verify that the data is a Buffer object;
+    // we assume that the JS binding code ensures that.
+    if (!args[0]->IsArray() || !args[1]->IsObject()) {
+        THROW_TYPE_ERROR("Wrong arguments");
+    }
+    
+    
+    /// Extract arguments
+    
+    EmiChannelQualifier channelQualifier = EMI_CHANNEL_QUALIFIER_DEFAULT;
+    EmiPriority priority = EMI_PRIORITY_DEFAULT;
+    
+    if (numArgs >= 3 && !args[2]->IsUndefined()) {
+        if (!args[2]->IsNumber()) {
+            THROW_TYPE_ERROR("Wrong channel quality argument");
+        }
+        
+        channelQualifier = (EmiChannelQualifier) args[2]->Uint32Value();
+    }
+    
+    if (numArgs >= 4 && !args[3]->IsUndefined()) {
+        if (!args[3]->IsNumber()) {
+            THROW_TYPE_ERROR("Wrong priority argument");
+        }
+        
+        priority = (EmiPriority) args[3]->Uint32Value();
+    }
+    
+    Local<Array> connHandles(Local<Array>::Cast(args[0]));
+    uint32_t numConns = connHandles->Length();
+    
+    std::vector<EC*> conns;
+    conns.reserve(numConns);
+    
+    for (uint32_t i=0; i<numConns; i++) {
+        // An accepted connection that Javascript hasn't called into yet
+        // is still a v8::External (see EmiConnection::getHandle). It is
+        // used as it is, so that broadcasting to lots of new connections
+        // doesn't make a wrapper object for each of them.
+        Local<Value> connHandle(connHandles->Get(i));
+        EmiConnection *ec;
+        if (connHandle->IsExternal()) {
+            ec = (EmiConnection *)External::Cast(*connHandle)->Value();
+        }
+        else if (connHandle->IsObject() &&
+                 0 != connHandle->ToObject()->InternalFieldCount()) {
+            ec = ObjectWrap::Unwrap<EmiConnection>(connHandle->ToObject());
+        }
+        else {
+            THROW_TYPE_ERROR("Wrong connection argument");
+        }
+        
+        conns.push_back(&ec->getConn());
+    }
+    
+    
+    // Do the actual broadcast
+    
+    UNWRAP(EmiSocket, es, args);
+    
+    size_t numSent = es->_sock.broadcast(EmiNodeUtil::now(),
+                                         conns.empty() ? NULL : &conns[0],
+                                         conns.size(),
+                                         EmiNodeUtil::copyBuffer(args[1]->ToObject()),
+                                         channelQualifier,
+                                         priority);
+    
+    return scope.Close(Number::New(numSent));
+}
@@ -13,6 +13,7 @@
 
 class EmiSocket : public EmiObjectWrap {
     typedef EmiSock<EmiSockDelegate, EmiConnDelegate> EmiS;
+    typedef EmiConn<EmiSockDelegate, EmiConnDelegate> EC;
     
     friend class EmiConnDelegate;
     friend class EmiSockDelegate;
@@ -30,6 +31,17 @@ private:
     static v8::Persistent<v8::String> receiverBufferSizeSymbol;
     static v8::Persistent<v8::String> senderBufferSizeSymbol;
     static v8::Persistent<v8::String> acceptConnectionsSymbol;
+    static v8::Persistent<v8::String> synCookieThresholdSymbol;
+    static v8::Persistent<v8::String> reusePortSymbol;
+    static v8::Persistent<v8::String> reusePortShardSymbol;
+    static v8::Persistent<v8::String> reusePortShardsSymbol;
+    static v8::Persistent<v8::String> pollQueueSizeSymbol;
+    static v8::Persistent<v8::String> streamMessagesSymbol;
+    static v8::Persistent<v8::String> incompleteMessageTimeoutSymbol;
+    static v8::Persistent<v8::String> incompleteMessageTimeoutRttsSymbol;
+    static v8::Persistent<v8::String> congestionControlSymbol;
+    static v8::Persistent<v8::String> targetQueueingDelaySymbol;
+    static v8::Persistent<v8::String> scavengerTargetQueueingDelaySymbol;
     static v8::Persistent<v8::String> typeSymbol;
     static v8::Persistent<v8::String> portSymbol;
     static v8::Persistent<v8::String> addressSymbol;
@@ -47,13 +59,14 @@ private:
     static v8::Handle<v8::Value> DoConnect(const v8::Arguments& args, int family);
     static v8::Handle<v8::Value> Connect4(const v8::Arguments& args);
     static v8::Handle<v8::Value> Connect6(const v8::Arguments& args);
+    static v8::Handle<v8::Value> Broadcast(const v8::Arguments& args);
     
 public:
     static void Init(v8::Handle<v8::Object> target);
     
     static v8::Persistent<v8::Function> gotConnection;
     static v8::Persistent<v8::Function> connectionPacketLoss;
-    static v8::Persistent<v8::Function> connectionMessage;
+    static v8::Persistent<v8::Function> connectionMessages;
     static v8::Persistent<v8::Function> connectionLost;
     static v8::Persistent<v8::Function> connectionRegained;
     static v8::Persistent<v8::Function> connectionDisconnect;
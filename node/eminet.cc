@@ -2,7 +2,6 @@
 
 #include "EmiSocket.h"
 #include "EmiConnection.h"
-#include "EmiConnectionParams.h"
 #include "EmiP2PSocket.h"
 #include "../core/EmiTypes.h"
 
@@ -15,7 +14,6 @@ void InitAll(Handle<Object> target) {
     
     EmiSocket::Init(target);
     EmiConnection::Init(target);
-    EmiConnectionParams::Init(target);
     EmiP2PSocket::Init(target);
     
     
@@ -44,6 +42,12 @@ void InitAll(Handle<Object> target) {
     X(CONNECTION_TIMED_OUT,       EMI_REASON_CONNECTION_TIMED_OUT);
     X(OTHER_HOST_DID_NOT_RESPOND, EMI_REASON_OTHER_HOST_DID_NOT_RESPOND);
     
+    // EmiCongestionControlType
+    X(CONGESTION_CONTROL_UDT, EMI_CONGESTION_CONTROL_UDT);
+    X(CONGESTION_CONTROL_BBR, EMI_CONGESTION_CONTROL_BBR);
+    X(CONGESTION_CONTROL_LOW_LATENCY, EMI_CONGESTION_CONTROL_LOW_LATENCY);
+    X(CONGESTION_CONTROL_SCAVENGER,   EMI_CONGESTION_CONTROL_SCAVENGER);
+    
 #undef X
 }
 
@@ -40,8 +40,11 @@ var lookup6 = function(address, callback) {
     return lookup(address || '::0', 6, callback);
 };
 
-var gotConnection = function(sock, sockHandle, connHandle) {
-  var conn = new EmiConnection(false, sockHandle, connHandle);
+// connExternal refers to the native connection. It is only turned into
+// a connection handle when the connection is first used, see
+// EmiConnection.prototype._getHandle.
+var gotConnection = function(sock, sockHandle, connExternal) {
+  var conn = new EmiConnection(false, sockHandle, connExternal);
   sock && sock.emit('connection', conn);
   return conn;
 };
@@ -50,8 +53,65 @@ var connectionPacketLoss = function(conn, connHandle, channelQualifier, packetsL
   conn && conn.emit('loss', channelQualifier, packetsLost);
 };
 
-var connectionMessage = function(conn, connHandle, channelQualifier, slowBuffer, offset, length) {
-  conn && conn.emit('message', channelQualifier, new Buffer(slowBuffer, length, offset));
+// Part flags, see EmiMessagePartFlag in EmiTypes.h
+var MESSAGE_PART_FIRST = 1;
+var MESSAGE_PART_LAST  = 2;
+
+var emitMessages = function(conn, buffer, channelQualifiers, offsets, lengths, partFlags) {
+  conn.emit('messages', buffer, channelQualifiers, offsets, lengths, partFlags);
+  
+  // Only make Buffer slices for the per message events if someone
+  // actually listens to them
+  var emitMessage = conn.listeners('message').length;
+  var emitPart = partFlags && conn.listeners('messagePart').length;
+  if (emitMessage || emitPart) {
+    for (var i = 0; i < channelQualifiers.length; i++) {
+      var flags = partFlags ? partFlags[i] : MESSAGE_PART_FIRST | MESSAGE_PART_LAST;
+      if ((MESSAGE_PART_FIRST | MESSAGE_PART_LAST) == flags) {
+        emitMessage && conn.emit('message', channelQualifiers[i], buffer.slice(offsets[i], offsets[i]+lengths[i]));
+      }
+      else if (emitPart) {
+        conn.emit('messagePart',
+                  channelQualifiers[i],
+                  buffer.slice(offsets[i], offsets[i]+lengths[i]),
+                  !!(flags & MESSAGE_PART_FIRST),
+                  !!(flags & MESSAGE_PART_LAST));
+      }
+    }
+  }
+};
+
+// The messages that were received during one event loop iteration, for
+// all connections. The messages of each connection are in order, and
+// are usually next to each other, so this emits one 'messages' event
+// for each run of messages to the same connection. partFlags is
+// undefined unless some of the messages are parts of streamed
+// messages.
+var connectionMessages = function(conns, slowBuffer, channelQualifiers, offsets, lengths, partFlags) {
+  var buffer = new Buffer(slowBuffer, slowBuffer.length, 0);
+  var count = conns.length;
+  
+  var start = 0;
+  while (start < count) {
+    var conn = conns[start];
+    var end = start+1;
+    while (end < count && conns[end] === conn) end++;
+    
+    if (conn) {
+      if (0 == start && count == end) {
+        emitMessages(conn, buffer, channelQualifiers, offsets, lengths, partFlags);
+      }
+      else {
+        emitMessages(conn, buffer,
+                     channelQualifiers.slice(start, end),
+                     offsets.slice(start, end),
+                     lengths.slice(start, end),
+                     partFlags && partFlags.slice(start, end));
+      }
+    }
+    
+    start = end;
+  }
 };
 
 var connectionLost = function(conn, connHandle) {
@@ -83,7 +143,7 @@ var p2pSockError = function() {
 EmiNetAddon.setCallbacks(
   gotConnection,
   connectionPacketLoss,
-  connectionMessage,
+  connectionMessages,
   connectionLost,
   connectionRegained,
   connectionDisconnect,
@@ -136,21 +196,32 @@ var EmiConnection = function(initiator, sockHandle, address, port, cb, p2pCookie
     }
   }
   else {
-    this._handle = address;
+    this._handle = null;
+    this._external = address;
   }
 };
 
 Util.inherits(EmiConnection, Events.EventEmitter);
 
+EmiConnection.prototype._getHandle = function() {
+  if (!this._handle) {
+    this._handle = EmiNetAddon.wrapConnection(this._external);
+    this._external = null;
+  }
+  return this._handle;
+};
+
 [
-  'close', 'forceClose', 'closeOrForceClose', 'send',
+  'close', 'forceClose', 'closeOrForceClose', 'send', 'sendMany',
   'hasIssuedConnectionWarning', 'getSocket', 'getAddressType',
   'getLocalPort', 'getLocalAddress', 'getRemoteAddress',
   'getRemotePort', 'getInboundPort', 'isOpen', 'isOpening',
-  'getP2PState'
+  'getP2PState', 'pollMessages', 'getDroppedPolledMessages',
+  'getEvictedBytes'
 ].forEach(function(name) {
   EmiConnection.prototype[name] = function() {
-    return this._handle[name].apply(this._handle, arguments);
+    var handle = this._getHandle();
+    return handle[name].apply(handle, arguments);
   };
 });
 
@@ -173,6 +244,15 @@ EmiSocket.prototype.connectP2P = function(address, port, p2pCookie, sharedSecret
   return new EmiConnection(/*initiator:*/true, this._handle, address, port, cb, p2pCookie, sharedSecret);
 };
 
+EmiSocket.prototype.broadcast = function(conns, data, opts) {
+  // The native side takes the External of a connection that has not
+  // been wrapped yet, so this doesn't wrap them
+  var handles = conns.map(function(conn) { return conn._handle || conn._external; });
+  return this._handle.broadcast(handles, data,
+                                opts && opts.channelQualifier,
+                                opts && opts.priority);
+};
+
 
 var EmiP2PSocket = function(args) {
   this._handle = new EmiNetAddon.EmiP2PSocket(this, args);
@@ -0,0 +1,161 @@
+//
+//  EmiBbrCongestionControlTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiBbrCongestionControl.h"
+
+#include <math.h>
+
+// Drives EmiBbrCongestionControl through EmiCongestionControlPolicy the
+// way EmiCongestionControl does, and checks its congestion window and
+// pacing rate in each mode.
+
+typedef EmiCongestionControlPolicy::State State;
+
+static const size_t PACKET_SIZE = 1000;
+// 4 packets
+static const size_t MIN_CWND = 4*PACKET_SIZE;
+static const float BANDWIDTH = 1000000;
+static const EmiTimeInterval RTT = 0.1;
+// 2/ln(2), the gain of STARTUP
+static const float HIGH_GAIN = 2.885f;
+
+static bool near(double a, double b) {
+    return fabs(a-b) <= 0.001*fabs(b) + 1;
+}
+
+static State makeState(size_t bytesInFlight) {
+    State state;
+    state.rtt = RTT;
+    state.minRtt = RTT;
+    state.bytesInFlight = bytesInFlight;
+    return state;
+}
+
+// Gets the policy through STARTUP and DRAIN to PROBE_BW, and returns
+// the time
+static EmiTimeInterval reachProbeBw(EmiCongestionControlPolicy& policy) {
+    EmiTimeInterval now = 1;
+    
+    // Without a model of the path, the window grows like in slow start,
+    // and sending is not paced
+    CHECK(EMI_MIN_CONGESTION_WINDOW == policy.congestionWindow());
+    CHECK(0 == policy.pacingRate());
+    for (EmiPacketSequenceNumber sn=0; sn<10; sn++) {
+        policy.onPacketSent(now, sn, PACKET_SIZE);
+    }
+    policy.onAck(now, makeState(0));
+    CHECK(10*PACKET_SIZE == policy.congestionWindow());
+    CHECK(0 == policy.pacingRate());
+    
+    // STARTUP paces and sizes the window with the high gain
+    policy.onRttSample(now, RTT, makeState(0));
+    policy.onDataArrivalRateSample(now, BANDWIDTH);
+    CHECK(near(policy.congestionWindow(), HIGH_GAIN*BANDWIDTH*RTT));
+    CHECK(near(policy.pacingRate(), HIGH_GAIN*BANDWIDTH));
+    
+    // The bandwidth stops growing, so the pipe is full, and DRAIN paces
+    // below the bandwidth
+    for (int i=0; i<3; i++) {
+        now += RTT;
+        policy.onDataArrivalRateSample(now, BANDWIDTH);
+    }
+    CHECK(near(policy.pacingRate(), BANDWIDTH/HIGH_GAIN));
+    
+    // Once the queue is drained, PROBE_BW keeps two bandwidth-delay
+    // products in flight
+    now += RTT;
+    policy.onAck(now, makeState((size_t)(BANDWIDTH*RTT)));
+    CHECK(near(policy.congestionWindow(), 2*BANDWIDTH*RTT));
+    
+    return now;
+}
+
+static void testModes() {
+    EmiBbrCongestionControl bbr;
+    EmiCongestionControlPolicy& policy(bbr);
+    
+    EmiTimeInterval now = reachProbeBw(policy);
+    
+    // PROBE_BW cycles through the pacing gains 1.25, 0.75 and 1, and
+    // does not start at 0.75
+    CHECK(near(policy.pacingRate(), 1.25f*BANDWIDTH) ||
+          near(policy.pacingRate(), BANDWIDTH));
+    bool sawProbe = false;
+    bool sawDrain = false;
+    for (int i=0; i<16; i++) {
+        now += RTT*1.01;
+        policy.onAck(now, makeState((size_t)(2*BANDWIDTH*RTT)));
+        
+        float rate = policy.pacingRate();
+        sawProbe = sawProbe || near(rate, 1.25f*BANDWIDTH);
+        sawDrain = sawDrain || near(rate, 0.75f*BANDWIDTH);
+        CHECK(near(rate, 1.25f*BANDWIDTH) ||
+              near(rate, 0.75f*BANDWIDTH) ||
+              near(rate, BANDWIDTH));
+        CHECK(near(policy.congestionWindow(), 2*BANDWIDTH*RTT));
+    }
+    CHECK(sawProbe && sawDrain);
+    
+    // Loss is not a congestion signal
+    size_t cwnd = policy.congestionWindow();
+    float rate = policy.pacingRate();
+    policy.onNak(now, 100, 110, makeState(cwnd));
+    CHECK(cwnd == policy.congestionWindow());
+    CHECK(rate == policy.pacingRate());
+    
+    // After an RTO, only a few packets may be sent until the next ack
+    policy.onRto();
+    CHECK(MIN_CWND == policy.congestionWindow());
+    policy.onAck(now, makeState(0));
+    CHECK(near(policy.congestionWindow(), 2*BANDWIDTH*RTT));
+    
+    // When the minimum RTT is 10 seconds old, PROBE_RTT cuts the window
+    // to the minimum and paces at the bandwidth
+    now += 10.5;
+    policy.onRttSample(now, RTT, makeState(0));
+    CHECK(MIN_CWND == policy.congestionWindow());
+    CHECK(near(policy.pacingRate(), BANDWIDTH));
+    
+    // It lasts 200ms from when the window has been drained, and then it
+    // goes back to PROBE_BW
+    policy.onAck(now, makeState(MIN_CWND));
+    now += 0.1;
+    policy.onAck(now, makeState(MIN_CWND));
+    CHECK(MIN_CWND == policy.congestionWindow());
+    now += 0.15;
+    policy.onAck(now, makeState(MIN_CWND));
+    CHECK(near(policy.congestionWindow(), 2*BANDWIDTH*RTT));
+    
+    // A new path starts over from scratch
+    policy.onPathChange();
+    CHECK(EMI_MIN_CONGESTION_WINDOW == policy.congestionWindow());
+    CHECK(0 == policy.pacingRate());
+    reachProbeBw(policy);
+}
+
+// The window never goes below a few packets, even when the model of
+// the path says that less would do
+static void testMinimumWindow() {
+    EmiBbrCongestionControl bbr;
+    EmiCongestionControlPolicy& policy(bbr);
+    
+    EmiTimeInterval now = 1;
+    policy.onPacketSent(now, 0, PACKET_SIZE);
+    policy.onRttSample(now, 0.001, makeState(0));
+    policy.onDataArrivalRateSample(now, 1000);
+    CHECK(MIN_CWND == policy.congestionWindow());
+}
+
+int main() {
+    testModes();
+    testMinimumWindow();
+    
+    return 0;
+}
@@ -0,0 +1,95 @@
+//
+//  EmiBufferTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiBuffer.h"
+
+#include <pthread.h>
+#include <cstring>
+
+static void testMakeAndRelease() {
+    const uint8_t bytes[] = { 1, 2, 3, 4, 5 };
+    EmiBuffer *buffer = EmiBuffer::make(bytes, sizeof(bytes));
+    CHECK(sizeof(bytes) == buffer->length());
+    CHECK(0 == memcmp(bytes, buffer->data(), sizeof(bytes)));
+    
+    {
+        EmiBufferRef ref(buffer);
+        EmiBufferRef copy(ref);
+        buffer->release();
+        CHECK(copy.data() == buffer->data());
+    }
+    
+    // Released buffers are reused
+    EmiBuffer *first = EmiBuffer::make(100);
+    first->release();
+    EmiBuffer *second = EmiBuffer::make(120);
+    CHECK(first == second);
+    second->release();
+    
+    // Buffers that are too large for the pool are not
+    EmiBuffer *large = EmiBuffer::make(EmiBuffer::MAX_POOLED_LENGTH+1);
+    CHECK(EmiBuffer::MAX_POOLED_LENGTH+1 == large->length());
+    large->release();
+}
+
+static const size_t NUM_THREADS = 4;
+static const size_t ITERATIONS = 100000;
+
+// Buffers that the threads hand to each other, so that buffers are
+// made in one thread and released in another
+static EmiBuffer *volatile shared[NUM_THREADS];
+
+static void *churn(void *arg) {
+    size_t index = (size_t)arg;
+    
+    for (size_t i=0; i<ITERATIONS; i++) {
+        size_t length = 1 + (i*7 + index*13) % 3000;
+        EmiBuffer *buffer = EmiBuffer::make(length);
+        memset(buffer->data(), (int)index, length);
+        
+        // Another thread holds a reference for a while
+        buffer->retain();
+        EmiBuffer *old = __sync_lock_test_and_set(&shared[(index+1) % NUM_THREADS], buffer);
+        if (old) {
+            old->release();
+        }
+        
+        for (size_t j=0; j<length; j++) {
+            CHECK((uint8_t)index == buffer->data()[j]);
+        }
+        buffer->release();
+    }
+    
+    return NULL;
+}
+
+static void testThreads() {
+    pthread_t threads[NUM_THREADS];
+    for (size_t i=0; i<NUM_THREADS; i++) {
+        CHECK(0 == pthread_create(&threads[i], NULL, churn, (void *)i));
+    }
+    for (size_t i=0; i<NUM_THREADS; i++) {
+        CHECK(0 == pthread_join(threads[i], NULL));
+    }
+    
+    for (size_t i=0; i<NUM_THREADS; i++) {
+        if (shared[i]) {
+            shared[i]->release();
+            shared[i] = NULL;
+        }
+    }
+}
+
+int main() {
+    testMakeAndRelease();
+    testThreads();
+    
+    return 0;
+}
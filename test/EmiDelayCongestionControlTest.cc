@@ -0,0 +1,117 @@
+//
+//  EmiDelayCongestionControlTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiDelayCongestionControl.h"
+
+// Drives EmiDelayCongestionControl through EmiCongestionControlPolicy
+// the way EmiCongestionControl does, and checks how its congestion
+// window reacts to queueing delay, loss and RTOs.
+
+typedef EmiCongestionControlPolicy::State State;
+
+static const size_t PACKET_SIZE = 1000;
+// 2 packets
+static const size_t MIN_CWND = 2*PACKET_SIZE;
+static const EmiTimeInterval MIN_RTT = 0.1;
+static const EmiTimeInterval TARGET = 0.02;
+
+static State makeState() {
+    State state;
+    state.minRtt = MIN_RTT;
+    return state;
+}
+
+// Sends packets and acks them until slow start has grown the window to
+// 10 packets
+static void slowStart(EmiCongestionControlPolicy& policy, EmiTimeInterval now) {
+    CHECK(EMI_MIN_CONGESTION_WINDOW == policy.congestionWindow());
+    for (EmiPacketSequenceNumber sn=0; sn<10; sn++) {
+        policy.onPacketSent(now, sn, PACKET_SIZE);
+    }
+    policy.onAck(now, makeState());
+    CHECK(10*PACKET_SIZE == policy.congestionWindow());
+}
+
+static void testQueueingDelay() {
+    EmiDelayCongestionControl delay(TARGET);
+    EmiCongestionControlPolicy& policy(delay);
+    
+    EmiTimeInterval now = 1;
+    slowStart(policy, now);
+    
+    // Without queueing delay, slow start goes on, and the window is
+    // paced out over an RTT
+    policy.onRttSample(now, MIN_RTT, makeState());
+    CHECK(10*PACKET_SIZE == policy.congestionWindow());
+    CHECK(10*PACKET_SIZE/MIN_RTT == policy.pacingRate());
+    
+    // A queueing delay far above the target cuts the window in half,
+    // which is the most it is cut at a time
+    now += MIN_RTT;
+    policy.onRttSample(now, MIN_RTT+0.1, makeState());
+    CHECK(5*PACKET_SIZE == policy.congestionWindow());
+    
+    // It is cut at most once per RTT
+    now += 0.05;
+    policy.onRttSample(now, MIN_RTT+0.1, makeState());
+    CHECK(5*PACKET_SIZE == policy.congestionWindow());
+    
+    // Slightly above the target, it is cut in proportion to how far
+    // above the target the delay is: BETA*(0.03-0.02)/0.03 = 0.8/3
+    now += 0.2;
+    policy.onRttSample(now, MIN_RTT+0.03, makeState());
+    size_t cwnd = policy.congestionWindow();
+    CHECK(cwnd < (size_t)(5*PACKET_SIZE*(1-0.8/3)) + 2);
+    CHECK(cwnd > (size_t)(5*PACKET_SIZE*(1-0.8/3)) - 2);
+    
+    // Below the target, it grows by one packet per RTT
+    now += MIN_RTT;
+    policy.onRttSample(now, MIN_RTT+0.01, makeState());
+    CHECK(cwnd + PACKET_SIZE >= policy.congestionWindow());
+    CHECK(cwnd + PACKET_SIZE - 2*PACKET_SIZE/10 <= policy.congestionWindow());
+}
+
+static void testLossAndRto() {
+    EmiDelayCongestionControl delay(TARGET);
+    EmiCongestionControlPolicy& policy(delay);
+    
+    EmiTimeInterval now = 1;
+    slowStart(policy, now);
+    policy.onRttSample(now, MIN_RTT, makeState());
+    
+    // A packet that reports several ranges of lost packets only
+    // decreases the window once, by an eighth
+    now += MIN_RTT;
+    policy.onNak(now, 20, 30, makeState());
+    policy.onNak(now, 25, 30, makeState());
+    CHECK(10*PACKET_SIZE*7/8 == policy.congestionWindow());
+    
+    // An RTO goes back to slow start, from the minimum window, up to
+    // half the window
+    policy.onRto();
+    CHECK(MIN_CWND == policy.congestionWindow());
+    for (EmiPacketSequenceNumber sn=40; sn<50; sn++) {
+        policy.onPacketSent(now, sn, PACKET_SIZE);
+    }
+    policy.onAck(now, makeState());
+    CHECK(10*PACKET_SIZE*7/16 == policy.congestionWindow());
+    
+    // A new path starts over from scratch
+    policy.onPathChange();
+    CHECK(0 == policy.pacingRate());
+    slowStart(policy, now);
+}
+
+int main() {
+    testQueueingDelay();
+    testLossAndRto();
+    
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+//  EmiHashTableTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiHashTable.h"
+#include "EmiAddressKey.h"
+#include "EmiAddressCmp.h"
+#include "EmiNetUtil.h"
+
+#include <map>
+
+typedef EmiHashTable<EmiAddressKey, int>               Table;
+typedef std::map<sockaddr_storage, int, EmiAddressCmp> Map;
+
+static sockaddr_storage makeAddress(uint32_t ip, uint16_t port) {
+    uint32_t ipN = htonl(ip);
+    sockaddr_storage address;
+    memset(&address, 0, sizeof(address));
+    EmiNetUtil::makeAddress(AF_INET, (const uint8_t *)&ipN, sizeof(ipN), htons(port), &address);
+    return address;
+}
+
+// Checks that the table has exactly the entries of the map
+static void checkSame(Table& table, const Map& map) {
+    CHECK(table.size() == map.size());
+    
+    for (Map::const_iterator iter=map.begin(); iter!=map.end(); ++iter) {
+        int *value = table.find(EmiAddressKey(iter->first));
+        CHECK(value && *value == iter->second);
+    }
+    
+    size_t count = 0;
+    for (Table::iterator iter=table.begin(); iter!=table.end(); ++iter) {
+        count++;
+    }
+    CHECK(count == map.size());
+}
+
+// Runs random inserts and erases against both a table and a std::map.
+// The addresses are drawn from a small space, so that there are lots
+// of collisions, long probe sequences and backward shift deletions.
+static void testRandomOperations() {
+    Table table(EmiSipHash::Key(1, 2));
+    Map map;
+    
+    uint32_t random = 12345;
+    for (int i=0; i<200000; i++) {
+        random = random*1103515245 + 12345;
+        sockaddr_storage address = makeAddress(0x0a000000 | ((random >> 8) & 0xff), (random >> 16) & 3);
+        EmiAddressKey key(address);
+        
+        if (random & 0x80000000) {
+            bool inserted = table.insert(key, i);
+            bool mapInserted = map.insert(std::make_pair(address, i)).second;
+            CHECK(inserted == mapInserted);
+        }
+        else {
+            CHECK(table.erase(key) == map.erase(address));
+        }
+        
+        if (0 == i % 10000) {
+            checkSame(table, map);
+        }
+    }
+    
+    checkSame(table, map);
+}
+
+// IPv4 and IPv6 keys, and keys that differ only in the port, are
+// different keys
+static void testKeys() {
+    Table table(EmiSipHash::Key(3, 4));
+    
+    sockaddr_storage a = makeAddress(0x7f000001, 1);
+    sockaddr_storage b = makeAddress(0x7f000001, 2);
+    
+    uint8_t ip6[16] = { 0 };
+    memcpy(ip6, "\x7f\x00\x00\x01", 4);
+    sockaddr_storage c;
+    memset(&c, 0, sizeof(c));
+    EmiNetUtil::makeAddress(AF_INET6, ip6, sizeof(ip6), htons(1), &c);
+    
+    CHECK(table.insert(EmiAddressKey(a), 1));
+    CHECK(table.insert(EmiAddressKey(b), 2));
+    CHECK(table.insert(EmiAddressKey(c), 3));
+    CHECK(!table.insert(EmiAddressKey(a), 4));
+    
+    CHECK(1 == *table.find(EmiAddressKey(a)));
+    CHECK(2 == *table.find(EmiAddressKey(b)));
+    CHECK(3 == *table.find(EmiAddressKey(c)));
+    
+    // The hash depends on the table's key
+    CHECK(EmiAddressKey(a).hash(EmiSipHash::Key(3, 4)) != EmiAddressKey(a).hash(EmiSipHash::Key(3, 5)));
+}
+
+int main() {
+    testRandomOperations();
+    testKeys();
+    
+    return 0;
+}
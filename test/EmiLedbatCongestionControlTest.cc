@@ -0,0 +1,169 @@
+//
+//  EmiLedbatCongestionControlTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiLedbatCongestionControl.h"
+
+// Drives EmiLedbatCongestionControl through EmiCongestionControlPolicy
+// the way EmiCongestionControl does, and checks that it backs off when
+// a queue builds up, and that it lets the queue drain every now and
+// then.
+
+typedef EmiCongestionControlPolicy::State State;
+
+static const size_t PACKET_SIZE = 1000;
+// 2 packets
+static const size_t MIN_CWND = 2*PACKET_SIZE;
+static const EmiTimeInterval MIN_RTT = 0.1;
+static const EmiTimeInterval TARGET = 0.01;
+
+static State makeState() {
+    State state;
+    state.minRtt = MIN_RTT;
+    return state;
+}
+
+static bool near(size_t a, size_t b) {
+    return a+2 >= b && a <= b+2;
+}
+
+static void sendPackets(EmiCongestionControlPolicy& policy, EmiTimeInterval now, size_t count) {
+    for (size_t i=0; i<count; i++) {
+        policy.onPacketSent(now, (EmiPacketSequenceNumber)i, PACKET_SIZE);
+    }
+}
+
+// Sends packets and acks them until slow start has grown the window to
+// 10 packets
+static void slowStart(EmiCongestionControlPolicy& policy, EmiTimeInterval now) {
+    CHECK(EMI_MIN_CONGESTION_WINDOW == policy.congestionWindow());
+    sendPackets(policy, now, 10);
+    policy.onAck(now, makeState());
+    CHECK(10*PACKET_SIZE == policy.congestionWindow());
+    
+    policy.onRttSample(now, MIN_RTT, makeState());
+    CHECK(10*PACKET_SIZE == policy.congestionWindow());
+}
+
+static void testBackOff() {
+    EmiLedbatCongestionControl ledbat(TARGET);
+    EmiCongestionControlPolicy& policy(ledbat);
+    
+    EmiTimeInterval now = 1;
+    slowStart(policy, now);
+    
+    // A queueing delay 20% above the target ends slow start, and cuts
+    // the window by 20%
+    now += 0.1;
+    policy.onRttSample(now, MIN_RTT+0.012, makeState());
+    CHECK(near(8*PACKET_SIZE, policy.congestionWindow()));
+    
+    // Slow start is over, so sending more doesn't grow the window
+    sendPackets(policy, now, 20);
+    policy.onAck(now, makeState());
+    CHECK(near(8*PACKET_SIZE, policy.congestionWindow()));
+    
+    // The window is cut at most once per RTT
+    now += 0.05;
+    policy.onRttSample(now, MIN_RTT+0.02, makeState());
+    CHECK(near(8*PACKET_SIZE, policy.congestionWindow()));
+    
+    // Far above the target, the window is halved
+    now += 0.1;
+    policy.onRttSample(now, MIN_RTT+0.03, makeState());
+    CHECK(near(4*PACKET_SIZE, policy.congestionWindow()));
+    
+    // Loss halves the window too, once per RTT
+    now += 0.05;
+    policy.onNak(now, 30, 40, makeState());
+    CHECK(near(4*PACKET_SIZE, policy.congestionWindow()));
+    now += 0.1;
+    policy.onNak(now, 30, 40, makeState());
+    CHECK(MIN_CWND == policy.congestionWindow());
+    
+    // It never goes below the minimum
+    now += 0.2;
+    policy.onNak(now, 50, 60, makeState());
+    CHECK(MIN_CWND == policy.congestionWindow());
+}
+
+// Slow start ends before the queueing delay reaches the target
+static void testSlowStartExit() {
+    EmiLedbatCongestionControl ledbat(TARGET);
+    EmiCongestionControlPolicy& policy(ledbat);
+    
+    EmiTimeInterval now = 1;
+    slowStart(policy, now);
+    
+    now += 0.1;
+    policy.onRttSample(now, MIN_RTT+0.008, makeState());
+    size_t cwnd = policy.congestionWindow();
+    CHECK(10*PACKET_SIZE <= cwnd && cwnd < 11*PACKET_SIZE);
+    
+    sendPackets(policy, now, 20);
+    policy.onAck(now, makeState());
+    CHECK(cwnd == policy.congestionWindow());
+}
+
+static void testSlowdown() {
+    EmiLedbatCongestionControl ledbat(TARGET);
+    EmiCongestionControlPolicy& policy(ledbat);
+    
+    EmiTimeInterval now = 1;
+    slowStart(policy, now);
+    
+    // Ending slow start schedules the first slowdown two RTTs later
+    now += 0.1;
+    EmiTimeInterval rtt = MIN_RTT+0.008;
+    policy.onRttSample(now, rtt, makeState());
+    size_t cwnd = policy.congestionWindow();
+    
+    now += 1.5*rtt;
+    policy.onAck(now, makeState());
+    CHECK(cwnd == policy.congestionWindow());
+    
+    // During the slowdown, the window is at the minimum, and neither
+    // queueing delay nor loss changes it
+    now += rtt;
+    policy.onAck(now, makeState());
+    CHECK(MIN_CWND == policy.congestionWindow());
+    policy.onRttSample(now, MIN_RTT+0.03, makeState());
+    policy.onNak(now, 30, 40, makeState());
+    CHECK(MIN_CWND == policy.congestionWindow());
+    
+    // After two RTTs, it slow starts back up to the window it had
+    // before the slowdown
+    now += 2*rtt;
+    policy.onAck(now, makeState());
+    CHECK(MIN_CWND == policy.congestionWindow());
+    sendPackets(policy, now, 20);
+    policy.onAck(now, makeState());
+    CHECK(cwnd == policy.congestionWindow());
+    
+    // An RTO goes back to slow start from the minimum window, up to
+    // half the window
+    policy.onRto();
+    CHECK(MIN_CWND == policy.congestionWindow());
+    sendPackets(policy, now, 20);
+    policy.onAck(now, makeState());
+    CHECK(cwnd/2 == policy.congestionWindow());
+    
+    // A new path starts over from scratch
+    policy.onPathChange();
+    CHECK(0 == policy.pacingRate());
+    slowStart(policy, now);
+}
+
+int main() {
+    testBackOff();
+    testSlowStartExit();
+    testSlowdown();
+    
+    return 0;
+}
@@ -0,0 +1,122 @@
+//
+//  EmiLossListTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiLossList.h"
+
+static const EmiTimeInterval RTT = 0.1;
+
+static void checkRange(const EmiNakRange& range,
+                       EmiPacketSequenceNumber oldest,
+                       EmiPacketSequenceNumber newest) {
+    CHECK(oldest == range.oldest);
+    CHECK(newest == range.newest);
+}
+
+// Packets that are not received are reported, and are no longer
+// reported once they arrive
+static void testGap() {
+    EmiLossList lossList;
+    EmiNakRange ranges[EMI_MAX_NAK_RANGES];
+    
+    lossList.gotPacket(0, 10);
+    lossList.gotPacket(0, 11);
+    CHECK(0 == lossList.calculateNaks(0, RTT, ranges, EMI_MAX_NAK_RANGES));
+    
+    lossList.gotPacket(0, 15);
+    lossList.gotPacket(0, 13);
+    CHECK(2 == lossList.calculateNaks(0, RTT, ranges, EMI_MAX_NAK_RANGES));
+    checkRange(ranges[0], 12, 12);
+    checkRange(ranges[1], 14, 14);
+    
+    // Not again until an RTT-based timeout has passed
+    CHECK(0 == lossList.calculateNaks(0, RTT, ranges, EMI_MAX_NAK_RANGES));
+    
+    lossList.gotPacket(0, 12);
+    CHECK(1 == lossList.calculateNaks(1, RTT, ranges, EMI_MAX_NAK_RANGES));
+    checkRange(ranges[0], 14, 14);
+}
+
+// A range of lost packets that wraps around the largest sequence
+// number is reported as one range
+static void testWraparound() {
+    EmiLossList lossList;
+    EmiNakRange ranges[EMI_MAX_NAK_RANGES];
+    
+    lossList.gotPacket(0, EMI_PACKET_SEQUENCE_NUMBER_MASK-1);
+    lossList.gotPacket(0, 2);
+    
+    CHECK(1 == lossList.calculateNaks(0, RTT, ranges, EMI_MAX_NAK_RANGES));
+    checkRange(ranges[0], EMI_PACKET_SEQUENCE_NUMBER_MASK, 1);
+    
+    // A packet that arrives late, from before the wraparound
+    lossList.gotPacket(1, EMI_PACKET_SEQUENCE_NUMBER_MASK);
+    CHECK(1 == lossList.calculateNaks(1, RTT, ranges, EMI_MAX_NAK_RANGES));
+    checkRange(ranges[0], 0, 1);
+}
+
+// When the sequence number jumps ahead by more than the loss list can
+// keep track of, only the newest packets are reported
+static void testLargeJump() {
+    EmiLossList lossList;
+    EmiNakRange ranges[EMI_MAX_NAK_RANGES];
+    
+    lossList.gotPacket(0, 0);
+    lossList.gotPacket(0, 5000);
+    
+    CHECK(1 == lossList.calculateNaks(0, RTT, ranges, EMI_MAX_NAK_RANGES));
+    CHECK(4999 == ranges[0].newest);
+    CHECK(5000 > ranges[0].oldest && ranges[0].oldest > 3000);
+    EmiPacketSequenceNumber oldestTracked = ranges[0].oldest;
+    
+    // Packets that are too old are ignored
+    lossList.gotPacket(1, 1);
+    lossList.gotPacket(1, oldestTracked-1);
+    
+    // Packets in the middle split the range
+    lossList.gotPacket(1, 4000);
+    CHECK(2 == lossList.calculateNaks(1, RTT, ranges, EMI_MAX_NAK_RANGES));
+    checkRange(ranges[0], oldestTracked, 3999);
+    checkRange(ranges[1], 4001, 4999);
+    
+    // Two more jumps, the last of which wraps. The range that is
+    // reported is as long as the first one, and wraps too.
+    lossList.gotPacket(2, 5000+EMI_PACKET_SEQUENCE_NUMBER_MASK/2);
+    lossList.gotPacket(2, 5);
+    CHECK(1 == lossList.calculateNaks(2, RTT, ranges, EMI_MAX_NAK_RANGES));
+    checkRange(ranges[0], (5-(5000-oldestTracked)) & EMI_PACKET_SEQUENCE_NUMBER_MASK, 4);
+}
+
+// More ranges than fit in a packet: the newest are reported first
+static void testManyRanges() {
+    EmiLossList lossList;
+    EmiNakRange ranges[EMI_MAX_NAK_RANGES];
+    
+    for (EmiPacketSequenceNumber sn=0; sn<=2*(EMI_MAX_NAK_RANGES+1); sn+=2) {
+        lossList.gotPacket(0, sn);
+    }
+    
+    CHECK(EMI_MAX_NAK_RANGES == lossList.calculateNaks(0, RTT, ranges, EMI_MAX_NAK_RANGES));
+    for (size_t i=0; i<EMI_MAX_NAK_RANGES; i++) {
+        EmiPacketSequenceNumber sn = (EmiPacketSequenceNumber)(3+2*i);
+        checkRange(ranges[i], sn, sn);
+    }
+    
+    CHECK(1 == lossList.calculateNaks(0, RTT, ranges, EMI_MAX_NAK_RANGES));
+    checkRange(ranges[0], 1, 1);
+}
+
+int main() {
+    testGap();
+    testWraparound();
+    testLargeJump();
+    testManyRanges();
+    
+    return 0;
+}
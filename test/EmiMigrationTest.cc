@@ -0,0 +1,105 @@
+//
+//  EmiMigrationTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+#include "EmiTestDelegates.h"
+
+// A client changes address, as if its NAT had dropped its mapping, and
+// its connection follows it. Then the NAT gives the old address to a
+// new client. The server must not take the new client for the one that
+// moved away, so it has to open a connection for it.
+
+static const uint16_t SERVER_PORT = 9000;
+
+class EmiMigrationTestContext : public EmiTestContext {
+public:
+    std::vector<EmiTestConnection *> conns;
+    
+    explicit EmiMigrationTestContext(const EmiSockConfig& config) :
+    EmiTestContext(config), conns() {}
+    
+    virtual void gotServerConnection(EmiTestConnection& conn) {
+        EmiTestContext::gotServerConnection(conn);
+        conns.push_back(&conn);
+    }
+    
+    virtual void connectionOpened(EmiTestConnection& conn, bool error, EmiDisconnectReason reason) {
+        EmiTestContext::connectionOpened(conn, error, reason);
+        if (!error) {
+            conns.push_back(&conn);
+        }
+    }
+};
+
+static void sendMessage(EmiTestConnection& conn) {
+    static const uint8_t message[] = "hello";
+    
+    EmiTestError err;
+    CHECK(conn.conn.send(EmiTestNetwork::get().now(),
+                         EmiTestBinding::makePersistentData(message, sizeof(message)),
+                         EMI_CHANNEL_QUALIFIER_DEFAULT,
+                         EMI_PRIORITY_DEFAULT,
+                         err));
+}
+
+int main() {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    
+    {
+        EmiSockConfig serverConfig;
+        serverConfig.acceptConnections = true;
+        serverConfig.port = SERVER_PORT;
+        
+        EmiTestError err;
+        EmiMigrationTestContext server(serverConfig);
+        CHECK(server.sock->open(err));
+        
+        EmiMigrationTestContext client((EmiSockConfig()));
+        CHECK(client.connect(SERVER_PORT));
+        net.run(1);
+        
+        CHECK(1 == client.openedConnections);
+        CHECK(1 == server.serverConnections);
+        EmiTestConnection& moved(*server.conns[0]);
+        
+        // The first client moves
+        uint16_t oldPort = client.conns[0]->conn.getSocket()->getLocalPort();
+        CHECK(net.natRebind(oldPort));
+        sendMessage(*client.conns[0]);
+        net.run(1);
+        
+        CHECK(1 == moved.receivedMessages);
+        CHECK(oldPort != EmiNetUtil::addrPortH(moved.conn.getRemoteAddress()));
+        
+        // A new client gets the old address
+        net.reusePort(oldPort);
+        CHECK(client.connect(SERVER_PORT));
+        net.run(1);
+        
+        CHECK(2 == client.openedConnections);
+        CHECK(2 == server.serverConnections);
+        CHECK(oldPort == EmiNetUtil::addrPortH(server.conns[1]->conn.getRemoteAddress()));
+        
+        // Both clients reach their own server connections
+        sendMessage(*client.conns[0]);
+        sendMessage(*client.conns[1]);
+        net.run(1);
+        
+        CHECK(2 == moved.receivedMessages);
+        CHECK(1 == server.conns[1]->receivedMessages);
+        for (size_t i=0; i<2; i++) {
+            CHECK(!client.conns[i]->disconnected);
+            CHECK(!server.conns[i]->disconnected);
+        }
+    }
+    
+    net.run(1);
+    net.reset();
+    
+    return 0;
+}
@@ -0,0 +1,276 @@
+//
+//  EmiMpscQueueTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiMpscQueue.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+typedef EmiMpscQueue<size_t> Queue;
+
+static void testSingleThread() {
+    Queue queue(5);
+    CHECK(8 == queue.capacity());
+    CHECK(queue.empty());
+    
+    size_t value;
+    CHECK(!queue.pop(value));
+    
+    // Only the first push wakes the consumer up
+    bool wake;
+    CHECK(queue.push(1, wake));
+    CHECK(wake);
+    CHECK(queue.push(2, wake));
+    CHECK(!wake);
+    CHECK(!queue.empty());
+    
+    queue.clearPending();
+    CHECK(queue.pop(value) && 1 == value);
+    CHECK(queue.pop(value) && 2 == value);
+    CHECK(!queue.pop(value));
+    CHECK(queue.empty());
+    
+    // The consumer has cleared the flag, so it is woken up again
+    CHECK(queue.push(3, wake));
+    CHECK(wake);
+    
+    // Fill the queue, and wrap around
+    for (size_t i=0; i<7; i++) {
+        CHECK(queue.push(4+i, wake));
+        CHECK(!wake);
+    }
+    CHECK(!queue.push(11, wake));
+    CHECK(!wake);
+    
+    for (size_t i=0; i<8; i++) {
+        CHECK(queue.pop(value) && 3+i == value);
+    }
+    CHECK(!queue.pop(value));
+    
+    for (size_t i=0; i<8; i++) {
+        CHECK(queue.push(100+i, wake));
+    }
+    for (size_t i=0; i<8; i++) {
+        CHECK(queue.pop(value) && 100+i == value);
+    }
+}
+
+static const size_t NUM_PRODUCERS = 4;
+static const size_t VALUES_PER_PRODUCER = 200000;
+
+struct Shared {
+    Queue           queue;
+    volatile size_t wakeups;
+    volatile size_t dropped;
+    
+    Shared() : queue(64), wakeups(0), dropped(0) {}
+};
+
+struct Producer {
+    Shared *shared;
+    size_t  index;
+};
+
+// The values encode the producer in the low bits and a counter in the
+// rest, so that the consumer can check the order per producer
+static void *produce(void *arg) {
+    Producer *producer = (Producer *)arg;
+    Shared& shared(*producer->shared);
+    
+    for (size_t i=0; i<VALUES_PER_PRODUCER; i++) {
+        size_t value = i*NUM_PRODUCERS + producer->index;
+        
+        bool wake;
+        while (!shared.queue.push(value, wake)) {
+            __sync_fetch_and_add(&shared.dropped, 1);
+            sched_yield();
+        }
+        if (wake) {
+            __sync_fetch_and_add(&shared.wakeups, 1);
+        }
+    }
+    
+    return NULL;
+}
+
+static void testManyProducers() {
+    Shared shared;
+    Producer producers[NUM_PRODUCERS];
+    pthread_t threads[NUM_PRODUCERS];
+    
+    for (size_t i=0; i<NUM_PRODUCERS; i++) {
+        producers[i].shared = &shared;
+        producers[i].index = i;
+        CHECK(0 == pthread_create(&threads[i], NULL, produce, &producers[i]));
+    }
+    
+    std::vector<size_t> next(NUM_PRODUCERS, 0);
+    size_t popped = 0;
+    size_t wakeupsSeen = 0;
+    
+    // Like EmiConn, the consumer only drains the queue after a wakeup.
+    // If a push that needs a wakeup does not report it, this never
+    // finishes.
+    while (popped < NUM_PRODUCERS*VALUES_PER_PRODUCER) {
+        if (wakeupsSeen == shared.wakeups) {
+            sched_yield();
+            continue;
+        }
+        wakeupsSeen = shared.wakeups;
+        
+        shared.queue.clearPending();
+        
+        size_t value;
+        while (shared.queue.pop(value)) {
+            size_t producer = value % NUM_PRODUCERS;
+            CHECK(next[producer] == value / NUM_PRODUCERS);
+            next[producer]++;
+            popped++;
+        }
+    }
+    
+    for (size_t i=0; i<NUM_PRODUCERS; i++) {
+        CHECK(0 == pthread_join(threads[i], NULL));
+    }
+    
+    size_t value;
+    CHECK(!shared.queue.pop(value));
+    for (size_t i=0; i<NUM_PRODUCERS; i++) {
+        CHECK(VALUES_PER_PRODUCER == next[i]);
+    }
+}
+
+// The wake protocol of EmiConn: A wakeup clears the pending flag and
+// schedules a tick, and every tick clears the flag before it looks at
+// the queue. The consumer here also ticks for unrelated reasons, which
+// lets a tick pop a value before the push that published it has set the
+// pending flag.
+struct WakeShared {
+    Queue           queue;
+    volatile size_t pushed;
+    volatile size_t popped;
+    volatile size_t wakeupsPosted;
+    volatile size_t wakeupsHandled;
+    
+    WakeShared() : queue(64), pushed(0), popped(0), wakeupsPosted(0), wakeupsHandled(0) {}
+    
+    // EmiConn::sendsWereEnqueued
+    void wakeUp() {
+        queue.clearPending();
+    }
+    
+    // EmiConn::drainEnqueuedSends
+    void tick() {
+        queue.clearPending();
+        
+        if (queue.empty()) {
+            return;
+        }
+        
+        size_t value;
+        while (queue.pop(value)) {
+            CHECK(popped == value);
+            __sync_fetch_and_add(&popped, 1);
+        }
+    }
+};
+
+static const size_t WAKE_BURSTS = 20000;
+
+static void *produceBursts(void *arg) {
+    WakeShared& shared(*(WakeShared *)arg);
+    
+    size_t value = 0;
+    for (size_t burst=0; burst<WAKE_BURSTS; burst++) {
+        // Wait until the consumer has popped everything and handled all
+        // wakeups. Then the first push of the burst must wake it up;
+        // if it doesn't, a wakeup has been lost.
+        while (shared.popped != value ||
+               shared.wakeupsHandled != shared.wakeupsPosted) {
+            sched_yield();
+        }
+        
+        size_t burstSize = 1 + burst%8;
+        for (size_t i=0; i<burstSize; i++) {
+            bool wake;
+            CHECK(shared.queue.push(value, wake));
+            CHECK(0 != i || wake);
+            value++;
+            __sync_fetch_and_add(&shared.pushed, 1);
+            
+            if (wake) {
+                __sync_fetch_and_add(&shared.wakeupsPosted, 1);
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+static void testWakeProtocol() {
+    // First the interleaving that used to lose wakeups, replayed in one
+    // thread: A tick pops a value after the push has published it but
+    // before the push has set the pending flag, so the flag is still set
+    // when the queue is empty and the push's wakeup arrives.
+    {
+        WakeShared shared;
+        bool wake;
+        size_t value;
+        
+        CHECK(shared.queue.push(0, wake));
+        CHECK(wake);
+        CHECK(shared.queue.pop(value) && 0 == value);
+        shared.wakeUp();
+        shared.tick();
+        
+        CHECK(shared.queue.push(1, wake));
+        CHECK(wake);
+    }
+    
+    WakeShared shared;
+    
+    pthread_t thread;
+    CHECK(0 == pthread_create(&thread, NULL, produceBursts, &shared));
+    
+    size_t total = 0;
+    for (size_t burst=0; burst<WAKE_BURSTS; burst++) {
+        total += 1 + burst%8;
+    }
+    
+    while (shared.popped < total) {
+        bool tickScheduled = false;
+        
+        if (shared.wakeupsHandled != shared.wakeupsPosted) {
+            shared.wakeUp();
+            __sync_fetch_and_add(&shared.wakeupsHandled, 1);
+            tickScheduled = true;
+        }
+        
+        // Tick anyway every now and then, like a connection does when its
+        // other timers fire
+        if (tickScheduled || 0 == shared.pushed%3) {
+            shared.tick();
+        }
+        
+        sched_yield();
+    }
+    
+    CHECK(0 == pthread_join(thread, NULL));
+    CHECK(shared.queue.empty());
+}
+
+int main() {
+    testSingleThread();
+    testManyProducers();
+    testWakeProtocol();
+    
+    return 0;
+}
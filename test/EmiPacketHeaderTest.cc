@@ -0,0 +1,253 @@
+//
+//  EmiPacketHeaderTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiPacketHeader.h"
+#include "EmiNetUtil.h"
+
+#include <cstring>
+
+// Writes header at buf+offset, optionally adds filler, and parses it
+// back into out. Returns the length of the header.
+static size_t roundTrip(uint8_t *buf, size_t offset, const EmiPacketHeader& header,
+                        uint16_t fillerSize, EmiPacketHeader *out) {
+    size_t headerLength;
+    CHECK(EmiPacketHeader::write(buf+offset, EMI_PACKET_HEADER_MAX_LENGTH, header, &headerLength));
+    CHECK(EMI_PACKET_HEADER_MAX_LENGTH >= headerLength);
+    
+    if (fillerSize) {
+        EmiPacketHeader::addFillerBytes(buf+offset, headerLength, fillerSize);
+        headerLength += fillerSize;
+    }
+    
+    size_t parsedLength;
+    CHECK(EmiPacketHeader::parse(buf+offset, headerLength, out, &parsedLength));
+    CHECK(headerLength == parsedLength);
+    
+    return headerLength;
+}
+
+static void testReadWrite() {
+    uint8_t buf[8];
+    
+    // At an odd offset, to make sure that nothing assumes alignment
+    EmiNetUtil::write16(buf+1, 0x1234);
+    CHECK(0x12 == buf[1] && 0x34 == buf[2]);
+    CHECK(0x1234 == EmiNetUtil::read16(buf+1));
+    
+    EmiNetUtil::write32(buf+3, 0x89abcdefU);
+    CHECK(0x89 == buf[3] && 0xab == buf[4] && 0xcd == buf[5] && 0xef == buf[6]);
+    CHECK(0x89abcdefU == EmiNetUtil::read32(buf+3));
+}
+
+// The fields that are more than one byte long survive a round trip
+// when the header starts at an odd address, with and without filler.
+static void testUnalignedFields() {
+    EmiPacketHeader header;
+    header.flags = (EMI_SEQUENCE_NUMBER_PACKET_FLAG |
+                    EMI_LINK_CAPACITY_PACKET_FLAG |
+                    EMI_ARRIVAL_RATE_PACKET_FLAG);
+    header.extraFlags = EMI_CONNECTION_ID_EXTRA_PACKET_FLAG;
+    header.connectionId = 0xdeadbeefU;
+    header.sequenceNumber = 0x123456;
+    header.linkCapacity = 1234.5f;
+    header.arrivalRate = -0.25f;
+    
+    for (size_t offset=0; offset<4; offset++) {
+        for (uint16_t fillerSize=0; fillerSize<300; fillerSize+=(fillerSize < 4 ? 1 : 97)) {
+            uint8_t buf[EMI_PACKET_HEADER_MAX_LENGTH+300+4];
+            memset(buf, 0, sizeof(buf));
+            
+            EmiPacketHeader out;
+            size_t length = roundTrip(buf, offset, header, fillerSize, &out);
+            
+            CHECK(header.connectionId == out.connectionId);
+            CHECK(header.sequenceNumber == out.sequenceNumber);
+            CHECK(header.linkCapacity == out.linkCapacity);
+            CHECK(header.arrivalRate == out.arrivalRate);
+            
+            EmiConnectionId connectionId;
+            CHECK(EmiPacketHeader::parseConnectionId(buf+offset, length, &connectionId));
+            CHECK(header.connectionId == connectionId);
+        }
+    }
+}
+
+static void checkNakRanges(const EmiPacketHeader& expected, const EmiPacketHeader& actual) {
+    CHECK(expected.nakRangeCount == actual.nakRangeCount);
+    for (size_t i=0; i<expected.nakRangeCount; i++) {
+        CHECK(expected.nakRanges[i].oldest == actual.nakRanges[i].oldest);
+        CHECK(expected.nakRanges[i].newest == actual.nakRanges[i].newest);
+    }
+}
+
+// A header with every field set, and 1 or 4 NAK ranges, survives a
+// round trip with and without filler.
+static void testAllFields() {
+    static const uint16_t fillerSizes[] = { 0, 1, 2, 3, 300 };
+    
+    for (size_t nakRangeCount=1; nakRangeCount<=EMI_MAX_NAK_RANGES; nakRangeCount+=EMI_MAX_NAK_RANGES-1) {
+        EmiPacketHeader header;
+        header.flags = (EMI_SEQUENCE_NUMBER_PACKET_FLAG |
+                        EMI_ACK_PACKET_FLAG |
+                        EMI_NAK_PACKET_FLAG |
+                        EMI_LINK_CAPACITY_PACKET_FLAG |
+                        EMI_ARRIVAL_RATE_PACKET_FLAG |
+                        EMI_RTT_REQUEST_PACKET_FLAG |
+                        EMI_RTT_RESPONSE_PACKET_FLAG);
+        header.extraFlags = (EMI_CONNECTION_ID_EXTRA_PACKET_FLAG |
+                             EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG);
+        header.connectionId = 0x01020304U;
+        header.sequenceNumber = 0xfffffe;
+        header.ack = 0x000102;
+        header.nakRangeCount = nakRangeCount;
+        for (size_t i=0; i<nakRangeCount; i++) {
+            header.nakRanges[i].oldest = (EmiPacketSequenceNumber)(0xfffff0+i*10) & EMI_PACKET_SEQUENCE_NUMBER_MASK;
+            header.nakRanges[i].newest = (EmiPacketSequenceNumber)(0xfffff0+i*10+3) & EMI_PACKET_SEQUENCE_NUMBER_MASK;
+        }
+        header.linkCapacity = 100.0f;
+        header.arrivalRate = 200.5f;
+        header.rttResponse = 0xabcdef;
+        header.rttResponseDelay = 17;
+        header.receiveWindow = 0xfedcba98U;
+        
+        for (size_t i=0; i<sizeof(fillerSizes)/sizeof(fillerSizes[0]); i++) {
+            uint8_t buf[EMI_PACKET_HEADER_MAX_LENGTH+300];
+            memset(buf, 0xff, sizeof(buf));
+            
+            EmiPacketHeader out;
+            size_t length = roundTrip(buf, 0, header, fillerSizes[i], &out);
+            if (EMI_MAX_NAK_RANGES == nakRangeCount && 0 == fillerSizes[i]) {
+                CHECK(EMI_PACKET_HEADER_MAX_LENGTH == length);
+            }
+            
+            CHECK(header.flags == (out.flags & ~EMI_EXTRA_FLAGS_PACKET_FLAG));
+            CHECK(header.extraFlags == (out.extraFlags & (EMI_CONNECTION_ID_EXTRA_PACKET_FLAG |
+                                                           EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG)));
+            CHECK(header.connectionId == out.connectionId);
+            CHECK(header.sequenceNumber == out.sequenceNumber);
+            CHECK(header.ack == out.ack);
+            checkNakRanges(header, out);
+            CHECK(header.linkCapacity == out.linkCapacity);
+            CHECK(header.arrivalRate == out.arrivalRate);
+            CHECK(header.rttResponse == out.rttResponse);
+            CHECK(header.rttResponseDelay == out.rttResponseDelay);
+            CHECK(header.receiveWindow == out.receiveWindow);
+        }
+    }
+}
+
+// The largest header that can be written is exactly
+// EMI_PACKET_HEADER_MAX_LENGTH bytes, which is what heartbeats are
+// written into.
+static void testLargestHeader() {
+    EmiPacketHeader header;
+    header.flags = (EMI_SEQUENCE_NUMBER_PACKET_FLAG |
+                    EMI_ACK_PACKET_FLAG |
+                    EMI_NAK_PACKET_FLAG |
+                    EMI_LINK_CAPACITY_PACKET_FLAG |
+                    EMI_ARRIVAL_RATE_PACKET_FLAG |
+                    EMI_RTT_REQUEST_PACKET_FLAG |
+                    EMI_RTT_RESPONSE_PACKET_FLAG);
+    header.extraFlags = (EMI_CONNECTION_ID_EXTRA_PACKET_FLAG |
+                         EMI_RECEIVE_WINDOW_EXTRA_PACKET_FLAG);
+    header.connectionId = 1;
+    header.nakRangeCount = EMI_MAX_NAK_RANGES;
+    for (size_t i=0; i<EMI_MAX_NAK_RANGES; i++) {
+        header.nakRanges[i].oldest = (EmiPacketSequenceNumber)(i*10);
+        header.nakRanges[i].newest = (EmiPacketSequenceNumber)(i*10+1);
+    }
+    
+    uint8_t buf[EMI_PACKET_HEADER_MAX_LENGTH];
+    size_t headerLength;
+    CHECK(!EmiPacketHeader::write(buf, sizeof(buf)-1, header, &headerLength));
+    CHECK(EmiPacketHeader::write(buf, sizeof(buf), header, &headerLength));
+    CHECK(sizeof(buf) == headerLength);
+    
+    EmiPacketHeader out;
+    size_t parsedLength;
+    CHECK(EmiPacketHeader::parse(buf, headerLength, &out, &parsedLength));
+    CHECK(headerLength == parsedLength);
+    checkNakRanges(header, out);
+}
+
+// Peers that predate connection IDs, receive windows and NAK ranges
+// write a lone lost packet as a bare sequence number, and don't write
+// the extra flags byte unless they add filler. We write headers that
+// don't need the new fields the same way, so that they can read them,
+// and we can read theirs.
+static void testOldPeerPackets() {
+    // What we write
+    EmiPacketHeader header;
+    header.flags = (EMI_SEQUENCE_NUMBER_PACKET_FLAG |
+                    EMI_ACK_PACKET_FLAG |
+                    EMI_NAK_PACKET_FLAG);
+    header.sequenceNumber = 0x010203;
+    header.ack = 0x040506;
+    header.nakRangeCount = 1;
+    header.nakRanges[0].oldest = 0x070809;
+    header.nakRanges[0].newest = 0x070809;
+    
+    uint8_t buf[EMI_PACKET_HEADER_MAX_LENGTH+3];
+    size_t headerLength;
+    CHECK(EmiPacketHeader::write(buf, EMI_PACKET_HEADER_MAX_LENGTH, header, &headerLength));
+    
+    static const uint8_t oldPacket[] = {
+        EMI_SEQUENCE_NUMBER_PACKET_FLAG | EMI_ACK_PACKET_FLAG | EMI_NAK_PACKET_FLAG,
+        // 24 bit sequence numbers are written least significant byte
+        // first
+        0x03, 0x02, 0x01, // sequence number
+        0x06, 0x05, 0x04, // ack
+        0x09, 0x08, 0x07  // NAK
+    };
+    CHECK(sizeof(oldPacket) == headerLength);
+    CHECK(0 == memcmp(oldPacket, buf, sizeof(oldPacket)));
+    
+    // What they write
+    EmiPacketHeader out;
+    size_t parsedLength;
+    CHECK(EmiPacketHeader::parse(oldPacket, sizeof(oldPacket), &out, &parsedLength));
+    CHECK(sizeof(oldPacket) == parsedLength);
+    CHECK(header.flags == out.flags);
+    CHECK(0 == out.extraFlags);
+    CHECK(EMI_NO_CONNECTION_ID == out.connectionId);
+    CHECK(header.sequenceNumber == out.sequenceNumber);
+    CHECK(header.ack == out.ack);
+    checkNakRanges(header, out);
+    CHECK(0 == out.receiveWindow);
+    
+    EmiConnectionId connectionId;
+    CHECK(!EmiPacketHeader::parseConnectionId(oldPacket, sizeof(oldPacket), &connectionId));
+    
+    // With one byte of filler, which makes them write the extra flags
+    // byte, but none of the new extra flags
+    memcpy(buf, oldPacket, sizeof(oldPacket));
+    EmiPacketHeader::addFillerBytes(buf, sizeof(oldPacket), 2);
+    CHECK(EMI_EXTRA_FLAGS_PACKET_FLAG & buf[0]);
+    CHECK(EMI_1_BYTE_FILLER_EXTRA_PACKET_FLAG == buf[1]);
+    CHECK(EmiPacketHeader::parse(buf, sizeof(oldPacket)+2, &out, &parsedLength));
+    CHECK(sizeof(oldPacket)+2 == parsedLength);
+    CHECK(header.sequenceNumber == out.sequenceNumber);
+    CHECK(header.ack == out.ack);
+    checkNakRanges(header, out);
+    CHECK(0 == out.receiveWindow);
+    
+    // A truncated header is rejected
+    CHECK(!EmiPacketHeader::parse(oldPacket, sizeof(oldPacket)-1, &out, &parsedLength));
+}
+
+int main() {
+    testReadWrite();
+    testUnalignedFields();
+    testAllFields();
+    testLargestHeader();
+    testOldPeerPackets();
+    
+    return 0;
+}
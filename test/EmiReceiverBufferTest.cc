@@ -0,0 +1,161 @@
+//
+//  EmiReceiverBufferTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+#include "EmiTestBinding.h"
+
+#include "EmiReceiverBuffer.h"
+
+#include <vector>
+
+// Feeds messages straight into an EmiReceiverBuffer, without a
+// connection, and looks at what comes out of it and at how much of the
+// buffer it uses.
+
+struct EmiReceiverBufferTestSockDelegate {
+    typedef EmiTestBinding Binding;
+};
+
+class EmiReceiverBufferTestReceiver {
+public:
+    std::vector<std::vector<uint8_t> > messages;
+    std::vector<const uint8_t *> messageData;
+    
+    EmiSequenceNumber getOtherHostInitialSequenceNumber() const { return 0; }
+    bool isClosed() const { return false; }
+    
+    void enqueueAck(EmiChannelQualifier /*channelQualifier*/, EmiSequenceNumber /*sequenceNumber*/) {}
+    void emitPacketLoss(EmiChannelQualifier /*channelQualifier*/, EmiSequenceNumber /*packetsLost*/) {}
+    void gotReliableSequencedAck(EmiTimeInterval /*now*/,
+                                 EmiChannelQualifier /*channelQualifier*/,
+                                 EmiSequenceNumber /*ack*/) {}
+    void deregisterReliableMessages(EmiTimeInterval /*now*/,
+                                    int32_t /*channelQualifier*/,
+                                    EmiNonWrappingSequenceNumber /*nonWrappingSequenceNumber*/) {}
+    EmiNonWrappingSequenceNumber guessSequenceNumberWrapping(EmiChannelQualifier /*channelQualifier*/,
+                                                             EmiSequenceNumber sequenceNumber) {
+        return sequenceNumber;
+    }
+    
+    void emitMessage(EmiChannelQualifier /*channelQualifier*/,
+                     const EmiBufferRef& data, size_t offset, size_t size) {
+        const uint8_t *bytes = data.data()+offset;
+        messages.push_back(std::vector<uint8_t>(bytes, bytes+size));
+        messageData.push_back(bytes);
+    }
+    
+    void emitMessagePart(EmiChannelQualifier channelQualifier,
+                         const EmiBufferRef& data, size_t offset, size_t size,
+                         EmiMessagePartFlags /*partFlags*/) {
+        emitMessage(channelQualifier, data, offset, size);
+    }
+};
+
+typedef EmiReceiverBuffer<EmiReceiverBufferTestSockDelegate, EmiReceiverBufferTestReceiver> ERB;
+
+static const EmiChannelQualifier RELIABLE = EMI_CHANNEL_QUALIFIER(EMI_CHANNEL_TYPE_RELIABLE_ORDERED, 0);
+static const size_t HEADER_LENGTH = 7;
+
+static void gotMessage(ERB& buffer, EmiSequenceNumber sn, EmiMessageFlags flags,
+                       const uint8_t *data, size_t length) {
+    EmiMessageHeader header;
+    header.flags = flags;
+    header.channelQualifier = RELIABLE;
+    header.sequenceNumber = sn;
+    header.headerLength = HEADER_LENGTH;
+    header.length = length;
+    header.ack = -1;
+    
+    CHECK(buffer.gotMessage(/*now:*/0, header, EmiBufferRef(data, length), /*offset:*/0));
+}
+
+// The parts of a split message arrive in reverse order, and are
+// emitted as one message once they are all there
+static void testSplitOutOfOrder() {
+    EmiObjectPool pool;
+    EmiReceiverBufferTestReceiver receiver;
+    ERB buffer(64*1024, /*streamMessages:*/false, receiver, pool);
+    
+    static const uint8_t data[] = "abcdefghi";
+    
+    gotMessage(buffer, 2, EMI_SPLIT_NOT_FIRST_FLAG, data+6, 3);
+    gotMessage(buffer, 1, EMI_SPLIT_NOT_FIRST_FLAG | EMI_SPLIT_NOT_LAST_FLAG, data+3, 3);
+    CHECK(receiver.messages.empty());
+    gotMessage(buffer, 0, EMI_SPLIT_NOT_LAST_FLAG, data, 3);
+    
+    CHECK(1 == receiver.messages.size());
+    CHECK(std::vector<uint8_t>(data, data+9) == receiver.messages[0]);
+}
+
+// A message that is much further ahead than the others can't make the
+// window grow beyond the size of the receiver buffer, and the window
+// gives the memory back once it is empty
+static void testWindowMemoryIsBounded() {
+    static const size_t BUFFER_SIZE = 1024*1024;
+    static const uint8_t data[] = "x";
+    
+    EmiObjectPool pool;
+    EmiReceiverBufferTestReceiver receiver;
+    ERB buffer(BUFFER_SIZE, /*streamMessages:*/false, receiver, pool);
+    CHECK(BUFFER_SIZE == buffer.freeSpace());
+    
+    // This makes a window, with an array of the initial size
+    gotMessage(buffer, 1, 0, data, 1);
+    size_t freeSpace = buffer.freeSpace();
+    size_t emptyWindowFreeSpace = freeSpace+HEADER_LENGTH+1;
+    CHECK(emptyWindowFreeSpace < BUFFER_SIZE);
+    
+    // The array grows, and that takes up room in the buffer
+    gotMessage(buffer, 1000, 0, data, 1);
+    CHECK(buffer.freeSpace()+1000*sizeof(EmiBuffer *) < freeSpace);
+    freeSpace = buffer.freeSpace();
+    
+    // Buffering this would take an array of 65536 slots, which is more
+    // than the buffer has room for
+    gotMessage(buffer, 60000, 0, data, 1);
+    CHECK(freeSpace == buffer.freeSpace());
+    
+    for (EmiSequenceNumber sn=0; sn<1000; sn++) {
+        if (1 != sn) {
+            gotMessage(buffer, sn, 0, data, 1);
+        }
+    }
+    
+    // Message 60000 was not buffered, so it isn't emitted
+    CHECK(1001 == receiver.messages.size());
+    CHECK(emptyWindowFreeSpace == buffer.freeSpace());
+}
+
+// Split messages are merged in a buffer that is reused from one
+// message to the next
+static void testMergeBufferIsReused() {
+    EmiObjectPool pool;
+    EmiReceiverBufferTestReceiver receiver;
+    ERB buffer(64*1024, /*streamMessages:*/false, receiver, pool);
+    
+    static const uint8_t data[] = "abcdef";
+    
+    for (EmiSequenceNumber sn=0; sn<6; sn+=2) {
+        gotMessage(buffer, sn, EMI_SPLIT_NOT_LAST_FLAG, data, 3);
+        gotMessage(buffer, sn+1, EMI_SPLIT_NOT_FIRST_FLAG, data+3, 3);
+    }
+    
+    CHECK(3 == receiver.messages.size());
+    for (size_t i=0; i<receiver.messages.size(); i++) {
+        CHECK(std::vector<uint8_t>(data, data+6) == receiver.messages[i]);
+        CHECK(receiver.messageData[0] == receiver.messageData[i]);
+    }
+}
+
+int main() {
+    testSplitOutOfOrder();
+    testWindowMemoryIsBounded();
+    testMergeBufferIsReused();
+    
+    return 0;
+}
@@ -0,0 +1,132 @@
+//
+//  EmiReusePortTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+#include "EmiTestDelegates.h"
+
+// Two EmiSocks share a port with reusePort. Clients connect, and then
+// change address, as if their NAT had dropped its mapping. The new
+// address hashes to either EmiSock, but the datagrams carry the
+// connection ID, which steers them to the EmiSock that owns the
+// connection, so the connections survive the move.
+
+static const uint16_t SERVER_PORT = 9000;
+static const size_t NUM_SHARDS = 2;
+static const size_t NUM_CLIENTS = 16;
+
+class EmiReusePortTestContext : public EmiTestContext {
+public:
+    std::vector<EmiTestConnection *> conns;
+    size_t receivedMessages;
+    
+    explicit EmiReusePortTestContext(const EmiSockConfig& config) :
+    EmiTestContext(config), conns(), receivedMessages(0) {}
+    
+    virtual void gotServerConnection(EmiTestConnection& conn) {
+        EmiTestContext::gotServerConnection(conn);
+        conns.push_back(&conn);
+    }
+    
+    virtual void connectionOpened(EmiTestConnection& conn, bool error, EmiDisconnectReason reason) {
+        EmiTestContext::connectionOpened(conn, error, reason);
+        if (!error) {
+            conns.push_back(&conn);
+        }
+    }
+    
+    virtual void gotMessage(EmiTestConnection& conn,
+                            EmiChannelQualifier channelQualifier,
+                            const uint8_t *data,
+                            size_t size) {
+        EmiTestContext::gotMessage(conn, channelQualifier, data, size);
+        receivedMessages++;
+    }
+};
+
+static void sendMessage(EmiTestConnection& conn) {
+    static const uint8_t message[] = "hello";
+    
+    EmiTestError err;
+    CHECK(conn.conn.send(EmiTestNetwork::get().now(),
+                         EmiTestBinding::makePersistentData(message, sizeof(message)),
+                         EMI_CHANNEL_QUALIFIER_DEFAULT,
+                         EMI_PRIORITY_DEFAULT,
+                         err));
+}
+
+int main() {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    
+    {
+        EmiReusePortTestContext *shards[NUM_SHARDS];
+        for (size_t i=0; i<NUM_SHARDS; i++) {
+            EmiSockConfig config;
+            config.acceptConnections = true;
+            config.port = SERVER_PORT;
+            config.reusePort = true;
+            config.reusePortShard = i;
+            config.reusePortShards = NUM_SHARDS;
+            
+            EmiTestError err;
+            shards[i] = new EmiReusePortTestContext(config);
+            CHECK(shards[i]->sock->open(err));
+        }
+        
+        EmiReusePortTestContext client((EmiSockConfig()));
+        for (size_t i=0; i<NUM_CLIENTS; i++) {
+            CHECK(client.connect(SERVER_PORT));
+        }
+        net.run(1);
+        
+        CHECK(NUM_CLIENTS == client.openedConnections);
+        size_t serverConnections = 0;
+        for (size_t i=0; i<NUM_SHARDS; i++) {
+            serverConnections += shards[i]->serverConnections;
+            
+            // Each shard hands out connection IDs of its own
+            for (size_t j=0; j<shards[i]->conns.size(); j++) {
+                CHECK(i == shards[i]->conns[j]->conn.getConnectionId() % NUM_SHARDS);
+            }
+        }
+        CHECK(NUM_CLIENTS == serverConnections);
+        
+        // Move all clients to new ports
+        for (size_t i=0; i<NUM_CLIENTS; i++) {
+            CHECK(net.natRebind(client.conns[i]->conn.getSocket()->getLocalPort()));
+            sendMessage(*client.conns[i]);
+        }
+        net.run(1);
+        
+        size_t receivedMessages = 0;
+        for (size_t i=0; i<NUM_SHARDS; i++) {
+            // No connections were made for the new addresses
+            CHECK(shards[i]->conns.size() == shards[i]->serverConnections);
+            
+            for (size_t j=0; j<shards[i]->conns.size(); j++) {
+                CHECK(!shards[i]->conns[j]->disconnected);
+            }
+            
+            receivedMessages += shards[i]->receivedMessages;
+        }
+        CHECK(NUM_CLIENTS == serverConnections);
+        CHECK(NUM_CLIENTS == receivedMessages);
+        
+        for (size_t i=0; i<NUM_CLIENTS; i++) {
+            CHECK(!client.conns[i]->disconnected);
+        }
+        
+        for (size_t i=0; i<NUM_SHARDS; i++) {
+            delete shards[i];
+        }
+    }
+    
+    net.run(1);
+    net.reset();
+    
+    return 0;
+}
@@ -0,0 +1,33 @@
+//
+//  EmiSipHashTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiSipHash.h"
+
+// The test vectors of the SipHash paper: The key is the bytes 0 to 15,
+// and the message of length n is the bytes 0 to n-1.
+int main() {
+    const EmiSipHash::Key key(0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL);
+    
+    uint8_t msg[16];
+    for (size_t i=0; i<sizeof(msg); i++) {
+        msg[i] = (uint8_t)i;
+    }
+    
+    CHECK(0x726fdb47dd0e0e31ULL == EmiSipHash::hash(key, msg, 0));
+    CHECK(0x74f839c593dc67fdULL == EmiSipHash::hash(key, msg, 1));
+    CHECK(0x93f5f5799a932462ULL == EmiSipHash::hash(key, msg, 8));
+    CHECK(0xa129ca6149be45e5ULL == EmiSipHash::hash(key, msg, 15));
+    
+    // A different key gives a different hash
+    const EmiSipHash::Key otherKey(0x0706050403020100ULL, 0x0f0e0d0c0b0a0909ULL);
+    CHECK(EmiSipHash::hash(key, msg, 15) != EmiSipHash::hash(otherKey, msg, 15));
+    
+    return 0;
+}
@@ -0,0 +1,145 @@
+//
+//  EmiSteadyStateAllocationTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+#include "EmiTestDelegates.h"
+
+#include <new>
+#include <cstdlib>
+
+// Once two connections have warmed up, sending and receiving messages
+// must not allocate. This replaces the global operator new and
+// operator delete with versions that count the allocations, runs a
+// steady flow of messages for a while to warm up, and then checks that
+// the same flow doesn't allocate anything.
+//
+// The chunks of EmiObjectPool are allocated with malloc and aren't
+// counted, but the list of chunks that each pool keeps is, so a pool
+// that keeps growing is caught too.
+
+static size_t allocations = 0;
+
+// These are not inlined into the operators, because GCC would then see
+// free being called on memory from operator new and warn about it.
+static void *countedMalloc(size_t size) __attribute__((noinline));
+static void countedFree(void *ptr) __attribute__((noinline));
+
+static void *countedMalloc(size_t size) {
+    allocations++;
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void countedFree(void *ptr) {
+    free(ptr);
+}
+
+void *operator new(size_t size) throw(std::bad_alloc) {
+    return countedMalloc(size);
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc) {
+    return countedMalloc(size);
+}
+
+void operator delete(void *ptr) throw() {
+    countedFree(ptr);
+}
+
+void operator delete[](void *ptr) throw() {
+    countedFree(ptr);
+}
+
+static const uint16_t SERVER_PORT = 9000;
+
+class EmiAllocationTestContext : public EmiTestContext {
+public:
+    EmiTestConnection *conn;
+    
+    explicit EmiAllocationTestContext(const EmiSockConfig& config) :
+    EmiTestContext(config), conn(NULL) {}
+    
+    virtual void gotServerConnection(EmiTestConnection& conn_) {
+        EmiTestContext::gotServerConnection(conn_);
+        conn = &conn_;
+    }
+    
+    virtual void connectionOpened(EmiTestConnection& conn_, bool error, EmiDisconnectReason reason) {
+        EmiTestContext::connectionOpened(conn_, error, reason);
+        if (!error) {
+            conn = &conn_;
+        }
+    }
+};
+
+static void sendMessage(EmiTestConnection& conn, EmiChannelQualifier channelQualifier, size_t length) {
+    static const uint8_t payload[1000] = { 0 };
+    
+    EmiTestError err;
+    CHECK(conn.conn.send(EmiTestNetwork::get().now(),
+                         EmiTestBinding::makePersistentData(payload, length),
+                         channelQualifier,
+                         EMI_PRIORITY_DEFAULT,
+                         err));
+}
+
+// Sends a mix of small and large, reliable and unreliable messages in
+// both directions, every 10 ms for duration seconds
+static void runFlow(EmiTestConnection& client, EmiTestConnection& server, EmiTimeInterval duration) {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    
+    static const EmiChannelQualifier RELIABLE = EMI_CHANNEL_QUALIFIER(EMI_CHANNEL_TYPE_RELIABLE_ORDERED, 0);
+    static const EmiChannelQualifier UNRELIABLE = EMI_CHANNEL_QUALIFIER(EMI_CHANNEL_TYPE_UNRELIABLE, 1);
+    
+    const size_t steps = (size_t)(duration*100);
+    for (size_t step=0; step<steps; step++) {
+        sendMessage(client, RELIABLE, 16);
+        sendMessage(client, RELIABLE, 500);
+        sendMessage(client, UNRELIABLE, 40);
+        sendMessage(server, RELIABLE, 32);
+        
+        net.run(0.01);
+    }
+}
+
+int main() {
+    EmiTestNetwork& net(EmiTestNetwork::get());
+    
+    {
+        EmiSockConfig serverConfig;
+        serverConfig.acceptConnections = true;
+        serverConfig.port = SERVER_PORT;
+        
+        EmiAllocationTestContext server(serverConfig);
+        EmiAllocationTestContext client((EmiSockConfig()));
+        
+        EmiTestError err;
+        CHECK(server.sock->open(err));
+        CHECK(client.connect(SERVER_PORT));
+        net.run(1);
+        CHECK(client.conn && server.conn);
+        
+        runFlow(*client.conn, *server.conn, 10);
+        
+        size_t allocationsBefore = allocations;
+        size_t receivedBefore = server.conn->receivedMessages;
+        
+        runFlow(*client.conn, *server.conn, 10);
+        
+        CHECK(server.conn->receivedMessages > receivedBefore);
+        CHECK(allocationsBefore == allocations);
+    }
+    
+    net.run(1);
+    net.reset();
+    
+    return 0;
+}
@@ -0,0 +1,27 @@
+//
+//  EmiTest.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiTest_h
+#define eminet_EmiTest_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The tests are plain programs that exit with a non-zero status when a
+// check fails. Build and run them with make in this directory.
+
+#define CHECK(expr)                                                     \
+    do {                                                                \
+        if (!(expr)) {                                                  \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n",                \
+                    __FILE__, __LINE__, #expr);                         \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+    
+#endif
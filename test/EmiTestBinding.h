@@ -0,0 +1,529 @@
+//
+//  EmiTestBinding.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiTestBinding_h
+#define eminet_EmiTestBinding_h
+
+#include "EmiTypes.h"
+#include "EmiBuffer.h"
+#include "EmiTimerWheel.h"
+#include "EmiNetUtil.h"
+#include "EmiPacketHeader.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// A binding for the tests and benchmarks. Instead of real sockets and
+// timers, it has an in-process network (EmiTestNetwork) with a
+// simulated clock, so that connections can be run deterministically
+// and much faster than real time.
+//
+// The network has one interface, 127.0.0.1. Every datagram is delivered
+// after a fixed latency, unless it is dropped at random (see
+// setLossRate) or because the network's queue is full. Sockets that
+// are opened with SO_REUSEPORT share their port, and datagrams are
+// spread over them by a hash of the source address, like the kernel
+// does. Datagrams with a connection ID are steered by it, the way the
+// node binding's BPF program does on Linux.
+//
+// The datagram queue is preallocated and the datagrams are EmiBuffers,
+// so the network itself does not allocate in the steady state. That
+// lets the tests count the allocations of the core.
+//
+// Nothing here is thread safe.
+
+struct EmiTestError {
+    const char *domain;
+    int32_t     code;
+    
+    EmiTestError() : domain(NULL), code(0) {}
+    EmiTestError(const char *domain_, int32_t code_) :
+    domain(domain_), code(code_) {}
+};
+
+struct EmiTestSocket;
+
+typedef void (EmiTestOnMessage)(EmiTestSocket *socket,
+                                void *userData,
+                                EmiTimeInterval now,
+                                const sockaddr_storage& address,
+                                const EmiBufferRef& data,
+                                size_t offset,
+                                size_t len);
+
+struct EmiTestSocket {
+    sockaddr_storage  address;
+    // The address that other sockets see. It's the same as address,
+    // unless natRebind has been used.
+    sockaddr_storage  publicAddress;
+    size_t            reusePortShards;
+    EmiTestOnMessage *callback;
+    void             *userData;
+};
+
+class EmiTestNetwork {
+private:
+    struct Datagram {
+        EmiTimeInterval  deliveryTime;
+        sockaddr_storage from;
+        sockaddr_storage to;
+        EmiBuffer       *data;
+    };
+    
+    static const size_t QUEUE_SIZE = 8192;
+    static const uint16_t FIRST_PORT = 20000;
+    
+    EmiTimeInterval _now;
+    EmiTimerWheel   _wheel;
+    
+    std::vector<EmiTestSocket *> _sockets;
+    uint16_t                     _nextPort;
+    // When nonzero, the port that the next socket without a port gets
+    uint16_t                     _reusedPort;
+    
+    // A ring of QUEUE_SIZE datagrams. The latency is the same for all
+    // datagrams, so the ring is sorted on delivery time.
+    std::vector<Datagram> _queue;
+    size_t                _queueStart;
+    size_t                _queueCount;
+    
+    EmiTimeInterval _latency;
+    double          _lossRate;
+    uint64_t        _random;
+    
+    size_t _sentDatagrams;
+    size_t _droppedDatagrams;
+    
+    // Private copy constructor and assignment operator
+    inline EmiTestNetwork(const EmiTestNetwork& other);
+    inline EmiTestNetwork& operator=(const EmiTestNetwork& other);
+    
+    EmiTestNetwork() :
+    _now(1),
+    _wheel(0.001),
+    _sockets(),
+    _nextPort(FIRST_PORT),
+    _reusedPort(0),
+    _queue(QUEUE_SIZE),
+    _queueStart(0),
+    _queueCount(0),
+    _latency(0.01),
+    _lossRate(0),
+    _random(0x2545f4914f6cdd1dULL),
+    _sentDatagrams(0),
+    _droppedDatagrams(0) {
+        _sockets.reserve(1024);
+    }
+    
+    static uint32_t hashAddress(const sockaddr_storage& address) {
+        uint8_t ip[16];
+        size_t ipLen = EmiNetUtil::extractIp(address, ip, sizeof(ip));
+        uint32_t hash = 2166136261U ^ EmiNetUtil::addrPortH(address);
+        for (size_t i=0; i<ipLen; i++) {
+            hash = (hash ^ ip[i]) * 16777619U;
+        }
+        
+        // The low bits of FNV-1a depend on only a few bits of the input,
+        // so the hash is mixed before it is reduced modulo the number
+        // of sockets
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bU;
+        hash ^= hash >> 13;
+        return hash;
+    }
+    
+    EmiTestSocket *findSocket(const sockaddr_storage& from,
+                              const sockaddr_storage& to,
+                              const EmiBufferRef& data) const {
+        uint16_t port = EmiNetUtil::addrPortH(to);
+        
+        size_t numMatches = 0;
+        size_t shards = 0;
+        for (size_t i=0; i<_sockets.size(); i++) {
+            if (port == EmiNetUtil::addrPortH(_sockets[i]->publicAddress)) {
+                if (0 == numMatches) {
+                    shards = _sockets[i]->reusePortShards;
+                }
+                numMatches++;
+            }
+        }
+        
+        if (0 == numMatches) {
+            return NULL;
+        }
+        
+        // Like the kernel, fall back to the hash when the steering picks
+        // a socket that does not exist
+        size_t pick = hashAddress(from) % numMatches;
+        EmiConnectionId connectionId;
+        if (1 < shards &&
+            EmiPacketHeader::parseConnectionId(data.data(), data.length(), &connectionId) &&
+            connectionId % shards < numMatches) {
+            pick = connectionId % shards;
+        }
+        
+        for (size_t i=0; i<_sockets.size(); i++) {
+            if (port == EmiNetUtil::addrPortH(_sockets[i]->publicAddress) && 0 == pick--) {
+                return _sockets[i];
+            }
+        }
+        
+        return NULL;
+    }
+    
+    void deliverFirstDatagram() {
+        Datagram& dgram(_queue[_queueStart]);
+        _queueStart = (_queueStart+1) % QUEUE_SIZE;
+        _queueCount--;
+        
+        EmiBufferRef data(dgram.data);
+        dgram.data->release();
+        dgram.data = NULL;
+        
+        EmiTestSocket *socket = findSocket(dgram.from, dgram.to, data);
+        if (socket) {
+            socket->callback(socket, socket->userData, _now,
+                             dgram.from, data, 0, data.length());
+        }
+    }
+    
+public:
+    static EmiTestNetwork& get() {
+        static EmiTestNetwork network;
+        return network;
+    }
+    
+    inline EmiTimeInterval now() const {
+        return _now;
+    }
+    
+    inline EmiTimerWheel& wheel() {
+        return _wheel;
+    }
+    
+    inline void setLatency(EmiTimeInterval latency) {
+        _latency = latency;
+    }
+    
+    // The fraction of the datagrams that are dropped at random
+    inline void setLossRate(double lossRate) {
+        _lossRate = lossRate;
+    }
+    
+    inline size_t sentDatagrams() const {
+        return _sentDatagrams;
+    }
+    
+    inline size_t droppedDatagrams() const {
+        return _droppedDatagrams;
+    }
+    
+    inline size_t numSockets() const {
+        return _sockets.size();
+    }
+    
+    // A deterministic xorshift64* generator
+    uint64_t random() {
+        _random ^= _random >> 12;
+        _random ^= _random << 25;
+        _random ^= _random >> 27;
+        return _random * 2685821657736338717ULL;
+    }
+    
+    EmiTestSocket *openSocket(EmiTestOnMessage *callback,
+                              void *userData,
+                              const sockaddr_storage& address,
+                              size_t reusePortShards) {
+        sockaddr_storage ss(address);
+        uint16_t port = EmiNetUtil::addrPortH(ss);
+        
+        if (0 == port) {
+            if (_reusedPort) {
+                port = _reusedPort;
+                _reusedPort = 0;
+            }
+            else {
+                port = _nextPort++;
+            }
+            EmiNetUtil::addrSetPort(ss, port);
+        }
+        
+        for (size_t i=0; i<_sockets.size(); i++) {
+            if (port == EmiNetUtil::addrPortH(_sockets[i]->publicAddress) &&
+                !(reusePortShards && _sockets[i]->reusePortShards)) {
+                return NULL;
+            }
+        }
+        
+        EmiTestSocket *socket = new EmiTestSocket;
+        socket->address = ss;
+        socket->publicAddress = ss;
+        socket->reusePortShards = reusePortShards;
+        socket->callback = callback;
+        socket->userData = userData;
+        _sockets.push_back(socket);
+        return socket;
+    }
+    
+    void closeSocket(EmiTestSocket *socket) {
+        std::vector<EmiTestSocket *>::iterator iter(std::find(_sockets.begin(), _sockets.end(), socket));
+        ASSERT(_sockets.end() != iter);
+        _sockets.erase(iter);
+        delete socket;
+    }
+    
+    // Gives the socket that has the public port port a new public port,
+    // like a NAT that has changed its mapping. The socket itself does
+    // not notice. Returns false if there is no such socket.
+    bool natRebind(uint16_t port) {
+        for (size_t i=0; i<_sockets.size(); i++) {
+            if (port == EmiNetUtil::addrPortH(_sockets[i]->publicAddress)) {
+                EmiNetUtil::addrSetPort(_sockets[i]->publicAddress, _nextPort++);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Makes the next socket that is opened without a port get the
+    // given port, like a NAT that hands a port that one host has moved
+    // away from to another host.
+    inline void reusePort(uint16_t port) {
+        _reusedPort = port;
+    }
+    
+    // Sends a datagram with the given source address. This is also
+    // what the tests use to fabricate datagrams from addresses that
+    // don't have sockets.
+    void send(const sockaddr_storage& from,
+              const sockaddr_storage& to,
+              const uint8_t *data,
+              size_t size) {
+        _sentDatagrams++;
+        
+        if (QUEUE_SIZE == _queueCount ||
+            (0 != _lossRate && (random() >> 11)*(1.0/9007199254740992.0) < _lossRate)) {
+            _droppedDatagrams++;
+            return;
+        }
+        
+        Datagram& dgram(_queue[(_queueStart+_queueCount) % QUEUE_SIZE]);
+        dgram.deliveryTime = _now+_latency;
+        dgram.from = from;
+        dgram.to = to;
+        dgram.data = EmiBuffer::make(data, size);
+        _queueCount++;
+    }
+    
+    // Runs the network and the timers until duration seconds from now
+    void run(EmiTimeInterval duration) {
+        const EmiTimeInterval end = _now+duration;
+        
+        for (;;) {
+            EmiTimeInterval next = end;
+            
+            if (0 != _queueCount) {
+                next = std::min(next, _queue[_queueStart].deliveryTime);
+            }
+            
+            EmiTimeInterval timeout;
+            if (_wheel.nextTimeout(_now, timeout)) {
+                // The wheel might round the time down to the previous
+                // tick, so we make sure to land on the tick itself.
+                next = std::min(next, _now+timeout+1e-9);
+            }
+            
+            if (next > end) {
+                break;
+            }
+            
+            _now = std::max(_now, next);
+            
+            while (0 != _queueCount && _queue[_queueStart].deliveryTime <= _now) {
+                deliverFirstDatagram();
+            }
+            _wheel.advance(_now);
+            
+            if (_now >= end) {
+                break;
+            }
+        }
+        
+        _now = end;
+    }
+    
+    // Drops the datagrams in flight, and checks that nothing is left
+    // of the sockets and timers of the previous test
+    void reset() {
+        while (0 != _queueCount) {
+            _queue[_queueStart].data->release();
+            _queue[_queueStart].data = NULL;
+            _queueStart = (_queueStart+1) % QUEUE_SIZE;
+            _queueCount--;
+        }
+        
+        ASSERT(_sockets.empty());
+        ASSERT(_wheel.empty());
+        
+        _reusedPort = 0;
+        _latency = 0.01;
+        _lossRate = 0;
+        _sentDatagrams = 0;
+        _droppedDatagrams = 0;
+    }
+};
+
+class EmiTestBinding {
+private:
+    inline EmiTestBinding();
+    
+    inline static EmiTestNetwork& net() {
+        return EmiTestNetwork::get();
+    }
+    
+public:
+    typedef EmiTestError       Error;
+    typedef EmiTestSocket      SocketHandle;
+    typedef EmiBufferRef       TemporaryData;
+    typedef EmiBuffer*         PersistentData;
+    typedef EmiTimerWheelTimer Timer;
+    typedef void*              TimerCookie;
+    typedef void (TimerCb)(EmiTimeInterval now, Timer *timer, void *data);
+    typedef EmiTestOnMessage   EmiOnMessage;
+    
+    inline static Error makeError(const char *domain, int32_t code) {
+        return Error(domain, code);
+    }
+    
+    inline static EmiBuffer *makePersistentData(const uint8_t *data, size_t length) {
+        return EmiBuffer::make(data, length);
+    }
+    inline static EmiBufferRef makeTemporaryData(size_t size, uint8_t **outData) {
+        EmiBuffer *buf(EmiBuffer::make(size));
+        *outData = buf->data();
+        
+        EmiBufferRef ref(buf);
+        buf->release();
+        return ref;
+    }
+    inline static void releasePersistentData(EmiBuffer *buf) {
+        if (buf) buf->release();
+    }
+    inline static EmiBuffer *sharePersistentData(EmiBuffer *buf) {
+        if (buf) buf->retain();
+        return buf;
+    }
+    inline static EmiBufferRef castToTemporary(EmiBuffer *buf) {
+        return EmiBufferRef(buf);
+    }
+    
+    inline static const uint8_t *extractData(const EmiBufferRef& data) {
+        return data.data();
+    }
+    inline static size_t extractLength(const EmiBufferRef& data) {
+        return data.length();
+    }
+    inline static const uint8_t *extractData(const EmiBuffer *data) {
+        return data ? data->data() : NULL;
+    }
+    inline static size_t extractLength(const EmiBuffer *data) {
+        return data ? data->length() : 0;
+    }
+    
+    // This is not a real HMAC, it only has to be keyed and
+    // deterministic for the tests.
+    static const size_t HMAC_HASH_SIZE = 32;
+    static void hmacHash(const uint8_t *key, size_t keyLength,
+                         const uint8_t *data, size_t dataLength,
+                         uint8_t *buf, size_t bufLen) {
+        for (size_t i=0; i<bufLen; i++) {
+            uint32_t hash = 2166136261U ^ (uint32_t)i;
+            for (size_t j=0; j<keyLength; j++) {
+                hash = (hash ^ key[j]) * 16777619U;
+            }
+            for (size_t j=0; j<dataLength; j++) {
+                hash = (hash ^ data[j]) * 16777619U;
+            }
+            buf[i] = (uint8_t)(hash >> 24);
+        }
+    }
+    static void randomBytes(uint8_t *buf, size_t bufSize) {
+        for (size_t i=0; i<bufSize; i++) {
+            buf[i] = (uint8_t)(net().random() >> 56);
+        }
+    }
+    
+    static Timer *makeTimer(void * /*timerCookie*/) {
+        return new EmiTimerWheelTimer;
+    }
+    static void freeTimer(Timer *timer) {
+        net().wheel().deschedule(timer);
+        delete timer;
+    }
+    static void scheduleTimer(Timer *timer, TimerCb *timerCb, void *data, EmiTimeInterval interval,
+                              bool repeating, bool reschedule) {
+        if (!reschedule && timer->isScheduled()) {
+            return;
+        }
+        
+        net().wheel().schedule(timer, net().now(), timerCb, data, interval, repeating);
+    }
+    static void descheduleTimer(Timer *timer) {
+        net().wheel().deschedule(timer);
+    }
+    
+    // The index of the next interface
+    typedef int NetworkInterfaces;
+    static bool getNetworkInterfaces(NetworkInterfaces& ni, Error& /*err*/) {
+        ni = 0;
+        return true;
+    }
+    static bool nextNetworkInterface(NetworkInterfaces& ni, const char*& name, struct sockaddr_storage& addr) {
+        if (0 != ni++) {
+            return false;
+        }
+        
+        static const uint8_t loopback[] = { 127, 0, 0, 1 };
+        name = "lo";
+        EmiNetUtil::makeAddress(AF_INET, loopback, sizeof(loopback), 0, &addr);
+        return true;
+    }
+    static void freeNetworkInterfaces(const NetworkInterfaces& /*ni*/) {}
+    
+    static void closeSocket(SocketHandle *socket) {
+        net().closeSocket(socket);
+    }
+    static SocketHandle *openSocket(void * /*cookie*/,
+                                    EmiOnMessage *callback,
+                                    void *userData,
+                                    const sockaddr_storage& address,
+                                    size_t reusePortShards,
+                                    Error& err) {
+        SocketHandle *socket = net().openSocket(callback, userData, address, reusePortShards);
+        if (!socket) {
+            err = makeError("com.emilir.eminet.addrinuse", 0);
+        }
+        return socket;
+    }
+    static void extractLocalAddress(SocketHandle *socket, sockaddr_storage& address) {
+        address = socket->address;
+    }
+    static void sendData(SocketHandle *socket,
+                         const sockaddr_storage& address,
+                         const uint8_t *data,
+                         size_t size) {
+        net().send(socket->publicAddress, address, data, size);
+    }
+};
+
+#endif
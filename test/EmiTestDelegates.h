@@ -0,0 +1,316 @@
+//
+//  EmiTestDelegates.h
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#ifndef eminet_EmiTestDelegates_h
+#define eminet_EmiTestDelegates_h
+
+#include "EmiTestBinding.h"
+
+#include "EmiSock.h"
+#include "EmiConn.h"
+
+#include <vector>
+
+// Delegates that run EmiSock and EmiConn on EmiTestBinding. Each
+// EmiSock belongs to an EmiTestContext, which owns it and the
+// connections it makes. Tests subclass EmiTestContext to find out
+// about connections and messages.
+//
+// Closed connections are not deleted right away, because they are
+// invalidated from within EmiConn. reap deletes them; the tests call
+// it after EmiTestNetwork::run.
+//
+// The context closes the connections that are still open when it is
+// deleted. It does that itself, before it deletes the EmiSock, because
+// EmiSock::~EmiSock closes its server connections with
+// EmiConn::forceClose(), which only closes them on the next timer tick.
+
+class EmiTestContext;
+class EmiTestConnection;
+class EmiTestConnDelegate;
+
+class EmiTestSockDelegate {
+    typedef EmiConn<EmiTestSockDelegate, EmiTestConnDelegate> EC;
+    
+    EmiTestContext *_context;
+    
+public:
+    typedef EmiTestBinding   Binding;
+    typedef EmiTestContext*  ConnectionOpenedCallbackCookie;
+    
+    explicit EmiTestSockDelegate(EmiTestContext *context) : _context(context) {}
+    
+    inline EC *makeConnection(const EmiConnParams<EmiTestBinding>& params);
+    inline void gotServerConnection(EC& conn);
+    
+    inline static void connectionOpened(ConnectionOpenedCallbackCookie& cookie,
+                                        bool error,
+                                        EmiDisconnectReason reason,
+                                        EC& conn);
+    
+    inline void connectionGotMessage(EC *conn,
+                                     EmiUdpSocket<EmiTestBinding> *socket,
+                                     EmiTimeInterval now,
+                                     const sockaddr_storage& inboundAddress,
+                                     const sockaddr_storage& remoteAddress,
+                                     const EmiBufferRef& data,
+                                     size_t offset,
+                                     size_t len);
+    
+    inline void *getSocketCookie() { return _context; }
+    
+    // Everything runs in one thread
+    inline bool batchConnectionTicks() const { return true; }
+};
+
+class EmiTestConnDelegate {
+    EmiTestConnection *_conn;
+    
+public:
+    explicit EmiTestConnDelegate(EmiTestConnection *conn) : _conn(conn) {}
+    
+    inline void invalidate();
+    inline void emiConnMoved(const sockaddr_storage& oldAddress);
+    
+    inline void emiConnPacketLoss(EmiChannelQualifier channelQualifier,
+                                  EmiSequenceNumber packetsLost);
+    inline void emiConnMessage(EmiChannelQualifier channelQualifier,
+                               const EmiBufferRef& data,
+                               size_t offset,
+                               size_t size);
+    inline void emiConnMessagePart(EmiChannelQualifier channelQualifier,
+                                   const EmiBufferRef& data,
+                                   size_t offset,
+                                   size_t size,
+                                   EmiMessagePartFlags partFlags);
+    
+    inline void emiConnLost() {}
+    inline void emiConnRegained() {}
+    inline void emiConnDisconnect(EmiDisconnectReason reason);
+    inline void emiNatPunchthroughFinished(bool /*success*/) {}
+    
+    inline EmiTestConnection *getConnection() { return _conn; }
+    
+    inline void *getSocketCookie() { return _conn; }
+    inline void *getTimerCookie() { return _conn; }
+};
+
+typedef EmiSock<EmiTestSockDelegate, EmiTestConnDelegate> EmiTestSock;
+typedef EmiConn<EmiTestSockDelegate, EmiTestConnDelegate> EmiTestConn;
+
+class EmiTestConnection {
+private:
+    // Private copy constructor and assignment operator
+    inline EmiTestConnection(const EmiTestConnection& other);
+    inline EmiTestConnection& operator=(const EmiTestConnection& other);
+    
+public:
+    EmiTestContext& context;
+    EmiTestConn     conn;
+    
+    // The position of the connection in the context's list of open
+    // connections
+    size_t index;
+    
+    // Set by the default implementations of the EmiTestContext events
+    bool   opened;
+    bool   disconnected;
+    size_t receivedMessages;
+    size_t receivedBytes;
+    
+    inline EmiTestConnection(EmiTestContext& context_, const EmiConnParams<EmiTestBinding>& params);
+};
+
+class EmiTestContext {
+private:
+    // Private copy constructor and assignment operator
+    inline EmiTestContext(const EmiTestContext& other);
+    inline EmiTestContext& operator=(const EmiTestContext& other);
+    
+    std::vector<EmiTestConnection *> _openConns;
+    std::vector<EmiTestConnection *> _closedConns;
+    
+public:
+    EmiTestSock *sock;
+    
+    size_t serverConnections;
+    size_t openedConnections;
+    size_t failedConnections;
+    
+    explicit EmiTestContext(const EmiSockConfig& config) :
+    _openConns(),
+    _closedConns(),
+    sock(new EmiTestSock(config, EmiTestSockDelegate(this))),
+    serverConnections(0),
+    openedConnections(0),
+    failedConnections(0) {}
+    
+    virtual ~EmiTestContext() {
+        while (!_openConns.empty()) {
+            EmiTestConnection *conn = _openConns.back();
+            conn->conn.forceClose(EMI_REASON_THIS_HOST_CLOSED);
+            ASSERT(_openConns.empty() || conn != _openConns.back());
+        }
+        delete sock;
+        reap();
+    }
+    
+    // Opens a client connection to the given port on 127.0.0.1. The
+    // connection is made right away; the events tell when it is open.
+    bool connect(uint16_t port) {
+        static const uint8_t loopback[] = { 127, 0, 0, 1 };
+        sockaddr_storage address;
+        EmiNetUtil::makeAddress(AF_INET, loopback, sizeof(loopback), htons(port), &address);
+        
+        EmiTestError err;
+        EmiTestContext *cookie = this;
+        return sock->connect(EmiTestNetwork::get().now(), address, cookie, err);
+    }
+    
+    // Deletes the connections that have been closed
+    void reap() {
+        for (size_t i=0; i<_closedConns.size(); i++) {
+            delete _closedConns[i];
+        }
+        _closedConns.clear();
+    }
+    
+    inline size_t numOpenConnections() const {
+        return _openConns.size();
+    }
+    
+    void connectionWasMade(EmiTestConnection *conn) {
+        conn->index = _openConns.size();
+        _openConns.push_back(conn);
+    }
+    
+    void connectionWasInvalidated(EmiTestConnection *conn) {
+        EmiTestConnection *last = _openConns.back();
+        _openConns[conn->index] = last;
+        last->index = conn->index;
+        _openConns.pop_back();
+        
+        if (EMI_CONNECTION_TYPE_SERVER == conn->conn.getType()) {
+            sock->deregisterServerConnection(&conn->conn);
+        }
+        _closedConns.push_back(conn);
+    }
+    
+    virtual void gotServerConnection(EmiTestConnection& conn) {
+        serverConnections++;
+        conn.opened = true;
+    }
+    
+    virtual void connectionOpened(EmiTestConnection& conn, bool error, EmiDisconnectReason /*reason*/) {
+        if (error) {
+            failedConnections++;
+        }
+        else {
+            openedConnections++;
+            conn.opened = true;
+        }
+    }
+    
+    virtual void gotMessage(EmiTestConnection& conn,
+                            EmiChannelQualifier /*channelQualifier*/,
+                            const uint8_t * /*data*/,
+                            size_t size) {
+        conn.receivedMessages++;
+        conn.receivedBytes += size;
+    }
+    
+    virtual void gotMessagePart(EmiTestConnection& conn,
+                                EmiChannelQualifier /*channelQualifier*/,
+                                const uint8_t * /*data*/,
+                                size_t size,
+                                EmiMessagePartFlags partFlags) {
+        if (partFlags & EMI_MESSAGE_PART_LAST) {
+            conn.receivedMessages++;
+        }
+        conn.receivedBytes += size;
+    }
+    
+    virtual void gotPacketLoss(EmiTestConnection& /*conn*/,
+                               EmiChannelQualifier /*channelQualifier*/,
+                               EmiSequenceNumber /*packetsLost*/) {}
+    
+    virtual void disconnected(EmiTestConnection& conn, EmiDisconnectReason /*reason*/) {
+        conn.disconnected = true;
+    }
+};
+
+inline EmiTestConnection::EmiTestConnection(EmiTestContext& context_, const EmiConnParams<EmiTestBinding>& params) :
+context(context_),
+conn(EmiTestConnDelegate(this), context_.sock->config, params),
+index(0),
+opened(false),
+disconnected(false),
+receivedMessages(0),
+receivedBytes(0) {
+    context.connectionWasMade(this);
+}
+
+inline EmiTestSockDelegate::EC *EmiTestSockDelegate::makeConnection(const EmiConnParams<EmiTestBinding>& params) {
+    return &(new EmiTestConnection(*_context, params))->conn;
+}
+
+inline void EmiTestSockDelegate::gotServerConnection(EC& conn) {
+    _context->gotServerConnection(*conn.getDelegate().getConnection());
+}
+
+inline void EmiTestSockDelegate::connectionOpened(ConnectionOpenedCallbackCookie& cookie,
+                                                  bool error,
+                                                  EmiDisconnectReason reason,
+                                                  EC& conn) {
+    cookie->connectionOpened(*conn.getDelegate().getConnection(), error, reason);
+}
+
+inline void EmiTestSockDelegate::connectionGotMessage(EC *conn,
+                                                      EmiUdpSocket<EmiTestBinding> *socket,
+                                                      EmiTimeInterval now,
+                                                      const sockaddr_storage& inboundAddress,
+                                                      const sockaddr_storage& remoteAddress,
+                                                      const EmiBufferRef& data,
+                                                      size_t offset,
+                                                      size_t len) {
+    conn->onMessage(now, socket, inboundAddress, remoteAddress, data, offset, len);
+}
+
+inline void EmiTestConnDelegate::invalidate() {
+    _conn->context.connectionWasInvalidated(_conn);
+}
+
+inline void EmiTestConnDelegate::emiConnMoved(const sockaddr_storage& oldAddress) {
+    _conn->context.sock->serverConnectionMoved(&_conn->conn, oldAddress);
+}
+
+inline void EmiTestConnDelegate::emiConnPacketLoss(EmiChannelQualifier channelQualifier,
+                                                   EmiSequenceNumber packetsLost) {
+    _conn->context.gotPacketLoss(*_conn, channelQualifier, packetsLost);
+}
+
+inline void EmiTestConnDelegate::emiConnMessage(EmiChannelQualifier channelQualifier,
+                                                const EmiBufferRef& data,
+                                                size_t offset,
+                                                size_t size) {
+    _conn->context.gotMessage(*_conn, channelQualifier, data.data()+offset, size);
+}
+
+inline void EmiTestConnDelegate::emiConnMessagePart(EmiChannelQualifier channelQualifier,
+                                                    const EmiBufferRef& data,
+                                                    size_t offset,
+                                                    size_t size,
+                                                    EmiMessagePartFlags partFlags) {
+    _conn->context.gotMessagePart(*_conn, channelQualifier, data.data()+offset, size, partFlags);
+}
+
+inline void EmiTestConnDelegate::emiConnDisconnect(EmiDisconnectReason reason) {
+    _conn->context.disconnected(*_conn, reason);
+}
+
+#endif
@@ -0,0 +1,397 @@
+//
+//  EmiTimerWheelTest.cc
+//  eminet
+//
+//  Created on 2026-10-19.
+//  Copyright (c) 2026 the EmiNet contributors. See LICENSE.
+//
+
+#include "EmiTest.h"
+
+#include "EmiTimerWheel.h"
+
+#include <math.h>
+#include <vector>
+
+// Checks that EmiTimerWheel fires timers at the right tick, no matter
+// how many levels they are cascaded through, and that nextTimeout
+// never makes the caller wait past a timer's expiration.
+
+static const EmiTimeInterval GRANULARITY = 0.001;
+// The wheel has 4 levels of 64 slots
+static const uint64_t SPAN = 1ULL << 24;
+// Timers may fire up to one tick late, because they are rounded up to
+// the next tick. The rest is for floating point noise.
+static const EmiTimeInterval EPSILON = 1e-6;
+
+struct TestTimer {
+    EmiTimerWheelTimer timer;
+    EmiTimeInterval    deadline;
+    EmiTimeInterval    interval;
+    bool               repeating;
+    size_t             fired;
+    
+    TestTimer() : timer(), deadline(0), interval(0), repeating(false), fired(0) {}
+};
+
+static void checkedCallback(EmiTimeInterval now, EmiTimerWheelTimer * /*timer*/, void *data) {
+    TestTimer *t = (TestTimer *)data;
+    
+    CHECK(now+EPSILON >= t->deadline);
+    CHECK(now <= t->deadline+GRANULARITY+EPSILON);
+    
+    t->fired++;
+    if (t->repeating) {
+        t->deadline += t->interval;
+    }
+}
+
+static void schedule(EmiTimerWheel& wheel, TestTimer& t, EmiTimeInterval now,
+                     EmiTimeInterval interval, bool repeating) {
+    t.deadline = now+interval;
+    t.interval = interval;
+    t.repeating = repeating;
+    wheel.schedule(&t.timer, now, checkedCallback, &t, interval, repeating);
+}
+
+// Advances the wheel as far as nextTimeout says that it is safe to,
+// until the time end, and checks that no timer in timers expires
+// before the time that nextTimeout returns. Like EmiTestNetwork, it
+// adds a little to the timeout, because the wheel rounds the time down
+// to the previous tick.
+static EmiTimeInterval runUntil(EmiTimerWheel& wheel, EmiTimeInterval now, EmiTimeInterval end,
+                                const std::vector<TestTimer *>& timers) {
+    EmiTimeInterval timeout;
+    while (wheel.nextTimeout(now, timeout)) {
+        EmiTimeInterval next = now+timeout+1e-9;
+        if (next > end) {
+            break;
+        }
+        
+        for (size_t i=0; i<timers.size(); i++) {
+            if (timers[i]->timer.isScheduled()) {
+                CHECK(timers[i]->deadline+GRANULARITY+EPSILON >= next);
+            }
+        }
+        
+        now = next;
+        wheel.advance(now);
+    }
+    
+    wheel.advance(end);
+    return end;
+}
+
+// Timers that expire right before, at and right after the points where
+// they go from one level to the next fire on time, from several
+// positions of the wheel
+static void testCascadeBoundaries() {
+    static const uint64_t boundaries[] = { 64, 4096, 262144, SPAN };
+    static const EmiTimeInterval starts[] = { 1, 1.0005, 1.063, 5.0955, 300.123 };
+    
+    for (size_t s=0; s<sizeof(starts)/sizeof(*starts); s++) {
+        for (size_t b=0; b<sizeof(boundaries)/sizeof(*boundaries); b++) {
+            for (uint64_t ticks=boundaries[b]-1; ticks<=boundaries[b]+1; ticks++) {
+                EmiTimerWheel wheel(GRANULARITY);
+                EmiTimeInterval now = starts[s];
+                
+                // The second timer keeps the wheel busy until after the
+                // first one has fired
+                TestTimer timers[2];
+                std::vector<TestTimer *> list;
+                for (size_t i=0; i<2; i++) {
+                    schedule(wheel, timers[i], now, (ticks+i*100)*GRANULARITY, /*repeating:*/false);
+                    list.push_back(&timers[i]);
+                }
+                
+                // Advancing to just before the timer does not fire it,
+                // advancing a tick past it does
+                now = runUntil(wheel, now, timers[0].deadline-GRANULARITY/2, list);
+                CHECK(0 == timers[0].fired);
+                now = runUntil(wheel, now, timers[0].deadline+GRANULARITY, list);
+                CHECK(1 == timers[0].fired);
+                
+                now = runUntil(wheel, now, timers[1].deadline+GRANULARITY, list);
+                CHECK(1 == timers[1].fired);
+                CHECK(wheel.empty());
+            }
+        }
+    }
+}
+
+// Timers that expire further into the future than the wheel spans are
+// cascaded more than once
+static void testBeyondSpan() {
+    EmiTimerWheel wheel(GRANULARITY);
+    const EmiTimeInterval start = 10.0007;
+    EmiTimeInterval now = start;
+    
+    TestTimer timers[4];
+    std::vector<TestTimer *> list;
+    schedule(wheel, timers[0], now, (SPAN+1000)*GRANULARITY, /*repeating:*/false);
+    schedule(wheel, timers[1], now, 3*SPAN*GRANULARITY+0.5, /*repeating:*/false);
+    // A short repeating timer keeps the wheel turning slot by slot for
+    // a while, and a long one makes it jump
+    schedule(wheel, timers[2], now, 0.05, /*repeating:*/true);
+    schedule(wheel, timers[3], now, 1000, /*repeating:*/true);
+    for (size_t i=0; i<4; i++) {
+        list.push_back(&timers[i]);
+    }
+    
+    now = runUntil(wheel, now, now+100.025, list);
+    CHECK(2000 == timers[2].fired);
+    wheel.deschedule(&timers[2].timer);
+    
+    now = runUntil(wheel, now, timers[0].deadline-GRANULARITY/2, list);
+    CHECK(0 == timers[0].fired);
+    now = runUntil(wheel, now, timers[0].deadline+GRANULARITY, list);
+    CHECK(1 == timers[0].fired);
+    
+    now = runUntil(wheel, now, timers[1].deadline-GRANULARITY/2, list);
+    CHECK(0 == timers[1].fired);
+    now = runUntil(wheel, now, timers[1].deadline+GRANULARITY, list);
+    CHECK(1 == timers[1].fired);
+    
+    // The long repeating timer has kept firing all along
+    CHECK(50 == (size_t)((now-start)/1000));
+    CHECK(50 == timers[3].fired);
+    wheel.deschedule(&timers[3].timer);
+    CHECK(wheel.empty());
+    
+    EmiTimeInterval timeout;
+    CHECK(!wheel.nextTimeout(now, timeout));
+}
+
+// The callbacks in this test act on other timers through these
+struct CallbackTimer {
+    EmiTimerWheelTimer timer;
+    size_t             fired;
+    EmiTimeInterval    firedAt;
+    EmiTimerWheel     *wheel;
+    CallbackTimer     *other;
+    
+    CallbackTimer() : timer(), fired(0), firedAt(-1), wheel(NULL), other(NULL) {}
+};
+
+static void countCallback(EmiTimeInterval now, EmiTimerWheelTimer * /*timer*/, void *data) {
+    CallbackTimer *t = (CallbackTimer *)data;
+    t->fired++;
+    t->firedAt = now;
+}
+
+static void descheduleOtherCallback(EmiTimeInterval now, EmiTimerWheelTimer *timer, void *data) {
+    countCallback(now, timer, data);
+    CallbackTimer *t = (CallbackTimer *)data;
+    t->wheel->deschedule(&t->other->timer);
+}
+
+static void rescheduleOtherCallback(EmiTimeInterval now, EmiTimerWheelTimer *timer, void *data) {
+    countCallback(now, timer, data);
+    CallbackTimer *t = (CallbackTimer *)data;
+    t->wheel->schedule(&t->other->timer, now, countCallback, t->other, 0.1, /*repeating:*/false);
+}
+
+static void rescheduleSelfCallback(EmiTimeInterval now, EmiTimerWheelTimer *timer, void *data) {
+    countCallback(now, timer, data);
+    CallbackTimer *t = (CallbackTimer *)data;
+    if (1 == t->fired) {
+        t->wheel->schedule(timer, now, rescheduleSelfCallback, t, 0.2, /*repeating:*/false);
+    }
+}
+
+static void descheduleSelfCallback(EmiTimeInterval now, EmiTimerWheelTimer *timer, void *data) {
+    countCallback(now, timer, data);
+    CallbackTimer *t = (CallbackTimer *)data;
+    t->wheel->deschedule(timer);
+}
+
+static void deleteSelfCallback(EmiTimeInterval now, EmiTimerWheelTimer *timer, void *data) {
+    CallbackTimer *t = (CallbackTimer *)data;
+    countCallback(now, timer, t->other);
+    delete t;
+}
+
+static void testCallbacks() {
+    EmiTimerWheel wheel(GRANULARITY);
+    EmiTimeInterval now = 1;
+    
+    CallbackTimer t[8];
+    for (size_t i=0; i<8; i++) {
+        t[i].wheel = &wheel;
+    }
+    
+    // t0 and t1 expire on the same tick. Whichever fires first
+    // deschedules the other, so only one of them fires.
+    t[0].other = &t[1];
+    t[1].other = &t[0];
+    wheel.schedule(&t[0].timer, now, descheduleOtherCallback, &t[0], 0.01, /*repeating:*/false);
+    wheel.schedule(&t[1].timer, now, descheduleOtherCallback, &t[1], 0.01, /*repeating:*/false);
+    
+    // t2 moves t3, which also expires on that tick, 100ms later
+    t[2].other = &t[3];
+    wheel.schedule(&t[2].timer, now, rescheduleOtherCallback, &t[2], 0.01, /*repeating:*/false);
+    wheel.schedule(&t[3].timer, now, countCallback, &t[3], 0.0105, /*repeating:*/false);
+    
+    // t4 schedules itself again once, from within its callback
+    wheel.schedule(&t[4].timer, now, rescheduleSelfCallback, &t[4], 0.01, /*repeating:*/false);
+    
+    // t5 is repeating, but deschedules itself the first time it fires
+    wheel.schedule(&t[5].timer, now, descheduleSelfCallback, &t[5], 0.01, /*repeating:*/true);
+    
+    // A timer that deletes itself from within its callback; t6 counts
+    // its callbacks
+    CallbackTimer *deleted = new CallbackTimer;
+    deleted->other = &t[6];
+    wheel.schedule(&deleted->timer, now, deleteSelfCallback, deleted, 0.01, /*repeating:*/false);
+    
+    // t7 is repeating, and is rescheduled with another interval from
+    // t0's or t1's callback
+    wheel.schedule(&t[7].timer, now, countCallback, &t[7], 0.003, /*repeating:*/true);
+    
+    wheel.advance(now+0.0105);
+    CHECK(1 == t[0].fired + t[1].fired);
+    CHECK(1 == t[2].fired);
+    CHECK(0 == t[3].fired);
+    CHECK(t[3].timer.isScheduled());
+    CHECK(1 == t[4].fired);
+    CHECK(1 == t[5].fired);
+    CHECK(!t[5].timer.isScheduled());
+    CHECK(1 == t[6].fired);
+    CHECK(3 == t[7].fired);
+    
+    wheel.deschedule(&t[7].timer);
+    
+    wheel.advance(now+0.1);
+    CHECK(0 == t[3].fired);
+    wheel.advance(now+0.111);
+    CHECK(1 == t[3].fired);
+    CHECK(fabs(t[3].firedAt - (now+0.111)) < EPSILON);
+    
+    CHECK(1 == t[4].fired);
+    wheel.advance(now+0.211);
+    CHECK(2 == t[4].fired);
+    
+    CHECK(1 == t[0].fired + t[1].fired);
+    CHECK(1 == t[5].fired);
+    CHECK(wheel.empty());
+}
+
+// A deterministic xorshift64* generator
+static uint64_t randomState = 0x2545f4914f6cdd1dULL;
+static uint64_t random64() {
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return randomState * 2685821657736338717ULL;
+}
+
+static TestTimer *fuzzTimers;
+static size_t     fuzzTimerCount;
+static EmiTimerWheel *fuzzWheel;
+
+static EmiTimeInterval randomInterval() {
+    switch (random64() % 4) {
+        case 0:  return (random64() % 100)*GRANULARITY;
+        case 1:  return (random64() % 10000)*GRANULARITY;
+        case 2:  return (random64() % 1000000)*GRANULARITY/7;
+        default: return (random64() % (4*SPAN))*GRANULARITY;
+    }
+}
+
+// Checks the firing like checkedCallback, and then schedules or
+// deschedules a random timer
+static void fuzzCallback(EmiTimeInterval now, EmiTimerWheelTimer *timer, void *data) {
+    checkedCallback(now, timer, data);
+    
+    TestTimer& other(fuzzTimers[random64() % fuzzTimerCount]);
+    switch (random64() % 8) {
+        case 0:
+            fuzzWheel->deschedule(&other.timer);
+            break;
+        case 1:
+            other.deadline = now+randomInterval();
+            other.repeating = false;
+            fuzzWheel->schedule(&other.timer, now, fuzzCallback, &other, other.deadline-now, false);
+            break;
+    }
+}
+
+// Random schedules, deschedules and advances, checked against the
+// deadlines that the timers should fire at
+static void testRandom() {
+    static const size_t TIMERS = 500;
+    static const size_t STEPS = 20000;
+    
+    EmiTimerWheel wheel(GRANULARITY);
+    static TestTimer timers[TIMERS];
+    fuzzTimers = timers;
+    fuzzTimerCount = TIMERS;
+    fuzzWheel = &wheel;
+    
+    EmiTimeInterval now = 1000;
+    for (size_t i=0; i<TIMERS; i++) {
+        TestTimer& t(timers[i]);
+        t.repeating = (0 == random64() % 3);
+        if (t.repeating) {
+            // The wheel rounds the interval of repeating timers up to
+            // whole ticks, so only intervals of whole ticks are used, to
+            // keep the deadlines simple
+            t.interval = (5 + random64() % 20000)*GRANULARITY;
+        }
+        else {
+            t.interval = randomInterval();
+        }
+        t.deadline = now+t.interval;
+        wheel.schedule(&t.timer, now, fuzzCallback, &t, t.interval, t.repeating);
+    }
+    
+    for (size_t step=0; step<STEPS; step++) {
+        if (0 == random64() % 16) {
+            // Schedule or deschedule from outside of a callback
+            TestTimer& t(timers[random64() % TIMERS]);
+            if (t.timer.isScheduled() && 0 == random64() % 2) {
+                wheel.deschedule(&t.timer);
+            }
+            else {
+                t.interval = randomInterval();
+                t.deadline = now+t.interval;
+                t.repeating = false;
+                wheel.schedule(&t.timer, now, fuzzCallback, &t, t.interval, false);
+            }
+        }
+        
+        EmiTimeInterval timeout;
+        if (!wheel.nextTimeout(now, timeout)) {
+            break;
+        }
+        EmiTimeInterval next = now+timeout+1e-9;
+        for (size_t i=0; i<TIMERS; i++) {
+            if (timers[i].timer.isScheduled()) {
+                CHECK(timers[i].deadline+GRANULARITY+EPSILON >= next);
+            }
+        }
+        
+        // Sometimes advance less far than the timeout, which must not
+        // fire anything early either
+        if (0 == random64() % 4) {
+            next = now+timeout*(random64() % 1000)/1000;
+        }
+        
+        now = next;
+        wheel.advance(now);
+    }
+    
+    for (size_t i=0; i<TIMERS; i++) {
+        wheel.deschedule(&timers[i].timer);
+    }
+    CHECK(wheel.empty());
+}
+
+int main() {
+    testCascadeBoundaries();
+    testBeyondSpan();
+    testCallbacks();
+    testRandom();
+    
+    return 0;
+}